@@ -9,9 +9,11 @@
  * - Windows: async_runtime_iocp.c (using I/O Completion Ports)
  *   - Uses dedicated accept worker thread for listening sockets
  *   - Worker calls accept() and posts completed FD to IOCP
- * - Linux: async_runtime_epoll.c (using epoll + eventfd for completions)
+ * - Linux: async_runtime_epoll.c (using epoll, completion ring + eventfd doorbell)
  *   - Traditional readiness notification for listening sockets
- * - Fallback: async_runtime_poll.c (using poll + pipe for completions)
+ *   - With io_uring (async_runtime_uring.c), when the kernel supports it:
+ *     multishot accept/recv and batched sends for callers that opt in
+ * - Fallback: async_runtime_poll.c (using poll, completion ring + pipe doorbell)
  *   - Traditional readiness notification for listening sockets
  *
  * Design: docs/internals/async-library.md
@@ -38,6 +40,7 @@ typedef int socket_fd_t;
 #define EVENT_WRITE  0x02  /**< Socket/fd is writable */
 #define EVENT_ERROR  0x04  /**< Error occurred on socket/fd */
 #define EVENT_CLOSE  0x08  /**< Connection closed (EOF or remote shutdown) */
+#define EVENT_ACCEPT 0x10  /**< io_uring: fd is a connection already accepted on the listening socket */
 
 /**
  * Event structure returned by async_runtime_wait()
@@ -211,8 +214,13 @@ int async_runtime_wait(async_runtime_t* runtime, io_event_t* events,
  * 
  * Platform implementation:
  * - Windows: PostQueuedCompletionStatus() to IOCP
- * - Linux: write() to eventfd
- * - macOS/BSD: write() to pipe
+ * - POSIX: push to the completion ring (see completion_ring.h), then
+ *   write() to the eventfd/pipe doorbell if it isn't already pending
+ *
+ * Completions are never merged or dropped: every post is delivered as its
+ * own event, in order per posting thread.  If the ring is full the call
+ * yields until the main thread drains it, so the main thread itself must
+ * not post more than COMPLETION_RING_CAPACITY events between waits.
  * 
  * Usage example:
  * - Console worker: completion_key = CONSOLE_COMPLETION_KEY, data = unused
@@ -220,11 +228,24 @@ int async_runtime_wait(async_runtime_t* runtime, io_event_t* events,
  * 
  * @param runtime Runtime instance
  * @param completion_key User-defined key for identifying completion source
- * @param data Optional data value (platform-specific, often unused)
+ * @param data Optional data value, returned in io_event_t.bytes_transferred
  * @returns 0 on success, -1 on failure
  */
 int async_runtime_post_completion(async_runtime_t* runtime, uintptr_t completion_key, uintptr_t data);
 
+/**
+ * Post a complete event (called from worker threads)
+ *
+ * Like async_runtime_post_completion(), but the caller fills in the whole
+ * io_event_t (fd, context, buffer, ...) and async_runtime_wait() returns it
+ * unchanged.  Lets workers hand results back without a side queue.
+ *
+ * @param runtime Runtime instance
+ * @param event Event to deliver (copied)
+ * @returns 0 on success, -1 on failure
+ */
+int async_runtime_post_event(async_runtime_t* runtime, const io_event_t* event);
+
 /*
  * =============================================================================
  * Platform-Specific Helpers
@@ -232,7 +253,30 @@ int async_runtime_post_completion(async_runtime_t* runtime, uintptr_t completion
  */
 
 /**
- * Post asynchronous read operation (Windows IOCP only)
+ * Accept connections on a listening socket in the runtime
+ *
+ * Call after async_runtime_add().  On success, connections arrive already
+ * accepted, like with the IOCP accept worker: io_event_t.fd is the new
+ * socket and, on io_uring, EVENT_ACCEPT is set in event_type.
+ *
+ * - Windows: no-op, the accept worker serves all listening sockets
+ * - Linux with io_uring: arms a multishot accept
+ * - Otherwise: returns -1; the caller accept()s on EVENT_READ as before
+ *
+ * @param runtime Runtime instance
+ * @param fd Listening socket
+ * @returns 0 if the runtime accepts, -1 if the caller must
+ */
+int async_runtime_post_accept(async_runtime_t* runtime, socket_fd_t fd);
+
+/**
+ * Post asynchronous read operation (Windows IOCP, Linux io_uring)
+ * 
+ * With io_uring a multishot recv is armed once; further calls are no-ops.
+ * Received data arrives as EVENT_READ events with buffer/bytes_transferred
+ * set, and the buffer stays valid until the next async_runtime_wait().
+ * A closed connection arrives as EVENT_CLOSE.  Without either backend this
+ * is a no-op and EVENT_READ means the socket is readable.
  * 
  * @param runtime Runtime instance
  * @param fd File descriptor to read from
@@ -243,7 +287,11 @@ int async_runtime_post_completion(async_runtime_t* runtime, uintptr_t completion
 int async_runtime_post_read(async_runtime_t* runtime, socket_fd_t fd, void* buffer, size_t len);
 
 /**
- * Post asynchronous write operation (Windows IOCP only)
+ * Post asynchronous write operation (Windows IOCP, Linux io_uring)
+ * 
+ * With io_uring the data is copied, sends on the same fd go out in order,
+ * and all sends queued during a cycle are submitted with one system call
+ * at the next async_runtime_wait().
  * 
  * @param runtime Runtime instance
  * @param fd File descriptor to write to
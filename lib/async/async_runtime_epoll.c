@@ -2,12 +2,28 @@
  * @file async_runtime_epoll.c
  * @brief Linux epoll-based async runtime implementation
  * 
- * Uses epoll for efficient I/O multiplexing and eventfd for worker completion notifications.
+ * Uses epoll for efficient I/O multiplexing.  Worker completions travel through
+ * a lock-free completion ring; the eventfd is only the doorbell that wakes
+ * epoll_wait() when the ring goes from idle to non-empty.
+ *
+ * When built with io_uring support and the kernel allows it, accepts, reads
+ * and writes that callers opt into with async_runtime_post_accept(),
+ * async_runtime_post_read() and async_runtime_post_write() are done by the
+ * io_uring engine (async_runtime_uring.c) instead; otherwise those calls keep
+ * their readiness-based fallbacks.
  */
 
 #if defined(__linux__)
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include "async/async_runtime.h"
+#include "async/completion_ring.h"
+#ifdef HAVE_IO_URING
+#include "async/async_runtime_uring.h"
+#endif
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
 #include <sys/stat.h>
@@ -15,12 +31,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <sched.h>
 
 #define MAX_EVENTS 64
 
 struct async_runtime_s {
     int epoll_fd;
-    int event_fd;  /* For worker completions */
+    int event_fd;  /* Doorbell for worker completions */
+    completion_ring_t* completions;
+#ifdef HAVE_IO_URING
+    uring_io_t* uring;  /* NULL when io_uring isn't usable */
+#endif
     console_type_t console_type;  /* Detected console type */
 };
 
@@ -42,6 +63,23 @@ static uint32_t epoll_to_events(uint32_t epoll_events) {
     return events;
 }
 
+/* Events epoll watches for fd, minus those the io_uring engine delivers */
+static uint32_t watched_events(async_runtime_t* runtime, socket_fd_t fd, uint32_t events, void* context) {
+#ifdef HAVE_IO_URING
+    if (runtime->uring)
+        return uring_io_filter(runtime->uring, fd, events, context);
+#else
+    (void)runtime; (void)fd; (void)context;
+#endif
+    return events;
+}
+
+static int ring_doorbell(async_runtime_t* runtime) {
+    uint64_t val = 1;
+    ssize_t n = write(runtime->event_fd, &val, sizeof(val));
+    return (n == sizeof(val)) ? 0 : -1;
+}
+
 /* Public API */
 
 async_runtime_t* async_runtime_init(void) {
@@ -62,17 +100,39 @@ async_runtime_t* async_runtime_init(void) {
         return NULL;
     }
     
-    /* Add eventfd to epoll */
+    runtime->completions = completion_ring_create(COMPLETION_RING_CAPACITY);
+    if (!runtime->completions) {
+        close(runtime->event_fd);
+        close(runtime->epoll_fd);
+        free(runtime);
+        return NULL;
+    }
+    
+    /* Add eventfd to epoll.  Other descriptors carry their context pointer
+     * in data.ptr, so the runtime itself marks the doorbell. */
     struct epoll_event ev = {0};
     ev.events = EPOLLIN;
-    ev.data.fd = runtime->event_fd;
+    ev.data.ptr = runtime;
     if (epoll_ctl(runtime->epoll_fd, EPOLL_CTL_ADD, runtime->event_fd, &ev) < 0) {
+        completion_ring_destroy(runtime->completions);
         close(runtime->event_fd);
         close(runtime->epoll_fd);
         free(runtime);
         return NULL;
     }
     
+#ifdef HAVE_IO_URING
+    runtime->uring = uring_io_init();
+    if (runtime->uring) {
+        ev.events = EPOLLIN;
+        ev.data.ptr = runtime->uring;
+        if (epoll_ctl(runtime->epoll_fd, EPOLL_CTL_ADD, uring_io_fd(runtime->uring), &ev) < 0) {
+            uring_io_deinit(runtime->uring);
+            runtime->uring = NULL;
+        }
+    }
+#endif
+    
     return runtime;
 }
 
@@ -87,6 +147,10 @@ void async_runtime_deinit(async_runtime_t* runtime) {
         close(runtime->epoll_fd);
     }
     
+#ifdef HAVE_IO_URING
+    uring_io_deinit(runtime->uring);
+#endif
+    completion_ring_destroy(runtime->completions);
     free(runtime);
 }
 
@@ -94,7 +158,7 @@ int async_runtime_add(async_runtime_t* runtime, socket_fd_t fd, uint32_t events,
     if (!runtime || fd < 0) return -1;
     
     struct epoll_event ev = {0};
-    ev.events = events_to_epoll(events);
+    ev.events = events_to_epoll(watched_events(runtime, fd, events, context));
     ev.data.ptr = context;
     
     return epoll_ctl(runtime->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
@@ -104,7 +168,7 @@ int async_runtime_modify(async_runtime_t* runtime, socket_fd_t fd, uint32_t even
     if (!runtime || fd < 0) return -1;
     
     struct epoll_event ev = {0};
-    ev.events = events_to_epoll(events);
+    ev.events = events_to_epoll(watched_events(runtime, fd, events, context));
     ev.data.ptr = context;  /* Preserve context pointer when modifying events */
     
     return epoll_ctl(runtime->epoll_fd, EPOLL_CTL_MOD, fd, &ev);
@@ -113,15 +177,17 @@ int async_runtime_modify(async_runtime_t* runtime, socket_fd_t fd, uint32_t even
 int async_runtime_remove(async_runtime_t* runtime, socket_fd_t fd) {
     if (!runtime || fd < 0) return -1;
     
+#ifdef HAVE_IO_URING
+    if (runtime->uring)
+        uring_io_forget(runtime->uring, fd);
+#endif
     return epoll_ctl(runtime->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
 }
 
 int async_runtime_wakeup(async_runtime_t* runtime) {
     if (!runtime || runtime->event_fd < 0) return -1;
     
-    uint64_t val = 1;
-    ssize_t n = write(runtime->event_fd, &val, sizeof(val));
-    return (n == sizeof(val)) ? 0 : -1;
+    return ring_doorbell(runtime);
 }
 
 int async_runtime_wait(async_runtime_t* runtime, io_event_t* events,
@@ -133,6 +199,12 @@ int async_runtime_wait(async_runtime_t* runtime, io_event_t* events,
         timeout_ms = (timeout->tv_sec * 1000) + (timeout->tv_usec / 1000);
     }
     
+#ifdef HAVE_IO_URING
+    /* One submission per cycle for everything queued since the last wait */
+    if (runtime->uring)
+        uring_io_submit(runtime->uring);
+#endif
+    
     struct epoll_event epoll_events[MAX_EVENTS];
     int max_epoll_events = (max_events < MAX_EVENTS) ? max_events : MAX_EVENTS;
     
@@ -145,56 +217,128 @@ int async_runtime_wait(async_runtime_t* runtime, io_event_t* events,
     if (result == 0) return 0;  /* Timeout */
     
     int event_count = 0;
-    for (int i = 0; i < result && event_count < max_events; i++) {
-        /* Check if this is the eventfd */
-        if (epoll_events[i].data.fd == runtime->event_fd) {
-            /* Drain eventfd and decode worker completions */
-            uint64_t val;
-            while (read(runtime->event_fd, &val, sizeof(val)) == sizeof(val)) {
-                if (event_count < max_events) {
-                    events[event_count].fd = -1;
-                    events[event_count].completion_key = (uintptr_t)(val >> 32);
-                    events[event_count].context = NULL;
-                    events[event_count].event_type = EVENT_READ;
-                    events[event_count].bytes_transferred = (int)(val & 0xFFFFFFFF);
-                    events[event_count].buffer = NULL;
-                    event_count++;
-                }
-            }
-        } else {
-            /* Regular I/O event */
-            events[event_count].fd = epoll_events[i].data.fd;
-            events[event_count].completion_key = 0;
-            events[event_count].context = epoll_events[i].data.ptr;
-            events[event_count].event_type = epoll_to_events(epoll_events[i].events);
-            events[event_count].bytes_transferred = 0;
-            events[event_count].buffer = NULL;
-            event_count++;
+    bool doorbell = false;
+    for (int i = 0; i < result; i++) {
+        if (epoll_events[i].data.ptr == runtime) {
+            doorbell = true;
+            continue;
         }
+#ifdef HAVE_IO_URING
+        if (runtime->uring && epoll_events[i].data.ptr == runtime->uring)
+            continue;  /* completions are reaped below */
+#endif
+        if (event_count >= max_events) continue;
+        
+        /* Regular I/O event */
+        events[event_count].fd = -1;  /* not known: data carries the context */
+        events[event_count].completion_key = 0;
+        events[event_count].context = epoll_events[i].data.ptr;
+        events[event_count].event_type = epoll_to_events(epoll_events[i].events);
+        events[event_count].bytes_transferred = 0;
+        events[event_count].buffer = NULL;
+        event_count++;
+    }
+    
+    if (doorbell) {
+        /* Consume the doorbell, then re-arm it before draining so that a
+         * completion posted during the drain rings it again. */
+        uint64_t val;
+        while (read(runtime->event_fd, &val, sizeof(val)) == sizeof(val))
+            ;
+        completion_ring_arm(runtime->completions);
+    }
+    
+#ifdef HAVE_IO_URING
+    if (runtime->uring)
+        event_count += uring_io_reap(runtime->uring, events + event_count, max_events - event_count);
+#endif
+    
+    /* Drain completions in one batch into the remaining slots */
+    event_count += completion_ring_pop(runtime->completions, events + event_count,
+                                       max_events - event_count);
+    if (!completion_ring_is_empty(runtime->completions)) {
+        /* Out of room: make sure the next wait returns at once */
+        ring_doorbell(runtime);
     }
     
     return event_count;
 }
 
-int async_runtime_post_completion(async_runtime_t* runtime, uintptr_t completion_key, uintptr_t data) {
-    if (!runtime || runtime->event_fd < 0) return -1;
+int async_runtime_post_event(async_runtime_t* runtime, const io_event_t* event) {
+    if (!runtime || !event || runtime->event_fd < 0) return -1;
     
-    /* Write to eventfd to wake up epoll_wait */
-    uint64_t val = (((uint64_t)completion_key) << 32) | (data & 0xFFFFFFFF);
-    ssize_t n = write(runtime->event_fd, &val, sizeof(val));
+    int rc;
+    while ((rc = completion_ring_push(runtime->completions, event)) < 0) {
+        /* Ring full: nudge the main thread and wait for it to drain */
+        ring_doorbell(runtime);
+        sched_yield();
+    }
     
-    return (n == sizeof(val)) ? 0 : -1;
+    return rc ? ring_doorbell(runtime) : 0;
+}
+
+int async_runtime_post_completion(async_runtime_t* runtime, uintptr_t completion_key, uintptr_t data) {
+    io_event_t event = {0};
+    
+    event.fd = -1;
+    event.completion_key = completion_key;
+    event.event_type = EVENT_READ;
+    event.bytes_transferred = data;
+    return async_runtime_post_event(runtime, &event);
+}
+
+#ifdef HAVE_IO_URING
+/* Point epoll at what is left to watch once the engine has taken over reads */
+static int rewatch(async_runtime_t* runtime, socket_fd_t fd, uint32_t events, void* context) {
+    struct epoll_event ev = {0};
+    ev.events = events_to_epoll(events);
+    ev.data.ptr = context;
+    return epoll_ctl(runtime->epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+}
+#endif
+
+int async_runtime_post_accept(async_runtime_t* runtime, socket_fd_t fd) {
+#ifdef HAVE_IO_URING
+    if (runtime && runtime->uring && fd >= 0) {
+        uint32_t events;
+        void* context;
+        int rc = uring_io_accept(runtime->uring, fd, &events, &context);
+        if (rc > 0)
+            rewatch(runtime, fd, events, context);
+        return rc < 0 ? -1 : 0;
+    }
+#else
+    (void)runtime; (void)fd;
+#endif
+    return -1;  /* readiness-based: caller accepts on EVENT_READ */
 }
 
 int async_runtime_post_read(async_runtime_t* runtime, socket_fd_t fd, void* buffer, size_t len) {
-    /* No-op on epoll (readiness-based) */
-    (void)runtime; (void)fd; (void)buffer; (void)len;
+    (void)buffer; (void)len;  /* the engine reads into its provided buffers */
+#ifdef HAVE_IO_URING
+    if (runtime && runtime->uring && fd >= 0) {
+        uint32_t events;
+        void* context;
+        int rc = uring_io_recv(runtime->uring, fd, &events, &context);
+        if (rc > 0)
+            rewatch(runtime, fd, events, context);
+        return rc < 0 ? -1 : 0;
+    }
+#else
+    (void)runtime; (void)fd;
+#endif
+    /* No-op without io_uring (readiness-based) */
     return 0;
 }
 
 int async_runtime_post_write(async_runtime_t* runtime, socket_fd_t fd, void* buffer, size_t len) {
-    /* No-op on epoll (readiness-based) */
+#ifdef HAVE_IO_URING
+    if (runtime && runtime->uring && fd >= 0)
+        return uring_io_send(runtime->uring, fd, buffer, len);
+#else
     (void)runtime; (void)fd; (void)buffer; (void)len;
+#endif
+    /* No-op without io_uring (readiness-based) */
     return 0;
 }
 
@@ -32,6 +32,7 @@
 /* Completion keys for special events */
 #define ACCEPT_COMPLETION_KEY  ((uintptr_t)-2)
 #define WAKEUP_COMPLETION_KEY  ((uintptr_t)-3)
+#define EVENT_COMPLETION_KEY   ((uintptr_t)-4)  /* overlapped is a posted io_event_t */
 
 /**
  * IOCP context for each I/O operation
@@ -380,7 +381,12 @@ int async_runtime_wait(async_runtime_t* runtime, io_event_t* events,
         for (ULONG i = 0; i < num_entries && event_count < max_events; i++) {
             iocp_context_t* io_ctx = (iocp_context_t*)entries[i].lpOverlapped;
             
-            if (io_ctx) {
+            if (entries[i].lpCompletionKey == EVENT_COMPLETION_KEY) {
+                /* Full event posted by async_runtime_post_event() */
+                io_event_t* posted = (io_event_t*)entries[i].lpOverlapped;
+                events[event_count++] = *posted;
+                free(posted);
+            } else if (io_ctx) {
                 /* Connected socket I/O completion */
                 events[event_count].fd = io_ctx->fd;
                 events[event_count].handle = NULL;
@@ -424,6 +430,23 @@ int async_runtime_wait(async_runtime_t* runtime, io_event_t* events,
     return event_count;
 }
 
+int async_runtime_post_event(async_runtime_t* runtime, const io_event_t* event) {
+    if (!runtime || !runtime->iocp_handle || !event) return -1;
+    
+    /* IOCP queues are unbounded and lossless already; the event rides
+     * along as the overlapped pointer. */
+    io_event_t* posted = (io_event_t*)malloc(sizeof(io_event_t));
+    if (!posted) return -1;
+    *posted = *event;
+    
+    if (!PostQueuedCompletionStatus(runtime->iocp_handle, 0, EVENT_COMPLETION_KEY,
+                                    (LPOVERLAPPED)posted)) {
+        free(posted);
+        return -1;
+    }
+    return 0;
+}
+
 int async_runtime_post_completion(async_runtime_t* runtime, uintptr_t completion_key, uintptr_t data) {
     if (!runtime || !runtime->iocp_handle) return -1;
     
@@ -437,6 +460,12 @@ int async_runtime_post_completion(async_runtime_t* runtime, uintptr_t completion
     return result ? 0 : -1;
 }
 
+int async_runtime_post_accept(async_runtime_t* runtime, socket_fd_t fd) {
+    /* The accept worker already serves listening sockets added with async_runtime_add() */
+    (void)fd;
+    return runtime ? 0 : -1;
+}
+
 int async_runtime_post_read(async_runtime_t* runtime, socket_fd_t fd, void* buffer, size_t len) {
     if (!runtime || fd == INVALID_SOCKET) return -1;
     
@@ -2,13 +2,15 @@
  * @file async_runtime_poll.c
  * @brief Fallback poll-based async runtime implementation
  * 
- * Uses poll() for I/O multiplexing and pipe for worker completion notifications.
+ * Uses poll() for I/O multiplexing.  Worker completions travel through a
+ * lock-free completion ring; the pipe is only the doorbell that wakes poll().
  * Suitable for BSD, macOS, and other POSIX systems without epoll.
  */
 
 #if !defined(_WIN32) && !defined(__linux__)
 
 #include "async/async_runtime.h"
+#include "async/completion_ring.h"
 #include <poll.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -16,6 +18,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <sched.h>
 
 #define INITIAL_CAPACITY 64
 #define MAX_FD_COUNT 4096
@@ -35,8 +38,9 @@ struct async_runtime_s {
     int capacity;
     int count;
     
-    /* Notification pipe for worker completions */
+    /* Doorbell pipe for worker completions */
     int notify_pipe[2];
+    completion_ring_t* completions;
     
     console_type_t console_type;  /* Detected console type */
 };
@@ -95,6 +99,13 @@ static int expand_capacity(async_runtime_t* runtime) {
     return 0;
 }
 
+static int ring_doorbell(async_runtime_t* runtime) {
+    char byte = 1;
+    ssize_t n = write(runtime->notify_pipe[1], &byte, 1);
+    /* A full pipe means the doorbell is already pending */
+    return (n == 1 || (n < 0 && errno == EAGAIN)) ? 0 : -1;
+}
+
 /* Public API */
 
 async_runtime_t* async_runtime_init(void) {
@@ -131,9 +142,21 @@ async_runtime_t* async_runtime_init(void) {
         return NULL;
     }
     
-    /* Make read end non-blocking */
+    /* Make both ends non-blocking */
     int flags = fcntl(runtime->notify_pipe[0], F_GETFL, 0);
     fcntl(runtime->notify_pipe[0], F_SETFL, flags | O_NONBLOCK);
+    flags = fcntl(runtime->notify_pipe[1], F_GETFL, 0);
+    fcntl(runtime->notify_pipe[1], F_SETFL, flags | O_NONBLOCK);
+    
+    runtime->completions = completion_ring_create(COMPLETION_RING_CAPACITY);
+    if (!runtime->completions) {
+        close(runtime->notify_pipe[0]);
+        close(runtime->notify_pipe[1]);
+        free(runtime->pollfds);
+        free(runtime->mappings);
+        free(runtime);
+        return NULL;
+    }
     
     /* Add notify pipe to poll set */
     runtime->pollfds[0].fd = runtime->notify_pipe[0];
@@ -152,6 +175,7 @@ void async_runtime_deinit(async_runtime_t* runtime) {
     if (runtime->notify_pipe[0] >= 0) close(runtime->notify_pipe[0]);
     if (runtime->notify_pipe[1] >= 0) close(runtime->notify_pipe[1]);
     
+    completion_ring_destroy(runtime->completions);
     free(runtime->pollfds);
     free(runtime->mappings);
     free(runtime);
@@ -212,9 +236,7 @@ int async_runtime_remove(async_runtime_t* runtime, socket_fd_t fd) {
 int async_runtime_wakeup(async_runtime_t* runtime) {
     if (!runtime || runtime->notify_pipe[1] < 0) return -1;
     
-    char byte = 1;
-    ssize_t n = write(runtime->notify_pipe[1], &byte, 1);
-    return (n == 1) ? 0 : -1;
+    return ring_doorbell(runtime);
 }
 
 int async_runtime_wait(async_runtime_t* runtime, io_event_t* events,
@@ -235,23 +257,11 @@ int async_runtime_wait(async_runtime_t* runtime, io_event_t* events,
     if (result == 0) return 0;  /* Timeout */
     
     int event_count = 0;
+    bool doorbell = false;
     for (int i = 0; i < runtime->count && event_count < max_events; i++) {
         if (runtime->pollfds[i].revents) {
-            /* Check if this is the notify pipe */
             if (runtime->pollfds[i].fd == runtime->notify_pipe[0]) {
-                /* Drain the pipe */
-                uint64_t val;
-                while (read(runtime->notify_pipe[0], &val, sizeof(val)) == sizeof(val)) {
-                    if (event_count < max_events) {
-                        events[event_count].fd = -1;
-                        events[event_count].completion_key = (uintptr_t)(val >> 32);
-                        events[event_count].context = NULL;
-                        events[event_count].event_type = EVENT_READ;
-                        events[event_count].bytes_transferred = (int)(val & 0xFFFFFFFF);
-                        events[event_count].buffer = NULL;
-                        event_count++;
-                    }
-                }
+                doorbell = true;
             } else {
                 /* Regular I/O event */
                 events[event_count].fd = runtime->pollfds[i].fd;
@@ -265,16 +275,53 @@ int async_runtime_wait(async_runtime_t* runtime, io_event_t* events,
         }
     }
     
+    if (doorbell) {
+        /* Consume the doorbell, then re-arm it before draining so that a
+         * completion posted during the drain rings it again. */
+        char buf[64];
+        while (read(runtime->notify_pipe[0], buf, sizeof(buf)) > 0)
+            ;
+        completion_ring_arm(runtime->completions);
+    }
+    
+    /* Drain completions in one batch into the remaining slots */
+    event_count += completion_ring_pop(runtime->completions, events + event_count,
+                                       max_events - event_count);
+    if (!completion_ring_is_empty(runtime->completions)) {
+        /* Out of room: make sure the next wait returns at once */
+        ring_doorbell(runtime);
+    }
+    
     return event_count;
 }
 
-int async_runtime_post_completion(async_runtime_t* runtime, uintptr_t completion_key, uintptr_t data) {
-    if (!runtime || runtime->notify_pipe[1] < 0) return -1;
+int async_runtime_post_event(async_runtime_t* runtime, const io_event_t* event) {
+    if (!runtime || !event || runtime->notify_pipe[1] < 0) return -1;
+    
+    int rc;
+    while ((rc = completion_ring_push(runtime->completions, event)) < 0) {
+        /* Ring full: nudge the main thread and wait for it to drain */
+        ring_doorbell(runtime);
+        sched_yield();
+    }
     
-    uint64_t val = (((uint64_t)completion_key) << 32) | (data & 0xFFFFFFFF);
-    ssize_t n = write(runtime->notify_pipe[1], &val, sizeof(val));
+    return rc ? ring_doorbell(runtime) : 0;
+}
+
+int async_runtime_post_completion(async_runtime_t* runtime, uintptr_t completion_key, uintptr_t data) {
+    io_event_t event = {0};
     
-    return (n == sizeof(val)) ? 0 : -1;
+    event.fd = -1;
+    event.completion_key = completion_key;
+    event.event_type = EVENT_READ;
+    event.bytes_transferred = data;
+    return async_runtime_post_event(runtime, &event);
+}
+
+int async_runtime_post_accept(async_runtime_t* runtime, socket_fd_t fd) {
+    /* Readiness-based: caller accepts on EVENT_READ */
+    (void)runtime; (void)fd;
+    return -1;
 }
 
 int async_runtime_post_read(async_runtime_t* runtime, socket_fd_t fd, void* buffer, size_t len) {
@@ -0,0 +1,612 @@
+/**
+ * @file async_runtime_uring.c
+ * @brief io_uring completion engine for the Linux async runtime
+ *
+ * Talks to the kernel through the raw io_uring syscalls, so no liburing is
+ * needed.  See async_runtime_uring.h for how it fits into the epoll runtime.
+ */
+
+#if defined(__linux__)
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_IO_URING
+
+#include "async/async_runtime_uring.h"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define URING_ENTRIES     256   /* submission queue size */
+#define URING_CQ_ENTRIES  4096  /* completion queue size */
+#define URING_BUF_COUNT   1024  /* provided receive buffers (power of 2) */
+#define URING_BUF_SIZE    1024  /* bytes per receive buffer */
+#define URING_BGID        0     /* buffer group id */
+
+/*
+ * user_data: sends carry their (4-byte aligned) request pointer, everything
+ * else packs the operation, the fd and the fd's generation, so completions
+ * that arrive after uring_io_forget() can be recognised and dropped.
+ */
+#define OP_SEND    0
+#define OP_ACCEPT  1
+#define OP_RECV    2
+#define OP_IGNORE  3
+#define GEN_MASK   0x3fffffffu
+
+#define USER_DATA(op, fd, gen) \
+    (((uint64_t)(uint32_t)(fd) << 32) | ((uint64_t)((gen) & GEN_MASK) << 2) | (op))
+
+#define FD_ACCEPTING      0x01
+#define FD_RECEIVING      0x02
+#define FD_REARM_ACCEPT   0x04
+#define FD_REARM_RECV     0x08
+
+typedef struct send_req_s {
+    struct send_req_s* next;
+    socket_fd_t fd;
+    uint32_t gen;
+    size_t len;
+    size_t done;
+    char data[];
+} send_req_t;
+
+typedef struct {
+    void* context;
+    uint32_t gen;
+    uint32_t events;        /* readiness events requested through the runtime */
+    unsigned flags;
+    send_req_t* sends;      /* queued sends; the first one is in flight */
+} fd_state_t;
+
+struct uring_io_s {
+    int ring_fd;
+    unsigned sq_entries;
+    void* sq_ptr;
+    size_t sq_size;
+    void* cq_ptr;
+    size_t cq_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe* cqes;
+    unsigned to_submit;
+
+    struct io_uring_buf_ring* buf_ring;
+    size_t buf_ring_size;
+    char* buffers;
+    uint16_t buf_tail;
+    uint16_t returned[URING_BUF_COUNT];  /* handed out since the last submit */
+    int num_returned;
+
+    fd_state_t* fds;
+    int num_fds;
+    int rearm_pending;
+};
+
+/* Ring plumbing */
+
+static int ring_enter(uring_io_t* uring, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, uring->ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static void flush_sq(uring_io_t* uring) {
+    while (uring->to_submit) {
+        int n = ring_enter(uring, uring->to_submit, 0, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;  /* EAGAIN/EBUSY: the kernel is short on resources, retry next cycle */
+        }
+        if (n == 0) break;
+        uring->to_submit -= (unsigned)n;
+    }
+}
+
+static struct io_uring_sqe* get_sqe(uring_io_t* uring) {
+    unsigned tail = *uring->sq_tail;
+    unsigned head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+
+    if (tail - head >= uring->sq_entries) {
+        flush_sq(uring);
+        head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+        if (tail - head >= uring->sq_entries)
+            return NULL;
+    }
+
+    unsigned idx = tail & *uring->sq_mask;
+    struct io_uring_sqe* sqe = &uring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    uring->sq_array[idx] = idx;
+    return sqe;
+}
+
+static void push_sqe(uring_io_t* uring) {
+    __atomic_store_n(uring->sq_tail, *uring->sq_tail + 1, __ATOMIC_RELEASE);
+    uring->to_submit++;
+}
+
+static struct io_uring_cqe* peek_cqe(uring_io_t* uring) {
+    unsigned head = *uring->cq_head;
+    if (head == __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &uring->cqes[head & *uring->cq_mask];
+}
+
+static void advance_cq(uring_io_t* uring) {
+    __atomic_store_n(uring->cq_head, *uring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+static void return_buffer(uring_io_t* uring, uint16_t bid) {
+    uring->returned[uring->num_returned++] = bid;
+}
+
+static void recycle_buffers(uring_io_t* uring) {
+    if (!uring->num_returned) return;
+
+    for (int i = 0; i < uring->num_returned; i++) {
+        uint16_t bid = uring->returned[i];
+        struct io_uring_buf* buf = &uring->buf_ring->bufs[(uint16_t)(uring->buf_tail + i) & (URING_BUF_COUNT - 1)];
+        buf->addr = (uint64_t)(uintptr_t)(uring->buffers + (size_t)bid * URING_BUF_SIZE);
+        buf->len = URING_BUF_SIZE;
+        buf->bid = bid;
+    }
+    uring->buf_tail += (uint16_t)uring->num_returned;
+    __atomic_store_n(&uring->buf_ring->tail, uring->buf_tail, __ATOMIC_RELEASE);
+    uring->num_returned = 0;
+}
+
+/* Descriptor state */
+
+static fd_state_t* fd_state(uring_io_t* uring, socket_fd_t fd, int create) {
+    if (fd < 0) return NULL;
+    if (fd >= uring->num_fds) {
+        if (!create) return NULL;
+
+        int num = uring->num_fds ? uring->num_fds : 64;
+        while (num <= fd) num *= 2;
+        fd_state_t* fds = realloc(uring->fds, num * sizeof(fd_state_t));
+        if (!fds) return NULL;
+        memset(fds + uring->num_fds, 0, (num - uring->num_fds) * sizeof(fd_state_t));
+        uring->fds = fds;
+        uring->num_fds = num;
+    }
+    return &uring->fds[fd];
+}
+
+static int arm_accept(uring_io_t* uring, socket_fd_t fd, fd_state_t* st) {
+    struct io_uring_sqe* sqe = get_sqe(uring);
+    if (!sqe) return -1;
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = USER_DATA(OP_ACCEPT, fd, st->gen);
+    push_sqe(uring);
+    st->flags = (st->flags | FD_ACCEPTING) & ~FD_REARM_ACCEPT;
+    return 0;
+}
+
+static int arm_recv(uring_io_t* uring, socket_fd_t fd, fd_state_t* st) {
+    struct io_uring_sqe* sqe = get_sqe(uring);
+    if (!sqe) return -1;
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = USER_DATA(OP_RECV, fd, st->gen);
+    push_sqe(uring);
+    st->flags = (st->flags | FD_RECEIVING) & ~FD_REARM_RECV;
+    return 0;
+}
+
+static int submit_send(uring_io_t* uring, send_req_t* req) {
+    struct io_uring_sqe* sqe = get_sqe(uring);
+    if (!sqe) return -1;
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = req->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(req->data + req->done);
+    sqe->len = (uint32_t)(req->len - req->done);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (uint64_t)(uintptr_t)req;
+    push_sqe(uring);
+    return 0;
+}
+
+static void free_sends(send_req_t* req) {
+    while (req) {
+        send_req_t* next = req->next;
+        free(req);
+        req = next;
+    }
+}
+
+/*
+ * Check that the kernel does multishot recv from a provided buffer ring
+ * (Linux 6.0).  The receive ends with EOF, so nothing is left in flight.
+ */
+static int probe_multishot_recv(uring_io_t* uring) {
+    int sv[2];
+    int ok = 0;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) return 0;
+
+    struct io_uring_sqe* sqe = get_sqe(uring);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = sv[0];
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = USER_DATA(OP_IGNORE, 0, 0);
+    push_sqe(uring);
+
+    if (write(sv[1], "x", 1) == 1 &&
+        ring_enter(uring, uring->to_submit, 1, IORING_ENTER_GETEVENTS) >= 0) {
+        uring->to_submit = 0;
+        struct io_uring_cqe* cqe = peek_cqe(uring);
+        if (cqe) {
+            int more = cqe->flags & IORING_CQE_F_MORE;
+            ok = cqe->res == 1 && more;
+            if (cqe->flags & IORING_CQE_F_BUFFER)
+                return_buffer(uring, (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+            advance_cq(uring);
+            if (more) {
+                close(sv[1]);
+                sv[1] = -1;
+                while (!(cqe = peek_cqe(uring)) &&
+                       (ring_enter(uring, 0, 1, IORING_ENTER_GETEVENTS) >= 0 || errno == EINTR))
+                    ;
+                if (cqe) advance_cq(uring);
+            }
+        }
+    }
+
+    if (sv[1] >= 0) close(sv[1]);
+    close(sv[0]);
+    recycle_buffers(uring);
+    return ok;
+}
+
+/* Engine API */
+
+uring_io_t* uring_io_init(void) {
+    uring_io_t* uring = calloc(1, sizeof(uring_io_t));
+    if (!uring) return NULL;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL;
+    p.cq_entries = URING_CQ_ENTRIES;
+    uring->ring_fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (uring->ring_fd < 0) {
+        free(uring);  /* ENOSYS, EPERM under seccomp, EINVAL on old kernels */
+        return NULL;
+    }
+    uring->sq_entries = p.sq_entries;
+
+    uring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    uring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (uring->cq_size > uring->sq_size) uring->sq_size = uring->cq_size;
+        uring->cq_size = 0;
+    }
+    uring->sq_ptr = mmap(NULL, uring->sq_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_SQ_RING);
+    if (uring->sq_ptr == MAP_FAILED) {
+        uring->sq_ptr = NULL;
+        goto fail;
+    }
+    if (uring->cq_size) {
+        uring->cq_ptr = mmap(NULL, uring->cq_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_CQ_RING);
+        if (uring->cq_ptr == MAP_FAILED) {
+            uring->cq_ptr = NULL;
+            goto fail;
+        }
+    } else {
+        uring->cq_ptr = uring->sq_ptr;
+    }
+    uring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_SQES);
+    if (uring->sqes == MAP_FAILED) {
+        uring->sqes = NULL;
+        goto fail;
+    }
+
+    uring->sq_head = (unsigned*)((char*)uring->sq_ptr + p.sq_off.head);
+    uring->sq_tail = (unsigned*)((char*)uring->sq_ptr + p.sq_off.tail);
+    uring->sq_mask = (unsigned*)((char*)uring->sq_ptr + p.sq_off.ring_mask);
+    uring->sq_array = (unsigned*)((char*)uring->sq_ptr + p.sq_off.array);
+    uring->cq_head = (unsigned*)((char*)uring->cq_ptr + p.cq_off.head);
+    uring->cq_tail = (unsigned*)((char*)uring->cq_ptr + p.cq_off.tail);
+    uring->cq_mask = (unsigned*)((char*)uring->cq_ptr + p.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe*)((char*)uring->cq_ptr + p.cq_off.cqes);
+
+    /* Provided buffer ring for multishot recv (Linux 5.19) */
+    uring->buffers = malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+    uring->buf_ring_size = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+    uring->buf_ring = mmap(NULL, uring->buf_ring_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (uring->buf_ring == MAP_FAILED) {
+        uring->buf_ring = NULL;
+        goto fail;
+    }
+    if (!uring->buffers) goto fail;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)uring->buf_ring;
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BGID;
+    if (syscall(__NR_io_uring_register, uring->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        goto fail;
+
+    for (int i = 0; i < URING_BUF_COUNT; i++)
+        return_buffer(uring, (uint16_t)i);
+    recycle_buffers(uring);
+
+    if (!probe_multishot_recv(uring))
+        goto fail;
+
+    return uring;
+
+fail:
+    uring_io_deinit(uring);
+    return NULL;
+}
+
+void uring_io_deinit(uring_io_t* uring) {
+    if (!uring) return;
+
+    /* Closing the ring cancels whatever is still in flight */
+    if (uring->ring_fd >= 0) close(uring->ring_fd);
+    if (uring->sqes) munmap(uring->sqes, uring->sqes_size);
+    if (uring->cq_ptr && uring->cq_ptr != uring->sq_ptr) munmap(uring->cq_ptr, uring->cq_size);
+    if (uring->sq_ptr) munmap(uring->sq_ptr, uring->sq_size);
+    if (uring->buf_ring) munmap(uring->buf_ring, uring->buf_ring_size);
+    for (int i = 0; i < uring->num_fds; i++)
+        free_sends(uring->fds[i].sends);
+    free(uring->fds);
+    free(uring->buffers);
+    free(uring);
+}
+
+int uring_io_fd(uring_io_t* uring) {
+    return uring->ring_fd;
+}
+
+uint32_t uring_io_filter(uring_io_t* uring, socket_fd_t fd, uint32_t events, void* context) {
+    fd_state_t* st = fd_state(uring, fd, 1);
+    if (!st) return events;
+
+    st->events = events;
+    st->context = context;
+    if (st->flags & (FD_ACCEPTING | FD_RECEIVING | FD_REARM_ACCEPT | FD_REARM_RECV))
+        events &= ~EVENT_READ;
+    return events;
+}
+
+int uring_io_accept(uring_io_t* uring, socket_fd_t fd, uint32_t* events, void** context) {
+    fd_state_t* st = fd_state(uring, fd, 1);
+    if (!st) return -1;
+    if (st->flags & (FD_ACCEPTING | FD_REARM_ACCEPT)) return 0;
+
+    if (arm_accept(uring, fd, st) < 0) return -1;
+    *events = st->events & ~EVENT_READ;
+    *context = st->context;
+    return 1;
+}
+
+int uring_io_recv(uring_io_t* uring, socket_fd_t fd, uint32_t* events, void** context) {
+    fd_state_t* st = fd_state(uring, fd, 1);
+    if (!st) return -1;
+    if (st->flags & (FD_RECEIVING | FD_REARM_RECV)) return 0;
+
+    if (arm_recv(uring, fd, st) < 0) return -1;
+    *events = st->events & ~EVENT_READ;
+    *context = st->context;
+    return 1;
+}
+
+int uring_io_send(uring_io_t* uring, socket_fd_t fd, const void* buffer, size_t len) {
+    fd_state_t* st = fd_state(uring, fd, 1);
+    if (!st || !len) return -1;
+
+    send_req_t* req = malloc(sizeof(send_req_t) + len);
+    if (!req) return -1;
+    req->next = NULL;
+    req->fd = fd;
+    req->gen = st->gen;
+    req->len = len;
+    req->done = 0;
+    memcpy(req->data, buffer, len);
+
+    if (!st->sends) {
+        if (submit_send(uring, req) < 0) {
+            free(req);
+            return -1;
+        }
+        st->sends = req;
+    } else {
+        send_req_t* last = st->sends;
+        while (last->next) last = last->next;
+        last->next = req;
+    }
+    return 0;
+}
+
+void uring_io_forget(uring_io_t* uring, socket_fd_t fd) {
+    fd_state_t* st = fd_state(uring, fd, 0);
+    if (!st) return;
+
+    if (st->flags || st->sends) {
+        struct io_uring_sqe* sqe = get_sqe(uring);
+        if (sqe) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = fd;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+            sqe->user_data = USER_DATA(OP_IGNORE, 0, 0);
+            push_sqe(uring);
+        }
+        /* The caller closes fd next: cancel before that */
+        flush_sq(uring);
+    }
+
+    /* The send in flight is freed when its completion comes back */
+    if (st->sends) {
+        free_sends(st->sends->next);
+        st->sends->next = NULL;
+    }
+    st->sends = NULL;
+    st->gen++;
+    st->flags = 0;
+    st->events = 0;
+    st->context = NULL;
+}
+
+void uring_io_submit(uring_io_t* uring) {
+    recycle_buffers(uring);
+
+    if (uring->rearm_pending) {
+        uring->rearm_pending = 0;
+        for (int fd = 0; fd < uring->num_fds; fd++) {
+            fd_state_t* st = &uring->fds[fd];
+            if (((st->flags & FD_REARM_ACCEPT) && arm_accept(uring, fd, st) < 0) ||
+                ((st->flags & FD_REARM_RECV) && arm_recv(uring, fd, st) < 0))
+                uring->rearm_pending = 1;
+        }
+    }
+
+    flush_sq(uring);
+}
+
+int uring_io_reap(uring_io_t* uring, io_event_t* events, int max_events) {
+    struct io_uring_cqe* cqe;
+    int n = 0;
+
+    while (n < max_events && (cqe = peek_cqe(uring))) {
+        uint64_t user_data = cqe->user_data;
+        int res = cqe->res;
+        unsigned flags = cqe->flags;
+        int op = (int)(user_data & 3);
+        io_event_t* evt = &events[n];
+
+        advance_cq(uring);
+        memset(evt, 0, sizeof(*evt));
+
+        if (op == OP_SEND) {
+            send_req_t* req = (send_req_t*)(uintptr_t)user_data;
+            fd_state_t* st = fd_state(uring, req->fd, 0);
+
+            if (!st || st->gen != req->gen || st->sends != req) {
+                free(req);  /* forgotten meanwhile */
+                continue;
+            }
+            if (res > 0 && req->done + res < req->len) {
+                req->done += res;  /* short send: queue the rest */
+                if (submit_send(uring, req) == 0)
+                    continue;
+                res = -EAGAIN;
+            }
+            evt->fd = req->fd;
+            evt->context = st->context;
+            if (res < 0) {
+                evt->event_type = EVENT_ERROR;
+                free_sends(req);
+                st->sends = NULL;
+            } else {
+                evt->event_type = EVENT_WRITE;
+                evt->bytes_transferred = req->len;
+                st->sends = req->next;
+                free(req);
+                while (st->sends && submit_send(uring, st->sends) < 0) {
+                    send_req_t* dropped = st->sends;
+                    st->sends = dropped->next;
+                    free(dropped);
+                }
+            }
+            n++;
+            continue;
+        }
+
+        if (op == OP_IGNORE) {
+            if (flags & IORING_CQE_F_BUFFER)
+                return_buffer(uring, (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT));
+            continue;
+        }
+
+        socket_fd_t fd = (socket_fd_t)(user_data >> 32);
+        uint32_t gen = (uint32_t)(user_data >> 2) & GEN_MASK;
+        fd_state_t* st = fd_state(uring, fd, 0);
+        int stale = !st || (st->gen & GEN_MASK) != gen;
+        int more = flags & IORING_CQE_F_MORE;
+
+        if (op == OP_ACCEPT) {
+            if (stale) {
+                if (res >= 0) close(res);
+                continue;
+            }
+            if (!more) {
+                st->flags = (st->flags & ~FD_ACCEPTING) | FD_REARM_ACCEPT;
+                uring->rearm_pending = 1;
+            }
+            if (res == -ECANCELED)
+                continue;
+            evt->context = st->context;
+            if (res >= 0) {
+                evt->fd = res;
+                evt->event_type = EVENT_READ | EVENT_ACCEPT;
+            } else {
+                evt->fd = fd;
+                evt->event_type = EVENT_ERROR;
+            }
+            n++;
+            continue;
+        }
+
+        /* OP_RECV */
+        if (flags & IORING_CQE_F_BUFFER) {
+            uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+            return_buffer(uring, bid);  /* given back at the next submit */
+            evt->buffer = uring->buffers + (size_t)bid * URING_BUF_SIZE;
+        }
+        if (stale)
+            continue;
+        if (!more) {
+            st->flags &= ~FD_RECEIVING;
+            if (res > 0 || res == -ENOBUFS) {
+                st->flags |= FD_REARM_RECV;
+                uring->rearm_pending = 1;
+            }
+        }
+        if (res == -ENOBUFS || res == -ECANCELED)
+            continue;  /* out of buffers: re-armed once they come back */
+        evt->fd = fd;
+        evt->context = st->context;
+        if (res > 0) {
+            evt->event_type = EVENT_READ;
+            evt->bytes_transferred = (size_t)res;
+        } else {
+            evt->event_type = res == 0 ? EVENT_CLOSE : EVENT_ERROR;
+            evt->buffer = NULL;
+        }
+        n++;
+    }
+
+    return n;
+}
+
+#endif /* HAVE_IO_URING */
+
+#endif /* __linux__ */
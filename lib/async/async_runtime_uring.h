@@ -0,0 +1,88 @@
+/**
+ * @file async_runtime_uring.h
+ * @brief io_uring completion engine used by the epoll runtime (internal)
+ *
+ * The epoll runtime stays in charge of readiness (listening LPC sockets,
+ * the address server pipe, write interest).  When the kernel supports it,
+ * this engine takes over the hot paths that async_runtime_post_accept(),
+ * async_runtime_post_read() and async_runtime_post_write() opt into:
+ * - multishot accept: accepted connections arrive as EVENT_ACCEPT events
+ * - multishot recv into a provided buffer ring: data arrives as EVENT_READ
+ *   events carrying buffer/bytes_transferred, like IOCP completions
+ * - sends queued per descriptor and submitted together once per wait
+ *
+ * The ring's own fd is registered with epoll, so one epoll_wait() covers
+ * both models.  uring_io_init() returns NULL when io_uring is missing,
+ * forbidden (seccomp) or too old; the runtime then behaves as plain epoll.
+ */
+
+#ifndef ASYNC_RUNTIME_URING_H
+#define ASYNC_RUNTIME_URING_H
+
+#include "async/async_runtime.h"
+
+typedef struct uring_io_s uring_io_t;
+
+/**
+ * Set up the ring and the provided buffer ring, and check that multishot
+ * recv works on this kernel.
+ * @returns Engine, or NULL if io_uring can't be used
+ */
+uring_io_t* uring_io_init(void);
+
+/**
+ * Cancel everything in flight and release the ring
+ */
+void uring_io_deinit(uring_io_t* uring);
+
+/**
+ * @returns The ring fd, readable while completions are waiting
+ */
+int uring_io_fd(uring_io_t* uring);
+
+/**
+ * Remember the readiness events and context registered for fd, and filter
+ * out the events the engine delivers itself.
+ * @returns The events epoll should still watch for fd
+ */
+uint32_t uring_io_filter(uring_io_t* uring, socket_fd_t fd, uint32_t events, void* context);
+
+/**
+ * Arm a multishot accept on a listening socket registered with
+ * uring_io_filter().  When newly armed, *events and *context tell what
+ * epoll should watch from now on.
+ * @returns 1 if newly armed, 0 if already armed, -1 on failure
+ */
+int uring_io_accept(uring_io_t* uring, socket_fd_t fd, uint32_t* events, void** context);
+
+/**
+ * Arm a multishot recv on a connected socket, like uring_io_accept()
+ * @returns 1 if newly armed, 0 if already armed, -1 on failure
+ */
+int uring_io_recv(uring_io_t* uring, socket_fd_t fd, uint32_t* events, void** context);
+
+/**
+ * Queue a copy of buffer to be sent on fd after earlier sends on fd
+ * @returns 0 on success, -1 on failure
+ */
+int uring_io_send(uring_io_t* uring, socket_fd_t fd, const void* buffer, size_t len);
+
+/**
+ * Cancel all requests on fd and drop their pending completions
+ */
+void uring_io_forget(uring_io_t* uring, socket_fd_t fd);
+
+/**
+ * Give back the buffers handed out by the previous uring_io_reap(),
+ * re-arm starved receives and submit all queued requests in one call.
+ */
+void uring_io_submit(uring_io_t* uring);
+
+/**
+ * Turn completions into events.  Receive buffers stay valid until the
+ * next uring_io_submit().
+ * @returns Number of events stored
+ */
+int uring_io_reap(uring_io_t* uring, io_event_t* events, int max_events);
+
+#endif /* ASYNC_RUNTIME_URING_H */
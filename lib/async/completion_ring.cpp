@@ -0,0 +1,115 @@
+/**
+ * @file completion_ring.cpp
+ * @brief C++11 implementation of the lock-free completion ring
+ *
+ * Bounded MPSC queue after Dmitry Vyukov's bounded MPMC queue: each slot
+ * carries a sequence number telling producers when it is free and the
+ * consumer when it is published.  Producers claim slots with a CAS on the
+ * tail; the single consumer owns the head and needs no atomic RMW.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "completion_ring.h"
+#include <atomic>
+#include <new>
+
+namespace {
+
+struct Slot {
+    std::atomic<size_t> seq;
+    io_event_t event;
+};
+
+}
+
+struct completion_ring_s {
+    Slot* slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> tail;   /* next slot to claim (producers) */
+    alignas(64) size_t head;                /* next slot to pop (consumer) */
+    alignas(64) std::atomic<bool> rung;     /* doorbell pending */
+};
+
+extern "C" {
+
+completion_ring_t* completion_ring_create(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity)
+        size <<= 1;
+
+    completion_ring_t* ring = new (std::nothrow) completion_ring_s;
+    if (!ring) return nullptr;
+
+    ring->slots = new (std::nothrow) Slot[size];
+    if (!ring->slots) {
+        delete ring;
+        return nullptr;
+    }
+    for (size_t i = 0; i < size; i++)
+        ring->slots[i].seq.store(i, std::memory_order_relaxed);
+    ring->mask = size - 1;
+    ring->tail.store(0, std::memory_order_relaxed);
+    ring->head = 0;
+    ring->rung.store(false, std::memory_order_relaxed);
+    return ring;
+}
+
+void completion_ring_destroy(completion_ring_t* ring) {
+    if (!ring) return;
+    delete[] ring->slots;
+    delete ring;
+}
+
+int completion_ring_push(completion_ring_t* ring, const io_event_t* event) {
+    size_t pos = ring->tail.load(std::memory_order_relaxed);
+    Slot* slot;
+
+    for (;;) {
+        slot = &ring->slots[pos & ring->mask];
+        size_t seq = slot->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (ring->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return -1;  /* full: the consumer hasn't freed this slot yet */
+        } else {
+            pos = ring->tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->event = *event;
+    slot->seq.store(pos + 1, std::memory_order_release);
+
+    /* Every push takes part in the release sequence on rung, so the
+     * consumer's acquire in completion_ring_arm() sees all of them. */
+    return ring->rung.exchange(true, std::memory_order_acq_rel) ? 0 : 1;
+}
+
+void completion_ring_arm(completion_ring_t* ring) {
+    ring->rung.exchange(false, std::memory_order_acq_rel);
+}
+
+int completion_ring_pop(completion_ring_t* ring, io_event_t* events, int max_events) {
+    int n = 0;
+
+    while (n < max_events) {
+        Slot* slot = &ring->slots[ring->head & ring->mask];
+        if (slot->seq.load(std::memory_order_acquire) != ring->head + 1)
+            break;  /* empty, or claimed but not yet published */
+        events[n++] = slot->event;
+        slot->seq.store(ring->head + ring->mask + 1, std::memory_order_release);
+        ring->head++;
+    }
+    return n;
+}
+
+bool completion_ring_is_empty(completion_ring_t* ring) {
+    Slot* slot = &ring->slots[ring->head & ring->mask];
+    return slot->seq.load(std::memory_order_acquire) != ring->head + 1;
+}
+
+}
@@ -0,0 +1,87 @@
+/**
+ * @file completion_ring.h
+ * @brief Lock-free multi-producer, single-consumer ring of io_event_t
+ *
+ * Carries worker completions to the main thread on the POSIX runtimes.
+ * Any number of worker threads push full io_event_t payloads; only the
+ * thread calling async_runtime_wait() pops them.  The runtime's eventfd
+ * (or pipe) is used as a doorbell only: completion_ring_push() tells the
+ * producer when the doorbell has to be rung, so a burst of completions
+ * costs one write() no matter how many events it carries.
+ *
+ * C++11-based implementation providing C-compatible API (see port/sync.h).
+ */
+
+#ifndef ASYNC_COMPLETION_RING_H
+#define ASYNC_COMPLETION_RING_H
+
+#include "async/async_runtime.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct completion_ring_s completion_ring_t;
+
+/** Default number of slots used by the runtimes */
+#define COMPLETION_RING_CAPACITY 4096
+
+/**
+ * Create a completion ring
+ *
+ * @param capacity Number of slots, rounded up to a power of 2
+ * @returns Ring, or NULL on failure
+ */
+completion_ring_t* completion_ring_create(size_t capacity);
+
+/**
+ * Destroy a completion ring, discarding any events left in it
+ *
+ * @param ring Ring to destroy
+ */
+void completion_ring_destroy(completion_ring_t* ring);
+
+/**
+ * Push an event (any thread, lock-free)
+ *
+ * @param ring Ring to push to
+ * @param event Event to copy into the ring
+ * @returns 1 if pushed and the caller must ring the doorbell,
+ *          0 if pushed and the doorbell is already pending,
+ *          -1 if the ring is full
+ */
+int completion_ring_push(completion_ring_t* ring, const io_event_t* event);
+
+/**
+ * Re-arm the doorbell (consumer only)
+ *
+ * Call after the doorbell was consumed and before popping, so that a
+ * push racing with the drain rings it again.
+ *
+ * @param ring Ring to re-arm
+ */
+void completion_ring_arm(completion_ring_t* ring);
+
+/**
+ * Pop up to max_events events in FIFO order (consumer only)
+ *
+ * @param ring Ring to pop from
+ * @param events Output array
+ * @param max_events Size of the output array
+ * @returns Number of events popped
+ */
+int completion_ring_pop(completion_ring_t* ring, io_event_t* events, int max_events);
+
+/**
+ * Check whether there are events left to pop (consumer only)
+ *
+ * @param ring Ring to check
+ * @returns true if no published event is waiting
+ */
+bool completion_ring_is_empty(completion_ring_t* ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ASYNC_COMPLETION_RING_H */
@@ -0,0 +1,515 @@
+#ifdef	HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+
+#include "src/std.h"
+#include "rc.h"
+#include "lpc/object.h"
+#include "lpc/functional.h"
+#include "lpc/include/runtime_config.h"
+#include "src/interpret.h"
+#include "src/apply.h"
+#include "lpc/include/origin.h"
+#include "async/async_worker.h"
+#include "port/sync.h"
+
+#include "file_utils.h"
+#include "async_file.h"
+
+/*
+ * A job is created on the backend thread with everything the I/O needs
+ * (checked path, data to write, limits), handed to a worker through the
+ * pool queue, and comes back as the context of an ASYNC_FILE_COMPLETION_KEY
+ * event.  Workers only touch the path, data, len and result fields, and
+ * never call into the driver.
+ *
+ * Jobs for the same path run one at a time and in the order they were
+ * submitted: a worker skips a job while another worker is busy with its
+ * path, and any job queued behind it for that path.
+ */
+typedef enum {
+  ASYNC_READ_FILE,
+  ASYNC_WRITE_FILE,
+  ASYNC_SAVE_OBJECT
+} async_file_op_t;
+
+typedef struct async_file_job_s {
+  struct async_file_job_s *next;
+  async_file_op_t op;
+  char *path;			/* checked path, relative to the mudlib */
+  char *data;			/* data to write, or contents read */
+  size_t len;
+  size_t limit;			/* read: largest file to read */
+  int flags;			/* write: 1 to overwrite instead of append */
+  unsigned int serial;		/* numbers the job, for unique temporary files */
+  int result;			/* 0 or an errno value */
+  object_t *owner;
+  svalue_t file;		/* file name as given to the efun */
+  svalue_t callback;		/* function pointer or function name */
+} async_file_job_t;
+
+static struct {
+  async_runtime_t *runtime;
+  async_worker_t *workers[ASYNC_FILE_WORKERS];
+  int num_workers;
+  platform_mutex_t lock;
+  platform_event_t wakeup;	/* manual reset: set while a job can be taken */
+  platform_event_t done;	/* auto reset: set when a worker finishes a job */
+  async_file_job_t *head, *tail;
+  const char *busy[ASYNC_FILE_WORKERS];	/* paths of the jobs being worked on */
+  int pending;			/* submitted and not completed yet */
+  unsigned int serial;		/* last job number handed out */
+} pool;
+
+/* with the lock held */
+static int path_is_busy (const char *path) {
+  int i;
+
+  for (i = 0; i < ASYNC_FILE_WORKERS; i++)
+    if (pool.busy[i] && !strcmp (pool.busy[i], path))
+      return 1;
+  return 0;
+}
+
+/**
+ * Take the first queued job whose path no other worker is busy with.
+ * @param slot The busy slot of the calling worker.
+ */
+static async_file_job_t *take_job (int slot) {
+  async_file_job_t *job, **link, *prev = NULL;
+
+  platform_mutex_lock (&pool.lock);
+  for (link = &pool.head; (job = *link); prev = job, link = &job->next)
+    if (!path_is_busy (job->path))
+      break;
+  if (job)
+    {
+      *link = job->next;
+      if (pool.tail == job)
+        pool.tail = prev;
+      pool.busy[slot] = job->path;
+    }
+  else
+    platform_event_reset (&pool.wakeup);	/* empty, or waiting for busy paths */
+  platform_mutex_unlock (&pool.lock);
+  return job;
+}
+
+/* the worker in \p slot is done with its job */
+static void release_job (int slot) {
+  platform_mutex_lock (&pool.lock);
+  pool.busy[slot] = NULL;
+  if (pool.head)
+    platform_event_set (&pool.wakeup);
+  platform_mutex_unlock (&pool.lock);
+  platform_event_set (&pool.done);
+}
+
+static void read_job (async_file_job_t *job) {
+  struct stat st;
+  long n;
+  int fd;
+
+#ifdef _WIN32
+  fd = open (job->path, O_RDONLY | O_TEXT);
+#else
+  fd = open (job->path, O_RDONLY);
+#endif
+  if (fd == -1)
+    {
+      job->result = errno;
+      return;
+    }
+  if (fstat (fd, &st) == -1)
+    job->result = errno;
+  else if (st.st_mode & S_IFDIR)
+    job->result = EISDIR;
+  else if ((size_t)st.st_size > job->limit)
+    job->result = EFBIG;
+  else
+    {
+      /* text mode may return fewer bytes than st_size on Windows;
+       * plain malloc(), the driver's allocator isn't for worker threads */
+      job->data = (char *) malloc ((size_t)st.st_size + 1);
+      if (!job->data)
+        {
+          job->result = ENOMEM;
+          close (fd);
+          return;
+        }
+      while (job->len < (size_t)st.st_size)
+        {
+          n = read (fd, job->data + job->len, (unsigned)((size_t)st.st_size - job->len));
+          if (n < 0)
+            {
+              if (errno == EINTR)
+                continue;
+              job->result = errno;
+              break;
+            }
+          if (n == 0)
+            break;
+          job->len += (size_t)n;
+        }
+      job->data[job->len] = '\0';
+    }
+  close (fd);
+}
+
+static void write_job (async_file_job_t *job) {
+  FILE *f;
+
+  f = fopen (job->path, (job->flags & 1) ? "w" : "a");
+  if (!f)
+    {
+      job->result = errno;
+      return;
+    }
+  if (fwrite (job->data, 1, job->len, f) != job->len)
+    job->result = errno ? errno : EIO;
+  if (fclose (f) < 0 && !job->result)
+    job->result = errno;
+}
+
+static void *async_file_worker (void *context) {
+  async_worker_t *self = async_worker_current ();
+  int slot = (int) (intptr_t) context;
+  async_file_job_t *job;
+  io_event_t evt;
+
+  for (;;)
+    {
+      job = take_job (slot);
+      if (!job)
+        {
+          /* queued jobs are finished before stopping, so saves aren't lost */
+          if (async_worker_should_stop (self))
+            break;
+          platform_event_wait (&pool.wakeup, 100);
+          continue;
+        }
+
+      errno = 0;
+      switch (job->op)
+        {
+        case ASYNC_READ_FILE:
+          read_job (job);
+          break;
+        case ASYNC_WRITE_FILE:
+          write_job (job);
+          break;
+        case ASYNC_SAVE_OBJECT:
+          job->result = write_save_file (job->path, job->data, job->len, job->serial);
+          break;
+        }
+      release_job (slot);
+
+      memset (&evt, 0, sizeof (evt));
+      evt.fd = INVALID_SOCKET_FD;
+      evt.completion_key = ASYNC_FILE_COMPLETION_KEY;
+      evt.context = job;
+      async_runtime_post_event (pool.runtime, &evt);
+    }
+  return NULL;
+}
+
+/**
+ * @brief Start the file I/O workers.
+ * @param runtime The runtime completions are posted to.
+ * @returns 1 on success, 0 on failure.
+ */
+int async_file_init (async_runtime_t *runtime) {
+  int i;
+
+  if (pool.runtime)
+    return 1;
+  if (!runtime)
+    return 0;
+  if (!platform_mutex_init (&pool.lock))
+    return 0;
+  if (!platform_event_init (&pool.wakeup, true, false))
+    {
+      platform_mutex_destroy (&pool.lock);
+      return 0;
+    }
+  if (!platform_event_init (&pool.done, false, false))
+    {
+      platform_event_destroy (&pool.wakeup);
+      platform_mutex_destroy (&pool.lock);
+      return 0;
+    }
+  pool.runtime = runtime;
+  pool.head = pool.tail = NULL;
+  memset (pool.busy, 0, sizeof (pool.busy));
+  pool.pending = 0;
+  pool.num_workers = 0;
+  for (i = 0; i < ASYNC_FILE_WORKERS; i++)
+    {
+      pool.workers[i] = async_worker_create (async_file_worker, (void *) (intptr_t) i, 0);
+      if (!pool.workers[i])
+        break;
+      pool.num_workers++;
+    }
+  if (!pool.num_workers)
+    {
+      async_file_shutdown (0);
+      return 0;
+    }
+  opt_trace (TT_BACKEND|1, "started %d async file workers\n", pool.num_workers);
+  return 1;
+}
+
+/**
+ * @brief Stop the workers after they finish the queued jobs.
+ * Completions not yet processed by the backend are dropped.
+ * @param timeout_ms How long to wait for each worker.
+ */
+void async_file_shutdown (int timeout_ms) {
+  int i;
+
+  if (!pool.runtime)
+    return;
+  for (i = 0; i < pool.num_workers; i++)
+    async_worker_signal_stop (pool.workers[i]);
+  platform_event_set (&pool.wakeup);
+  for (i = 0; i < pool.num_workers; i++)
+    {
+      if (!async_worker_join (pool.workers[i], timeout_ms))
+        {
+          debug_warn ("Async file worker did not stop within timeout\n");
+          continue; /* leaked: it may still be using the pool */
+        }
+      async_worker_destroy (pool.workers[i]);
+    }
+  platform_event_destroy (&pool.done);
+  platform_event_destroy (&pool.wakeup);
+  platform_mutex_destroy (&pool.lock);
+  pool.num_workers = 0;
+  pool.runtime = NULL;
+}
+
+/**
+ * @returns Number of jobs whose callbacks haven't been called yet.
+ */
+int async_file_pending (void) {
+  return pool.pending;
+}
+
+/**
+ * @brief Wait until no queued or running job uses a path.
+ * Lets a synchronous write come after the asynchronous ones before it.
+ */
+void async_file_wait_path (const char *path) {
+  async_file_job_t *job;
+  int in_use;
+
+  if (!pool.runtime)
+    return;
+  for (;;)
+    {
+      platform_mutex_lock (&pool.lock);
+      in_use = path_is_busy (path);
+      for (job = pool.head; job && !in_use; job = job->next)
+        in_use = !strcmp (job->path, path);
+      platform_mutex_unlock (&pool.lock);
+      if (!in_use)
+        return;
+      platform_event_wait (&pool.done, 100);
+    }
+}
+
+static async_file_job_t *new_job (async_file_op_t op, const char *path, svalue_t *file, svalue_t *callback) {
+  async_file_job_t *job;
+
+  job = ALLOCATE (async_file_job_t, TAG_TEMPORARY, "async_file: job");
+  job->next = NULL;
+  job->op = op;
+  job->path = (char *) DXALLOC (strlen (path) + 1, TAG_TEMPORARY, "async_file: path");
+  strcpy (job->path, path);
+  job->data = NULL;
+  job->len = 0;
+  job->limit = 0;
+  job->flags = 0;
+  job->serial = ++pool.serial ? pool.serial : ++pool.serial;	/* 0 is for the backend */
+  job->result = 0;
+  job->owner = current_object;
+  add_ref (current_object, "async_file");
+  assign_svalue_no_free (&job->file, file);
+  assign_svalue_no_free (&job->callback, callback);
+  return job;
+}
+
+static void free_job (async_file_job_t *job) {
+  free_object (job->owner, "async_file");
+  free_svalue (&job->file, "async_file");
+  free_svalue (&job->callback, "async_file");
+  if (job->data && job->op == ASYNC_READ_FILE)
+    free (job->data);		/* see read_job() */
+  else if (job->data)
+    FREE (job->data);
+  FREE (job->path);
+  FREE (job);
+}
+
+static void submit_job (async_file_job_t *job) {
+  platform_mutex_lock (&pool.lock);
+  if (pool.tail)
+    pool.tail->next = job;
+  else
+    pool.head = job;
+  pool.tail = job;
+  platform_event_set (&pool.wakeup);
+  platform_mutex_unlock (&pool.lock);
+  pool.pending++;
+}
+
+/**
+ * @brief Call the callback of a finished job, from process_io().
+ *
+ * The callback is called as callback(file, result) in its owner, unless the
+ * owner has been destructed meanwhile.  For reads, result is the contents
+ * of the file, or 0 on failure; otherwise it is 1 on success, 0 on failure.
+ */
+void async_file_complete (const io_event_t *evt) {
+  async_file_job_t *job = (async_file_job_t *) evt->context;
+  char *str;
+
+  pool.pending--;
+  if (job->result && job->op != ASYNC_READ_FILE)
+    {
+      errno = job->result;
+      debug_perror ("async file I/O", job->path);
+    }
+
+  if (!(job->owner->flags & O_DESTRUCTED))
+    {
+      push_svalue (&job->file);
+      if (job->op != ASYNC_READ_FILE)
+        push_number (job->result == 0);
+      else if (job->result || !job->len || memchr (job->data, '\0', job->len))
+        push_number (0); /* same as read_file(): no empty or binary strings */
+      else
+        {
+          str = new_string (job->len, "async_read_file");
+          memcpy (str, job->data, job->len + 1);
+          push_malloced_string (str);
+        }
+
+      if (job->callback.type == T_FUNCTION)
+        safe_call_function_pointer (job->callback.u.fp, 2);
+      else
+        safe_apply (job->callback.u.string, job->owner, 2, ORIGIN_DRIVER);
+    }
+  free_job (job);
+}
+
+/**
+ * @brief Read a whole file on a worker thread.
+ * @returns 1 if the read was queued, 0 if denied or unavailable.
+ * @see docs/efuns/async_read_file.md
+ */
+int async_read_file (svalue_t *file, svalue_t *callback) {
+  async_file_job_t *job;
+  char *path;
+
+  if (!pool.runtime)
+    return 0;
+  path = check_valid_path (file->u.string, current_object, "read_file", 0);
+  if (!path)
+    return 0;
+
+  job = new_job (ASYNC_READ_FILE, path, file, callback);
+  job->limit = (size_t)CONFIG_INT (__MAX_READ_FILE_SIZE__);
+  submit_job (job);
+  return 1;
+}
+
+/**
+ * @brief Append or write a string to a file on a worker thread.
+ * @param flags If 1, overwrite the file instead of appending.
+ * @returns 1 if the write was queued, 0 if denied or unavailable.
+ * @see docs/efuns/async_write_file.md
+ */
+int async_write_file (svalue_t *file, const char *str, svalue_t *callback, int flags) {
+  async_file_job_t *job;
+  char *path;
+
+  if (!pool.runtime)
+    return 0;
+  path = check_valid_path (file->u.string, current_object, "write_file", 1);
+  if (!path)
+    return 0;
+
+  job = new_job (ASYNC_WRITE_FILE, path, file, callback);
+  job->len = strlen (str);
+  job->data = (char *) DXALLOC (job->len + 1, TAG_TEMPORARY, "async_write_file");
+  memcpy (job->data, str, job->len + 1);
+  job->flags = flags;
+  submit_job (job);
+  return 1;
+}
+
+/**
+ * @brief Save an object on a worker thread.
+ * The variables are formatted right away, so later changes aren't saved.
+ * @param flags SAVE_ZEROS, SAVE_BINARY, as for save_object()
+ * @returns 1 if the save was queued, 0 if denied or unavailable.
+ * @see docs/efuns/async_save_object.md
+ */
+int async_save_object (object_t *ob, svalue_t *file, svalue_t *callback, int flags) {
+  async_file_job_t *job;
+  char *path, *data;
+  size_t len;
+
+  if (!pool.runtime || (ob->flags & O_DESTRUCTED))
+    return 0;
+  path = save_object_path (ob, file->u.string);
+  if (!path)
+    return 0;
+
+  /* snapshot before creating the job: errors in it leave nothing behind */
+  data = save_object_snapshot (ob, flags, &len);
+  job = new_job (ASYNC_SAVE_OBJECT, path, file, callback);
+  job->data = data;
+  job->len = len;
+  submit_job (job);
+  return 1;
+}
+
+#ifdef F_ASYNC_READ_FILE
+void f_async_read_file (void) {
+  int i;
+
+  i = async_read_file (sp - 1, sp);
+  pop_2_elems ();
+  push_number (i);
+}
+#endif
+
+#ifdef F_ASYNC_WRITE_FILE
+void f_async_write_file (void) {
+  int flags = 0, i;
+
+  if (st_num_arg == 4)
+    flags = (int)(sp--)->u.number;
+  i = async_write_file (sp - 2, (sp - 1)->u.string, sp, flags);
+  pop_3_elems ();
+  push_number (i);
+}
+#endif
+
+#ifdef F_ASYNC_SAVE_OBJECT
+void f_async_save_object (void) {
+  int flag = 0, i;
+
+  if (st_num_arg == 3)
+    flag = (int)(sp--)->u.number;
+  i = async_save_object (current_object, sp - 1, sp, flag);
+  pop_2_elems ();
+  push_number (i);
+}
+#endif
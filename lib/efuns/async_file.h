@@ -0,0 +1,28 @@
+#pragma once
+#include "lpc/types.h"
+#include "async/async_runtime.h"
+
+/*
+ * async_file.c
+ *
+ * Callback-based file efuns.  Permission checks (valid_read/valid_write)
+ * and the save_object() snapshot happen on the calling thread; the file
+ * I/O runs on a small worker pool and the callback is called from the
+ * backend when the completion comes back through the async runtime.
+ */
+
+/** Completion key for finished async file jobs */
+#define ASYNC_FILE_COMPLETION_KEY 0xA5F11E
+
+/** Number of worker threads doing file I/O */
+#define ASYNC_FILE_WORKERS 2
+
+int async_file_init(async_runtime_t *);
+void async_file_shutdown(int);
+void async_file_complete(const io_event_t *);
+int async_file_pending(void);
+void async_file_wait_path(const char *);
+
+int async_read_file(svalue_t *, svalue_t *);
+int async_write_file(svalue_t *, const char *, svalue_t *, int);
+int async_save_object(object_t *, svalue_t *, svalue_t *, int);
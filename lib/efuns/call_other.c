@@ -6,12 +6,25 @@
 #include "src/interpret.h"
 #include "lpc/array.h"
 #include "lpc/object.h"
+#include "lpc/program.h"
 #include "lpc/include/origin.h"
 
+/*
+ * The inline cache of the call_other() being executed, or NULL when it is not
+ * called from a compiled program (e.g. through an efun pointer from the driver).
+ */
+static call_site_t *current_call_site (void)
+{
+  if (!current_prog || pc < current_prog->program ||
+      pc >= current_prog->program + current_prog->program_size)
+    return NULL;
+  return find_call_site (current_prog, pc);
+}
+
 /*
  * Call a function in all objects in an array.
  */
-static array_t *call_all_other (array_t * v, const char *func, int numargs)
+static array_t *call_all_other (array_t * v, const char *func, int numargs, call_site_t * site)
 {
   int size;
   svalue_t *tmp, *vptr, *rptr;
@@ -44,6 +57,12 @@ static array_t *call_all_other (array_t * v, const char *func, int numargs)
       i = numargs;
       while (i--)
         push_svalue (tmp - i);
+      if (site)
+        {
+          if (apply_call_site (site, func, ob, numargs))
+            *rptr = *sp--;
+          continue;
+        }
       call_origin = ORIGIN_CALL_OTHER;
       if (apply_low (func, ob, numargs))
         *rptr = *sp--;
@@ -62,6 +81,8 @@ f_call_other (void)
   object_t *ob;
   char *funcname;
   int num_arg = st_num_arg;
+  call_site_t *site;
+  int found;
 
   if (current_object->flags & O_DESTRUCTED)
     {
@@ -90,7 +111,7 @@ f_call_other (void)
     {
       array_t *ret;
 
-      ret = call_all_other (arg[0].u.arr, funcname, num_arg - 2);
+      ret = call_all_other (arg[0].u.arr, funcname, num_arg - 2, current_call_site ());
       pop_stack ();
       free_array (arg->u.arr);
       sp->u.arr = ret;
@@ -106,8 +127,14 @@ f_call_other (void)
     }
 
   /* Send the remaining arguments to the function. */
-  call_origin = ORIGIN_CALL_OTHER;
-  if (apply_low (funcname, ob, num_arg - 2) == 0)
+  if ((site = current_call_site ()))
+    found = apply_call_site (site, funcname, ob, num_arg - 2);
+  else
+    {
+      call_origin = ORIGIN_CALL_OTHER;
+      found = apply_low (funcname, ob, num_arg - 2);
+    }
+  if (!found)
     {				/* Function not found */
       pop_2_elems ();
       push_undefined ();
@@ -2,6 +2,8 @@
 #include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <limits.h>
+
 #include "src/std.h"
 #include "src/comm.h"
 #include "lpc/array.h"
@@ -11,26 +13,61 @@
 #include "lpc/operator.h"
 #include "call_out.h"
 
-#define CHUNK_SIZE	20
+#define CHUNK_SIZE	128
+
+/*
+ * Pending call_outs are kept in a hierarchical timer wheel. Level 0 has one
+ * slot per tick; each slot of level N covers a whole turn of level N-1 and is
+ * cascaded down when the lower level wraps around. Due call_outs are moved
+ * to a separate list (EXPIRED_SLOT) before their functions are called.
+ *
+ * Each call_out is also linked into its owner object's list (ob->call_outs)
+ * and into a hash table of handles, so that lookups by object, function name
+ * or handle do not need to scan the wheel.
+ */
+#define WHEEL_SIZE	(1 << CALLOUT_WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SIZE - 1)
+#define WHEEL_SLOTS	(WHEEL_SIZE * CALLOUT_WHEEL_LEVELS)
+#define WHEEL_RANGE	((uint64_t)1 << (CALLOUT_WHEEL_BITS * CALLOUT_WHEEL_LEVELS))
+#define EXPIRED_SLOT	WHEEL_SLOTS
 
 typedef struct pending_call_s
 {
-  time_t delta;
+  uint64_t expire;		/* tick when this call is due */
   string_or_func_t function;
   object_t *ob;
   array_t *vs;
-  struct pending_call_s *next;
+  struct pending_call_s *next;	/* wheel slot list */
+  struct pending_call_s **pprev;
+  struct pending_call_s *next_in_obj;	/* owner's call_out list */
+  struct pending_call_s **pprev_in_obj;
+  struct pending_call_s *next_handle;	/* handle hash chain */
 #ifdef THIS_PLAYER_IN_CALL_OUT
   object_t *command_giver;
 #endif
   int handle;
+  int slot;
 }
 pending_call_t;
 
-static pending_call_t *call_list[CALLOUT_CYCLE_SIZE];
+typedef struct
+{
+  pending_call_t *head;
+  pending_call_t **tail;
+}
+wheel_slot_t;
+
+static wheel_slot_t wheel[WHEEL_SLOTS + 1];
+static uint64_t wheel_bitmap[CALLOUT_WHEEL_LEVELS];
+static uint64_t wheel_tick = 0;	/* next tick to be processed */
+static int64_t last_clock = 0;
+
+static pending_call_t **handle_table = 0;
+static int handle_table_size = 0;
+
 static pending_call_t *call_list_free;
-static time_t call_out_time = 0;
-static int num_call;
+static int num_call;		/* allocated */
+static int num_pending;
 static int unique = 0;
 
 static void free_call (pending_call_t *);
@@ -71,19 +108,232 @@ free_call (pending_call_t * cop)
   free_called_call (cop);
 }
 
+/**
+ * @brief Monotonic clock of the call_out timer wheel, in microseconds.
+ * Wall clock adjustments backwards are absorbed by holding the clock still.
+ */
+static int64_t call_out_clock (void) {
+  struct timeval tv;
+  int64_t now;
+
+  gettimeofday (&tv, NULL);
+  now = (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+  if (now < last_clock)
+    now = last_clock;
+  last_clock = now;
+  return now;
+}
+
+/**
+ * @brief Convert a due tick to the number of seconds left, rounded to nearest.
+ */
+static int time_left (uint64_t expire, int64_t now) {
+  int64_t usec = (int64_t) expire * CALLOUT_TICK_INTERVAL - now;
+
+  if (usec <= 0)
+    return 0;
+  return (int) ((usec + 500000) / 1000000);
+}
+
+static void
+link_slot (pending_call_t * cop, int slot)
+{
+  wheel_slot_t *ws = &wheel[slot];
+
+  if (!ws->head)
+    {
+      ws->tail = &ws->head;
+      if (slot < WHEEL_SLOTS)
+        wheel_bitmap[slot >> CALLOUT_WHEEL_BITS] |= (uint64_t) 1 << (slot & WHEEL_MASK);
+    }
+  cop->next = 0;
+  cop->pprev = ws->tail;
+  *ws->tail = cop;
+  ws->tail = &cop->next;
+  cop->slot = slot;
+}
+
+static void
+unlink_slot (pending_call_t * cop)
+{
+  wheel_slot_t *ws = &wheel[cop->slot];
+
+  if ((*cop->pprev = cop->next))
+    cop->next->pprev = cop->pprev;
+  else
+    ws->tail = cop->pprev;
+  if (!ws->head && cop->slot < WHEEL_SLOTS)
+    wheel_bitmap[cop->slot >> CALLOUT_WHEEL_BITS] &= ~((uint64_t) 1 << (cop->slot & WHEEL_MASK));
+}
+
+/**
+ * @brief Put a call_out in the wheel slot matching its due tick.
+ * Call_outs beyond the range of the wheel are parked in the outermost
+ * level and re-inserted when that slot is cascaded.
+ */
+static void
+wheel_insert (pending_call_t * cop)
+{
+  uint64_t expire = cop->expire, delta;
+  int level;
+
+  if (expire < wheel_tick)
+    expire = wheel_tick;
+  delta = expire - wheel_tick;
+  if (delta >= WHEEL_RANGE)
+    {
+      delta = WHEEL_RANGE - 1;
+      expire = wheel_tick + delta;
+    }
+  for (level = 0; level < CALLOUT_WHEEL_LEVELS - 1; level++)
+    {
+      if (delta < ((uint64_t) 1 << (CALLOUT_WHEEL_BITS * (level + 1))))
+        break;
+    }
+  link_slot (cop, level * WHEEL_SIZE + (int) ((expire >> (CALLOUT_WHEEL_BITS * level)) & WHEEL_MASK));
+}
+
+static void
+cascade (int level, int index)
+{
+  wheel_slot_t *ws = &wheel[level * WHEEL_SIZE + index];
+  pending_call_t *cop;
+
+  while ((cop = ws->head))
+    {
+      unlink_slot (cop);
+      wheel_insert (cop);
+    }
+}
+
+/**
+ * @brief Process one tick of the wheel: cascade the outer levels if the
+ * inner level wrapped around, then move the slot of this tick to the list
+ * of due call_outs.
+ */
+static void
+advance_wheel (void)
+{
+  wheel_slot_t *ws;
+  pending_call_t *cop;
+  int level;
+
+  for (level = 1; level < CALLOUT_WHEEL_LEVELS; level++)
+    {
+      if ((wheel_tick >> (CALLOUT_WHEEL_BITS * (level - 1))) & WHEEL_MASK)
+        break;
+      cascade (level, (int) ((wheel_tick >> (CALLOUT_WHEEL_BITS * level)) & WHEEL_MASK));
+    }
+
+  ws = &wheel[wheel_tick & WHEEL_MASK];
+  while ((cop = ws->head))
+    {
+      unlink_slot (cop);
+      link_slot (cop, EXPIRED_SLOT);
+    }
+  wheel_tick++;
+}
+
+static void
+handle_insert (pending_call_t * cop)
+{
+  pending_call_t **bucket;
+
+  if (num_pending > handle_table_size)
+    {
+      pending_call_t **old_table = handle_table;
+      int old_size = handle_table_size, i;
+
+      handle_table_size = old_size ? old_size * 2 : 256;
+      handle_table = CALLOCATE (handle_table_size, pending_call_t *,
+                                TAG_CALL_OUT, "handle_insert");
+      memset (handle_table, 0, sizeof (pending_call_t *) * handle_table_size);
+      for (i = 0; i < old_size; i++)
+        {
+          pending_call_t *next, *p;
+
+          for (p = old_table[i]; p; p = next)
+            {
+              next = p->next_handle;
+              bucket = &handle_table[p->handle & (handle_table_size - 1)];
+              p->next_handle = *bucket;
+              *bucket = p;
+            }
+        }
+      if (old_table)
+        FREE (old_table);
+    }
+  bucket = &handle_table[cop->handle & (handle_table_size - 1)];
+  cop->next_handle = *bucket;
+  *bucket = cop;
+}
+
+static pending_call_t *
+handle_lookup (int handle)
+{
+  pending_call_t *cop;
+
+  if (!handle_table_size)
+    return 0;
+  for (cop = handle_table[handle & (handle_table_size - 1)]; cop; cop = cop->next_handle)
+    {
+      if (cop->handle == handle)
+        return cop;
+    }
+  return 0;
+}
+
+static inline object_t *
+call_out_owner (pending_call_t * cop)
+{
+  return cop->ob ? cop->ob : cop->function.f->hdr.owner;
+}
+
+/**
+ * @brief Take a call_out off the wheel, its owner's list and the handle table.
+ * The structure itself must be released by free_call() or free_called_call().
+ */
+static void
+detach_call (pending_call_t * cop)
+{
+  pending_call_t **copp;
+
+  unlink_slot (cop);
+
+  if ((*cop->pprev_in_obj = cop->next_in_obj))
+    cop->next_in_obj->pprev_in_obj = cop->pprev_in_obj;
+
+  for (copp = &handle_table[cop->handle & (handle_table_size - 1)]; *copp; copp = &(*copp)->next_handle)
+    {
+      if (*copp == cop)
+        {
+          *copp = cop->next_handle;
+          break;
+        }
+    }
+  num_pending--;
+}
+
 
 /**
  * Setup a new call out.
+ * @param ob The object to call (ignored for function pointers).
+ * @param fun The function name or function pointer.
+ * @param delay Delay in microseconds.
+ * @param num_args Number of extra arguments.
+ * @param arg The extra arguments, which are transferred to the call_out.
+ * @return The handle of the call_out.
  */
-int new_call_out (object_t * ob, svalue_t * fun, time_t delay, int num_args, svalue_t* arg) {
-  pending_call_t *cop, **copp;
-  int tm;
+int new_call_out (object_t * ob, svalue_t * fun, int64_t delay, int num_args, svalue_t* arg) {
+  pending_call_t *cop;
+  object_t *owner;
+  int64_t now = call_out_clock ();
+  uint64_t now_tick = (uint64_t) (now / CALLOUT_TICK_INTERVAL);
 
-  if (delay < 1)
-    delay = 1;
-  /* Needs to be initialized here in case of very early call_outs */
-  if (!call_out_time)
-    call_out_time = current_time;
+  if (delay < 0)
+    delay = 0;
+  if (!num_pending && wheel_tick < now_tick)
+    wheel_tick = now_tick;	/* the wheel is idle, catch up for free */
 
   if (!call_list_free)
     {
@@ -125,30 +375,24 @@ int new_call_out (object_t * ob, svalue_t * fun, time_t delay, int num_args, sva
   else
     cop->vs = 0;
 
-  /* Find out which slot this one fits in */
-  tm = (delay + current_time) & (CALLOUT_CYCLE_SIZE - 1);
-  delay = (1 + (delay + current_time - call_out_time - 1) / CALLOUT_CYCLE_SIZE);
-
-  for (copp = &call_list[tm]; *copp; copp = &(*copp)->next)
-    {
-      if ((*copp)->delta >= delay)
-        {
-          (*copp)->delta -= delay;
-          cop->delta = delay;
-          cop->next = *copp;
-          *copp = cop;
-          tm += CALLOUT_CYCLE_SIZE * ++unique;
-          cop->handle = tm;
-          return tm;
-        }
-      delay -= (*copp)->delta;
-    }
-  *copp = cop;
-  cop->delta = delay;
-  cop->next = 0;
-  tm += CALLOUT_CYCLE_SIZE * ++unique;
-  cop->handle = tm;
-  return tm;
+  /* round up to the next tick, and never due in the tick being processed */
+  cop->expire = (uint64_t) ((now + delay + CALLOUT_TICK_INTERVAL - 1) / CALLOUT_TICK_INTERVAL);
+  if (cop->expire <= now_tick)
+    cop->expire = now_tick + 1;
+  wheel_insert (cop);
+
+  owner = call_out_owner (cop);
+  if ((cop->next_in_obj = owner->call_outs))
+    cop->next_in_obj->pprev_in_obj = &cop->next_in_obj;
+  cop->pprev_in_obj = &owner->call_outs;
+  owner->call_outs = cop;
+
+  if (++unique <= 0)
+    unique = 1;
+  cop->handle = unique;
+  num_pending++;
+  handle_insert (cop);
+  return cop->handle;
 }
 
 
@@ -164,7 +408,7 @@ call_out ()
   static pending_call_t *cop = 0;
   object_t *save_command_giver = command_giver;
   error_context_t econ;
-  int tm;
+  uint64_t now_tick;
 
   current_interactive = 0;
 
@@ -174,110 +418,172 @@ call_out ()
       free_called_call (cop);
       cop = 0;
     }
-  if (!call_out_time)
-    call_out_time = current_time;
+  now_tick = (uint64_t) (call_out_clock () / CALLOUT_TICK_INTERVAL);
+  if (!num_pending)
+    {
+      if (wheel_tick <= now_tick)
+        wheel_tick = now_tick + 1;
+      return;
+    }
   save_context (&econ);
 
-  while (call_out_time < current_time)
-    {
-      /* we increment at the end in case we are interrupted by errors,
-         but we need to use call_out_time + 1 here. */
-      tm = (call_out_time + 1) & (CALLOUT_CYCLE_SIZE - 1);
-      if (call_list[tm] && --call_list[tm]->delta == 0)
-        do
-          {
-            /* Move the first call_out out of the chain. */
-            cop = call_list[tm];
-            call_list[tm] = call_list[tm]->next;
-            if (cop->ob && (cop->ob->flags & O_DESTRUCTED))
-              {
-                opt_trace (TT_BACKEND|2, "removing call_out to destructed object %s", cop->ob->name);
-                free_call (cop);
-                cop = 0;
-              }
-            else
-              {
-                opt_trace (TT_BACKEND|2, "executing call_out to %s \"%s\"",
-                           cop->ob ? cop->ob->name : "(function)",
-                           cop->ob ? cop->function.s : "");
-                if (setjmp (econ.context))
-                  {
-                    restore_context (&econ);
-                  }
-                else
-                  {
-                    object_t *ob = cop->ob;
-                    command_giver = 0;
+  for (;;)
+    {
+      while ((cop = wheel[EXPIRED_SLOT].head))
+        {
+          /* Move the first call_out out of the due list. */
+          detach_call (cop);
+          if (cop->ob && (cop->ob->flags & O_DESTRUCTED))
+            {
+              opt_trace (TT_BACKEND|2, "removing call_out to destructed object %s", cop->ob->name);
+              free_call (cop);
+              cop = 0;
+            }
+          else
+            {
+              opt_trace (TT_BACKEND|2, "executing call_out to %s \"%s\"",
+                         cop->ob ? cop->ob->name : "(function)",
+                         cop->ob ? cop->function.s : "");
+              if (setjmp (econ.context))
+                {
+                  restore_context (&econ);
+                }
+              else
+                {
+                  object_t *ob = cop->ob;
+                  command_giver = 0;
 #ifdef THIS_PLAYER_IN_CALL_OUT
-                    if (cop->command_giver &&
-                        !(cop->command_giver->flags & O_DESTRUCTED))
-                      {
-                        command_giver = cop->command_giver;
-                      }
-                    else if (ob && (ob->flags & O_LISTENER))
-                      {
-                        command_giver = ob;
-                      }
+                  if (cop->command_giver &&
+                      !(cop->command_giver->flags & O_DESTRUCTED))
+                    {
+                      command_giver = cop->command_giver;
+                    }
+                  else if (ob && (ob->flags & O_LISTENER))
+                    {
+                      command_giver = ob;
+                    }
 #endif
-                    /* current object no longer set */
-
-                    if (cop->vs)
-                      {
-                        array_t *vec = cop->vs;
-                        svalue_t *svp = vec->item + vec->size;
-
-                        while (svp-- > vec->item)
-                          {
-                            if (svp->type == T_OBJECT && (svp->u.ob->flags & O_DESTRUCTED))
-                              {
-                                free_object (svp->u.ob, "call_out");
-                                *svp = const0;
-                              }
-                          }
-                        /* cop->vs is ref one */
-                        extra = cop->vs->size;
-                        transfer_push_some_svalues (cop->vs->item, extra);
-                        free_empty_array (cop->vs);
-                      }
-                    else
-                      extra = 0;
-
-                    if (cop->ob)
-                      {
-                        if (cop->function.s[0] == APPLY___INIT_SPECIAL_CHAR)
-                          error ("Illegal function name\n");
-                        (void) apply (cop->function.s, cop->ob, extra, ORIGIN_CALL_OUT);
-                      }
-                    else
-                      {
-                        (void) call_function_pointer (cop->function.f, extra);
-                      }
-                  }
-                free_called_call (cop);
-                cop = 0;
-              }
-          }
-        while (call_list[tm] && call_list[tm]->delta == 0);
-      call_out_time++;
+                  /* current object no longer set */
+
+                  if (cop->vs)
+                    {
+                      array_t *vec = cop->vs;
+                      svalue_t *svp = vec->item + vec->size;
+
+                      while (svp-- > vec->item)
+                        {
+                          if (svp->type == T_OBJECT && (svp->u.ob->flags & O_DESTRUCTED))
+                            {
+                              free_object (svp->u.ob, "call_out");
+                              *svp = const0;
+                            }
+                        }
+                      /* cop->vs is ref one */
+                      extra = cop->vs->size;
+                      transfer_push_some_svalues (cop->vs->item, extra);
+                      free_empty_array (cop->vs);
+                    }
+                  else
+                    extra = 0;
+
+                  if (cop->ob)
+                    {
+                      if (cop->function.s[0] == APPLY___INIT_SPECIAL_CHAR)
+                        error ("Illegal function name\n");
+                      (void) apply (cop->function.s, cop->ob, extra, ORIGIN_CALL_OUT);
+                    }
+                  else
+                    {
+                      (void) call_function_pointer (cop->function.f, extra);
+                    }
+                }
+              free_called_call (cop);
+              cop = 0;
+            }
+        }
+
+      if (wheel_tick > now_tick)
+        break;
+      if (!num_pending)
+        {
+          wheel_tick = now_tick + 1;
+          break;
+        }
+      if (!wheel_bitmap[0] && (wheel_tick & WHEEL_MASK))
+        {
+          /* nothing in the innermost level, skip to the next cascade */
+          wheel_tick = (wheel_tick | WHEEL_MASK) + 1;
+          if (wheel_tick > now_tick + 1)
+            wheel_tick = now_tick + 1;
+          continue;
+        }
+      advance_wheel ();
     }
 
   pop_context (&econ);
   command_giver = save_command_giver;
 }
 
+/**
+ * @brief Get the time until call_out() has due call_outs or cascades to do.
+ * The backend uses this to shorten its polling timeout between heart beats.
+ * @return Microseconds to wait, 0 if call_out() should be called now, or -1
+ * if there is no pending call_out.
+ */
+int64_t call_out_wait_time (void) {
+  uint64_t next = 0;
+  int64_t usec;
+  int level, i;
+
+  if (!num_pending)
+    return -1;
+  if (wheel[EXPIRED_SLOT].head)
+    return 0;
 
-static time_t time_left (int slot, time_t delay) {
-  int current_slot = call_out_time & (CALLOUT_CYCLE_SIZE - 1);
-  if (slot > current_slot)
+  if (wheel_bitmap[0])
     {
-      return (delay - 1) * CALLOUT_CYCLE_SIZE + (slot - current_slot) +
-        call_out_time - current_time;
+      for (i = 0; i < WHEEL_SIZE; i++)
+        {
+          if (wheel_bitmap[0] & ((uint64_t) 1 << ((wheel_tick + i) & WHEEL_MASK)))
+            break;
+        }
+      next = wheel_tick + i;
     }
-  else
+  for (level = 1; level < CALLOUT_WHEEL_LEVELS; level++)
+    {
+      if (wheel_bitmap[level])
+        {
+          /* outer levels are checked again when the innermost level wraps */
+          uint64_t boundary = (wheel_tick & WHEEL_MASK) ? (wheel_tick | WHEEL_MASK) + 1 : wheel_tick;
+          if (!wheel_bitmap[0] || boundary < next)
+            next = boundary;
+          break;
+        }
+    }
+
+  usec = (int64_t) next * CALLOUT_TICK_INTERVAL - call_out_clock ();
+  return usec > 0 ? usec : 0;
+}
+
+/**
+ * @brief Find the call_out of an object's function that is due first.
+ */
+static pending_call_t *
+find_call_by_name (object_t * ob, const char *fun)
+{
+  pending_call_t *cop, *found = 0;
+  char *sfun;
+
+  if (!ob || !(sfun = findstring (fun)))
+    return 0;	/* function names of call_outs are always shared */
+  for (cop = ob->call_outs; cop; cop = cop->next_in_obj)
     {
-      return delay * CALLOUT_CYCLE_SIZE + (slot - current_slot) +
-        call_out_time - current_time;
+      /* older call_outs are further down the list, prefer them on a tie */
+      if (cop->ob == ob && cop->function.s == sfun &&
+          (!found || cop->expire <= found->expire))
+        found = cop;
     }
+  return found;
 }
 
 
@@ -287,111 +593,65 @@ static time_t time_left (int slot, time_t delay) {
  * -1 is returned if no call out pending.
  */
 int remove_call_out (object_t * ob, char *fun) {
-  pending_call_t **copp, *cop;
-  time_t delay;
-  int i;
+  pending_call_t *cop = find_call_by_name (ob, fun);
+  int ret;
 
-  if (!ob)
+  if (!cop)
     return -1;
-  for (i = 0; i < CALLOUT_CYCLE_SIZE; i++)
-    {
-      delay = 0;
-      for (copp = &call_list[i]; *copp; copp = &(*copp)->next)
-        {
-          delay += (*copp)->delta;
-          if ((*copp)->ob == ob && strcmp ((*copp)->function.s, fun) == 0)
-            {
-              cop = *copp;
-              if (cop->next)
-                cop->next->delta += cop->delta;
-              *copp = cop->next;
-              free_call (cop);
-              return (int)time_left (i, delay);
-            }
-        }
-    }
-  return -1;
+  ret = time_left (cop->expire, call_out_clock ());
+  detach_call (cop);
+  free_call (cop);
+  return ret;
 }
 
 int remove_call_out_by_handle (int handle) {
-  pending_call_t **copp, *cop;
-  time_t delay = 0;
+  pending_call_t *cop = handle_lookup (handle);
+  int ret;
 
-  for (copp = &call_list[handle & (CALLOUT_CYCLE_SIZE - 1)]; *copp; copp = &(*copp)->next)
-    {
-      delay += (*copp)->delta;
-      if ((*copp)->handle == handle)
-        {
-          cop = *copp;
-          if (cop->next)
-            cop->next->delta += cop->delta;
-          *copp = cop->next;
-          free_call (cop);
-          return (int)time_left (handle & (CALLOUT_CYCLE_SIZE - 1), delay);
-        }
-    }
-  return -1;
+  if (!cop)
+    return -1;
+  ret = time_left (cop->expire, call_out_clock ());
+  detach_call (cop);
+  free_call (cop);
+  return ret;
 }
 
 int find_call_out_by_handle (int handle) {
-  pending_call_t *cop;
-  time_t delay = 0;
+  pending_call_t *cop = handle_lookup (handle);
 
-  for (cop = call_list[handle & (CALLOUT_CYCLE_SIZE - 1)]; cop;
-       cop = cop->next)
-    {
-      delay += cop->delta;
-      if (cop->handle == handle)
-        return (int)time_left (handle & (CALLOUT_CYCLE_SIZE - 1), delay);
-    }
-  return -1;
+  if (!cop)
+    return -1;
+  return time_left (cop->expire, call_out_clock ());
 }
 
 int find_call_out (object_t * ob, char *fun) {
-  pending_call_t *cop;
-  time_t delay;
-  int i;
+  pending_call_t *cop = find_call_by_name (ob, fun);
 
-  if (!ob)
+  if (!cop)
     return -1;
-  for (i = 0; i < CALLOUT_CYCLE_SIZE; i++)
-    {
-      delay = 0;
-      for (cop = call_list[i]; cop; cop = cop->next)
-        {
-          delay += cop->delta;
-          if (cop->ob == ob && strcmp (cop->function.s, fun) == 0)
-            return (int)time_left (i, delay);
-        }
-    }
-  return -1;
+  return time_left (cop->expire, call_out_clock ());
 }
 
 int
 print_call_out_usage (outbuffer_t * ob, int verbose)
 {
-  int i, j;
-  pending_call_t *cop;
-
-  for (i = 0, j = 0; j < CALLOUT_CYCLE_SIZE; j++)
-    for (cop = call_list[j]; cop; cop = cop->next)
-      i++;
-
   if (verbose == 1)
     {
       outbuf_add (ob, "Call out information:\n");
       outbuf_add (ob, "---------------------\n");
       outbuf_addv (ob, "Number of allocated call outs: %8d, %8d bytes\n",
                    num_call, num_call * sizeof (pending_call_t));
-      outbuf_addv (ob, "Current length: %d\n", i);
+      outbuf_addv (ob, "Current length: %d\n", num_pending);
+      outbuf_addv (ob, "Handle table size: %d, %d bytes\n",
+                   handle_table_size, handle_table_size * sizeof (pending_call_t *));
     }
   else
     {
       if (verbose != -1)
         outbuf_addv (ob, "call out:\t\t\t%8d %8d (current length %d)\n",
-                     num_call, num_call * sizeof (pending_call_t), i);
+                     num_call, num_call * sizeof (pending_call_t), num_pending);
     }
-  return (int) (num_call * sizeof (pending_call_t));
+  return (int) (num_call * sizeof (pending_call_t) + handle_table_size * sizeof (pending_call_t *));
 }
 
 /*
@@ -402,27 +662,24 @@ print_call_out_usage (outbuffer_t * ob, int verbose)
  * 2:	The delay.
  */
 array_t* get_all_call_outs () {
-  time_t delay;
-  int i, j, tm;
+  int i, j;
+  int64_t now = call_out_clock ();
   pending_call_t *cop;
   array_t *v;
 
-  for (i = 0, j = 0; j < CALLOUT_CYCLE_SIZE; j++)
-    for (cop = call_list[j]; cop; cop = cop->next)
+  for (i = 0, j = 0; j <= EXPIRED_SLOT; j++)
+    for (cop = wheel[j].head; cop; cop = cop->next)
       if (!cop->ob || !(cop->ob->flags & O_DESTRUCTED))
         i++;
 
   v = allocate_empty_array (i);
-  tm = call_out_time & (CALLOUT_CYCLE_SIZE - 1);
 
-  for (i = 0, j = 0; j < CALLOUT_CYCLE_SIZE; j++)
+  for (i = 0, j = 0; j <= EXPIRED_SLOT; j++)
     {
-      delay = 0;
-      for (cop = call_list[j]; cop; cop = cop->next)
+      for (cop = wheel[j].head; cop; cop = cop->next)
         {
           array_t *vv;
 
-          delay += cop->delta;
           if (cop->ob && (cop->ob->flags & O_DESTRUCTED))
             continue;
           vv = allocate_empty_array (3);
@@ -445,18 +702,7 @@ array_t* get_all_call_outs () {
               vv->item[1].u.string = make_shared_string ("<function>");
             }
           vv->item[2].type = T_NUMBER;
-          if (j > tm)
-            {
-              vv->item[2].u.number =
-                (delay - 1) * CALLOUT_CYCLE_SIZE + (j - tm) + call_out_time -
-                current_time;
-            }
-          else
-            {
-              vv->item[2].u.number =
-                delay * CALLOUT_CYCLE_SIZE + (j - tm) + call_out_time -
-                current_time;
-            }
+          vv->item[2].u.number = time_left (cop->expire, now);
 
           v->item[i].type = T_ARRAY;
           v->item[i++].u.arr = vv;	/* Ref count is already 1 */
@@ -465,38 +711,45 @@ array_t* get_all_call_outs () {
   return v;
 }
 
+/**
+ * @brief Remove all call_outs owned by an object, including function
+ * pointers bound to it. This is also done when the object is destructed.
+ */
 void
 remove_all_call_out (object_t * obj)
 {
-  pending_call_t **copp, *cop;
-  int i;
+  pending_call_t *cop;
 
-  for (i = 0; i < CALLOUT_CYCLE_SIZE; i++)
+  while ((cop = obj->call_outs))
     {
-      copp = &call_list[i];
-      while (*copp)
-        {
-          if (((*copp)->ob &&
-               (((*copp)->ob == obj) || ((*copp)->ob->flags & O_DESTRUCTED)))
-              || (!(*copp)->ob
-                  && ((*copp)->function.f->hdr.owner == obj
-                      || (*copp)->function.f->hdr.owner->
-                      flags & O_DESTRUCTED)))
-            {
-              cop = *copp;
-              if (cop->next)
-                cop->next->delta += cop->delta;
-              *copp = cop->next;
-              free_call (cop);
-            }
-          else
-            copp = &(*copp)->next;
-        }
+      detach_call (cop);
+      free_call (cop);
     }
 }
 
 
 #ifdef F_CALL_OUT
+/**
+ * @brief Convert the delay argument of call_out() to microseconds.
+ * Integer delays are whole seconds (at least one), float delays may be
+ * fractions of a second.
+ */
+static int64_t call_out_delay (svalue_t * sv) {
+  if (sv->type == T_REAL)
+    {
+      if (!(sv->u.real > 0))
+        return 0;
+      if (sv->u.real > INT_MAX)
+        return (int64_t) INT_MAX * 1000000;
+      return (int64_t) (sv->u.real * 1000000);
+    }
+  if (sv->u.number < 1)
+    return 1000000;
+  if (sv->u.number > INT_MAX)
+    return (int64_t) INT_MAX * 1000000;
+  return (int64_t) sv->u.number * 1000000;
+}
+
 void f_call_out (void) {
   svalue_t *arg = sp - st_num_arg + 1;
   int num = st_num_arg - 2;
@@ -505,7 +758,7 @@ void f_call_out (void) {
 
   if (!(current_object->flags & O_DESTRUCTED))
     {
-      ret = new_call_out (current_object, arg, (time_t)arg[1].u.number, num, arg + 2);
+      ret = new_call_out (current_object, arg, call_out_delay (&arg[1]), num, arg + 2);
       /* args have been transfered; don't free them;
          also don't need to free the int */
       sp -= num + 1;
@@ -522,7 +775,7 @@ void f_call_out (void) {
 #else
   if (!(current_object->flags & O_DESTRUCTED))
     {
-      new_call_out (current_object, arg, (time_t)arg[1].u.number, num, arg + 2);
+      new_call_out (current_object, arg, call_out_delay (&arg[1]), num, arg + 2);
       sp -= num + 1;
     }
   else
@@ -14,6 +14,8 @@
 #include "lpc/functional.h"
 #include "lpc/mapping.h"
 #include "lpc/program.h"
+#include "lpc/lex.h"
+#include "regexp.h"
 #include "lpc/include/function.h"
 
 #include "call_out.h"
@@ -52,13 +54,18 @@ void f_throw (void) {
 
 
 #ifdef F_CACHE_STATS
+/* a percentage, 0 before anything was counted */
+static double percent (unsigned long part, unsigned long total) {
+  return total ? 100 * ((double) part / total) : 0.0;
+}
+
 static void
 print_cache_stats (outbuffer_t * ob)
 {
   outbuf_add (ob, "Function cache information\n");
   outbuf_add (ob, "-------------------------------\n");
   outbuf_addv (ob, "%% cache hits:    %10.2f\n",
-               100 * ((double) apply_low_cache_hits / apply_low_call_others));
+               percent (apply_low_cache_hits, apply_low_call_others));
   outbuf_addv (ob, "call_others:     %10lu\n", apply_low_call_others);
   outbuf_addv (ob, "cache hits:      %10lu\n", apply_low_cache_hits);
   outbuf_addv (ob, "cache size:      %10lu\n", APPLY_CACHE_SIZE);
@@ -67,7 +74,32 @@ print_cache_stats (outbuffer_t * ob)
                100 * ((double) apply_low_slots_used / APPLY_CACHE_SIZE));
   outbuf_addv (ob, "collisions:      %10lu\n", apply_low_collisions);
   outbuf_addv (ob, "%% collisions:    %10.2f\n",
-               100 * ((double) apply_low_collisions / apply_low_call_others));
+               percent (apply_low_collisions, apply_low_call_others));
+  outbuf_add (ob, "\n");
+  print_call_site_stats (ob, 10);
+  outbuf_add (ob, "\n#include cache\n");
+  outbuf_add (ob, "-------------------------------\n");
+  outbuf_addv (ob, "paths cached:    %10lu\n", include_cache_entries);
+  outbuf_addv (ob, "hits:            %10lu\n", include_cache_hits);
+  outbuf_addv (ob, "misses:          %10lu\n", include_cache_misses);
+  outbuf_addv (ob, "%% hits:          %10.2f\n",
+               percent (include_cache_hits, include_cache_hits + include_cache_misses));
+  outbuf_add (ob, "\nregexp cache\n");
+  outbuf_add (ob, "-------------------------------\n");
+  outbuf_addv (ob, "patterns cached: %10d\n", regexp_cache_size ());
+  outbuf_addv (ob, "cache size:      %10d\n", REGEXP_CACHE_SIZE);
+  outbuf_addv (ob, "hits:            %10lu\n", regexp_cache_hits);
+  outbuf_addv (ob, "misses:          %10lu\n", regexp_cache_misses);
+  outbuf_addv (ob, "%% hits:          %10.2f\n",
+               percent (regexp_cache_hits, regexp_cache_hits + regexp_cache_misses));
+  outbuf_add (ob, "\nsprintf format cache\n");
+  outbuf_add (ob, "-------------------------------\n");
+  outbuf_addv (ob, "formats cached:  %10d\n", sprintf_cache_size ());
+  outbuf_addv (ob, "cache size:      %10d\n", SPRINTF_CACHE_SIZE);
+  outbuf_addv (ob, "hits:            %10lu\n", sprintf_cache_hits);
+  outbuf_addv (ob, "misses:          %10lu\n", sprintf_cache_misses);
+  outbuf_addv (ob, "%% hits:          %10.2f\n",
+               percent (sprintf_cache_hits, sprintf_cache_hits + sprintf_cache_misses));
 }
 
 void f_cache_stats (void) {
@@ -80,6 +112,24 @@ void f_cache_stats (void) {
 #endif
 
 
+#ifdef F_OPCODE_PAIRS
+void f_opcode_pairs (void) {
+  outbuffer_t ob;
+
+  if (sp->u.number == 0)
+    {
+      clear_opcode_pairs ();
+      put_constant_string ("");
+      return;
+    }
+  outbuf_zero (&ob);
+  print_opcode_pairs (&ob, (int)sp->u.number);
+  sp--;
+  outbuf_push (&ob);
+}
+#endif
+
+
 #ifdef F_CALL_STACK
 void f_call_stack (void) {
   int i;
@@ -279,9 +329,15 @@ void f_mud_status (void) {
       outbuf_add (&ob, "add_message statistics\n");
       outbuf_add (&ob, "------------------------------\n");
       outbuf_addv (&ob,
-                   "Calls to add_message: %d   Packets: %d   Average packet size: %f\n\n",
+                   "Calls to add_message: %d   Packets: %d   Average packet size: %f\n",
                    add_message_calls, inet_packets,
                    (float) inet_volume / inet_packets);
+      outbuf_addv (&ob,
+                   "Socket writes: %d   Write interest changes: %d   Per cycle: %.2f / %.2f\n",
+                   comm_write_calls, comm_interest_calls,
+                   comm_cycles ? (float) comm_write_calls / comm_cycles : 0.0,
+                   comm_cycles ? (float) comm_interest_calls / comm_cycles : 0.0);
+      outbuf_addv (&ob, "Shared message blocks: %d\n\n", comm_message_blocks);
 
 #ifndef NO_ADD_ACTION
       stat_living_objects (&ob);
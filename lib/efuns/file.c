@@ -460,7 +460,7 @@ void f_restore_object (void) {
 void f_save_object (void) {
   int flag;
 
-  flag = (st_num_arg == 2) && (sp--)->u.number;
+  flag = (st_num_arg == 2) ? (int)(sp--)->u.number : 0;
   flag = save_object (current_object, sp->u.string, flag);
   free_string_svalue (sp);
   put_number (flag);
@@ -28,6 +28,9 @@ operator loop_cond_local, loop_cond_number;
 operator loop_incr;
 operator while_dec;
 
+/* superinstructions, c.f. i_generate_node() */
+operator add_locals, return_local, global_branch_when_zero, local_index_lvalue;
+
 operator lor, land;
 
 operator catch, end_catch;
@@ -117,7 +120,7 @@ string file_name(object default: F_THIS_OBJECT);
 string capitalize(string);
 string *explode(string, string);
 mixed implode(mixed *, string | function, void | mixed);
-int call_out(string | function, int,...);
+int call_out(string | function, int | float,...);
 int member_array(mixed, string | mixed *, void | int);
 int input_to(string | function,...);
 int random(int);
@@ -130,6 +133,7 @@ object next_inventory(object default: F_THIS_OBJECT);
 void say(string, void | object | object *);
 void tell_room(object | string, string | object | int | float, void | object *);
 object present(object | string, void | object);
+void set_ids(string *);
 void move_object(object | string);
 
 void add_action(string | function, string | string *, void | int, ...);
@@ -232,6 +236,11 @@ string read_bytes(string, void | int, void | int);
 string read_file(string, void | int, void | int);
 int cp(string, string);
 
+/* file I/O on worker threads, results passed to a callback */
+int async_read_file(string, string | function);
+int async_write_file(string, string, string | function, void | int);
+int async_save_object(string, string | function, void | int);
+
     int link(string, string);
     int mkdir(string);
     int rm(string);
@@ -303,6 +312,7 @@ int cp(string, string);
 
     int get_char(string | function,...);
     object *children(string);
+    int clone_count(string | object);
 
     void reload_object(object);
 
@@ -319,6 +329,9 @@ int cp(string, string);
 #ifdef CACHE_STATS
     string cache_stats();
 #endif
+#ifdef OPCODE_PAIR_PROFILE
+    string opcode_pairs(int default: 20);
+#endif
 
     mixed filter(mixed * | mapping, string | function, ...);
     mixed filter_array filter(mixed *, string | function, ...);
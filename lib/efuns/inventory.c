@@ -87,6 +87,19 @@ f_present (void)
 #endif
 
 
+#ifdef F_SET_IDS
+void
+f_set_ids (void)
+{
+  if (current_object->flags & O_DESTRUCTED)
+    error ("set_ids(): can't set the ids of a destructed object\n");
+
+  set_object_ids (current_object, sp->u.arr);
+  free_array ((sp--)->u.arr);
+}
+#endif
+
+
 #ifdef F_FIRST_INVENTORY
 void
 f_first_inventory (void)
@@ -402,6 +402,19 @@
  */
 #undef PROFILE_FUNCTIONS
 
+/* OPCODE_PAIR_PROFILE: define this to count how often each pair of opcodes
+ *   is executed in sequence, and to enable the opcode_pairs() efun listing
+ *   the most frequent pairs (candidates for new superinstructions).  This
+ *   slows down the interpreter and disables computed goto dispatch.
+ */
+#undef OPCODE_PAIR_PROFILE
+
+/* NO_COMPUTED_GOTO: define this to dispatch opcodes with a plain switch
+ *   statement even if the compiler supports computed goto (GNU C labels as
+ *   values).  Mostly useful to compare both dispatch methods.
+ */
+#undef NO_COMPUTED_GOTO
+
 /* NO_BUFFER_TYPE: if this is #define'd then LPC code using the 'buffer'
  *   type won't be allowed to compile (since the 'buffer' type won't be
  *   recognized by the lexer.
@@ -543,14 +556,21 @@
  */
 #define HEARTBEAT_INTERVAL 2000000
 
-/* 
- * CALLOUT_CYCLE_SIZE: This is the number of slots in the call_out list.
- * It should be approximately the average number of active call_outs, or
- * a few times smaller.  It should also be a power of 2, and also be relatively
- * prime to any common call_out lengths.  If all this is too confusing, 32
- * isn't a bad number :-)
+/* CALLOUT_TICK_INTERVAL: define the resolution of the call_out timer wheel
+ *   in microseconds (us).  A call_out() with an integer delay still counts
+ *   whole seconds, while a float delay is rounded up to the next tick.
+ *   The backend wakes up at most once per tick while call_outs are due.
+ */
+#define CALLOUT_TICK_INTERVAL 100000
+
+/* CALLOUT_WHEEL_BITS, CALLOUT_WHEEL_LEVELS: The call_out timer wheel has
+ *   CALLOUT_WHEEL_LEVELS levels of (1 << CALLOUT_WHEEL_BITS) slots each.
+ *   The defaults (6 bits, 4 levels) cover 2^24 ticks, i.e. about 19 days at
+ *   100ms ticks.  Longer delays are parked in the outermost level and
+ *   re-inserted as the wheel turns.  CALLOUT_WHEEL_BITS must not exceed 6.
  */
-#define CALLOUT_CYCLE_SIZE 32
+#define CALLOUT_WHEEL_BITS    6
+#define CALLOUT_WHEEL_LEVELS  4
 
 /* LARGEST_PRINTABLE_STRING: defines the size of the vsprintf() buffer in
  *   comm.c's add_message(). Instead of blindly making this value larger,
@@ -558,17 +578,29 @@
  */
 #define LARGEST_PRINTABLE_STRING 8192
 
-/* MESSAGE_BUFFER_SIZE: determines the size of the buffer for output that
- *   is sent to users.
+/* MESSAGE_BUFFER_SIZE: determines the initial size of the buffer for output
+ *   that is sent to users.
  */
 #define MESSAGE_BUFFER_SIZE 4096
 
+/* MESSAGE_BUFFER_LIMIT: the output buffer grows on demand up to this size
+ *   before the driver forces a flush.  Output that still does not fit (the
+ *   user is not reading) is discarded.
+ */
+#define MESSAGE_BUFFER_LIMIT (MESSAGE_BUFFER_SIZE * 64)
+
 /* APPLY_CACHE_BITS: defines the number of bits to use in the call_other cache
  *   (in interpret.c).  Somewhere between six (6) and ten (10) is probably
  *   sufficient for small muds.
  */
 #define APPLY_CACHE_BITS 11
 
+/* CALL_SITE_CACHE_ENTRIES: the number of (program -> function) lookups
+ *   remembered by each call_other() call site in addition to the global
+ *   apply cache.  A handful covers the objects a typical site talks to.
+ */
+#define CALL_SITE_CACHE_ENTRIES 4
+
 /* CACHE_STATS: define this if you want call_other (apply_low) cache 
  * statistics.  Causes HAS_CACHE_STATS to be defined in all LPC objects.
  */
@@ -601,10 +633,8 @@
  */
 #undef TRACE_CODE
 
-/* HEART_BEAT_CHUNK: The number of heart_beat chunks allocated at a time.
- * A large number wastes memory as some will be sitting around unused, while
- * a small one wastes more CPU reallocating when it needs to grow.  Default
- * to a middlish value.
+/* HEART_BEAT_CHUNK: The initial number of heart_beat slots allocated.
+ * The heart beat table doubles in size whenever it is full.
  */
 #define HEART_BEAT_CHUNK      32
 
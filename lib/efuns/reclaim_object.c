@@ -73,42 +73,31 @@ gc_mapping (mapping_t * m)
    * just call check_svalue() b/c the hash would be wrong and the '0'
    * element we add would be unreferenceable (in most cases)
    */
-  mapping_node_t **prev, *elt;
-  int j = (int) m->table_size;
+  mapping_node_t *elt;
+  uint32_t j;
 
-  do
+  for (j = 0; j < m->fill; j++)
     {
-      prev = m->table + j;
-      while ((elt = *prev))
+      elt = map_node (m, j);
+      if (elt->values[0].type == T_INVALID)
+	continue;
+      if (elt->values[0].type == T_OBJECT)
 	{
-	  if (elt->values[0].type == T_OBJECT)
+	  if (elt->values[0].u.ob->flags & O_DESTRUCTED)
 	    {
-	      if (elt->values[0].u.ob->flags & O_DESTRUCTED)
-		{
-		  free_object (elt->values[0].u.ob, "gc_mapping");
-
-		  /* found one, do a map_delete() */
-		  if (!(*prev = elt->next) && !m->table[j])
-		    m->unfilled++;
-		  cleaned++;
-		  m->count--;
-		  total_mapping_nodes--;
-		  total_mapping_size -= sizeof (mapping_node_t);
-		  free_svalue (elt->values + 1, "gc_mapping");
-		  free_node (elt);
-		  continue;
-		}
-	    }
-	  else
-	    {
-	      /* in case the key is a mapping or something */
-	      check_svalue (elt->values);
+	      /* found one, do a map_delete() */
+	      mapping_delete (m, elt->values);
+	      cleaned++;
+	      continue;
 	    }
-	  check_svalue (elt->values + 1);
-	  prev = &(elt->next);
 	}
+      else
+	{
+	  /* in case the key is a mapping or something */
+	  check_svalue (elt->values);
+	}
+      check_svalue (elt->values + 1);
     }
-  while (j--);
 }
 
 int
@@ -60,6 +60,7 @@
 /* Headers */
 
 #include "src/std.h"
+#include "hash.h"
 #include "regexp.h"
 #include "efuns/ed.h"
 
@@ -1304,3 +1305,131 @@ regsub (regexp * prog, char *source, char *dest, int n)
   *dst = '\0';
   return dst;
 }
+
+/*
+ * Cache of compiled regular expressions.  The efuns tend to use the same
+ * few patterns over and over, so compiled programs are kept by pattern
+ * text and excompat flag, and the least recently used one is dropped when
+ * the cache is full.
+ *
+ * A cached program belongs to the cache: callers must not FREE() it, and
+ * may only rely on it until they look up REGEXP_CACHE_SIZE other patterns.
+ */
+#define REGEXP_CACHE_BUCKETS (2 * REGEXP_CACHE_SIZE)	/* must be a power of 2 */
+
+typedef struct regexp_cache_entry_s {
+  struct regexp_cache_entry_s *next;	/* hash chain */
+  struct regexp_cache_entry_s *newer, *older;
+  uint64_t hash;
+  int excompat;
+  regexp *prog;
+  char pattern[1];
+} regexp_cache_entry_t;
+
+static regexp_cache_entry_t *regexp_cache[REGEXP_CACHE_BUCKETS];
+static regexp_cache_entry_t *regexp_newest = NULL, *regexp_oldest = NULL;
+static int regexp_cache_used = 0;
+
+unsigned long regexp_cache_hits = 0;
+unsigned long regexp_cache_misses = 0;
+
+static void
+regexp_cache_unlink (regexp_cache_entry_t * entry)
+{
+  if (entry->newer)
+    entry->newer->older = entry->older;
+  else
+    regexp_newest = entry->older;
+  if (entry->older)
+    entry->older->newer = entry->newer;
+  else
+    regexp_oldest = entry->newer;
+}
+
+static void
+regexp_cache_evict (regexp_cache_entry_t * entry)
+{
+  regexp_cache_entry_t **p = &regexp_cache[entry->hash & (REGEXP_CACHE_BUCKETS - 1)];
+
+  while (*p != entry)
+    p = &(*p)->next;
+  *p = entry->next;
+  regexp_cache_unlink (entry);
+  FREE ((char *) entry->prog);
+  FREE (entry);
+  regexp_cache_used--;
+}
+
+/*
+ - regcomp_cached - regcomp() through the cache
+ *
+ * Returns NULL and sets regexp_error like regcomp() if the pattern doesn't
+ * compile; failures are not cached.
+ */
+regexp *
+regcomp_cached (const char *exp, int excompat)
+{
+  size_t len = strlen (exp);
+  uint64_t hash = strhash64 (exp, len);
+  regexp_cache_entry_t *entry;
+  regexp *prog;
+
+  for (entry = regexp_cache[hash & (REGEXP_CACHE_BUCKETS - 1)]; entry; entry = entry->next)
+    {
+      if (entry->hash == hash && entry->excompat == excompat && strcmp (entry->pattern, exp) == 0)
+        {
+          regexp_cache_hits++;
+          if (entry != regexp_newest)
+            {
+              regexp_cache_unlink (entry);
+              entry->older = regexp_newest;
+              entry->newer = NULL;
+              regexp_newest->newer = entry;
+              regexp_newest = entry;
+            }
+          return entry->prog;
+        }
+    }
+
+  regexp_cache_misses++;
+  if (!(prog = regcomp ((unsigned char *) exp, excompat)))
+    return NULL;
+  if (regexp_cache_used == REGEXP_CACHE_SIZE)
+    regexp_cache_evict (regexp_oldest);
+
+  entry = (regexp_cache_entry_t *) DXALLOC (sizeof (regexp_cache_entry_t) + len, TAG_PERMANENT, "regcomp_cached");
+  memcpy (entry->pattern, exp, len + 1);
+  entry->hash = hash;
+  entry->excompat = excompat;
+  entry->prog = prog;
+  entry->next = regexp_cache[hash & (REGEXP_CACHE_BUCKETS - 1)];
+  regexp_cache[hash & (REGEXP_CACHE_BUCKETS - 1)] = entry;
+  entry->newer = NULL;
+  entry->older = regexp_newest;
+  if (regexp_newest)
+    regexp_newest->newer = entry;
+  else
+    regexp_oldest = entry;
+  regexp_newest = entry;
+  regexp_cache_used++;
+  return prog;
+}
+
+/*
+ - clear_regexp_cache - free all cached programs
+ */
+void
+clear_regexp_cache (void)
+{
+  while (regexp_oldest)
+    regexp_cache_evict (regexp_oldest);
+}
+
+/*
+ - regexp_cache_size - number of cached programs
+ */
+int
+regexp_cache_size (void)
+{
+  return regexp_cache_used;
+}
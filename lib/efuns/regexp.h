@@ -31,4 +31,14 @@ regexp *regcomp(unsigned char *, int);
 int regexec(regexp *, char *);
 char *regsub(regexp *, char *, char *, int);
 
+/* compiled programs kept by regcomp_cached() */
+#define REGEXP_CACHE_SIZE 512
+
+extern unsigned long regexp_cache_hits;
+extern unsigned long regexp_cache_misses;
+
+regexp *regcomp_cached(const char *, int);
+void clear_regexp_cache(void);
+int regexp_cache_size(void);
+
 #endif
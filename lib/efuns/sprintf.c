@@ -500,19 +500,18 @@ void svalue_to_string (svalue_t * obj, outbuffer_t * outbuf, int indent, char de
           numadd (outbuf, obj->u.map->count);
           outbuf_add (outbuf, " element(s) */\n");
 #endif
-          for (i = 0; i <= (int) (obj->u.map->table_size); i++)
+          for (i = 0; i < (int) (obj->u.map->fill); i++)
             {
-              mapping_node_t *elm;
+              mapping_node_t *elm = map_node (obj->u.map, i);
 
-              for (elm = obj->u.map->table[i]; elm; elm = elm->next)
-                {
-                  svalue_to_string (&(elm->values[0]), outbuf, indent + 2, ':', flags | SV2STR_NONEWLINE);
-                  svalue_to_string (
-                    &(elm->values[1]), outbuf, indent + 2,
-                    ((++count==obj->u.map->count) && (flags & SV2STR_NOINDENT)) ? 0 : ',',
-                    flags | SV2STR_DONEINDENT
-                  );
-                }
+              if (elm->values[0].type == T_INVALID)
+                continue;
+              svalue_to_string (&(elm->values[0]), outbuf, indent + 2, ':', flags | SV2STR_NONEWLINE);
+              svalue_to_string (
+                &(elm->values[1]), outbuf, indent + 2,
+                ((++count==obj->u.map->count) && (flags & SV2STR_NOINDENT)) ? 0 : ',',
+                flags | SV2STR_DONEINDENT
+              );
             }
           if (indent > 0 && 0==(flags & SV2STR_NOINDENT))
             add_space (outbuf, indent);
@@ -622,26 +621,22 @@ static void add_nstr (char *str, size_t len) {
  */
 static void add_justified (char *str, size_t slen, pad_info_t * pad, int fs, format_info finfo, short int trailing) {
   /* compensate field size by adding count of characters for ANSI escape sequences */
-  const char *pstr;
-  for (pstr = str; pstr - str < (ptrdiff_t)slen;)
+  const char *pstr, *end = str + slen;
+  for (pstr = memchr (str, '\x1B', slen); pstr;) /* ESC */
     {
-      if (*pstr == '\x1B') /* ESC */
+      pstr++;
+      fs += 2;
+      if (*pstr++ == '[')
         {
-          pstr++;
-          fs += 2;
-          if (*pstr++ == '[')
+          while (isdigit (*pstr) || *pstr == ';')
             {
-              while (isdigit (*pstr) || *pstr == ';')
-                {
-                  pstr++;
-                  fs++;
-                }
               pstr++;
               fs++;
             }
-          continue;
+          pstr++;
+          fs++;
         }
-      pstr++;
+      pstr = pstr < end ? memchr (pstr, '\x1B', end - pstr) : NULL;
     }
 
   fs -= (int)slen;
@@ -818,6 +813,436 @@ pad_info_t* make_pad (pad_info_t * p) {
   return x;
 }
 
+/*
+ * Compiled format strings.
+ *
+ * A format string is split once into a list of ops: literal text, line
+ * ends, "%%" and conversions.  A conversion without '*' is parsed once for
+ * all, so only its arguments are looked at when it is printed.  One that
+ * takes '*' arguments keeps the offset of its '%' and is parsed again each
+ * time, with its arguments.
+ *
+ * The format strings of sprintf() and printf() are usually shared string
+ * constants of programs.  Their compiled form is kept in an LRU cache keyed
+ * by the address of the shared string, which the cache holds a reference
+ * to.  Other format strings are compiled for the one call.
+ */
+#define FOP_TEXT	0	/* literal text */
+#define FOP_NEWLINE	1	/* '\n', flushes columns and tables */
+#define FOP_END		2	/* end of the format string */
+#define FOP_PERCENT	3	/* "%%" */
+#define FOP_CONV	4	/* conversion parsed at compile time */
+#define FOP_CONV_ARGS	5	/* conversion parsed at each call */
+
+typedef struct format_op_s {
+  unsigned int op;		/* FOP_* */
+  unsigned int start;		/* offset of the text, or of the '%' */
+  unsigned int end;		/* offset after the text or conversion */
+  format_info info;
+  int fs;			/* field size */
+  int pres;			/* presision */
+  pad_info_t pad;
+} format_op_t;
+
+typedef struct format_s {
+  struct format_s *next;	/* hash chain */
+  struct format_s *newer, *older;
+  char *str;			/* the format string, shared if cached */
+  format_op_t ops[1];
+} format_t;
+
+#define SPRINTF_CACHE_BUCKETS (2 * SPRINTF_CACHE_SIZE)	/* must be a power of 2 */
+#define FORMAT_HASH(p) ((unsigned int) (((uint64_t) (uintptr_t) (p) * 0x9e3779b97f4a7c15ULL) >> 32) & (SPRINTF_CACHE_BUCKETS - 1))
+
+static format_t *format_cache[SPRINTF_CACHE_BUCKETS];
+static format_t *format_newest = 0, *format_oldest = 0;
+static int format_cache_used = 0;
+static format_t *uncached_format = 0;	/* compiled for one call */
+
+unsigned long sprintf_cache_hits = 0;
+unsigned long sprintf_cache_misses = 0;
+
+/*
+ * Parse the modifiers and type of a conversion, from the character after
+ * the '%' at *fposp up to the character after the type, which *fposp is
+ * left at.
+ *
+ * With argv, '*' takes its value from the arguments and errors are raised,
+ * as the conversion is printed.  Without argv, the conversion is compiled:
+ * returns 0 if it takes '*' arguments, -1 if it is an error that is raised
+ * when it is printed, and 1 if it was parsed for all calls.
+ */
+static int parse_conversion (char *format_str, unsigned int *fposp, format_op_t * conv,
+                             svalue_t ** cargp, int argc, svalue_t * argv) {
+  svalue_t *carg = argv ? *cargp : 0;
+  unsigned int fpos = *fposp;
+  format_info finfo = 0;
+  int fs = 0, pres = 0, ret = 1;
+  pad_info_t pad;
+
+  pad.what = 0;
+  pad.len = 0;
+  for (; !(finfo & INFO_T); fpos++)
+    {
+      if (!format_str[fpos])
+        {
+          finfo |= INFO_T_ERROR;
+          break;
+        }
+      if (((format_str[fpos] >= '0') && (format_str[fpos] <= '9'))
+          || (format_str[fpos] == '*'))
+        {
+          if (pres == -1)
+            {
+              if (format_str[fpos] == '*')
+                {
+                  if (!argv)
+                    {
+                      ret = 0;
+                      continue;
+                    }
+                  if (carg->type != T_NUMBER)
+                    sprintf_error (ERR_INVALID_STAR);
+                  pres = (int)carg->u.number;
+                  GET_NEXT_ARG;
+                  continue;
+                }
+              pres = format_str[fpos] - '0';
+              for (fpos++; isdigit (format_str[fpos]); fpos++)
+                pres = pres * 10 + format_str[fpos] - '0';
+              if (pres < 0)
+                pres = 0;
+            }
+          else
+            {
+              if ((format_str[fpos] == '0')
+                  &&
+                  (((format_str
+                     [fpos + 1] >= '1')
+                    && (format_str[fpos + 1] <= '9'))
+                   || (format_str[fpos + 1] == '*')))
+                {
+                  pad.what = "0";
+                  pad.len = 1;
+                }
+              else
+                {
+                  if (format_str[fpos] == '*')
+                    {
+                      if (!argv)
+                        {
+                          ret = 0;
+                          continue;
+                        }
+                      if (carg->type != T_NUMBER)
+                        sprintf_error (ERR_INVALID_STAR);
+                      fs = (int)carg->u.number;
+                      if (fs < 0)
+                        fs = 0;
+                      if (pres == -2)
+                        pres = fs;	/* colon */
+                      GET_NEXT_ARG;
+                      continue;
+                    }
+                  fs = format_str[fpos] - '0';
+                }
+              for (fpos++; isdigit (format_str[fpos]); fpos++)
+                fs = fs * 10 + format_str[fpos] - '0';
+              if (fs < 0)
+                fs = 0;
+              if (pres == -2)
+                {	/* colon */
+                  pres = fs;
+                }
+            }
+          fpos--;	/* about to get incremented */
+          continue;
+        }
+      switch (format_str[fpos])
+        {
+        case ' ':
+          finfo |= INFO_PP_SPACE;
+          break;
+        case '+':
+          finfo |= INFO_PP_PLUS;
+          break;
+        case '-':
+          finfo |= INFO_J_LEFT;
+          break;
+        case '|':
+          finfo |= INFO_J_CENTRE;
+          break;
+        case '@':
+          finfo |= INFO_ARRAY;
+          break;
+        case '=':
+          finfo |= INFO_COLS;
+          break;
+        case '#':
+          finfo |= INFO_TABLE;
+          break;
+        case '.':
+          pres = -1;
+          break;
+        case ':':
+          pres = -2;
+          break;
+        case 'O':
+          finfo |= INFO_T_LPC;
+          break;
+        case 's':
+          finfo |= INFO_T_STRING;
+          break;
+        case 'd':
+        case 'i':
+          finfo |= INFO_T_INT;
+          break;
+        case 'f':
+          finfo |= INFO_T_FLOAT;
+          break;
+        case 'c':
+          finfo |= INFO_T_CHAR;
+          break;
+        case 'o':
+          finfo |= INFO_T_OCT;
+          break;
+        case 'x':
+          finfo |= INFO_T_HEX;
+          break;
+        case 'X':
+          finfo |= INFO_T_C_HEX;
+          break;
+        case '\'':
+          fpos++;
+          pad.what = format_str + fpos;
+          while (1)
+            {
+              if (!format_str[fpos])
+                {
+                  if (!argv)
+                    return -1;
+                  sprintf_error (ERR_UNEXPECTED_EOS);
+                }
+              if (format_str[fpos] == '\\')
+                {
+                  if (!format_str[++fpos])
+                    {
+                      if (!argv)
+                        return -1;
+                      sprintf_error (ERR_UNEXPECTED_EOS);
+                    }
+                }
+              else if (format_str[fpos] == '\'')
+                {
+                  pad.len = (int)(format_str + fpos - pad.what);
+                  if (!pad.len)
+                    {
+                      if (!argv)
+                        return -1;
+                      sprintf_error (ERR_NULL_PS);
+                    }
+                  break;
+                }
+              fpos++;
+            }
+          break;
+        default:
+          finfo |= INFO_T_ERROR;
+        }
+    }			/* end of for () */
+
+  *fposp = fpos;
+  conv->info = finfo;
+  conv->fs = fs;
+  conv->pres = pres;
+  conv->pad = pad;
+  if (argv)
+    *cargp = carg;
+  return ret;
+}
+
+/*
+ * Compile a format string.  Returns a format_t allocated for it, with the
+ * ops ending with FOP_END, or with a FOP_CONV_ARGS for a conversion that is
+ * an error.
+ */
+static format_t *compile_format (char *format_str) {
+  format_t *fmt;
+  format_op_t *op;
+  unsigned int fpos, last = 0, max_ops = 2;
+  char *p;
+
+  /* text before each '%' and '\n', and the end, each take two ops at most */
+  for (p = format_str; *p; p++)
+    if (*p == '%' || *p == '\n')
+      max_ops += 2;
+  fmt = (format_t *) DXALLOC (sizeof (format_t) + (max_ops - 1) * sizeof (format_op_t), TAG_PERMANENT, "compile_format");
+  fmt->str = format_str;
+  op = fmt->ops;
+
+  for (fpos = 0; 1; fpos++)
+    {
+      char c = format_str[fpos];
+
+      if (c != '\n' && c && c != '%')
+        continue;
+      if (last != fpos)
+        {
+          op->op = FOP_TEXT;
+          op->start = last;
+          op->end = fpos;
+          op++;
+        }
+      last = fpos + 1;
+
+      if (c != '%')
+        {
+          op->op = c ? FOP_NEWLINE : FOP_END;
+          op->start = fpos;
+          op->end = fpos + 1;
+          op++;
+          if (!c)
+            break;
+        }
+      else if (format_str[fpos + 1] == '%')
+        {
+          op->op = FOP_PERCENT;
+          op->start = fpos;
+          op->end = fpos + 2;
+          op++;
+          fpos++;
+          last++;
+        }
+      else
+        {
+          unsigned int start = fpos++;
+          int parsed = parse_conversion (format_str, &fpos, op, 0, 0, 0);
+
+          op->op = parsed > 0 ? FOP_CONV : FOP_CONV_ARGS;
+          op->start = start;
+          op->end = fpos;
+          op++;
+          if (parsed < 0)
+            break;		/* raises an error when printed */
+          last = fpos;
+          fpos--;		/* about to get incremented */
+        }
+    }
+  return fmt;
+}
+
+static void format_cache_unlink (format_t * fmt) {
+  if (fmt->newer)
+    fmt->newer->older = fmt->older;
+  else
+    format_newest = fmt->older;
+  if (fmt->older)
+    fmt->older->newer = fmt->newer;
+  else
+    format_oldest = fmt->newer;
+}
+
+static void format_cache_evict (format_t * fmt) {
+  format_t **p = &format_cache[FORMAT_HASH (fmt->str)];
+
+  while (*p != fmt)
+    p = &(*p)->next;
+  *p = fmt->next;
+  format_cache_unlink (fmt);
+  free_string (fmt->str);
+  FREE (fmt);
+  format_cache_used--;
+}
+
+/* Look up the compiled form of a shared format string, compiling it if needed. */
+static format_t *lookup_format (char *format_str) {
+  format_t *fmt;
+
+  for (fmt = format_cache[FORMAT_HASH (format_str)]; fmt; fmt = fmt->next)
+    {
+      if (fmt->str == format_str)
+        {
+          sprintf_cache_hits++;
+          if (fmt != format_newest)
+            {
+              format_cache_unlink (fmt);
+              fmt->older = format_newest;
+              fmt->newer = 0;
+              format_newest->newer = fmt;
+              format_newest = fmt;
+            }
+          return fmt;
+        }
+    }
+
+  sprintf_cache_misses++;
+  if (format_cache_used == SPRINTF_CACHE_SIZE)
+    format_cache_evict (format_oldest);
+  fmt = compile_format (format_str);
+  ref_string (format_str);
+  fmt->next = format_cache[FORMAT_HASH (format_str)];
+  format_cache[FORMAT_HASH (format_str)] = fmt;
+  fmt->newer = 0;
+  fmt->older = format_newest;
+  if (format_newest)
+    format_newest->newer = fmt;
+  else
+    format_oldest = fmt;
+  format_newest = fmt;
+  format_cache_used++;
+  return fmt;
+}
+
+/**
+ * @brief Free all compiled format strings, and their references to the
+ * shared strings.
+ */
+void clear_sprintf_cache (void) {
+  while (format_oldest)
+    format_cache_evict (format_oldest);
+  if (uncached_format)
+    {
+      FREE (uncached_format);
+      uncached_format = 0;
+    }
+}
+
+/** @brief Number of compiled format strings in the cache. */
+int sprintf_cache_size (void) {
+  return format_cache_used;
+}
+
+/*
+ * Format an integer for %d and %i into buf, which has room for pres digits
+ * and 22 more characters.  Returns the length.
+ */
+static int format_decimal (char *buf, int64_t num, int pres, format_info finfo) {
+  char digits[24], *p = digits + sizeof (digits);
+  uint64_t n = num < 0 ? -(uint64_t) num : (uint64_t) num;
+  int len = 0, ndigits;
+
+  do
+    {
+      *--p = (char) ('0' + n % 10);
+      n /= 10;
+    }
+  while (n);
+  ndigits = (int) (digits + sizeof (digits) - p);
+
+  if (num < 0)
+    buf[len++] = '-';
+  else if ((finfo & INFO_PP) == INFO_PP_PLUS)
+    buf[len++] = '+';
+  else if ((finfo & INFO_PP) == INFO_PP_SPACE)
+    buf[len++] = ' ';
+  for (; pres > ndigits; pres--)
+    buf[len++] = '0';
+  memcpy (buf + len, p, ndigits);
+  len += ndigits;
+  buf[len] = 0;
+  return len;
+}
+
 /*
  * THE (s)printf() function.
  * It returns a pointer to it's internal buffer (or a string in the text
@@ -825,7 +1250,9 @@ pad_info_t* make_pad (pad_info_t * p) {
  * this function is called again, or if it's going to be modified (esp.
  * if it risks being free()ed).
  */
-char* string_print_formatted (char *format_str, int argc, svalue_t * argv) {
+static char* print_formatted (format_t * fmt, int argc, svalue_t * argv) {
+  char *format_str = fmt->str;
+  format_op_t *op, conv;
   format_info finfo;
   svalue_t *carg;		/* current arg */
   unsigned int nelemno = 0;	/* next offset into array */
@@ -835,55 +1262,19 @@ char* string_print_formatted (char *format_str, int argc, svalue_t * argv) {
   pad_info_t pad;		/* fs pad string */
   unsigned int i;
   char *retvalue;
-  int last;
-
-  /* prevent recursion, since many of our important variables are global */
-  if (guard)
-    {
-      guard = 0;
-      error ("Illegal to use sprintf() within the object_name() master call.\n");
-    }
-
-  /* free anything that is sitting around here from errors */
-  if (clean.type != T_NUMBER)
-    {
-      free_svalue (&clean, "sprintf error");
-      clean.type = T_NUMBER;
-    }
-
-  /* The string we construct */
-  if (obuff.buffer)
-    FREE_MSTR (obuff.buffer);
-  outbuf_zero (&obuff);
-
-  /* Table info */
-  while (csts)
-    {
-      cst *next = csts->next;
-      if (!(csts->info & INFO_COLS) && csts->d.tab)
-        FREE (csts->d.tab);
-      FREE (csts);
-      csts = next;
-    }
 
   cur_arg = -1;
-  last = 0;
-  for (fpos = 0; 1; fpos++)
+  for (op = fmt->ops; 1; op++)
     {
-      char c = format_str[fpos];
-
-      if (c == '\n' || !c)
+      if (op->op == FOP_TEXT)
         {
+          add_nstr (format_str + op->start, op->end - op->start);
+        }
+      else if (op->op == FOP_NEWLINE || op->op == FOP_END)
+        {
+          char c = format_str[op->start];
           int column_stat = 0;
 
-          if (last != (int)fpos)
-            {
-              add_nstr (format_str + last, fpos - last);
-              last = fpos + 1;
-            }
-          else
-            last++;
-
           if (!csts)
             {
               if (!c)
@@ -924,175 +1315,47 @@ char* string_print_formatted (char *format_str, int argc, svalue_t * argv) {
           if (!c)
             break;
         }
-      else if (c == '%')
+      else if (op->op == FOP_PERCENT)
+        {
+          ADD_CHAR ('%');
+        }
+      else
         {
-          if (last != (int)fpos)
+          GET_NEXT_ARG;
+          if (op->op == FOP_CONV && carg->type == T_STRING && !op->pad.len && op->pres >= 0
+              && (op->info == INFO_T_STRING || op->info == (INFO_T_STRING | INFO_J_LEFT)))
             {
-              add_nstr (format_str + last, fpos - last);
-              last = fpos + 1;
+              /* %s and %-Ns are the common case: no columns, tables, arrays
+               * or pad strings, just the string and maybe some spaces */
+              size_t slen = SVALUE_STRLEN (carg);
+
+              if (op->pres && op->pres < (int) slen)
+                slen = op->pres;
+              if (!op->fs)
+                add_nstr (carg->u.string, slen);
+              else
+                add_justified (carg->u.string, slen, NULL, op->fs, op->info,
+                               (format_str[op->end] != '\n' && format_str[op->end] != '\0')
+                               || !slen || carg->u.string[slen - 1] != '\n');
+              continue;
             }
-          else
-            last++;
-
-          if (format_str[fpos + 1] == '%')
+          if (op->op == FOP_CONV)
             {
-              ADD_CHAR ('%');
-              fpos++;
-              last++;
-              continue;
+              fpos = op->end;
+              finfo = op->info;
+              fs = op->fs;
+              pres = op->pres;
+              pad = op->pad;
             }
-
-          GET_NEXT_ARG;
-          fs = 0;
-          pres = 0;
-          pad.len = 0;
-          finfo = 0;
-          for (fpos++; !(finfo & INFO_T); fpos++)
+          else
             {
-              if (!format_str[fpos])
-                {
-                  finfo |= INFO_T_ERROR;
-                  break;
-                }
-              if (((format_str[fpos] >= '0') && (format_str[fpos] <= '9'))
-                  || (format_str[fpos] == '*'))
-                {
-                  if (pres == -1)
-                    {
-                      if (format_str[fpos] == '*')
-                        {
-                          if (carg->type != T_NUMBER)
-                            sprintf_error (ERR_INVALID_STAR);
-                          pres = (int)carg->u.number;
-                          GET_NEXT_ARG;
-                          continue;
-                        }
-                      pres = format_str[fpos] - '0';
-                      for (fpos++; isdigit (format_str[fpos]); fpos++)
-                        pres = pres * 10 + format_str[fpos] - '0';
-                      if (pres < 0)
-                        pres = 0;
-                    }
-                  else
-                    {
-                      if ((format_str[fpos] == '0')
-                          &&
-                          (((format_str
-                             [fpos + 1] >= '1')
-                            && (format_str[fpos + 1] <= '9'))
-                           || (format_str[fpos + 1] == '*')))
-                        {
-                          pad.what = "0";
-                          pad.len = 1;
-                        }
-                      else
-                        {
-                          if (format_str[fpos] == '*')
-                            {
-                              if (carg->type != T_NUMBER)
-                                sprintf_error (ERR_INVALID_STAR);
-                              fs = (int)carg->u.number;
-                              if (fs < 0)
-                                fs = 0;
-                              if (pres == -2)
-                                pres = fs;	/* colon */
-                              GET_NEXT_ARG;
-                              continue;
-                            }
-                          fs = format_str[fpos] - '0';
-                        }
-                      for (fpos++; isdigit (format_str[fpos]); fpos++)
-                        fs = fs * 10 + format_str[fpos] - '0';
-                      if (fs < 0)
-                        fs = 0;
-                      if (pres == -2)
-                        {	/* colon */
-                          pres = fs;
-                        }
-                    }
-                  fpos--;	/* about to get incremented */
-                  continue;
-                }
-              switch (format_str[fpos])
-                {
-                case ' ':
-                  finfo |= INFO_PP_SPACE;
-                  break;
-                case '+':
-                  finfo |= INFO_PP_PLUS;
-                  break;
-                case '-':
-                  finfo |= INFO_J_LEFT;
-                  break;
-                case '|':
-                  finfo |= INFO_J_CENTRE;
-                  break;
-                case '@':
-                  finfo |= INFO_ARRAY;
-                  break;
-                case '=':
-                  finfo |= INFO_COLS;
-                  break;
-                case '#':
-                  finfo |= INFO_TABLE;
-                  break;
-                case '.':
-                  pres = -1;
-                  break;
-                case ':':
-                  pres = -2;
-                  break;
-                case 'O':
-                  finfo |= INFO_T_LPC;
-                  break;
-                case 's':
-                  finfo |= INFO_T_STRING;
-                  break;
-                case 'd':
-                case 'i':
-                  finfo |= INFO_T_INT;
-                  break;
-                case 'f':
-                  finfo |= INFO_T_FLOAT;
-                  break;
-                case 'c':
-                  finfo |= INFO_T_CHAR;
-                  break;
-                case 'o':
-                  finfo |= INFO_T_OCT;
-                  break;
-                case 'x':
-                  finfo |= INFO_T_HEX;
-                  break;
-                case 'X':
-                  finfo |= INFO_T_C_HEX;
-                  break;
-                case '\'':
-                  fpos++;
-                  pad.what = format_str + fpos;
-                  while (1)
-                    {
-                      if (!format_str[fpos])
-                        sprintf_error (ERR_UNEXPECTED_EOS);
-                      if (format_str[fpos] == '\\')
-                        {
-                          if (!format_str[++fpos])
-                            sprintf_error (ERR_UNEXPECTED_EOS);
-                        }
-                      else if (format_str[fpos] == '\'')
-                        {
-                          pad.len = (int)(format_str + fpos - pad.what);
-                          if (!pad.len)
-                            sprintf_error (ERR_NULL_PS);
-                          break;
-                        }
-                      fpos++;
-                    }
-                  break;
-                default:
-                  finfo |= INFO_T_ERROR;
-                }
-            }			/* end of for () */
+              fpos = op->start + 1;
+              parse_conversion (format_str, &fpos, &conv, &carg, argc, argv);
+              finfo = conv.info;
+              fs = conv.fs;
+              pres = conv.pres;
+              pad = conv.pad;
+            }
           if (pres < 0)
             sprintf_error (ERR_PRES_EXPECTED);
           /*
@@ -1103,11 +1366,7 @@ char* string_print_formatted (char *format_str, int argc, svalue_t * argv) {
               if (carg->type != T_ARRAY)
                 sprintf_error (ERR_ARRAY_EXPECTED);
               if (carg->u.arr->size == 0)
-                {
-                  last = fpos;
-                  fpos--;	/* 'bout to get incremented */
-                  continue;
-                }
+                continue;
               carg = (argv + cur_arg)->u.arr->item;
               nelemno = 1;	/* next element number */
             }
@@ -1179,7 +1438,7 @@ char* string_print_formatted (char *format_str, int argc, svalue_t * argv) {
                           tmp = ((format_str[fpos] != '\n')
                                  && (format_str[fpos] != '\0'))
                             || ((finfo & INFO_ARRAY)
-                                && (nelemno < (argv + cur_arg)->u.arr->size));
+                                && (nelemno < (unsigned int) (argv + cur_arg)->u.arr->size));
                           tmp = add_column (temp, tmp);
                           if (tmp == 2 && !format_str[fpos])
                             {
@@ -1296,7 +1555,7 @@ char* string_print_formatted (char *format_str, int argc, svalue_t * argv) {
                         slen = pres;
                       add_justified (carg->u.string, slen, &pad, fs, finfo, (
                         ((format_str[fpos] != '\n') && (format_str[fpos] != '\0')) ||
-                        ((finfo & INFO_ARRAY) && (nelemno < (argv + cur_arg)->u.arr->size))
+                        ((finfo & INFO_ARRAY) && (nelemno < (unsigned int) (argv + cur_arg)->u.arr->size))
                         ) ||
                         carg->u.string[slen - 1] != '\n'
                       );
@@ -1305,71 +1564,84 @@ char* string_print_formatted (char *format_str, int argc, svalue_t * argv) {
               else if (finfo & INFO_T_INT)
                 {		/* one of the integer
                                  * types */
-                  char cheat[8];
+                  char cheat[24];
                   char temp[100];
+                  int tmpl;
 
-                  *cheat = '%';
-                  i = 1;
-                  switch (finfo & INFO_PP)
-                    {
-                    case INFO_PP_SPACE:
-                      cheat[i++] = ' ';
-                      break;
-                    case INFO_PP_PLUS:
-                      cheat[i++] = '+';
-                      break;
-                    }
-                  if (pres)
+                  if ((finfo & INFO_T) == INFO_T_INT && carg->type == T_NUMBER
+                      && pres < (int) sizeof (temp) - 24)
                     {
-                      cheat[i++] = '.';
-                      sprintf (cheat + i, "%d", pres);
-                      i += (int)strlen (cheat + i);
+                      /* %d and %i are the common case, no need for sprintf() */
+                      tmpl = format_decimal (temp, carg->u.number, pres, finfo);
                     }
-                  switch (finfo & INFO_T)
-                    {
-                    case INFO_T_INT:
-                      cheat[i++] = 'd';
-                      break;
-                    case INFO_T_FLOAT:
-                      cheat[i++] = 'f';
-                      break;
-                    case INFO_T_CHAR:
-                      cheat[i++] = 'c';
-                      break;
-                    case INFO_T_OCT:
-                      cheat[i++] = 'o';
-                      break;
-                    case INFO_T_HEX:
-                      cheat[i++] = 'x';
-                      break;
-                    case INFO_T_C_HEX:
-                      cheat[i++] = 'X';
-                      break;
-                    default:
-                      sprintf_error (ERR_BAD_INT_TYPE);
-                    }
-                  if ((cheat[i - 1] == 'f' && carg->type != T_REAL)
-                      || (cheat[i - 1] != 'f' && carg->type != T_NUMBER))
+                  else
                     {
-                      error
-                        ("ERROR: (s)printf(): Incorrect argument type to %%%c.\n",
-                         cheat[i - 1]);
-                    }
-                  cheat[i] = '\0';
+                      *cheat = '%';
+                      i = 1;
+                      switch (finfo & INFO_PP)
+                        {
+                        case INFO_PP_SPACE:
+                          cheat[i++] = ' ';
+                          break;
+                        case INFO_PP_PLUS:
+                          cheat[i++] = '+';
+                          break;
+                        }
+                      if (pres)
+                        {
+                          cheat[i++] = '.';
+                          sprintf (cheat + i, "%d", pres);
+                          i += (int)strlen (cheat + i);
+                        }
+                      /* LPC ints are 64 bits */
+                      if ((finfo & INFO_T) != INFO_T_FLOAT && (finfo & INFO_T) != INFO_T_CHAR)
+                        {
+                          cheat[i++] = 'l';
+                          cheat[i++] = 'l';
+                        }
+                      switch (finfo & INFO_T)
+                        {
+                        case INFO_T_INT:
+                          cheat[i++] = 'd';
+                          break;
+                        case INFO_T_FLOAT:
+                          cheat[i++] = 'f';
+                          break;
+                        case INFO_T_CHAR:
+                          cheat[i++] = 'c';
+                          break;
+                        case INFO_T_OCT:
+                          cheat[i++] = 'o';
+                          break;
+                        case INFO_T_HEX:
+                          cheat[i++] = 'x';
+                          break;
+                        case INFO_T_C_HEX:
+                          cheat[i++] = 'X';
+                          break;
+                        default:
+                          sprintf_error (ERR_BAD_INT_TYPE);
+                        }
+                      if ((cheat[i - 1] == 'f' && carg->type != T_REAL)
+                          || (cheat[i - 1] != 'f' && carg->type != T_NUMBER))
+                        {
+                          error
+                            ("ERROR: (s)printf(): Incorrect argument type to %%%c.\n",
+                             cheat[i - 1]);
+                        }
+                      cheat[i] = '\0';
 
-                  if (carg->type == T_REAL)
-                    {
-                      sprintf (temp, cheat, carg->u.real);
+                      if (carg->type == T_REAL)
+                        snprintf (temp, sizeof (temp), cheat, carg->u.real);
+                      else if (cheat[i - 1] == 'c')
+                        snprintf (temp, sizeof (temp), cheat, (int) carg->u.number);
+                      else
+                        snprintf (temp, sizeof (temp), cheat, (long long) carg->u.number);
+                      tmpl = (int)strlen (temp);
                     }
-                  else
-                    sprintf (temp, cheat, carg->u.number);
-                  {
-                    int tmpl = (int)strlen (temp);
-
-                    add_justified (temp, tmpl, &pad, fs, finfo,
-                                   (((format_str[fpos] != '\n') && (format_str[fpos] != '\0'))
-                                    || ((finfo & INFO_ARRAY) && (nelemno < (argv + cur_arg)->u.arr->size))));
-                  }
+                  add_justified (temp, tmpl, &pad, fs, finfo,
+                                 (((format_str[fpos] != '\n') && (format_str[fpos] != '\0'))
+                                  || ((finfo & INFO_ARRAY) && (nelemno < (unsigned int) (argv + cur_arg)->u.arr->size))));
                 }
               else		/* type not found */
                 sprintf_error (ERR_UNDEFINED_TYPE);
@@ -1381,20 +1653,89 @@ char* string_print_formatted (char *format_str, int argc, svalue_t * argv) {
 
               if (!(finfo & INFO_ARRAY))
                 break;
-              if (nelemno >= (argv + cur_arg)->u.arr->size)
+              if (nelemno >= (unsigned int) (argv + cur_arg)->u.arr->size)
                 break;
               carg = (argv + cur_arg)->u.arr->item + nelemno++;
             }			/* end of while (1) */
-          last = fpos;
-          fpos--;		/* bout to get incremented */
         }
-    }				/* end of for (fpos=0; 1; fpos++) */
+    }				/* end of for (op = fmt->ops; 1; op++) */
 
   outbuf_fix (&obuff);
   retvalue = obuff.buffer;
   obuff.buffer = 0;
   return retvalue;
-}				/* end of string_print_formatted() */
+}				/* end of print_formatted() */
+
+/*
+ * Free what an error left behind in the last call, and start a new one.
+ */
+static void start_print_formatted (void) {
+  /* prevent recursion, since many of our important variables are global */
+  if (guard)
+    {
+      guard = 0;
+      error ("Illegal to use sprintf() within the object_name() master call.\n");
+    }
+
+  /* free anything that is sitting around here from errors */
+  if (clean.type != T_NUMBER)
+    {
+      free_svalue (&clean, "sprintf error");
+      clean.type = T_NUMBER;
+    }
+  if (uncached_format)
+    {
+      FREE (uncached_format);
+      uncached_format = 0;
+    }
+
+  /* The string we construct */
+  if (obuff.buffer)
+    FREE_MSTR (obuff.buffer);
+  outbuf_zero (&obuff);
+
+  /* Table info */
+  while (csts)
+    {
+      cst *next = csts->next;
+      if (!(csts->info & INFO_COLS) && csts->d.tab)
+        FREE (csts->d.tab);
+      FREE (csts);
+      csts = next;
+    }
+}
+
+/**
+ * @brief Format a string like sprintf(), compiling the format for this call.
+ * @return A malloced string, or NULL if the result is empty.
+ */
+char* string_print_formatted (char *format_str, int argc, svalue_t * argv) {
+  char *ret;
+
+  start_print_formatted ();
+  uncached_format = compile_format (format_str);
+  ret = print_formatted (uncached_format, argc, argv);
+  FREE (uncached_format);
+  uncached_format = 0;
+  return ret;
+}
+
+/**
+ * @brief Format a string like sprintf(), using the cached compiled form of
+ * a shared format string.
+ * @return A malloced string, or NULL if the result is empty.
+ */
+char* string_print_shared_format (char *format_str, int argc, svalue_t * argv) {
+  start_print_formatted ();
+  return print_formatted (lookup_format (format_str), argc, argv);
+}
+
+/* The format string svalue of sprintf() or printf(). */
+static char* print_formatted_svalue (svalue_t * format, int argc, svalue_t * argv) {
+  if (format->subtype == STRING_SHARED)
+    return string_print_shared_format (format->u.string, argc, argv);
+  return string_print_formatted (format->u.string, argc, argv);
+}
 
 #endif /* defined(F_SPRINTF) || defined(F_PRINTF) */
 
@@ -1404,8 +1745,7 @@ void f_sprintf (void) {
   char *s;
   int num_arg = st_num_arg;
 
-  s = string_print_formatted ((sp - num_arg + 1)->u.string,
-                              num_arg - 1, sp - num_arg + 2);
+  s = print_formatted_svalue (sp - num_arg + 1, num_arg - 1, sp - num_arg + 2);
   pop_n_elems (num_arg);
 
   (++sp)->type = T_STRING;
@@ -1430,8 +1770,7 @@ void f_printf (void) {
 
   if (command_giver)
     {
-      ret = string_print_formatted ((sp - num_arg + 1)->u.string,
-                                    num_arg - 1, sp - num_arg + 2);
+      ret = print_formatted_svalue (sp - num_arg + 1, num_arg - 1, sp - num_arg + 2);
       if (ret)
         {
           tell_object (command_giver, ret);
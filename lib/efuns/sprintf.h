@@ -6,3 +6,13 @@
 
 void svalue_to_string(svalue_t *, outbuffer_t *, int, char, int);
 char *string_print_formatted(char *, int, svalue_t *);
+char *string_print_shared_format(char *, int, svalue_t *);
+
+/* compiled format strings kept by sprintf() and printf() */
+#define SPRINTF_CACHE_SIZE 256
+
+extern unsigned long sprintf_cache_hits;
+extern unsigned long sprintf_cache_misses;
+
+void clear_sprintf_cache(void);
+int sprintf_cache_size(void);
@@ -178,7 +178,7 @@ int inter_sscanf (svalue_t * arg, svalue_t * s0, svalue_t * s1, int num_arg) {
                   memcpy (buf, fmt, n);
                   buf[n] = 0;
                   regexp_user = EFUN_REGEXP;
-                  reg = regcomp ((unsigned char *) buf, 0);
+                  reg = regcomp_cached (buf, 0);
                   FREE (buf);
                   if (!reg)
                     error (regexp_error);
@@ -193,7 +193,6 @@ int inter_sscanf (svalue_t * arg, svalue_t * s0, svalue_t * s1, int num_arg) {
                       SSCANF_ASSIGN_SVALUE_STRING (buf);
                     }
                   in_string = *reg->endp;
-                  FREE ((char *) reg);
                   fmt = ++tmp;
                   break;
                 }
@@ -309,7 +308,7 @@ int inter_sscanf (svalue_t * arg, svalue_t * s0, svalue_t * s1, int num_arg) {
                       memcpy (buf, fmt, n);
                       buf[n] = 0;
                       regexp_user = EFUN_REGEXP;
-                      reg = regcomp ((unsigned char *) buf, 0);
+                      reg = regcomp_cached (buf, 0);
                       FREE (buf);
                       if (!reg)
                         error (regexp_error);
@@ -319,7 +318,6 @@ int inter_sscanf (svalue_t * arg, svalue_t * s0, svalue_t * s1, int num_arg) {
                             {
                               SSCANF_ASSIGN_SVALUE_STRING (string_copy (in_string, "sscanf"));
                             }
-                          FREE ((char *) reg);
                           return number_of_matches;
                         }
                       else
@@ -339,7 +337,6 @@ int inter_sscanf (svalue_t * arg, svalue_t * s0, svalue_t * s1, int num_arg) {
                               match[num] = 0;
                               SSCANF_ASSIGN_SVALUE_STRING (match);
                             }
-                          FREE ((char *) reg);
                         }
                       fmt = ++tmp;
                       break;
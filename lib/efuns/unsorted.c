@@ -68,6 +68,40 @@ f_children (void)
 #endif
 
 
+#ifdef F_CLONE_COUNT
+void
+f_clone_count (void)
+{
+  char tmpbuf[MAX_OBJECT_NAME_SIZE];
+  int n = 0, hidden = 0;
+
+  if (sp->type == T_OBJECT)
+    {
+      const char *p = strrchr (sp->u.ob->name, '#');
+      size_t len = p ? (size_t) (p - sp->u.ob->name) : strlen (sp->u.ob->name);
+
+      if (len < sizeof tmpbuf)
+        {
+          memcpy (tmpbuf, sp->u.ob->name, len);
+          tmpbuf[len] = 0;
+          lookup_clones (tmpbuf, &n, &hidden);
+        }
+      free_object (sp->u.ob, "f_clone_count");
+    }
+  else
+    {
+      if (strip_name (sp->u.string, tmpbuf, sizeof tmpbuf))
+        lookup_clones (tmpbuf, &n, &hidden);
+      free_string_svalue (sp);
+    }
+  /* hidden clones are counted like children() lists them */
+  if (hidden && !valid_hide (current_object))
+    n -= hidden;
+  put_number (n);
+}
+#endif
+
+
 #ifdef F_CLONE_OBJECT
 void
 f_clone_object (void)
@@ -448,13 +482,12 @@ f_member_array (void)
       int size = (v = sp->u.arr)->size;
       svalue_t *sv;
       svalue_t *find;
-      int flen = 0;
+      size_t flen = 0;
 
       find = (sp - 1);
       /* optimize a bit */
       if (find->type == T_STRING)
         {
-          /* *not* COUNTED_STRLEN() which can do a (costly) strlen() call */
           if (find->subtype & STRING_COUNTED)
             flen = MSTR_SIZE (find->u.string);
           else
@@ -466,6 +499,11 @@ f_member_array (void)
           switch (find->type | (sv = v->item + i)->type)
             {
             case T_STRING:
+              if (find->u.string == sv->u.string)
+                break;
+              /* equal shared strings are the same string */
+              if (find->subtype == STRING_SHARED && sv->subtype == STRING_SHARED)
+                continue;
               if (flen && (sv->subtype & STRING_COUNTED)
                   && flen != MSTR_SIZE (sv->u.string))
                 continue;
@@ -770,13 +808,13 @@ f_set_hide (void)
     {
       if (!(current_object->flags & O_HIDDEN) && current_object->interactive)
         num_hidden++;
-      current_object->flags |= O_HIDDEN;
+      set_object_hidden (current_object, 1);
     }
   else
     {
       if ((current_object->flags & O_HIDDEN) && current_object->interactive)
         num_hidden--;
-      current_object->flags &= ~O_HIDDEN;
+      set_object_hidden (current_object, 0);
     }
 }
 #endif
@@ -7,13 +7,15 @@
 #include "src/interpret.h"
 #include "src/comm.h"
 #include "efuns/regexp.h"
-#include "qsort.h"
 
 #include "array.h"
+#include "mapping.h"
+#include "sort.h"
 #include "object.h"
 #include "otable.h"
 #include "program.h"
 #include "lpc/include/origin.h"
+#include "hash.h"
 
 #ifdef ARRAY_STATS
 int num_arrays;
@@ -56,7 +58,7 @@ array_t* allocate_array (size_t n) {
 #endif
   p = ALLOC_ARRAY (n);
   p->ref = 1;
-  p->size = (unsigned short)n;
+  p->size = (int)n;
   while (n--)
     p->item[n] = const0;
   return p;
@@ -76,7 +78,7 @@ array_t* allocate_empty_array (size_t n) {
 #endif
   p = ALLOC_ARRAY (n);
   p->ref = 1;
-  p->size = (unsigned short)n;
+  p->size = (int)n;
   while (n--)
     p->item[n] = const0;
   return p;
@@ -498,7 +500,7 @@ array_t* slice_array (array_t * p, int from, int to) {
       while (cnt--)
         free_svalue (sv2++, "slice_array:3");
       p = RESIZE_ARRAY (p, to - from + 1);
-      p->size = (unsigned short)(to - from + 1);
+      p->size = to - from + 1;
       p->ref = 1;
       return p;
     }
@@ -698,6 +700,7 @@ typedef struct unique_s
 {
   svalue_t mark;
   int count;
+  int alloc;			/* room in indices */
   struct unique_s *next;
   int *indices;
 }
@@ -706,10 +709,32 @@ unique_t;
 typedef struct unique_list_s
 {
   unique_t *head;
+  unique_t **table;		/* hash of the marks of large arrays, or NULL */
+  uint32_t mask;
   struct unique_list_s *next;
 }
 unique_list_t;
 
+/* arrays this large look marks up in a hash rather than the list */
+#define UNIQUE_HASH_THRESHOLD 32
+
+/* A hash of svalues that agrees with sameval(). */
+static uint32_t
+sameval_hash (svalue_t * v)
+{
+  switch (v->type)
+    {
+    case T_STRING:
+      return (uint32_t) strhash64 (v->u.string, SVALUE_STRLEN (v));
+    case T_REAL:
+      if (v->u.real == 0)
+        return 0;		/* -0.0 == 0.0 */
+      /* fall through */
+    default:
+      return MAP_POINTER_HASH (v->u.number);
+    }
+}
+
 static unique_list_t *g_u_list = 0;
 
 void
@@ -727,6 +752,8 @@ unique_array_error_handler (void)
       FREE ((char *) uptr);
       uptr = nptr;
     }
+  if (unlist->table)
+    FREE ((char *) unlist->table);
   FREE ((char *) unlist);
 }
 
@@ -738,6 +765,7 @@ f_unique_array (void)
   svalue_t *skipval, *sv, *svp;
   unique_list_t *unlist;
   unique_t **head, *uptr, *nptr;
+  uint32_t h = 0;
   funptr_t *funp = 0;
   char *func = NULL;
 
@@ -770,8 +798,19 @@ f_unique_array (void)
   unlist = ALLOCATE (unique_list_t, TAG_TEMPORARY, "f_unique_array:1");
   unlist->next = g_u_list;
   unlist->head = 0;
+  unlist->table = 0;
   head = &unlist->head;
   g_u_list = unlist;
+  if (size >= UNIQUE_HASH_THRESHOLD)
+    {
+      uint32_t slots = 2;
+
+      while (slots < (uint32_t) size * 2)
+        slots <<= 1;
+      unlist->mask = slots - 1;
+      unlist->table = CALLOCATE (slots, unique_t *, TAG_TEMPORARY, "f_unique_array:5");
+      memset (unlist->table, 0, slots * sizeof (unique_t *));
+    }
 
   (++sp)->type = T_ERROR_HANDLER;
   sp->u.error_handler = unique_array_error_handler;
@@ -792,28 +831,42 @@ f_unique_array (void)
 
       if (sv && !sameval (sv, skipval))
         {
-          uptr = *head;
-          while (uptr)
+          if (unlist->table)
+            {
+              /* an empty slot ends the probe with uptr NULL */
+              for (h = sameval_hash (sv) & unlist->mask; (uptr = unlist->table[h]); h = (h + 1) & unlist->mask)
+                if (sameval (sv, &uptr->mark))
+                  break;
+            }
+          else
             {
-              if (sameval (sv, &uptr->mark))
+              uptr = *head;
+              while (uptr && !sameval (sv, &uptr->mark))
+                uptr = uptr->next;
+            }
+          if (uptr)
+            {
+              if (uptr->count == uptr->alloc)
                 {
-                  uptr->indices = RESIZE (uptr->indices, uptr->count + 1, int,
+                  uptr->alloc *= 2;
+                  uptr->indices = RESIZE (uptr->indices, uptr->alloc, int,
                                           TAG_TEMPORARY, "f_unique_array:2");
-                  uptr->indices[uptr->count++] = i;
-                  break;
                 }
-              uptr = uptr->next;
+              uptr->indices[uptr->count++] = i;
             }
-          if (!uptr)
+          else
             {
               numkeys++;
               uptr = ALLOCATE (unique_t, TAG_TEMPORARY, "f_unique_array:3");
               uptr->indices = ALLOCATE (int, TAG_TEMPORARY, "f_unique_array:4");
               uptr->count = 1;
+              uptr->alloc = 1;
               uptr->indices[0] = i;
               uptr->next = *head;
               assign_svalue_no_free (&uptr->mark, sv);
               *head = uptr;
+              if (unlist->table)
+                unlist->table[h] = uptr;
             }
         }
     }
@@ -839,6 +892,8 @@ f_unique_array (void)
     }
 
   unlist = g_u_list->next;
+  if (g_u_list->table)
+    FREE ((char *) g_u_list->table);
   FREE ((char *) g_u_list);
   g_u_list = unlist;
   sp--;
@@ -913,7 +968,7 @@ add_array (array_t * p, array_t * r)
       total_array_size += sizeof (svalue_t) * (r->size);
 #endif
       /* d->ref = 1;     d is p, and p's ref was already one -Beek */
-      d->size = (unsigned short)res;
+      d->size = res;
     }
   else
     {
@@ -1120,10 +1175,77 @@ static function_to_call_t *sort_array_ftc;
 
 #define COMPARE_NUMS(x,y) (x < y ? -1 : (x > y ? 1 : 0))
 
+/*
+ * Sort an array of strings, ints, floats or arrays; a dir less than zero
+ * sorts in descending order, and a dir of 2 or -2 keeps elements with equal
+ * keys in order.  The types are checked before sorting, so that a type
+ * error is raised up front rather than halfway through the sort.
+ */
 array_t* builtin_sort_array (array_t * inlist, int dir) {
 
-  quickSort ((char *) inlist->item, inlist->size, sizeof (inlist->item),
-             (dir < 0) ? builtin_sort_array_cmp_rev : builtin_sort_array_cmp_fwd);
+  svalue_t *v = inlist->item;
+  int n = inlist->size, type, i;
+
+  if (n < 2)
+    return inlist;
+
+  type = v[0].type;
+  for (i = 1; i < n; i++)
+    if (v[i].type != type)
+      error
+        ("built-in sort_array() can only handle homogeneous arrays of strings/ints/floats/arrays\n");
+
+  switch (type)
+    {
+    case T_NUMBER:
+      sort_numbers (v, n);
+      break;
+
+    case T_REAL:
+      sort_reals (v, n);
+      break;
+
+    case T_STRING:
+      sort_strings (v, n);
+      break;
+
+    case T_ARRAY:
+      {
+        /* arrays are sorted by their first elements */
+        int key_type = T_INVALID;
+
+        for (i = 0; i < n; i++)
+          {
+            array_t *elem = v[i].u.arr;
+
+            if (!elem->size)
+              error ("Illegal to have empty array in array for sort_array()\n");
+            if (i == 0)
+              key_type = elem->item->type;
+            if (elem->item->type != key_type ||
+                !(key_type & (T_STRING | T_NUMBER | T_REAL)))
+              error
+                ("sort_array() cannot handle arrays of arrays whose 1st elems\naren't strings/ints/floats\n");
+          }
+        sort_svalues (v, n, (dir < 0) ? builtin_sort_array_cmp_rev : builtin_sort_array_cmp_fwd,
+                      (dir >= 2 || dir <= -2) ? SORT_STABLE : 0);
+        return inlist;
+      }
+
+    default:
+      error
+        ("built-in sort_array() can only handle homogeneous arrays of strings/ints/floats/arrays\n");
+    }
+
+  /* equal strings, ints or floats can't be told apart, so reversing is fine */
+  if (dir < 0)
+    for (i = 0; i < n / 2; i++)
+      {
+        svalue_t tmp = v[i];
+
+        v[i] = v[n - 1 - i];
+        v[n - 1 - i] = tmp;
+      }
 
   return inlist;
 }
@@ -1296,8 +1418,7 @@ f_sort_array (void)
         process_efun_callback (1, &ftc, F_SORT_ARRAY);
 
         tmp = copy_array (tmp);
-        quickSort ((char *) tmp->item, tmp->size, sizeof (tmp->item),
-                   sort_array_cmp);
+        sort_svalues (tmp->item, tmp->size, sort_array_cmp, 0);
         sort_array_ftc = old_ptr;
         break;
       }
@@ -1427,12 +1548,108 @@ deep_inventory (object_t * ob, int take_top)
 static int alist_cmp (svalue_t * p1, svalue_t * p2) {
 
   if (p1->u.number != p2->u.number)
-    return (int)(p1->u.number - p2->u.number);
+    return p1->u.number < p2->u.number ? -1 : 1;
   if (p1->type != p2->type)
     return (int)(p1->type - p2->type);
   return 0;
 }
 
+/*
+ * Set operations on large arrays
+ *
+ * subtract_array() and intersect_array() compare svalues by identity, as
+ * alist_cmp() does: the same type and the same bits, with strings made
+ * shared so that equal strings are the same pointer.  Sorting an alist
+ * costs O(n log n) on every call, so from SET_HASH_THRESHOLD elements on
+ * the svalues go into a transient open addressing hash instead.
+ */
+#define SET_HASH_THRESHOLD 16
+
+typedef struct svalue_set_s {
+  svalue_t **slots;
+  uint32_t mask;
+} svalue_set_t;
+
+#define SVALUE_SET_HASH(v) MAP_POINTER_HASH ((v)->u.number)
+
+/*
+ * Copy the elements of an array for alist_cmp(): destructed objects are
+ * replaced by 0 (in the array, too) and strings are made shared.
+ */
+static svalue_t *set_elements (array_t * v) {
+
+  svalue_t *tab, *sv;
+  int j;
+
+  tab = CALLOCATE (v->size, svalue_t, TAG_TEMPORARY, "set_elements");
+  for (j = 0; j < v->size; j++)
+    {
+      sv = v->item + j;
+      if (sv->type == T_OBJECT && (sv->u.ob->flags & O_DESTRUCTED))
+        {
+          free_object (sv->u.ob, "set_elements");
+          tab[j] = *sv = const0;
+        }
+      else if (sv->type == T_STRING && sv->subtype != STRING_SHARED)
+        {
+          tab[j].type = T_STRING;
+          tab[j].subtype = STRING_SHARED;
+          tab[j].u.string = make_shared_string (sv->u.string);
+        }
+      else
+        assign_svalue_no_free (tab + j, sv);
+    }
+  return tab;
+}
+
+static void svalue_set_init (svalue_set_t * set, svalue_t * tab, int n) {
+
+  uint32_t size = 2, h;
+  int j;
+
+  while (size < (uint32_t) n * 2)
+    size <<= 1;
+  set->mask = size - 1;
+  set->slots = CALLOCATE (size, svalue_t *, TAG_TEMPORARY, "svalue_set_init");
+  memset (set->slots, 0, size * sizeof (svalue_t *));
+
+  for (j = 0; j < n; j++)
+    {
+      for (h = SVALUE_SET_HASH (tab + j) & set->mask; set->slots[h]; h = (h + 1) & set->mask)
+        if (!alist_cmp (set->slots[h], tab + j))
+          break;
+      set->slots[h] = tab + j;
+    }
+}
+
+static int svalue_set_member (svalue_set_t * set, svalue_t * v) {
+
+  uint32_t h;
+
+  for (h = SVALUE_SET_HASH (v) & set->mask; set->slots[h]; h = (h + 1) & set->mask)
+    if (set->slots[h]->u.number == v->u.number && set->slots[h]->type == v->type)
+      return 1;
+  return 0;
+}
+
+/* Binary search of a sorted alist. */
+static int alist_member (svalue_t * svt, int size, svalue_t * v) {
+
+  int l = 0, h = size - 1, o, d;
+
+  while (l <= h)
+    {
+      o = (l + h) >> 1;
+      if (!(d = alist_cmp (v, svt + o)))
+        return 1;
+      if (d < 0)
+        h = o - 1;
+      else
+        l = o + 1;
+    }
+  return 0;
+}
+
 static svalue_t* alist_sort (array_t * inlist) {
 
   int size, j, curix, parix, child1, child2, flag;
@@ -1550,8 +1767,9 @@ static svalue_t* alist_sort (array_t * inlist) {
 array_t* subtract_array (array_t * minuend, array_t * subtrahend) {
 
   array_t *difference;
-  svalue_t *source, *dest, *svt;
-  int i, size, o, d, l, h;
+  svalue_t *source, *dest, *svt, *key, stmp;
+  svalue_set_t set;
+  int i, size, hashed;
   ptrdiff_t msize;
 
   if (!(size = subtrahend->size))
@@ -1564,12 +1782,17 @@ array_t* subtract_array (array_t * minuend, array_t * subtrahend) {
       free_array (subtrahend);
       return &the_null_array;
     }
-  svt = alist_sort (subtrahend);
+  if ((hashed = (size >= SET_HASH_THRESHOLD)))
+    {
+      svt = set_elements (subtrahend);
+      svalue_set_init (&set, svt, size);
+    }
+  else
+    svt = alist_sort (subtrahend);
   difference = ALLOC_ARRAY (msize);
   for (source = minuend->item, dest = difference->item, i = (int)msize; i--; source++)
     {
-      l = 0;
-      o = (h = size - 1) >> 1;
+      key = source;
       if ((source->type == T_OBJECT) && (source->u.ob->flags & O_DESTRUCTED))
         {
           free_object (source->u.ob, "subtract_array");
@@ -1578,49 +1801,30 @@ array_t* subtract_array (array_t * minuend, array_t * subtrahend) {
       else if ((source->type == T_STRING)
                && !(source->subtype == STRING_SHARED))
         {
-          svalue_t stmp = { .type = T_STRING, STRING_SHARED };
-
+          /* a string that isn't shared can't be in the subtrahend */
+          stmp.type = T_STRING;
+          stmp.subtype = STRING_SHARED;
           if (!(stmp.u.string = findstring (source->u.string)))
             {
               assign_svalue_no_free (dest++, source);
               continue;
             }
-          while ((d = alist_cmp (&stmp, svt + o)))
-            {
-              if (d < 0)
-                h = o - 1;
-              else
-                l = o + 1;
-              if (l > h)
-                {
-                  assign_svalue_no_free (dest++, source);
-                  break;
-                }
-              o = (l + h) >> 1;
-            }
-          continue;
-        }
-
-      while ((d = alist_cmp (source, svt + o)))
-        {
-          if (d < 0)
-            h = o - 1;
-          else
-            l = o + 1;
-          if (l > h)
-            {
-              assign_svalue_no_free (dest++, source);
-              break;
-            }
-          o = (l + h) >> 1;
+          key = &stmp;
         }
 
+      if (!(hashed ? svalue_set_member (&set, key) : alist_member (svt, size, key)))
+        assign_svalue_no_free (dest++, source);
     }
   i = size;
   while (i--)
     free_svalue (svt + i, "subtract_array");
   FREE ((char *) svt);
-  if (subtrahend != &the_null_array)
+  if (hashed)
+    {
+      FREE ((char *) set.slots);
+      free_array (subtrahend);
+    }
+  else if (subtrahend != &the_null_array)
     {
       if (subtrahend->ref > 1)
         {
@@ -1643,7 +1847,7 @@ array_t* subtract_array (array_t * minuend, array_t * subtrahend) {
       return &the_null_array;
     }
   difference = RESIZE_ARRAY (difference, msize);
-  difference->size = (unsigned short)msize;
+  difference->size = (int)msize;
   difference->ref = 1;
 #ifdef ARRAY_STATS
   total_array_size += sizeof (array_t) + sizeof (svalue_t[1]) * (msize - 1);
@@ -1652,6 +1856,65 @@ array_t* subtract_array (array_t * minuend, array_t * subtrahend) {
   return difference;
 }
 
+/*
+ * intersect_array() of large arrays: the elements of a2 that are in a1, in
+ * the order of the alist of a2 that the merge of sorted alists gives.
+ */
+static array_t *intersect_array_hashed (array_t * a1, array_t * a2) {
+
+  array_t *a3;
+  svalue_t *svt_1, *sv, stmp;
+  svalue_set_t set;
+  int a1s = a1->size, a2s = a2->size, j, l = 0;
+
+  svt_1 = set_elements (a1);
+  svalue_set_init (&set, svt_1, a1s);
+
+  a3 = ALLOC_ARRAY (a2s);
+  for (j = 0; j < a2s; j++)
+    {
+      sv = a2->item + j;
+      if (sv->type == T_OBJECT && (sv->u.ob->flags & O_DESTRUCTED))
+        {
+          free_object (sv->u.ob, "intersect_array");
+          *sv = const0;
+        }
+      else if (sv->type == T_STRING && sv->subtype != STRING_SHARED)
+        {
+          stmp.type = T_STRING;
+          stmp.subtype = STRING_SHARED;
+          if (!(stmp.u.string = findstring (sv->u.string)))
+            continue;
+          sv = &stmp;
+        }
+      if (svalue_set_member (&set, sv))
+        assign_svalue_no_free (a3->item + l++, sv);
+    }
+
+  j = a1s;
+  while (j--)
+    free_svalue (svt_1 + j, "intersect_array");
+  FREE ((char *) svt_1);
+  FREE ((char *) set.slots);
+  free_array (a1);
+  free_array (a2);
+
+  if (!l)
+    {
+      FREE ((char *) a3);
+      return &the_null_array;
+    }
+  sort_svalues (a3->item, l, alist_cmp, 0);
+  a3 = RESIZE_ARRAY (a3, l);
+  a3->ref = 1;
+  a3->size = l;
+#ifdef ARRAY_STATS
+  total_array_size += sizeof (array_t) + (l - 1) * sizeof (svalue_t);
+  num_arrays++;
+#endif
+  return a3;
+}
+
 array_t *
 intersect_array (array_t * a1, array_t * a2)
 {
@@ -1666,6 +1929,8 @@ intersect_array (array_t * a1, array_t * a2)
       free_array (a2);
       return &the_null_array;
     }
+  if (a1s >= SET_HASH_THRESHOLD || a2s >= SET_HASH_THRESHOLD)
+    return intersect_array_hashed (a1, a2);
 
   svt_1 = alist_sort (a1);
   if ((flag = (a2->ref > 1)))
@@ -1835,7 +2100,7 @@ settle_business:
     }
   a3 = RESIZE_ARRAY (a3, l);
   a3->ref = 1;
-  a3->size = (unsigned short)l;
+  a3->size = l;
 #ifdef ARRAY_STATS
   total_array_size += sizeof (array_t) + (l - 1) * sizeof (svalue_t);
   num_arrays++;
@@ -1850,11 +2115,10 @@ match_single_regexp (char *str, char *pattern)
   int ret;
 
   regexp_user = EFUN_REGEXP;
-  reg = regcomp ((unsigned char *) pattern, 0);
+  reg = regcomp_cached (pattern, 0);
   if (!reg)
     error (regexp_error);
   ret = regexec (reg, str);
-  FREE ((char *) reg);
   return ret;
 }
 
@@ -1870,7 +2134,7 @@ match_regexp (array_t * v, char *pattern, int flag)
   regexp_user = EFUN_REGEXP;
   if (!(size = v->size))
     return &the_null_array;
-  reg = regcomp ((unsigned char *) pattern, 0);
+  reg = regcomp_cached (pattern, 0);
   if (!reg)
     error (regexp_error);
   res = (char *) DMALLOC (size, TAG_TEMPORARY, "match_regexp: res");
@@ -1916,7 +2180,6 @@ match_regexp (array_t * v, char *pattern, int flag)
         }
     }
   FREE (res);
-  FREE ((char *) reg);
   return ret;
 }
 
@@ -1993,66 +2256,43 @@ inherit_list (object_t * ob)
 
 array_t* children (char *str) {
 
-  int i, j;
-  int t_sz;
-  size_t sl, ol;
-  object_t *ob;
-  object_t **tmp_children;
+  int i = 0, n, hidden;
+  object_t *blueprint, *clones, *ob;
   array_t *ret;
   int display_hidden;
   char tmpbuf[MAX_OBJECT_NAME_SIZE];
 
-  display_hidden = -1;
   if (!strip_name (str, tmpbuf, sizeof tmpbuf))
     return &the_null_array;
 
-  sl = strlen (tmpbuf);
-
-  if (!(tmp_children = (object_t **)
-        DMALLOC (sizeof (object_t *) * (t_sz = 50),
-                 TAG_TEMPORARY, "children: tmp_children")))
-    return &the_null_array;	/* unable to malloc enough temp space */
-
-  for (i = 0, ob = obj_list; ob; ob = ob->next_all)
+  /* the object itself, then its clones, newest first */
+  blueprint = lookup_object_hash (tmpbuf);
+  clones = lookup_clones (tmpbuf, &n, &hidden);
+  if (blueprint)
     {
-      ol = strlen (ob->name);
-      if (((ol == sl) || ((ol > sl) && (ob->name[sl] == '#')))
-          && !strncmp (tmpbuf, ob->name, sl))
-        {
-          if (ob->flags & O_HIDDEN)
-            {
-              if (display_hidden == -1)
-                {
-                  display_hidden = valid_hide (current_object);
-                }
-              if (!display_hidden)
-                continue;
-            }
-          tmp_children[i] = ob;
-          if ((++i == t_sz) && (!(tmp_children
-                                  =
-                                  RESIZE (tmp_children, (t_sz += 50),
-                                          object_t *, TAG_TEMPORARY,
-                                          "children: tmp_children: realloc"))))
-            {
-              /* unable to REALLOC more space 
-               * (tmp_children is now NULL) */
-              return &the_null_array;
-            }
-        }
+      n++;
+      if (blueprint->flags & O_HIDDEN)
+        hidden++;
     }
-  if (i > CONFIG_INT (__MAX_ARRAY_SIZE__))
+
+  display_hidden = !hidden || valid_hide (current_object);
+  if (!display_hidden)
+    n -= hidden;
+  if (n > CONFIG_INT (__MAX_ARRAY_SIZE__))
     {
-      i = CONFIG_INT (__MAX_ARRAY_SIZE__);
+      n = CONFIG_INT (__MAX_ARRAY_SIZE__);
     }
-  ret = allocate_empty_array (i);
-  for (j = 0; j < i; j++)
+  ret = allocate_empty_array (n);
+  for (ob = blueprint ? blueprint : clones; ob && i < n;
+       ob = (ob == blueprint) ? clones : ob->next_clone)
     {
-      ret->item[j].type = T_OBJECT;
-      ret->item[j].u.ob = tmp_children[j];
-      add_ref (tmp_children[j], "children");
+      if ((ob->flags & O_HIDDEN) && !display_hidden)
+        continue;
+      ret->item[i].type = T_OBJECT;
+      ret->item[i].u.ob = ob;
+      add_ref (ob, "children");
+      i++;
     }
-  FREE ((void *) tmp_children);
   return ret;
 }
 
@@ -2122,7 +2362,9 @@ f_objects (void)
   else
     func = sp->u.string;
 
-  if (!(tmp = (object_t **) new_string ((t_sz = 1000) * sizeof (object_t *),
+  /* room for every object, so the buffer normally doesn't have to grow */
+  t_sz = tot_alloc_object > 1000 ? (int) tot_alloc_object + 1 : 1000;
+  if (!(tmp = (object_t **) new_string (t_sz * sizeof (object_t *),
                                         "TMP: objects: tmp")))
     fatal ("Out of memory!\n");
 
@@ -2174,8 +2416,8 @@ f_objects (void)
           if (!
               (tmp =
                (object_t **) extend_string ((char *) tmp,
-                                            (t_sz +=
-                                             1000) * sizeof (object_t *))))
+                                            (t_sz *=
+                                             2) * sizeof (object_t *))))
             fatal ("Out of memory!\n");
           else
             sp->u.string = (char *) tmp;
@@ -2245,16 +2487,19 @@ reg_assoc (char *str, array_t * pat, array_t * tok, svalue_t * def)
       int index;
       struct regexp *tmpreg;
       char *laststart, *currstart;
+      /* all patterns must stay in the cache until we're done */
+      int cached = size <= REGEXP_CACHE_SIZE;
 
       rgpp =
         CALLOCATE (size, struct regexp *, TAG_TEMPORARY, "reg_assoc : rgpp");
       for (i = 0; i < size; i++)
         {
           if (!
-              (rgpp[i] =
+              (rgpp[i] = cached ?
+               regcomp_cached (pat->item[i].u.string, 0) :
                regcomp ((unsigned char *) pat->item[i].u.string, 0)))
             {
-              while (i--)
+              while (!cached && i--)
                 FREE ((char *) rgpp[i]);
               FREE ((char *) rgpp);
               free_empty_array (ret);
@@ -2357,7 +2602,7 @@ reg_assoc (char *str, array_t * pat, array_t * tok, svalue_t * def)
       sv1->subtype = STRING_MALLOC;
       sv1->u.string = string_copy (tmp, "reg_assoc");
       assign_svalue_no_free (sv2, def);
-      for (i = 0; i < size; i++)
+      for (i = 0; !cached && i < size; i++)
         FREE ((char *) rgpp[i]);
       FREE ((char *) rgpp);
 
@@ -2,11 +2,11 @@
 #include "types.h"
 
 struct array_s {
-    unsigned short ref;
+    uint32_t ref;
 #ifdef DEBUG
     int extra_ref;
 #endif
-    unsigned short size;
+    int size;
     svalue_t item[1];
 };
 
@@ -2293,7 +2293,7 @@ static program_t *epilog ()
     }
 #endif
 #ifdef BINARIES
-  if ((pragmas & PRAGMA_SAVE_BINARY)
+  if ((pragmas & PRAGMA_SAVE_BINARY) || save_all_binaries
 #ifdef LPC_TO_C
       || compile_to_c
 #endif
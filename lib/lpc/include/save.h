@@ -0,0 +1,8 @@
+#ifndef	LPC_SAVE_H
+#define	LPC_SAVE_H
+
+/* flags of save_object() and async_save_object() */
+#define SAVE_ZEROS	1	/* also save variables that are 0 */
+#define SAVE_BINARY	2	/* compact binary format, detected by restore_object() */
+
+#endif	/* LPC_SAVE_H */
@@ -14,6 +14,8 @@
  *   Added get_array_block()...using @@ENDMARKER to return array of strings
  */
 
+#include <sys/stat.h>
+
 #define SUPPRESS_COMPILER_INLINES
 #include "src/std.h"
 #include "rc.h"
@@ -77,10 +79,28 @@ static int nexpands = 0;
 char yytext[MAXLINE];
 static char *outptr;
 
+/*
+ * Contents of a header file.  Shared between the include cache and every
+ * #include currently reading from it, so a header can be reloaded while
+ * an older copy is still being lexed.
+ */
+typedef struct include_data_s
+{
+  int ref;
+  size_t size;
+  char text[1];
+}
+include_data_t;
+
+static include_data_t *yyin_data;	/* header being read, or NULL */
+static size_t yyin_pos;			/* read position in yyin_data */
+
 typedef struct incstate_s
 {
   struct incstate_s *next;
   int yyin_desc;
+  include_data_t *yyin_data;
+  size_t yyin_pos;
   int line;
   char *file;
   int file_id;
@@ -193,7 +213,8 @@ static void add_quoted_predefine (char *, char *);
 static void lexerror (char *);
 static int skip_to (char *, char *);
 static void handle_cond (int);
-static int inc_open (char *, const char *);
+static include_data_t *inc_open (char *, const char *);
+static void free_include_data (include_data_t *);
 static void handle_include (const char *, int);
 static int get_terminator (char *);
 static int get_array_block (char *);
@@ -205,6 +226,7 @@ static void handle_pragma (char *);
 static int cmygetc (void);
 static void refill (void);
 static void refill_buffer (void);
+static size_t read_input (char *, size_t);
 static int exgetc (void);
 static int old_func (void);
 static void yyerrorp (char *);
@@ -370,23 +392,170 @@ static int skip_to (char *token, char *atoken)
     }
 }
 
+/*
+ * Include cache.  Every object includes the same few headers, often from
+ * several directories of the search path, so the contents of each header
+ * and the paths that don't exist are kept by path name.  Like the stat()
+ * cache of binaries.c, an entry is trusted within the second it was
+ * checked in; after that a stat() tells whether the file changed.
+ */
+#define INCLUDE_CACHE_SIZE 256		/* must be a power of 2 */
+#define INCLUDE_CACHE_MAX_BYTES (4 * 1024 * 1024)
+
+typedef struct include_cache_entry_s
+{
+  struct include_cache_entry_s *next;
+  time_t checked;		/* when the file was last stat()'ed */
+  time_t mtime;
+  off_t size;
+  include_data_t *data;		/* NULL if the file doesn't exist */
+  char name[1];
+}
+include_cache_entry_t;
+
+static include_cache_entry_t *include_cache[INCLUDE_CACHE_SIZE];
+static size_t include_cache_bytes = 0;
+
+unsigned long include_cache_hits = 0;	/* served without reading the file */
+unsigned long include_cache_misses = 0;	/* read from the file */
+unsigned long include_cache_entries = 0;
+
+static void free_include_data (include_data_t *data) {
+  if (data && --data->ref == 0)
+    FREE (data);
+}
+
+/**
+ * @brief Drop all cached headers.
+ * Headers that are still being read are freed when the #include ends.
+ */
+void clear_include_cache (void) {
+  int i;
+
+  for (i = 0; i < INCLUDE_CACHE_SIZE; i++)
+    {
+      while (include_cache[i])
+        {
+          include_cache_entry_t *entry = include_cache[i];
+
+          include_cache[i] = entry->next;
+          free_include_data (entry->data);
+          FREE (entry);
+        }
+    }
+  include_cache_bytes = 0;
+  include_cache_entries = 0;
+}
+
+static include_data_t *read_include (const char *name, off_t size) {
+  include_data_t *data;
+  size_t len = 0;
+  int fd, n;
+
+  if ((fd = FILE_OPEN (name, O_RDONLY)) == -1)
+    return NULL;
+  data = (include_data_t *) DXALLOC (sizeof (include_data_t) + size, TAG_COMPILER, "read_include");
+  while (len < (size_t) size && (n = FILE_READ (fd, data->text + len, (unsigned int) (size - len))) > 0)
+    len += n;
+  FILE_CLOSE (fd);
+  data->ref = 1;
+  data->size = len;
+  opt_trace (TT_COMPILE|3, "read %zu bytes: \"%s\"", len, name);
+  return data;
+}
+
+/**
+ * @brief Look up a header file.
+ * @param name Path of the file, relative to the mudlib directory.
+ * @return Contents of the file with a reference added, or NULL if the file
+ *         doesn't exist.
+ */
+static include_data_t *include_cache_lookup (const char *name) {
+  size_t len = strlen (name);
+  time_t now = time (NULL);
+  include_cache_entry_t **bucket = &include_cache[strhash64 (name, len) & (INCLUDE_CACHE_SIZE - 1)];
+  include_cache_entry_t *entry;
+  struct stat st;
+
+  for (entry = *bucket; entry; entry = entry->next)
+    if (strcmp (entry->name, name) == 0)
+      break;
+
+  if (entry && entry->checked == now)
+    {
+      include_cache_hits++;
+      if (!entry->data)
+        return NULL;
+      entry->data->ref++;
+      return entry->data;
+    }
+
+  if (stat (name, &st) == -1 || !S_ISREG (st.st_mode))
+    {
+      st.st_mtime = 0;
+      st.st_size = -1;
+    }
+  if (entry && entry->mtime == st.st_mtime && entry->size == st.st_size)
+    {
+      /* unchanged since last time */
+      entry->checked = now;
+      include_cache_hits++;
+      if (!entry->data)
+        return NULL;
+      entry->data->ref++;
+      return entry->data;
+    }
+
+  if (!entry)
+    {
+      if (include_cache_bytes > INCLUDE_CACHE_MAX_BYTES)
+        clear_include_cache ();
+      entry = (include_cache_entry_t *) DXALLOC (sizeof (include_cache_entry_t) + len, TAG_COMPILER, "include_cache_lookup");
+      memcpy (entry->name, name, len + 1);
+      entry->data = NULL;
+      entry->next = *bucket;
+      *bucket = entry;
+      include_cache_entries++;
+    }
+  else if (entry->data)
+    {
+      include_cache_bytes -= entry->data->size;
+      free_include_data (entry->data);
+      entry->data = NULL;
+    }
+
+  include_cache_misses++;
+  entry->checked = now;
+  entry->mtime = st.st_mtime;
+  entry->size = st.st_size;
+  if (st.st_size < 0 || !(entry->data = read_include (name, st.st_size)))
+    {
+      entry->size = -1;
+      return NULL;
+    }
+  include_cache_bytes += entry->data->size;
+  entry->data->ref++;
+  return entry->data;
+}
+
 /**
  * @brief Try to open an include file.
  * @param buf Buffer to store the normalized path.
  * @param name Argument of the #include directive.
  *             If it contains dot or dot-dot in the path, it is normalized using current_file as the base.
- * @return File descriptor, or -1 on failure.
+ * @return Contents of the file, or NULL on failure.
  */
-static int inc_open (char *buf, const char *name) {
+static include_data_t *inc_open (char *buf, const char *name) {
 
-  int i, fd;
+  int i;
   char *p;
+  include_data_t *data;
 
   inc_lexically_normal (current_file, name, buf);
-  if ((fd = FILE_OPEN (buf, O_RDONLY)) != -1)
+  if ((data = include_cache_lookup (buf)))
     {
-      opt_trace (TT_COMPILE|3, "opened (fd %d): \"%s\"", fd, buf);
-      return fd;
+      opt_trace (TT_COMPILE|3, "opened: \"%s\"", buf);
+      return data;
     }
   /*
    * Search all include dirs specified.
@@ -394,7 +563,7 @@ static int inc_open (char *buf, const char *name) {
   for (p = strchr (name, '.'); p; p = strchr (p + 1, '.'))
     {
       if (p[1] == '.')
-        return -1;
+        return NULL;
     }
   for (i = 0; i < inc_list_size; i++)
     {
@@ -403,13 +572,13 @@ static int inc_open (char *buf, const char *name) {
       if (inc_list[i] == 0)
         continue;
       sprintf (buf, "%s/%s", inc_list[i], name);
-      if ((fd = FILE_OPEN (buf, O_RDONLY)) != -1)
+      if ((data = include_cache_lookup (buf)))
         {
-          opt_trace (TT_COMPILE|3, "opened (fd %d): \"%s\"", fd, buf);
-          return fd;
+          opt_trace (TT_COMPILE|3, "opened: \"%s\"", buf);
+          return data;
         }
     }
-  return -1;
+  return NULL;
 }
 
 #define include_error(x) do {\
@@ -423,7 +592,8 @@ static void handle_include (const char *inc_name, int optional) {
   char fname[PATH_MAX];
   static char buf[1024];
   incstate_t *is;
-  int delim, fd;
+  include_data_t *data;
+  int delim;
 
   /* need a writable copy */
   fname[sizeof(fname)-1] = 0;
@@ -471,10 +641,12 @@ static void handle_include (const char *inc_name, int optional) {
     {
       include_error ("Maximum include depth exceeded");
     }
-  else if ((fd = inc_open (buf, name)) != -1) /* open header file */
+  else if ((data = inc_open (buf, name))) /* open header file */
     {
       is = ALLOCATE (incstate_t, TAG_COMPILER, "handle_include: 1");
       is->yyin_desc = yyin_desc;
+      is->yyin_data = yyin_data;
+      is->yyin_pos = yyin_pos;
       is->line = current_line;
       is->file = current_file;
       is->file_id = current_file_id;
@@ -489,7 +661,9 @@ static void handle_include (const char *inc_name, int optional) {
       current_line = 1;
       current_file = make_shared_string (buf);
       current_file_id = add_program_file (buf, 0);
-      yyin_desc = fd;
+      yyin_desc = -1;
+      yyin_data = data;
+      yyin_pos = 0;
       refill_buffer ();
     }
   else if (!optional)
@@ -1052,6 +1226,29 @@ char* show_error_context () {
   return buf;
 }
 
+/* Read up to max_read bytes of the current file, returns the number read. */
+static size_t read_input (char *p, size_t max_read) {
+  size_t size = 0;
+
+  if (yyin_data)
+    {
+      size = yyin_data->size - yyin_pos;
+      if (size > max_read)
+        size = max_read;
+      memcpy (p, yyin_data->text + yyin_pos, size);
+      yyin_pos += size;
+      return size;
+    }
+  while (size < max_read)
+    {
+      int n = FILE_READ (yyin_desc, p + size, (unsigned int) (max_read - size));
+      if (n <= 0)
+        break;
+      size += n;
+    }
+  return size;
+}
+
 static void refill_buffer () {
   if (cur_lbuf != &head_lbuf)
     {
@@ -1097,15 +1294,7 @@ static void refill_buffer () {
 
         if (yyin_desc != -1)
           {
-            unsigned int max_read = MAXLINE;
-            for (size = 0; max_read > 0; )
-              {
-                int n = FILE_READ (yyin_desc, p + size, max_read);
-                if (n <= 0)
-                  break;
-                size += n;
-                max_read -= n;
-              }
+            size = read_input (p, MAXLINE);
             cur_lbuf->buf_end = p += size;
           }
         else
@@ -1173,25 +1362,10 @@ static void refill_buffer () {
             flag = 1;
           }
 
-        if (yyin_desc != -1)
-          {
-            unsigned int max_read = MAXLINE;
-            for (size = 0; max_read > 0; )
-              {
-                int n = FILE_READ (yyin_desc, p + size, max_read);
-                if (n <= 0)
-                  break;
-                size += n;
-                max_read -= n;
-              }
-            end = p += size;
-            if (flag)
-              cur_lbuf->buf_end = p;
-          }
-        else
-          {
-            size = 0;
-          }
+        size = read_input (p, MAXLINE);
+        end = p += size;
+        if (flag)
+          cur_lbuf->buf_end = p;
         if (size < MAXLINE)
           {
             *(last_nl = p) = LEX_EOF;
@@ -1289,8 +1463,8 @@ int yylex () {
               incstate_t *p;
 
               p = inctop;
-              close (yyin_desc);
-              opt_trace (TT_COMPILE|3, "closed (fd %d): \"%s\"", yyin_desc,
+              free_include_data (yyin_data);
+              opt_trace (TT_COMPILE|3, "closed: \"%s\"",
                          current_file ? current_file : "<unknown>");
               save_file_info (current_file_id, current_line - current_line_saved);
               current_line_saved = p->line - 1;
@@ -1314,6 +1488,8 @@ int yylex () {
               current_line = p->line;
 
               yyin_desc = p->yyin_desc;
+              yyin_data = p->yyin_data;
+              yyin_pos = p->yyin_pos;
               last_nl = p->last_nl;
               outptr = p->outptr;
               inctop = p->next;
@@ -2454,11 +2630,13 @@ void end_new_file () {
       incstate_t *p;
 
       p = inctop;
-      close (yyin_desc);
-      opt_trace (TT_COMPILE|3, "closed fd = %d (%s)\n", yyin_desc, current_file);
+      free_include_data (yyin_data);
+      opt_trace (TT_COMPILE|3, "closed: \"%s\"", current_file);
       free_string (current_file);
       current_file = p->file;
       yyin_desc = p->yyin_desc;
+      yyin_data = p->yyin_data;
+      yyin_pos = p->yyin_pos;
       inctop = p->next;
       FREE ((char *) p);
     }
@@ -2562,6 +2740,7 @@ void start_new_file (int fd, const char* pre_text) {
       FREE (dir);
     }
   yyin_desc = fd; /* lexer input file descriptor */
+  yyin_data = NULL;
   lex_fatal = 0;
   last_function_context = -1;
   current_function_context = 0;
@@ -2619,6 +2798,8 @@ static void int_add_instr_name (char *name, int n, short t) {
  */
 void init_instrs () {
   int i, n;
+  /* the alias flag is stripped from the tokens, so remember it for the next call */
+  static char is_alias[NELEM (predefs)];
 
   for (i = 0; i < BASE; i++)
     {
@@ -2630,8 +2811,9 @@ void init_instrs () {
       if (n & F_ALIAS_FLAG)
         {
           predefs[i].token ^= F_ALIAS_FLAG;
+          is_alias[i] = 1;
         }
-      else
+      else if (!is_alias[i])
         {
           instrs[n].min_arg = predefs[i].min_args;
           instrs[n].max_arg = predefs[i].max_args;
@@ -2692,6 +2874,10 @@ void init_instrs () {
   add_instr_name ("real", 0, F_REAL, T_REAL);
   add_instr_name ("local_lvalue", "C_LVALUE(fp + %i);\n", F_LOCAL_LVALUE, T_LVALUE);
   add_instr_name ("while_dec", "C_WHILE_DEC(%i); if (lpc_int)\n", F_WHILE_DEC, -1);
+  add_instr_name ("add_locals", 0, F_ADD_LOCALS, T_ANY);
+  add_instr_name ("return_local", 0, F_RETURN_LOCAL, -1);
+  add_instr_name ("global_branch_when_zero", 0, F_GLOBAL_BRANCH_WHEN_ZERO, -1);
+  add_instr_name ("local_index_lvalue", 0, F_LOCAL_INDEX_LVALUE, T_LVALUE | T_LVALUE_BYTE);
   add_instr_name ("const1", "push_number(1);\n", F_CONST1, T_NUMBER);
   add_instr_name ("subtract", "c_subtract();\n", F_SUBTRACT, T_NUMBER | T_REAL | T_ARRAY);
   add_instr_name ("(void)assign", "c_void_assign();\n", F_VOID_ASSIGN, T_NUMBER);
@@ -2711,6 +2897,7 @@ void init_instrs () {
   add_instr_name ("branch_when_zero", 0, F_BRANCH_WHEN_ZERO, -1);
   add_instr_name ("branch_when_non_zero", 0, F_BRANCH_WHEN_NON_ZERO, -1);
   add_instr_name ("pop", "pop_stack();\n", F_POP_VALUE, -1);
+  add_instr_name ("push", 0, F_PUSH, -1);
   add_instr_name ("const0", "push_number(0);\n", F_CONST0, T_NUMBER);
 #ifdef F_JUMP_WHEN_ZERO
   add_instr_name ("jump_when_zero", F_JUMP_WHEN_ZERO, -1);
@@ -3437,6 +3624,8 @@ void set_inc_list (const char *list) {
  */
 void reset_inc_list (void) {
   int i;
+
+  clear_include_cache ();
   if (inc_list)
     {
       for (i = 0; i < inc_list_size; i++)
@@ -110,6 +110,10 @@ const char *query_opcode_name(int);
 
 void set_inc_list(const char *);
 void reset_inc_list(void);
+void clear_include_cache(void);
+extern unsigned long include_cache_hits;
+extern unsigned long include_cache_misses;
+extern unsigned long include_cache_entries;
 
 void start_new_file(int fd, const char* pre_text);
 void end_new_file(void);
@@ -15,80 +15,300 @@ int num_mappings = 0;
 int total_mapping_size = 0;
 int total_mapping_nodes = 0;
 
-static int node_hash (mapping_node_t * mn)
-{
-  return (int)MAP_POINTER_HASH (mn->values[0].u.number);
+/* nodes indexed into the new hash index per insertion or deletion */
+#define REHASH_STEP 8
+
+#define NODE_DELETED(n)	((n)->values[0].type == T_INVALID)
+#define NODE_HASH(n)	MAP_POINTER_HASH ((n)->values[0].u.number)
+
+static map_slot_t *alloc_table (uint32_t size) {
+
+  map_slot_t *a;
+
+  a = CALLOCATE (size, map_slot_t, TAG_MAP_TBL, "alloc_table");
+  if (!a)
+    error ("Allocate_mapping - out of memory.\n");
+  memset (a, 0, size * sizeof (map_slot_t));
+  total_mapping_size += (int)(size * sizeof (map_slot_t));
+  return a;
+}
+
+static void free_table (map_slot_t *a, uint32_t mask) {
+  total_mapping_size -= (int)((mask + 1) * sizeof (map_slot_t));
+  FREE ((char *) a);
 }
 
 /**
-  @brief based on hash.c:hsplit() from Larry Wall's Perl.
+ * @brief Add a node to a hash index, Robin Hood style.
+ * A new slot takes the place of any slot that is closer to its home
+ * position; the displaced slot moves on.  This keeps the probe sequences
+ * short and even at high load.
+ */
+static void index_node (map_slot_t *table, uint32_t mask, uint32_t hash, uint32_t node) {
 
-  growMap doubles the size of the hash table.  It is called when FILL_PERCENT
-  of the buckets in the hash table contain values.  This routine is
-  efficient since the entries in the table don't need to be rehashed (even
-  though the entries are redistributed across the both halves of the hash
-  table).
-*/
-int growMap (mapping_t * m) {
+  map_slot_t ins, tmp;
+  uint32_t i = hash & mask, dist = 0, d;
 
-  int oldsize = m->table_size + 1;
-  int newsize = oldsize << 1;
-  int i;
-  mapping_node_t **a, **b, **eltp, *elt;
+  ins.hash = hash;
+  ins.node = node + 1;
+  for (;; i = (i + 1) & mask, dist++)
+    {
+      if (!table[i].node)
+        {
+          table[i] = ins;
+          return;
+        }
+      d = (i - table[i].hash) & mask;	/* probe distance of the occupant */
+      if (d < dist)
+        {
+          tmp = table[i];
+          table[i] = ins;
+          ins = tmp;
+          dist = d;
+        }
+    }
+}
 
-  if (newsize > MAX_TABLE_SIZE)
-    return 0;
-  /* resize the hash table to be twice the old size */
-  a = RESIZE (m->table, newsize, mapping_node_t *, TAG_MAP_TBL, "growMap");
-  if (!a)
+/**
+ * @brief Remove a slot from a hash index.
+ * The following slots of the cluster are shifted back, no tombstones.
+ */
+static void unindex_slot (map_slot_t *table, uint32_t mask, map_slot_t *slot) {
+
+  uint32_t i = (uint32_t)(slot - table), next;
+
+  for (;; i = next)
     {
-      /*
-         We couldn't grow the hash table.  Rather than die, we just
-         accept the performance hit resulting from having an overfull
-         table.
-       */
-      return 0;
+      next = (i + 1) & mask;
+      if (!table[next].node || ((next - table[next].hash) & mask) == 0)
+        break;
+      table[i] = table[next];
     }
+  table[i].node = 0;
+}
 
-  m->table = a;
+/* Keys are compared like msameval(), shared strings by address only. */
+static inline int same_key (svalue_t *k, svalue_t *key) {
+  if (key->type == T_STRING)
+    return k->type == T_STRING && k->u.string == key->u.string;
+  return k->type != T_INVALID && msameval (k, key);
+}
 
-  /* hash table doubles in size -- keep track of the memory used */
-  total_mapping_size += oldsize * sizeof (mapping_node_t *);
+static map_slot_t *probe_table (mapping_t *m, map_slot_t *table, uint32_t mask, svalue_t *key, uint32_t hash) {
 
-  m->unfilled = (unsigned short)oldsize * (unsigned) FILL_PERCENT / (unsigned) 100;
-  m->table_size = (unsigned short)newsize - 1;
+  uint32_t i = hash & mask, dist = 0;
 
-  /* zero out the new storage area (2nd half of table) */
-  a += oldsize;
-  memset (a, 0, oldsize * sizeof (mapping_node_t *));
-  i = oldsize;
-  while (a--, i--)
+  for (;; i = (i + 1) & mask, dist++)
     {
-      if (!(elt = *a))
-        continue;
+      map_slot_t *slot = table + i;
 
-      eltp = a;
-      b = a + oldsize;
+      /* stop where the key would have displaced the occupant */
+      if (!slot->node || ((i - slot->hash) & mask) < dist)
+        return NULL;
+      if (slot->hash == hash && same_key (map_node (m, slot->node - 1)->values, key))
+        return slot;
+    }
+}
+
+/**
+ * @brief Look up the node of a key.
+ * @param slotp Set to the slot in the current hash index, or to NULL if the
+ *   node was found through the old index of a resize in progress.
+ * @return The node, or NULL if not found.
+ */
+static mapping_node_t *lookup_node (mapping_t *m, svalue_t *key, uint32_t hash, map_slot_t **slotp) {
+
+  map_slot_t *slot;
+
+  if ((slot = probe_table (m, m->table, m->table_size, key, hash)))
+    {
+      if (slotp)
+        *slotp = slot;
+      return map_node (m, slot->node - 1);
+    }
+  /* Not indexed yet.  The old index still has slots of deleted nodes, but
+   * same_key() never matches a deleted node.
+   */
+  if (m->old_table && (slot = probe_table (m, m->old_table, m->old_table_size, key, hash)))
+    {
+      if (slotp)
+        *slotp = NULL;
+      return map_node (m, slot->node - 1);
+    }
+  return NULL;
+}
 
-      do
+/**
+ * @brief Index up to \p n more nodes into the new hash index.
+ * The old index is freed when all nodes have been indexed.
+ */
+static void rehash_step (mapping_t *m, uint32_t n) {
+
+  mapping_node_t *node;
+
+  for (; n && m->rehash_pos < m->rehash_end; n--, m->rehash_pos++)
+    {
+      node = map_node (m, m->rehash_pos);
+      if (!NODE_DELETED (node))
+        index_node (m->table, m->table_size, NODE_HASH (node), m->rehash_pos);
+    }
+  if (m->rehash_pos >= m->rehash_end)
+    {
+      free_table (m->old_table, m->old_table_size);
+      m->old_table = NULL;
+    }
+}
+
+/**
+ * @brief Replace the hash index with one twice as large.
+ * The nodes are indexed into the new one by later calls to rehash_step().
+ */
+static void grow_table (mapping_t *m) {
+
+  uint32_t size = m->table_size + 1;
+
+  if (m->old_table)
+    rehash_step (m, UINT32_MAX);	/* finish the previous resize first */
+  while ((uint32_t) m->count * 2 >= size)
+    size <<= 1;
+
+  m->old_table = m->table;
+  m->old_table_size = m->table_size;
+  m->rehash_pos = 0;
+  m->rehash_end = m->fill;
+  m->table = alloc_table (size);
+  m->table_size = size - 1;
+  rehash_step (m, REHASH_STEP);
+}
+
+static void add_chunk (mapping_t *m) {
+
+  uint32_t size = MAP_CHUNK_MIN << m->num_chunks;
+
+  if (m->num_chunks >= MAP_MAX_CHUNKS)
+    mapping_too_large ();
+  m->chunks = RESIZE (m->chunks, m->num_chunks + 1, mapping_node_t *, TAG_MAP_TBL, "add_chunk");
+  m->chunks[m->num_chunks++] = CALLOCATE (size, mapping_node_t, TAG_MAP_NODE_BLOCK, "add_chunk");
+  total_mapping_size += (int)(size * sizeof (mapping_node_t) + sizeof (mapping_node_t *));
+}
+
+/* mappings with many deleted nodes, to be compacted by compact_mappings() */
+static mapping_t *compact_list = NULL;
+
+/**
+ * @brief Squeeze out the deleted nodes and rebuild the hash index.
+ * The nodes keep their order.  This moves nodes, so it must not be done
+ * while a pointer to a value can be held, as the lvalue of an assignment
+ * in progress.  Chunks that are no longer needed are freed.
+ */
+static void compact_nodes (mapping_t *m) {
+
+  mapping_node_t *from, *to;
+  uint32_t i, j, size;
+  int keep;
+
+  if (m->old_table)
+    rehash_step (m, UINT32_MAX);
+  memset (m->table, 0, (m->table_size + 1) * sizeof (map_slot_t));
+  for (i = j = 0; i < m->fill; i++)
+    {
+      from = map_node (m, i);
+      if (NODE_DELETED (from))
+        continue;
+      to = from;
+      if (i != j)
         {
-          if (node_hash (elt) & oldsize)
-            {
-              *eltp = elt->next;
-              if (!(elt->next = *b))
-                m->unfilled--;
-              *b = elt;
-              elt = *eltp;
-            }
-          else
-            elt = *(eltp = &elt->next);
+          to = map_node (m, j);
+          *to = *from;
+          from->values[0].type = T_INVALID;
         }
-      while (elt);
+      index_node (m->table, m->table_size, NODE_HASH (to), j);
+      j++;
+    }
+  m->fill = j;
 
-      if (!*a)
-        m->unfilled++;
+  /* keep one chunk past the ones in use, for the insertions to come */
+  for (keep = 2; MAP_CHUNK_MIN * ((1U << (keep - 1)) - 1) < m->fill; keep++)
+    ;
+  while (m->num_chunks > keep)
+    {
+      size = MAP_CHUNK_MIN << --m->num_chunks;
+      FREE ((char *) m->chunks[m->num_chunks]);
+      total_mapping_size -= (int)(size * sizeof (mapping_node_t) + sizeof (mapping_node_t *));
     }
-  return 1;
+}
+
+/**
+ * @brief Compact the mappings that filled up with deleted nodes.
+ * Insertions never move nodes, since the lvalue of an assignment may point
+ * into the mapping, as in m[a] = (m[b] = x).  They only put the mapping on
+ * a list, and the nodes are moved here, between evaluations, when no lvalue
+ * can be held.
+ */
+void compact_mappings (void) {
+
+  mapping_t *m;
+
+  while ((m = compact_list))
+    {
+      compact_list = m->next_compact;
+      m->next_compact = NULL;
+      m->compact_pending = 0;
+      compact_nodes (m);
+    }
+}
+
+/**
+ * @brief Append a node for a key that is not in the mapping and index it.
+ * The node is uninitialized.  Other nodes don't move.
+ */
+static mapping_node_t *new_node (mapping_t *m, uint32_t hash) {
+
+  mapping_node_t *node;
+
+  if (((uint32_t) m->count + 1) * 8 > (m->table_size + 1) * MAP_FILL_EIGHTHS)
+    grow_table (m);
+  else if (m->old_table)
+    rehash_step (m, REHASH_STEP);
+
+  if (m->fill == MAP_CAPACITY (m))
+    {
+      /* reclaim the space of deleted nodes later if there's a lot of it */
+      if (m->fill && (m->fill - (uint32_t) m->count) * 2 >= m->fill && !m->compact_pending)
+        {
+          m->compact_pending = 1;
+          m->next_compact = compact_list;
+          compact_list = m;
+        }
+      add_chunk (m);
+    }
+
+  node = map_node (m, m->fill);
+  index_node (m->table, m->table_size, hash, m->fill);
+  m->fill++;
+  m->count++;
+  total_mapping_nodes++;
+  return node;
+}
+
+/**
+ * @brief Free the key and value of a node and remove it from the mapping.
+ * Other nodes don't move, so this is safe while iterating over the nodes.
+ */
+static void delete_node (mapping_t *m, mapping_node_t *node, map_slot_t *slot) {
+
+  if (slot)
+    unindex_slot (m->table, m->table_size, slot);
+  free_svalue (node->values + 1, "delete_node");
+  free_svalue (node->values, "delete_node");
+  node->values[0].type = T_INVALID;
+  m->count--;
+  total_mapping_nodes--;
+
+  if (m->old_table)
+    rehash_step (m, REHASH_STEP);
+  else if (!m->count)
+    m->fill = 0;		/* empty, start over at the first chunk */
 }
 
 /*
@@ -97,22 +317,23 @@ int growMap (mapping_t * m) {
   specifics of the particular data structure being used so that it won't be
   so difficult to change the data structure if the need arises.
   -- Truilkan 92/07/19
+
+  The elements are visited in insertion order.  'func' may delete the
+  element it was called with.
 */
 mapping_t *mapTraverse (mapping_t * m, int (*func) (mapping_t *, mapping_node_t *, void *), void *extra) {
 
-  mapping_node_t *elt, *nelt;
-  int j = (int) m->table_size;
+  mapping_node_t *elt;
+  uint32_t i;
 
-  do
+  for (i = 0; i < m->fill; i++)
     {
-      for (elt = m->table[j]; elt; elt = nelt)
-        {
-          nelt = elt->next;
-          if ((*func) (m, elt, extra))
-            return m;
-        }
+      elt = map_node (m, i);
+      if (NODE_DELETED (elt))
+        continue;
+      if ((*func) (m, elt, extra))
+        break;
     }
-  while (j--);
   return m;
 }
 
@@ -120,31 +341,40 @@ mapping_t *mapTraverse (mapping_t * m, int (*func) (mapping_t *, mapping_node_t
 
 void dealloc_mapping (mapping_t * m) {
 
-  num_mappings--;
-  {
-    int j = m->table_size, c = m->count;
-    mapping_node_t *elt, *nelt, **a = m->table;
-
-    total_mapping_size -= (sizeof (mapping_t) + sizeof (mapping_node_t *) * (j + 1) + sizeof (mapping_node_t) * c);
-    total_mapping_nodes -= c;
-
-    do
-      {
-        for (elt = a[j]; elt; elt = nelt)
-          {
-            nelt = elt->next;
-            free_svalue (elt->values + 1, "free_mapping");
-            free_svalue (elt->values, "free_mapping");
-            free_node (elt);
-
-          }
-      }
-    while (j--);
+  mapping_node_t *elt;
+  uint32_t i;
+  int c;
 
+  num_mappings--;
+  total_mapping_nodes -= m->count;
+  if (m->compact_pending)
+    {
+      mapping_t **mp;
 
-    FREE ((char *) a);
-  }
+      for (mp = &compact_list; *mp != m; mp = &(*mp)->next_compact)
+        ;
+      *mp = m->next_compact;
+    }
+  for (i = 0; i < m->fill; i++)
+    {
+      elt = map_node (m, i);
+      if (NODE_DELETED (elt))
+        continue;
+      free_svalue (elt->values + 1, "free_mapping");
+      free_svalue (elt->values, "free_mapping");
+    }
+  for (c = 0; c < m->num_chunks; c++)
+    {
+      total_mapping_size -= (int)((MAP_CHUNK_MIN << c) * sizeof (mapping_node_t) + sizeof (mapping_node_t *));
+      FREE ((char *) m->chunks[c]);
+    }
+  if (m->chunks)
+    FREE ((char *) m->chunks);
+  if (m->old_table)
+    free_table (m->old_table, m->old_table_size);
+  free_table (m->table, m->table_size);
 
+  total_mapping_size -= sizeof (mapping_t);
   FREE ((char *) m);
 }
 
@@ -155,77 +385,32 @@ void free_mapping (mapping_t * m) {
   dealloc_mapping (m);
 }
 
-static mapping_node_t *free_nodes = 0;
-mapping_node_block_t *mapping_node_blocks = 0;
-
-mapping_node_t* new_map_node () {
-
-  mapping_node_block_t *mnb;
-  mapping_node_t *ret;
-  int i;
-
-  if ((ret = free_nodes))
-    {
-      free_nodes = ret->next;
-    }
-  else
-    {
-      mnb = ALLOCATE (mapping_node_block_t, TAG_MAP_NODE_BLOCK, "new_map_node");
-      mnb->next = mapping_node_blocks;
-      mapping_node_blocks = mnb;
-      mnb->nodes[MNB_SIZE - 1].next = 0;
-      for (i = MNB_SIZE - 1; i--;)
-        mnb->nodes[i].next = &mnb->nodes[i + 1];
-      ret = &mnb->nodes[0];
-      free_nodes = &mnb->nodes[1];
-    }
-  return ret;
-}
-
-void free_node (mapping_node_t * mn) {
-  mn->next = free_nodes;
-  free_nodes = mn;
-}
-
 /** @brief Allocate a new, empty mapping.
- *  call with n == 0 if you will be doing many deletions from the map.
- *  call with n == "approx. # of insertions you plan to do" if you won't be
- *  doing many deletions from the map.
  *  @param n An estimate of the number of elements the mapping will hold.
+ *    Room for that many is allocated right away.
  *  @return A pointer to the newly allocated mapping.
  */
 mapping_t *allocate_mapping (size_t n) {
 
   mapping_t *newmap;
-  mapping_node_t **a;
+  uint32_t size;
 
   if (n > (size_t)CONFIG_INT (__MAX_MAPPING_SIZE__))
     n = CONFIG_INT (__MAX_MAPPING_SIZE__);
   newmap = ALLOCATE (mapping_t, TAG_MAPPING, "allocate_mapping: 1");
   if (newmap == NULL)
     error ("Allocate_mapping - out of memory.\n");
+  memset (newmap, 0, sizeof (mapping_t));
+  total_mapping_size += sizeof (mapping_t);
+
+  for (size = MAP_HASH_TABLE_SIZE; n * 8 > (size_t) size * MAP_FILL_EIGHTHS; size <<= 1)
+    ;
+  newmap->table = alloc_table (size);
+  newmap->table_size = size - 1;
+  while (MAP_CAPACITY (newmap) < n)
+    add_chunk (newmap);
 
-  if (n > MAP_HASH_TABLE_SIZE)
-    {
-      n |= n >> 1;
-      n |= n >> 2;
-      n |= n >> 4;
-      if (n & 0xff00)
-        n |= n >> 8;
-      newmap->table_size = (unsigned short)n++;
-    }
-  else
-    newmap->table_size = (unsigned short)((n = MAP_HASH_TABLE_SIZE) - 1);
-  /* The size is actually 1 higher */
-  newmap->unfilled = (unsigned short) (n * FILL_PERCENT / 100);
-  a = newmap->table = (mapping_node_t **) DXALLOC (n *= sizeof (mapping_node_t *), TAG_MAP_TBL, "allocate_mapping: 3");
-  if (!a)
-    error ("Allocate_mapping 2 - out of memory.\n");
-  /* zero out the hash table */
-  memset (a, 0, n);
-  total_mapping_size += (int)(sizeof (mapping_t) + n);
   newmap->ref = 1;
-  newmap->count = 0;
   num_mappings++;
   return newmap;
 }
@@ -237,45 +422,23 @@ mapping_t *allocate_mapping (size_t n) {
 mapping_t* copyMapping (mapping_t * m) {
 
   mapping_t *newmap;
-  int k = m->table_size;
-  mapping_node_t *elt, *nelt, **a, **b = m->table, **c;
+  mapping_node_t *elt, *nelt;
+  uint32_t i;
 
-  newmap = ALLOCATE (mapping_t, TAG_MAPPING, "copy_mapping: 1");
-  if (newmap == NULL)
-    error ("copyMapping - out of memory.\n");
-  newmap->table_size = (unsigned short)k++;
-  newmap->unfilled = m->unfilled;
-  newmap->ref = 1;
-  c = newmap->table = CALLOCATE (k, mapping_node_t *, TAG_MAP_TBL, "copy_mapping: 2");
-  if (!c)
-    {
-      FREE ((char *) newmap);
-      error ("copyMapping 2 - out of memory.\n");
-    }
-  total_mapping_nodes += (newmap->count = m->count);
-  memset (c, 0, k * sizeof (mapping_node_t *));
-  total_mapping_size += (sizeof (mapping_t) + sizeof (mapping_node_t *) * k + sizeof (mapping_node_t) * m->count);
-  num_mappings++;
-  while (k--)
+  newmap = allocate_mapping (m->count);
+  for (i = 0; i < m->fill; i++)
     {
-      if ((elt = b[k]))
-        {
-          a = c + k;
-          do
-            {
-              nelt = new_map_node ();
-
-              assign_svalue_no_free (nelt->values, elt->values);
-              assign_svalue_no_free (nelt->values + 1, elt->values + 1);
-              nelt->next = *a;
-              *a = nelt;
-            }
-          while ((elt = elt->next));
-        }
+      elt = map_node (m, i);
+      if (NODE_DELETED (elt))
+        continue;
+      nelt = new_node (newmap, NODE_HASH (elt));
+      assign_svalue_no_free (nelt->values, elt->values);
+      assign_svalue_no_free (nelt->values + 1, elt->values + 1);
     }
   return newmap;
 }
 
+
 int restore_hash_string (char **val, svalue_t * sv) {
   register char *cp = *val;
   char c, *start = cp;
@@ -335,10 +498,11 @@ int restore_hash_string (char **val, svalue_t * sv) {
 }
 
 /*
- * svalue_t_to_int: Converts an svalue into an integer index.
+ * map_key_hash: Hashes a key for insertion.  A string key is made shared
+ * first, so that keys can be compared by address.
  */
 
-int svalue_to_int (svalue_t * v) {
+static uint32_t map_key_hash (svalue_t * v) {
   if (v->type == T_STRING && v->subtype != STRING_SHARED)
     {
       char *p = make_shared_string (v->u.string);
@@ -346,11 +510,27 @@ int svalue_to_int (svalue_t * v) {
       v->subtype = STRING_SHARED;
       v->u.string = p;
     }
-  /* The bottom bits of pointers tend to be bad ... 
-   * Note that this means close groups of numbers don't hash particularly
-   * well, but then one wonders why they aren't using an array ...
-   */
-  return (int)MAP_POINTER_HASH (v->u.number);
+  return MAP_POINTER_HASH (v->u.number);
+}
+
+/*
+ * lookup_key: Sets up a key for lookup only.  A string that isn't in the
+ * shared string table can't be a key of any mapping, so there's no need to
+ * allocate a shared copy of it.  Returns 0 in that case.
+ */
+
+static int lookup_key (svalue_t * v, svalue_t * key, uint32_t * hash) {
+  if (v->type == T_STRING && v->subtype != STRING_SHARED)
+    {
+      if (!(key->u.string = findstring (v->u.string)))
+        return 0;
+      key->type = T_STRING;
+      key->subtype = STRING_SHARED;
+    }
+  else
+    *key = *v;
+  *hash = MAP_POINTER_HASH (key->u.number);
+  return 1;
 }
 
 int msameval (svalue_t * arg1, svalue_t * arg2) {
@@ -365,57 +545,18 @@ int msameval (svalue_t * arg1, svalue_t * arg2) {
     }
 }
 
-/*
- * node_find_in_mapping: Like find_for_insert(), but doesn't attempt
- * to add anything if a value is not found.  The returned pointer won't
- * necessarily have any meaningful value.
- */
-
-mapping_node_t* node_find_in_mapping (mapping_t * m, svalue_t * lv) {
-  int i;
-  mapping_node_t *elt, **a = m->table;
-
-  i = svalue_to_int (lv) & m->table_size;
-  for (elt = a[i]; elt; elt = elt->next)
-    {
-      if (msameval (elt->values, lv))
-        return elt;
-    }
-  return (mapping_node_t *) 0;
-}
-
 /*
    mapping_delete: delete an element from the mapping
 */
 
 void mapping_delete (mapping_t * m, svalue_t * lv) {
-  int i = svalue_to_int (lv) & m->table_size;
-  mapping_node_t **prev = m->table + i, *elt;
-
-  if ((elt = *prev))
-    {
-      do
-        {
-          if (msameval (elt->values, lv))
-            {
-              if (!(*prev = elt->next) && !m->table[i])
-                {
-                  m->unfilled++;
-                }
-              m->count--;
-              total_mapping_nodes--;
-              total_mapping_size -= sizeof (mapping_node_t);
-              free_svalue (elt->values + 1, "mapping_delete");
-              free_svalue (elt->values, "mapping_delete");
-              free_node (elt);
-              return;
-
-            }
-          prev = &(elt->next);
-        }
-      while ((elt = elt->next));
+  svalue_t key;
+  uint32_t hash;
+  mapping_node_t *elt;
+  map_slot_t *slot;
 
-    }
+  if (lookup_key (lv, &key, &hash) && (elt = lookup_node (m, &key, hash, &slot)))
+    delete_node (m, elt, slot);
 }
 
 /*
@@ -426,55 +567,23 @@ void mapping_delete (mapping_t * m, svalue_t * lv) {
  */
 
 svalue_t* find_for_insert (mapping_t * m, svalue_t * lv, int doTheFree) {
-  int oi = svalue_to_int (lv);
-  unsigned short i = oi & m->table_size;
-  mapping_node_t *n, *newnode, **a = m->table + i;
+  uint32_t hash = map_key_hash (lv);
+  mapping_node_t *elt;
 
-  if ((n = *a))
+  if ((elt = lookup_node (m, lv, hash, NULL)))
     {
-      do
-        {
-          if (msameval (lv, n->values))
-            {
-              /* normally, the f_assign would free the old value */
-              if (doTheFree)
-                free_svalue (n->values + 1, "find_for_insert");
-              return n->values + 1;
-            }
-        }
-      while ((n = n->next));
-      n = *a;
+      /* normally, the f_assign would free the old value */
+      if (doTheFree)
+        free_svalue (elt->values + 1, "find_for_insert");
+      return elt->values + 1;
     }
-  else if (!(--m->unfilled))
-    {
-      int size = m->table_size + 1;
 
-      if (growMap (m))
-        {
-          if (oi & size)
-            i |= size;
-          n = *(a = m->table + i);
-        }
-      else
-        {
-          error ("Out of memory\n");
-        }
-    }
-
-  if (++m->count > CONFIG_INT (__MAX_MAPPING_SIZE__))
-    {
-      m->count--;
-      mapping_too_large ();
-    }
-  total_mapping_size += sizeof (mapping_node_t);
-  newnode = new_map_node ();
-  assign_svalue_no_free (newnode->values, lv);
-  /* insert at head of bucket */
-  (*a = newnode)->next = n;
-  lv = newnode->values + 1;
-  *lv = const0u;
-  total_mapping_nodes++;
-  return lv;
+  if (m->count >= CONFIG_INT (__MAX_MAPPING_SIZE__))
+    mapping_too_large ();
+  elt = new_node (m, hash);
+  assign_svalue_no_free (elt->values, lv);
+  elt->values[1] = const0u;
+  return elt->values + 1;
 }
 
 #ifdef F_UNIQUE_MAPPING
@@ -489,7 +598,7 @@ typedef struct unique_node_s {
 typedef struct unique_m_list_s {
   unique_node_t **utable;
   struct unique_m_list_s *next;
-  unsigned short mask;
+  size_t mask;
 } unique_m_list_t;
 
 static unique_m_list_t *g_u_m_list = 0;
@@ -498,7 +607,7 @@ void unique_mapping_error_handler (void) {
   unique_m_list_t *nlist = g_u_m_list;
   unique_node_t **table = nlist->utable;
   unique_node_t *uptr, *nptr;
-  int mask = nlist->mask;
+  size_t mask = nlist->mask;
 
   g_u_m_list = g_u_m_list->next;
 
@@ -526,12 +635,10 @@ void f_unique_mapping (void) {
   svalue_t *arg = sp - st_num_arg + 1, *sv;
   unique_node_t **table, *uptr, *nptr;
   array_t *v = arg->u.arr, *ret;
-  size_t size, mask;
-  unsigned short oi, i, numkeys = 0;
+  size_t size, mask, i, numkeys = 0;
   unsigned short num_arg = (unsigned short)st_num_arg;
-  unsigned short nmask;
   mapping_t *m;
-  mapping_node_t **mtable, *elt;
+  mapping_node_t *elt;
   int *ind;
   size_t j;
   function_to_call_t ftc;
@@ -553,8 +660,8 @@ void f_unique_mapping (void) {
       size |= size >> 1;
       size |= size >> 2;
       size |= size >> 4;
-      if (size & 0xff00)
-        size |= size >> 8;
+      size |= size >> 8;
+      size |= size >> 16;
       mask = size++;
     }
   else
@@ -569,7 +676,7 @@ void f_unique_mapping (void) {
   nlist = ALLOCATE (unique_m_list_t, 101, "f_unique_mapping:2");
   nlist->next = g_u_m_list;
   nlist->utable = table;
-  nlist->mask = (unsigned short)mask;
+  nlist->mask = mask;
   g_u_m_list = nlist;
 
   (++sp)->type = T_ERROR_HANDLER;
@@ -580,7 +687,7 @@ void f_unique_mapping (void) {
     {
       push_svalue (v->item + size);
       sv = call_efun_callback (&ftc, 1);
-      i = (oi = (unsigned short)svalue_to_int (sv)) & mask;
+      i = map_key_hash (sv) & mask;
       if ((uptr = table[i]))
         {
           do
@@ -607,20 +714,7 @@ void f_unique_mapping (void) {
         }
     }
 
-  m = allocate_mapping (nmask = numkeys << 1);
-  mtable = m->table;
-  numkeys = 0;
-
-  if (nmask > MAP_HASH_TABLE_SIZE)
-    {
-      nmask |= nmask >> 1;
-      nmask |= nmask >> 2;
-      nmask |= nmask >> 4;
-      if (size & 0xff00)
-        nmask |= nmask >> 8;
-    }
-  else
-    nmask = MAP_HASH_TABLE_SIZE - 1;
+  m = allocate_mapping (numkeys);
   j = mask;
   sv = v->item;
 
@@ -630,41 +724,9 @@ void f_unique_mapping (void) {
         {
           do
             {
+              /* the keys are unique, no need to look them up */
               nptr = uptr->next;
-              oi = (unsigned short)MAP_POINTER_HASH (uptr->key.u.number);
-              i = oi & nmask;
-              if (!mtable[i] && !(--m->unfilled))
-                {
-                  if (growMap (m))
-                    {
-                      mtable = m->table;
-                      nmask <<= 1;
-                      nmask--;
-                    }
-                  else
-                    {
-                      do
-                        {
-                          do
-                            {
-                              nptr = uptr->next;
-                              free_svalue (&uptr->key, "f_unique_mapping");
-                              FREE ((char *) uptr->indices);
-                              FREE ((char *) uptr);
-                            }
-                          while ((uptr = nptr));
-                          uptr = table[--j];
-                        }
-                      while (j);
-                      total_mapping_size +=
-                        sizeof (mapping_node_t) * (m->count = numkeys);
-                      total_mapping_nodes += numkeys;
-                      free_mapping (m);
-                      error ("Out of memory\n");
-                    }
-                }
-
-              elt = ALLOCATE (mapping_node_t, 105, "f_unique_mapping:6");
+              elt = new_node (m, MAP_POINTER_HASH (uptr->key.u.number));
               *elt->values = uptr->key;
               (elt->values + 1)->type = T_ARRAY;
               ret = (elt->values + 1)->u.arr = allocate_empty_array (size = uptr->count);
@@ -673,19 +735,15 @@ void f_unique_mapping (void) {
                 {
                   assign_svalue_no_free (ret->item + size, sv + ind[size]);
                 }
-              elt->next = mtable[i];
-              mtable[i] = elt;
               FREE ((char *) ind);
               FREE ((char *) uptr);
-              numkeys++;
+              table[j] = nptr;	/* for the error handler */
             }
           while ((uptr = nptr));
         }
     }
   while (j--);
 
-  total_mapping_size += sizeof (mapping_node_t) * (m->count = numkeys);
-  total_mapping_nodes += numkeys;
   FREE ((char *) table);
   g_u_m_list = g_u_m_list->next;
   FREE ((char *) nlist);
@@ -705,103 +763,57 @@ void f_unique_mapping (void) {
 mapping_t* load_mapping_from_aggregate (svalue_t * sv_pairs, int n) {
 
   mapping_t *m;
-  int mask, i, oi, count = 0;
-  mapping_node_t **a, *elt, *elt2;
+  mapping_node_t *elt;
+  uint32_t hash;
 
   m = allocate_mapping (n >> 1);
-  if (!n)
-    return m;
-  mask = m->table_size;
-  a = m->table;
-  do
+  for (; n; n -= 2)
     {
-      i = (oi = svalue_to_int (++sv_pairs)) & mask;
-      if ((elt2 = elt = a[i]))
+      hash = map_key_hash (++sv_pairs);
+      if ((elt = lookup_node (m, sv_pairs, hash, NULL)))
         {
-          do
-            {
-              if (msameval (sv_pairs, elt->values))
-                {
-                  free_svalue (sv_pairs, "load_mapping_from_aggregate: duplicate key");
-                  free_svalue (elt->values + 1, "load_mapping_from_aggregate");
-                  *(elt->values + 1) = *++sv_pairs;
-                  break;
-                }
-            }
-          while ((elt = elt->next));
-          if (elt)
-            continue;
-        }
-      else if (!(--m->unfilled))
-        {
-          if (growMap (m))
-            {
-              a = m->table;
-              if (oi & ++mask)
-                elt2 = a[i |= mask];
-              mask <<= 1;
-              mask--;
-            }
-          else
-            {
-              total_mapping_size += sizeof (mapping_node_t) * (m->count = count);
-              total_mapping_nodes += count;
-              free_mapping (m);
-              error ("Out of memory\n");
-            }
+          free_svalue (sv_pairs, "load_mapping_from_aggregate: duplicate key");
+          free_svalue (elt->values + 1, "load_mapping_from_aggregate");
+          *(elt->values + 1) = *++sv_pairs;
+          continue;
         }
 
-      if (++count > CONFIG_INT (__MAX_MAPPING_SIZE__))
+      if (m->count >= CONFIG_INT (__MAX_MAPPING_SIZE__))
         {
-          total_mapping_size += sizeof (mapping_node_t) * (m->count = count);
-          total_mapping_nodes += count;
           free_mapping (m);
           mapping_too_large ();
         }
 
-      elt = new_map_node ();
+      elt = new_node (m, hash);
       *elt->values = *sv_pairs++;
       *(elt->values + 1) = *sv_pairs;
-      (a[i] = elt)->next = elt2;
     }
-  while (n -= 2);
-  total_mapping_size += sizeof (mapping_node_t) * (m->count = count);
-  total_mapping_nodes += count;
   return m;
 }
 
 /* is ok */
 
 svalue_t* find_in_mapping (mapping_t * m, svalue_t * lv) {
-  int i = svalue_to_int (lv) & m->table_size;
-  mapping_node_t *n = m->table[i];
+  svalue_t key;
+  uint32_t hash;
+  mapping_node_t *elt;
 
-  while (n)
-    {
-      if (msameval (n->values, lv))
-        return n->values + 1;
-      n = n->next;
-    }
+  if (lookup_key (lv, &key, &hash) && (elt = lookup_node (m, &key, hash, NULL)))
+    return elt->values + 1;
 
   return &const0u;
 }
 
 svalue_t* find_string_in_mapping (mapping_t * m, char *p) {
-  char *ss = findstring (p);
-  int i;
-  mapping_node_t *n;
+  svalue_t key;
+  mapping_node_t *elt;
 
-  if (!ss)
+  if (!(key.u.string = findstring (p)))
     return &const0u;
-  i = (unsigned short)MAP_POINTER_HASH (ss);
-  n = m->table[i & m->table_size];
-
-  while (n)
-    {
-      if (n->values->type == T_STRING && n->values->u.string == ss)
-        return n->values + 1;
-      n = n->next;
-    }
+  key.type = T_STRING;
+  key.subtype = STRING_SHARED;
+  if ((elt = lookup_node (m, &key, MAP_POINTER_HASH (key.u.number), NULL)))
+    return elt->values + 1;
   return &const0u;
 }
 
@@ -810,80 +822,32 @@ svalue_t* find_string_in_mapping (mapping_t * m, char *p) {
 */
 
 static void add_to_mapping (mapping_t * m1, mapping_t * m2, int free_flag) {
-  int mask = m1->table_size, j = m2->table_size;
-  int count = m1->count;
-  int i, oi;
-  mapping_node_t *elt1, *elt2, *newnode, *n;
-  mapping_node_t **a1 = m1->table, **a2 = m2->table;
-  svalue_t *sv;
+  mapping_node_t *elt1, *elt2;
+  uint32_t i, hash;
 
-  do
+  for (i = 0; i < m2->fill; i++)
     {
-      for (elt2 = a2[j]; elt2; elt2 = elt2->next)
+      elt2 = map_node (m2, i);
+      if (NODE_DELETED (elt2))
+        continue;
+      hash = NODE_HASH (elt2);
+      if ((elt1 = lookup_node (m1, elt2->values, hash, NULL)))
         {
-          i = (oi = node_hash (elt2)) & mask;
-          sv = elt2->values;
-          if ((n = elt1 = a1[i]))
-            {
-              do
-                {
-                  if (msameval (sv, elt1->values))
-                    {
-                      assign_svalue (elt1->values + 1, sv + 1);
-                      break;
-                    }
-                }
-              while ((elt1 = elt1->next));
-              if (elt1)
-                continue;
-            }
-          else if (!(--m1->unfilled))
-            {
-              if (growMap (m1))
-                {
-                  a1 = m1->table;
-                  if (oi & ++mask)
-                    n = a1[i |= mask];
-                  mask <<= 1;
-                  mask--;
-                }
-              else
-                {
-                  count -= m1->count;
-                  total_mapping_size += count * sizeof (mapping_node_t);
-                  total_mapping_nodes += count;
-                  m1->count += count;
-                  if (free_flag)
-                    free_mapping (m1);
-                  error ("Out of memory\n");
-                }
-            }
-          if (++count > CONFIG_INT (__MAX_MAPPING_SIZE__))
-            {
-              if (count -= m1->count + 1)
-                {
-                  total_mapping_size += count * sizeof (mapping_node_t);
-                  total_mapping_nodes += count;
-                }
-              m1->count += count;
-              mapping_too_large ();
-            }
+          assign_svalue (elt1->values + 1, elt2->values + 1);
+          continue;
+        }
 
-          newnode = new_map_node ();
-          assign_svalue_no_free (newnode->values, elt2->values);
-          assign_svalue_no_free (newnode->values + 1, elt2->values + 1);
-          (a1[i] = newnode)->next = n;
+      if (m1->count >= CONFIG_INT (__MAX_MAPPING_SIZE__))
+        {
+          if (free_flag)
+            free_mapping (m1);
+          mapping_too_large ();
         }
-    }
-  while (j--);
 
-  if (count -= m1->count)
-    {
-      total_mapping_size += count * sizeof (mapping_node_t);
-      total_mapping_nodes += count;
+      elt1 = new_node (m1, hash);
+      assign_svalue_no_free (elt1->values, elt2->values);
+      assign_svalue_no_free (elt1->values + 1, elt2->values + 1);
     }
-
-  m1->count += count;
 }
 
 /* 
@@ -892,80 +856,29 @@ static void add_to_mapping (mapping_t * m1, mapping_t * m2, int free_flag) {
 */
 
 static void unique_add_to_mapping (mapping_t * m1, mapping_t * m2, int free_flag) {
-  int mask = m1->table_size, j = m2->table_size;
-  int count = m1->count;
-  int i, oi;
-  mapping_node_t *elt1, *elt2, *newnode, *n;
-  mapping_node_t **a1 = m1->table, **a2 = m2->table;
-  svalue_t *sv;
+  mapping_node_t *elt1, *elt2;
+  uint32_t i, hash;
 
-  do
+  for (i = 0; i < m2->fill; i++)
     {
-      for (elt2 = a2[j]; elt2; elt2 = elt2->next)
-        {
-          i = (oi = node_hash (elt2)) & mask;
-          sv = elt2->values;
-          if ((n = elt1 = a1[i]))
-            {
-              do
-                {
-                  if (msameval (sv, elt1->values))
-                    break;
-                }
-              while ((elt1 = elt1->next));
-              if (elt1)
-                continue;
-            }
-          else if (!(--m1->unfilled))
-            {
-              if (growMap (m1))
-                {
-                  a1 = m1->table;
-                  if (oi & ++mask)
-                    n = a1[i |= mask];
-                  mask <<= 1;
-                  mask--;
-                }
-              else
-                {
-                  ++m1->unfilled;
-                  count -= m1->count;
-                  total_mapping_size += count * sizeof (mapping_node_t);
-                  total_mapping_nodes += count;
-                  m1->count += count;
-                  if (free_flag)
-                    free_mapping (m1);
-
-                  error ("Out of memory\n");
-                }
-            }
-
-          if (++count > CONFIG_INT (__MAX_MAPPING_SIZE__))
-            {
-              if (count -= m1->count + 1)
-                {
-                  total_mapping_size += count * sizeof (mapping_node_t);
-                  total_mapping_nodes += count;
-                }
-              m1->count += count;
-              mapping_too_large ();
-            }
+      elt2 = map_node (m2, i);
+      if (NODE_DELETED (elt2))
+        continue;
+      hash = NODE_HASH (elt2);
+      if (lookup_node (m1, elt2->values, hash, NULL))
+        continue;
 
-          newnode = new_map_node ();
-          assign_svalue_no_free (newnode->values, elt2->values);
-          assign_svalue_no_free (newnode->values + 1, elt2->values + 1);
-          (a1[i] = newnode)->next = n;
+      if (m1->count >= CONFIG_INT (__MAX_MAPPING_SIZE__))
+        {
+          if (free_flag)
+            free_mapping (m1);
+          mapping_too_large ();
         }
-    }
-  while (j--);
 
-  if (count -= m1->count)
-    {
-      total_mapping_size += count * sizeof (mapping_node_t);
-      total_mapping_nodes += count;
+      elt1 = new_node (m1, hash);
+      assign_svalue_no_free (elt1->values, elt2->values);
+      assign_svalue_no_free (elt1->values + 1, elt2->values + 1);
     }
-
-  m1->count += count;
 }
 
 void absorb_mapping (mapping_t * m1, mapping_t * m2) {
@@ -1007,8 +920,8 @@ mapping_t* add_mapping (mapping_t * m1, mapping_t * m2) {
 void map_mapping (svalue_t * arg, int num_arg) {
 
   mapping_t *m = arg->u.map;
-  mapping_node_t **a, *elt;
-  int j = m->table_size;
+  mapping_node_t *elt;
+  uint32_t i;
   svalue_t *ret;
   function_to_call_t ftc;
 
@@ -1018,21 +931,19 @@ void map_mapping (svalue_t * arg, int num_arg) {
   (++sp)->type = T_MAPPING;
   sp->u.map = m;
 
-  a = m->table;
-  do
+  for (i = 0; i < m->fill; i++)
     {
-      for (elt = a[j]; elt; elt = elt->next)
-        {
-          push_svalue (elt->values);
-          push_svalue (elt->values + 1);
-          ret = call_efun_callback (&ftc, 2);
-          if (ret)
-            assign_svalue (elt->values + 1, ret);
-          else
-            break;
-        }
+      elt = map_node (m, i);
+      if (NODE_DELETED (elt))
+        continue;
+      push_svalue (elt->values);
+      push_svalue (elt->values + 1);
+      ret = call_efun_callback (&ftc, 2);
+      if (ret)
+        assign_svalue (elt->values + 1, ret);
+      else
+        break;
     }
-  while (j--);
 
   sp--;
   pop_n_elems (num_arg);
@@ -1046,11 +957,9 @@ void map_mapping (svalue_t * arg, int num_arg) {
 void filter_mapping (svalue_t * arg, int num_arg) {
 
   mapping_t *m, *newmap;
-  mapping_node_t **a, *elt;
-  mapping_node_t **b, *newnode, *n;
-  int j, count = 0, size;
+  mapping_node_t *elt, *newnode;
+  uint32_t i;
   svalue_t *ret;
-  unsigned short tb_index;
   function_to_call_t ftc;
 
   process_efun_callback (1, &ftc, F_FILTER);
@@ -1068,64 +977,28 @@ void filter_mapping (svalue_t * arg, int num_arg) {
 
   newmap = allocate_mapping (0);
   push_refed_mapping (newmap);
-  b = newmap->table;
-  size = newmap->table_size;
 
-  a = m->table;
-  j = m->table_size;
-  do
+  for (i = 0; i < m->fill; i++)
     {
-      for (elt = a[j]; elt; elt = elt->next)
+      elt = map_node (m, i);
+      if (NODE_DELETED (elt))
+        continue;
+      push_svalue (elt->values);
+      push_svalue (elt->values + 1);
+      ret = call_efun_callback (&ftc, 2);
+      if (!ret)
+        break;
+      else if (ret->type != T_NUMBER || ret->u.number)
         {
-          push_svalue (elt->values);
-          push_svalue (elt->values + 1);
-          ret = call_efun_callback (&ftc, 2);
-          if (!ret)
-            break;
-          else if (ret->type != T_NUMBER || ret->u.number)
-            {
-              tb_index = (unsigned short)(node_hash (elt) & size);
-              b = newmap->table + tb_index;
-              if (!(n = *b) && !(--newmap->unfilled))
-                {
-                  if (growMap (newmap))
-                    {
-                      size = newmap->table_size;
-                      tb_index = (unsigned short)(node_hash (elt) & size);
-                      n = *(b = newmap->table + tb_index);
-                    }
-                  else
-                    {
-                      total_mapping_size += count * sizeof (mapping_node_t);
-                      total_mapping_nodes += count;
-                      newmap->count = count;
-                      error ("Out of memory in filter_mapping\n");
-                    }
-                }
-              if (++count > CONFIG_INT (__MAX_MAPPING_SIZE__))
-                {
-                  count--;
-                  total_mapping_size += count * sizeof (mapping_node_t);
-                  total_mapping_nodes += count;
-                  newmap->count = count;
-                  mapping_too_large ();
-                }
+          if (newmap->count >= CONFIG_INT (__MAX_MAPPING_SIZE__))
+            mapping_too_large ();
 
-              newnode = new_map_node ();
-              assign_svalue_no_free (newnode->values, elt->values);
-              assign_svalue_no_free (newnode->values + 1, elt->values + 1);
-              (*b = newnode)->next = n;
-            }
+          /* the keys of m are unique */
+          newnode = new_node (newmap, NODE_HASH (elt));
+          assign_svalue_no_free (newnode->values, elt->values);
+          assign_svalue_no_free (newnode->values + 1, elt->values + 1);
         }
     }
-  while (j--);
-
-  if (count)
-    {
-      total_mapping_size += count * sizeof (mapping_node_t);
-      total_mapping_nodes += count;
-      newmap->count += count;
-    }
 
   sp--;
   pop_n_elems (num_arg);
@@ -1138,60 +1011,28 @@ void filter_mapping (svalue_t * arg, int num_arg) {
 
 mapping_t* compose_mapping (mapping_t * m1, mapping_t * m2, unsigned short flag) {
 
-  mapping_node_t *elt, *elt2, **a, **b = m2->table, **prev;
-  unsigned short j = m1->table_size, deleted = 0;
-  unsigned short mask = m2->table_size;
+  mapping_node_t *elt, *elt2;
+  map_slot_t *slot;
   svalue_t *sv;
+  uint32_t i;
 
   if (flag)
     m1 = copyMapping (m1);
-  a = m1->table;
 
-  do
+  for (i = 0; i < m1->fill; i++)
     {
-      if ((elt = *(prev = a)))
+      elt = map_node (m1, i);
+      if (NODE_DELETED (elt))
+        continue;
+      sv = elt->values + 1;
+      if ((elt2 = lookup_node (m2, sv, map_key_hash (sv), NULL)))
+        assign_svalue (sv, elt2->values + 1);
+      else
         {
-          do
-            {
-              sv = elt->values + 1;
-              if ((elt2 = b[svalue_to_int (sv) & mask]))
-                {
-                  do
-                    {
-                      if (msameval (sv, elt2->values))
-                        {
-                          assign_svalue (sv, elt2->values + 1);
-                          break;
-                        }
-                    }
-                  while ((elt2 = elt2->next));
-                }
-              if (!elt2)
-                {
-                  if (!(*prev = elt->next) && !(*a))
-                    m1->unfilled++;
-                  deleted++;
-                  free_svalue (sv--, "compose_mapping");
-                  free_svalue (sv, "compose_mapping");
-                  free_node (elt);
-                }
-              else
-                {
-                  prev = &(elt->next);
-                }
-            }
-          while ((elt = *prev));
+          lookup_node (m1, elt->values, NODE_HASH (elt), &slot);
+          delete_node (m1, elt, slot);
         }
     }
-  while (a++, j--);
-
-
-  if (deleted)
-    {
-      m1->count -= deleted;
-      total_mapping_nodes -= deleted;
-      total_mapping_size -= deleted * sizeof (mapping_node_t);
-    }
 
   if (flag)
     return m1;
@@ -1204,18 +1045,18 @@ mapping_t* compose_mapping (mapping_t * m1, mapping_t * m2, unsigned short flag)
 array_t* mapping_indices (mapping_t * m) {
 
   array_t *v;
-  int j = m->table_size;
-  mapping_node_t *elt, **a = m->table;
+  mapping_node_t *elt;
+  uint32_t i;
   svalue_t *sv;
 
   v = allocate_empty_array (m->count);
   sv = v->item;
-  do
+  for (i = 0; i < m->fill; i++)
     {
-      for (elt = a[j]; elt; elt = elt->next)
+      elt = map_node (m, i);
+      if (!NODE_DELETED (elt))
         assign_svalue_no_free (sv++, elt->values);
     }
-  while (j--);
   return v;
 }
 
@@ -1223,18 +1064,18 @@ array_t* mapping_indices (mapping_t * m) {
 
 array_t* mapping_values (mapping_t * m) {
   array_t *v;
-  int j = m->table_size;
-  mapping_node_t *elt, **a = m->table;
+  mapping_node_t *elt;
+  uint32_t i;
   svalue_t *sv;
 
   v = allocate_empty_array (m->count);
   sv = v->item;
-  do
+  for (i = 0; i < m->fill; i++)
     {
-      for (elt = a[j]; elt; elt = elt->next)
+      elt = map_node (m, i);
+      if (!NODE_DELETED (elt))
         assign_svalue_no_free (sv++, elt->values + 1);
     }
-  while (j--);
   return v;
 }
 
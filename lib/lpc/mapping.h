@@ -1,37 +1,76 @@
 #pragma once
 /* mapping.h - 1992/07/19 */
 
-#define MAP_POINTER_HASH(x) ((intptr_t)x >> 4)
+/* Fibonacci hashing: the bottom bits of pointers tend to be bad, and so do
+ * runs of small numbers.  The multiplication spreads them over all 32 bits.
+ */
+#define MAP_POINTER_HASH(x) ((uint32_t) (((uint64_t) (x) * 0x9e3779b97f4a7c15ULL) >> 32))
 
+/* A key/value pair.  A deleted node has a key of type T_INVALID. */
 typedef struct mapping_node_s {
-    struct mapping_node_s *next;
     svalue_t values[2];
 } mapping_node_t;
 
-#define MNB_SIZE 256
-
-typedef struct mapping_node_block_s {
-    struct mapping_node_block_s *next;
-    mapping_node_t nodes[MNB_SIZE];
-} mapping_node_block_t;
+/* A slot in the hash index of a mapping. */
+typedef struct map_slot_s {
+    uint32_t hash;              /* MAP_POINTER_HASH() of the key */
+    uint32_t node;              /* node number + 1, 0 if the slot is empty */
+} map_slot_t;
 
-#define MAX_TABLE_SIZE 32768
 #define MAP_HASH_TABLE_SIZE 8   /* must be a power of 2 */
-#define FILL_PERCENT 80         /* must not be larger than 99 */
+#define MAP_FILL_EIGHTHS 7      /* grow the index when more than 7/8 full */
+#define MAP_CHUNK_MIN 4         /* nodes in the first node chunk */
+#define MAP_MAX_CHUNKS 30
 
 #define MAPSIZE(size) sizeof(mapping_t)
 
+/*
+ * A mapping keeps its nodes inline, in insertion order, in chunks of
+ * MAP_CHUNK_MIN, 2 * MAP_CHUNK_MIN, 4 * MAP_CHUNK_MIN ... nodes.  The chunks
+ * are never moved, so pointers to values stay valid when the mapping grows.
+ * Deleted nodes are squeezed out only between evaluations, by
+ * compact_mappings().
+ *
+ * The hash index is a Robin Hood open addressing table of node numbers.
+ * When it gets too full it is replaced by one twice the size, and the nodes
+ * are indexed into the new table a few at a time by each following insertion
+ * or deletion (see rehash_step() in mapping.c), while lookups try both.
+ */
 struct mapping_s {
-    unsigned short ref;         /* how many times this map has been referenced */
+    uint32_t ref;               /* how many times this map has been referenced */
 #ifdef DEBUG
     int extra_ref;
 #endif
-    mapping_node_t **table;     /* the hash table */
-    unsigned short table_size;  /* bit-mask for # of buckets in hash table == power of 2 minus one */
-    unsigned short unfilled;    /* threshold to call growMap(), # of buckets among 80% of total buckets that do not have entries */
     int count;                  /* total # of nodes actually in mapping  */
+    uint32_t table_size;        /* bit-mask for # of slots in the hash index == power of 2 minus one */
+    uint32_t fill;              /* # of nodes used, including deleted ones */
+    map_slot_t *table;          /* the hash index */
+    mapping_node_t **chunks;    /* node storage, NULL until the first insertion */
+    int num_chunks;
+    uint32_t old_table_size;    /* bit-mask of old_table */
+    map_slot_t *old_table;      /* the previous hash index while resizing, or NULL */
+    uint32_t rehash_pos;        /* next node to index into table while resizing */
+    uint32_t rehash_end;        /* # of nodes to index into table */
+    int compact_pending;        /* waiting for compact_mappings() */
+    mapping_t *next_compact;    /* next mapping waiting for compact_mappings() */
 };
 
+/* Capacity of the chunks of a mapping, and the address of node number i. */
+#define MAP_CAPACITY(m) ((uint32_t) MAP_CHUNK_MIN * ((1U << (m)->num_chunks) - 1))
+
+static inline mapping_node_t *map_node (mapping_t *m, uint32_t i) {
+    uint32_t q = i / MAP_CHUNK_MIN + 1;
+#ifdef __GNUC__
+    int c = 31 - __builtin_clz (q);
+#else
+    int c = 0;
+    while (q >>= 1)
+        c++;
+#endif
+
+    return m->chunks[c] + (i - MAP_CHUNK_MIN * ((1U << c) - 1));
+}
+
 typedef struct finfo_s {
     char *func;
     object_t *obj;
@@ -62,7 +101,6 @@ extern int total_mapping_size;
 extern int total_mapping_nodes;
 
 int msameval(svalue_t *, svalue_t *);
-int mapping_save_size(mapping_t *);
 typedef int(*map_func_t)(mapping_t *, mapping_node_t *, void *);
 mapping_t *mapTraverse(mapping_t *, map_func_t, void *);
 mapping_t *load_mapping_from_aggregate(svalue_t *, int);
@@ -74,8 +112,6 @@ svalue_t *find_for_insert(mapping_t *, svalue_t *, int);
 void absorb_mapping(mapping_t *, mapping_t *);
 void mapping_delete(mapping_t *, svalue_t *);
 mapping_t *add_mapping(mapping_t *, mapping_t *);
-mapping_node_t *new_map_node(void);
-void free_node(mapping_node_t *);
 void map_mapping(svalue_t *, int);
 void filter_mapping(svalue_t *, int);
 mapping_t *compose_mapping(mapping_t *, mapping_t *, unsigned short);
@@ -84,7 +120,7 @@ array_t *mapping_values(mapping_t *);
 array_t *mapping_each(mapping_t *);
 char *save_mapping(mapping_t *);
 void dealloc_mapping(mapping_t *);
-void mark_mapping_node_blocks(void);
+void compact_mappings(void);
 
 void add_mapping_pair(mapping_t *, char *, int);
 void add_mapping_string(mapping_t *, char *, const char *);
@@ -93,5 +129,4 @@ void add_mapping_object(mapping_t *, char *, object_t *);
 void add_mapping_array(mapping_t *, char *, array_t *);
 void add_mapping_shared_string(mapping_t *, char *, char *);
 
-int growMap (mapping_t * m);
 int restore_hash_string (char **val, svalue_t * sv);
@@ -10,17 +10,24 @@
 #include "otable.h"
 #include "mapping.h"
 #include "program.h"
+#include "src/apply.h"
 #include "src/comm.h"
 #include "rc.h"
 #include "src/frame.h"
 #include "src/simul_efun.h"
 #include "lpc/include/origin.h"
 #include "lpc/include/runtime_config.h"
+#include "lpc/include/save.h"
 #include "efuns/call_out.h"
 #include "efuns/file_utils.h"
+#include "efuns/async_file.h"
 #include "socket/socket_efuns.h"
 
 #include <sys/stat.h>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#endif
 
 #define too_deep_save_error() \
     error("Mappings and/or arrays nested too deep (%d) for save_object\n", MAX_SAVE_SVALUE_DEPTH);
@@ -28,8 +35,6 @@
 size_t tot_alloc_object = 0, tot_alloc_object_size = 0;
 
 char *save_mapping (mapping_t * m);
-static int restore_array (char **str, svalue_t *);
-static int restore_class (char **str, svalue_t *);
 int restore_hash_string (char **str, svalue_t *);
 
 int valid_hide (object_t * obj) {
@@ -41,13 +46,21 @@ int valid_hide (object_t * obj) {
     }
   push_object (obj);
   ret = apply_master_ob (APPLY_VALID_HIDE, 1);
-  return (!IS_ZERO (ret));
+  return MASTER_APPROVED (ret);
 }
 
 
 int save_svalue_depth = 0;
-int save_max_depth;
-int *save_svalue_sizes = 0;
+
+/*
+ * Elements of the arrays, classes and mappings being restored are parsed
+ * onto this stack first, and moved into a container of the right size when
+ * its end is reached.  That way the save data is parsed in a single pass.
+ * Anything left over from an error is freed by the next restore.
+ */
+static svalue_t *restore_stack = 0;
+static size_t restore_stack_size = 0;
+static size_t restore_sp = 0;
 
 /**
  * Calculate the size needed to save an svalue_t.
@@ -104,22 +117,21 @@ size_t svalue_save_size (const svalue_t * v) {
 
     case T_MAPPING:
       {
-        mapping_node_t **a = v->u.map->table, *elt;
-        int j = v->u.map->table_size;
+        mapping_t *m = v->u.map;
+        mapping_node_t *elt;
+        uint32_t j;
         size_t size = 0;
 
         if (++save_svalue_depth > MAX_SAVE_SVALUE_DEPTH)
           {
             too_deep_save_error ();
           }
-        do
+        for (j = 0; j < m->fill; j++)
           {
-            for (elt = a[j]; elt; elt = elt->next)
-              {
-                size += svalue_save_size (elt->values) + svalue_save_size (elt->values + 1);
-              }
+            elt = map_node (m, j);
+            if (elt->values[0].type != T_INVALID)
+              size += svalue_save_size (elt->values) + svalue_save_size (elt->values + 1);
           }
-        while (j--);
         save_svalue_depth--;
         return size + 5; /* 5 for ([ and ]), 1 for comma delimiter */
       }
@@ -250,22 +262,22 @@ void save_svalue (svalue_t * v, char **buf) {
 
     case T_MAPPING:
       {
-        int j = v->u.map->table_size;
-        mapping_node_t **a = v->u.map->table, *elt;
+        mapping_t *m = v->u.map;
+        mapping_node_t *elt;
+        uint32_t j;
 
         *(*buf)++ = '(';
         *(*buf)++ = '[';
-        do
+        for (j = 0; j < m->fill; j++)
           {
-            for (elt = a[j]; elt; elt = elt->next)
-              {
-                save_svalue (elt->values, buf);
-                *(*buf)++ = ':';
-                save_svalue (elt->values + 1, buf);
-                *(*buf)++ = ',';
-              }
+            elt = map_node (m, j);
+            if (elt->values[0].type == T_INVALID)
+              continue;
+            save_svalue (elt->values, buf);
+            *(*buf)++ = ':';
+            save_svalue (elt->values + 1, buf);
+            *(*buf)++ = ',';
           }
-        while (j--);
 
         *(*buf)++ = ']';
         *(*buf)++ = ')';
@@ -275,268 +287,18 @@ void save_svalue (svalue_t * v, char **buf) {
     }
 }
 
-static int restore_internal_size (char **str, int is_mapping, int depth) {
-  register char *cp = *str;
-  int size = 0;
-  char c, delim, index = 0;
-
-  delim = is_mapping ? ':' : ',';
-  while ((c = *cp++))
+static void restore_push (svalue_t * v) {
+  if (restore_sp == restore_stack_size)
     {
-      switch (c)
-        {
-        case '"':
-          {
-            while ((c = *cp++) != '"')
-              if ((c == '\0') || (c == '\\' && !*cp++))
-                {
-                  return 0;
-                }
-            if (*cp++ != delim)
-              return 0;
-            size++;
-            break;
-          }
-
-        case '(':
-          {
-            if (*cp == '{')
-              {
-                *str = ++cp;
-                if (!restore_internal_size (str, 0, save_svalue_depth++))
-                  {
-                    return 0;
-                  }
-              }
-            else if (*cp == '[')
-              {
-                *str = ++cp;
-                if (!restore_internal_size (str, 1, save_svalue_depth++))
-                  {
-                    return 0;
-                  }
-              }
-            else if (*cp == '/')
-              {
-                *str = ++cp;
-                if (!restore_internal_size (str, 0, save_svalue_depth++))
-                  return 0;
-              }
-            else
-              {
-                return 0;
-              }
-
-            if (*(cp = *str) != delim)
-              {
-                return 0;
-              }
-            cp++;
-            size++;
-            break;
-          }
-
-        case ']':
-          {
-            if (*cp++ == ')' && is_mapping)
-              {
-                *str = cp;
-                if (!save_svalue_sizes)
-                  {
-                    save_max_depth = 128;
-                    while (save_max_depth <= depth)
-                      save_max_depth <<= 1;
-                    save_svalue_sizes = CALLOCATE (save_max_depth, int, TAG_TEMPORARY, "restore_internal_size");
-                  }
-                else if (depth >= save_max_depth)
-                  {
-                    while ((save_max_depth <<= 1) <= depth);
-                    save_svalue_sizes = RESIZE (save_svalue_sizes, save_max_depth, int, TAG_TEMPORARY, "restore_internal_size");
-                  }
-                save_svalue_sizes[depth] = size;
-                return 1;
-              }
-            else
-              {
-                return 0;
-              }
-          }
-
-        case '/':
-        case '}':
-          {
-            if (*cp++ == ')' && !is_mapping)
-              {
-                *str = cp;
-                if (!save_svalue_sizes)
-                  {
-                    save_max_depth = 128;
-                    while (save_max_depth <= depth)
-                      save_max_depth <<= 1;
-                    save_svalue_sizes = CALLOCATE (save_max_depth, int, TAG_TEMPORARY,
-                                       "restore_internal_size");
-                  }
-                else if (depth >= save_max_depth)
-                  {
-                    while ((save_max_depth <<= 1) <= depth);
-                    save_svalue_sizes = RESIZE (save_svalue_sizes, save_max_depth, int, TAG_TEMPORARY, "restore_internal_size");
-                  }
-                save_svalue_sizes[depth] = size;
-                return 1;
-              }
-            else
-              {
-                return 0;
-              }
-          }
-
-        case ':':
-        case ',':
-          {
-            if (c != delim)
-              return 0;
-            size++;
-            break;
-          }
-
-        default:
-          {
-            if (!(cp = strchr (cp, delim)))
-              return 0;
-            cp++;
-            size++;
-          }
-        }
-      if (is_mapping)
-        delim = (index ^= 1) ? ',' : ':';
+      restore_stack_size = restore_stack_size ? restore_stack_size * 2 : 256;
+      restore_stack = RESIZE (restore_stack, restore_stack_size, svalue_t, TAG_TEMPORARY, "restore_push");
     }
-  return 0;
+  restore_stack[restore_sp++] = *v;
 }
 
-static int restore_size (char **str, int is_mapping) {
-  register char *cp = *str;
-  int size = 0, mb_span;
-  char c, delim, index = 0;
-
-  delim = is_mapping ? ':' : ',';
-
-  while ((c = *cp))
-    {
-      mb_span = mblen (cp, MB_CUR_MAX);
-      if (mb_span < 0)
-                    return -1;
-      cp += mb_span; /* don't check in the middle of a multibyte character */
-      switch (c)
-                    {
-                      case '"':
-                        {
-                    char* start = cp - 1;
-                    while ((c = *cp) != '"')
-                      {
-                              mb_span = mblen (cp, MB_CUR_MAX);
-                              if (mb_span < 0)
-                                return -1;
-                              cp += mb_span; /* don't check backslash in the middle of a multibyte character */
-                              if ((c == '\0') || (c == '\\' && !*cp++))
-                                return 0;
-                      }
-                    cp++;
-
-                    if (*cp++ != delim)
-                      {
-                              debug_error ("corrupted multibyte string: %s", start);
-                              return -1;
-                      }
-                    size++;
-                    break;
-                  }
-
-                case '(':
-                  {
-                    if (*cp == '{')
-                      {
-                              *str = ++cp;
-                              if (!restore_internal_size (str, 0, save_svalue_depth++))
-                                return -1;
-                      }
-                    else if (*cp == '[')
-                      {
-                              *str = ++cp;
-                              if (!restore_internal_size (str, 1, save_svalue_depth++))
-                                return -1;
-                      }
-                    else if (*cp == '/')
-                      {
-                              *str = ++cp;
-                              if (!restore_internal_size (str, 0, save_svalue_depth++))
-                                return -1;
-                      }
-                    else
-                      {
-                              return -1;
-                }
-
-                    if (*(cp = *str) != delim)
-                      {
-                              return -1;
-                      }
-                    cp++;
-                    size++;
-                    break;
-                  }
-
-                case ']':
-                  {
-                    save_svalue_depth = 0;
-                    if (*cp++ == ')' && is_mapping)
-                      {
-                              *str = cp;
-                              return size;
-                      }
-                    else
-                      {
-                              return -1;
-                      }
-                  }
-
-                case '/':
-                case '}':
-                  {
-                    save_svalue_depth = 0;
-                    if (*cp++ == ')' && !is_mapping)
-                      {
-                              *str = cp;
-                              return size;
-                      }
-                    else
-                      {
-                              return -1;
-                      }
-                  }
-
-                case ':':
-                case ',':
-                  {
-                    if (c != delim)
-                      return -1;
-                    size++;
-                    break;
-                  }
-
-                default:
-                  {
-                    if (!(cp = strchr (cp, delim)))
-                      {
-                              return -1;
-                      }
-                    cp++;
-                    size++;
-                  }
-              }
-      if (is_mapping)
-              delim = (index ^= 1) ? ',' : ':';
-    }
-  return -1;
+static void restore_unwind (size_t base) {
+  while (restore_sp > base)
+    free_svalue (&restore_stack[--restore_sp], "restore_unwind");
 }
 
 static int restore_interior_string (char **val, svalue_t * sv) {
@@ -611,7 +373,8 @@ static int restore_interior_string (char **val, svalue_t * sv) {
 
 static int parse_numeric (char **cpp, char c, svalue_t * dest) {
   char *cp = *cpp;
-  int res, neg;
+  int64_t res;
+  int neg;
 
   if (c == '-')
     {
@@ -717,515 +480,218 @@ static int parse_numeric (char **cpp, char c, svalue_t * dest) {
     }
 }
 
-static void add_map_stats (mapping_t * m, int count) {
-  total_mapping_nodes += count;
-  total_mapping_size += count * sizeof (mapping_node_t);
-  m->count = count;
-}
-
-int growMap (mapping_t *);
+static int restore_container (char **str, svalue_t * sv, int depth);
 
-static int restore_mapping (char **str, svalue_t * sv) {
-  int size, i, mask, oi, count = 0;
-  char c;
-  mapping_t *m;
-  svalue_t key, value;
-  mapping_node_t **a, *elt, *elt2;
+/*
+ * Parse one element of a container and the delimiter after it.
+ * String keys of mappings are made shared right away.
+ */
+static int restore_element (char **str, svalue_t * sv, char delim, int is_key, int depth) {
   char *cp = *str;
+  char c;
   int err;
 
-  if (save_svalue_depth)
-    size = save_svalue_sizes[save_svalue_depth - 1];
-  else if ((size = restore_size (str, 1)) < 0)
+  switch (c = *cp++)
     {
-      debug_error ("corrupted");
+    case '"':
+      *str = cp;
+      if ((err = is_key ? restore_hash_string (str, sv) : restore_interior_string (str, sv)))
+        return err;
+      cp = *str;
+      break;
+
+    case '(':
+      *str = cp;
+      if ((err = restore_container (str, sv, depth + 1)))
+        return err;
+      cp = *str;
+      break;
+
+    case '-':
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+      if (!parse_numeric (&cp, c, sv))
+        return ROB_NUMERAL_ERROR;
+      cp--; /* parse_numeric() consumed the delimiter */
+      break;
+
+    default:
+      if (c != delim)
+        return ROB_GENERAL_ERROR;
+      *sv = const0;
+      *str = cp;
       return 0;
     }
 
-  if (!size)
+  if (*cp != delim)
     {
-      *str += 2;
-      sv->u.map = allocate_mapping (0);
-      sv->type = T_MAPPING;
-      return 0;
+      free_svalue (sv, "restore_element");
+      return ROB_GENERAL_ERROR;
     }
-  m = allocate_mapping (size >> 1);	/* have to clean up after this or */
-  a = m->table;			/* we'll leak */
-  mask = m->table_size;
+  *str = cp + 1;
+  return 0;
+}
+
+static int restore_mapping (char **str, svalue_t * sv, int depth) {
+  size_t base = restore_sp, n;
+  mapping_t *m;
+  svalue_t key, value, *ret;
+  int err;
 
-  while (1)
+  while (**str != ']')
     {
-      switch (c = *cp++)
+      if ((err = restore_element (str, &key, ':', 1, depth)))
+        goto error;
+      if ((err = restore_element (str, &value, ',', 0, depth)))
         {
-        case '"':
-          {
-            *str = cp;
-            if ((err = restore_hash_string (str, &key)))
-              goto key_error;
-            cp = *str;
-            cp++;
-            break;
-          }
+          free_svalue (&key, "restore_mapping");
+          goto error;
+        }
+      restore_push (&key);
+      restore_push (&value);
+    }
+  if ((*str)[1] != ')')
+    {
+      err = ROB_MAPPING_ERROR;
+      goto error;
+    }
+  *str += 2;
 
-        case '(':
-          {
-            save_svalue_depth++;
-            if (*cp == '[')
-              {
-                *str = ++cp;
-                if ((err = restore_mapping (str, &key)))
-                  goto key_error;
-              }
-            else if (*cp == '{')
-              {
-                *str = ++cp;
-                if ((err = restore_array (str, &key)))
-                  goto key_error;
-              }
-            else if (*cp == '/')
-              {
-                *str = ++cp;
-                if ((err = restore_class (str, &key)))
-                  goto key_error;
-              }
-            else
-              goto generic_key_error;
-            cp = *str;
-            cp++;
-            break;
-          }
+  n = (restore_sp - base) / 2;
+  if (n > (size_t)CONFIG_INT (__MAX_MAPPING_SIZE__))
+    {
+      restore_unwind (base);
+      mapping_too_large ();
+    }
+  m = allocate_mapping (n);
+  for (n = base; n < restore_sp; n += 2)
+    {
+      /* keys that can't be saved (objects, functions, buffers) all come
+       * back as 0: a duplicate key replaces, and frees, the earlier value */
+      ret = find_for_insert (m, &restore_stack[n], 1);
+      free_svalue (&restore_stack[n], "restore_mapping");
+      *ret = restore_stack[n + 1];
+    }
+  restore_sp = base;
+  sv->type = T_MAPPING;
+  sv->u.map = m;
+  return 0;
 
-        case ':':
-          {
-            key.u.number = 0;
-            key.type = T_NUMBER;
-            break;
-          }
+error:
+  restore_unwind (base);
+  return err == ROB_GENERAL_ERROR ? ROB_MAPPING_ERROR : err;
+}
+
+/* arrays and classes */
+static int restore_array (char **str, svalue_t * ret, int type, int depth) {
+  char close = (type == T_CLASS) ? '/' : '}';
+  int code = (type == T_CLASS) ? ROB_CLASS_ERROR : ROB_ARRAY_ERROR;
+  size_t base = restore_sp, n;
+  svalue_t value;
+  array_t *v;
+  int err;
 
-        case ']':
-          *str = ++cp;
-          add_map_stats (m, count);
-          sv->type = T_MAPPING;
-          sv->u.map = m;
-          return 0;
-
-        case '-':
-        case '0':
-        case '1':
-        case '2':
-        case '3':
-        case '4':
-        case '5':
-        case '6':
-        case '7':
-        case '8':
-        case '9':
-          if (!parse_numeric (&cp, c, &key))
-            goto key_numeral_error;
-          break;
-
-        default:
-          goto generic_key_error;
+  while (**str != close)
+    {
+      if ((err = restore_element (str, &value, ',', 0, depth)))
+        {
+          restore_unwind (base);
+          return err == ROB_GENERAL_ERROR ? code : err;
         }
+      restore_push (&value);
+    }
+  n = restore_sp - base;
+  if ((*str)[1] != ')' || n > (size_t)CONFIG_INT (__MAX_ARRAY_SIZE__))
+    {
+      restore_unwind (base);
+      return code;
+    }
+  *str += 2;
+
+  v = (type == T_CLASS) ? allocate_class_by_size ((int)n) : allocate_array (n);
+  if (n)
+    memcpy (v->item, restore_stack + base, n * sizeof (svalue_t));
+  restore_sp = base;
+  ret->u.arr = v;
+  ret->type = type;
+  return 0;
+}
+
+/* *str points after the '(' */
+static int restore_container (char **str, svalue_t * sv, int depth) {
+  char c = *(*str)++;
 
-      /* At this point, key is a valid, referenced svalue and we're
-         responsible for it */
+  if (depth > MAX_SAVE_SVALUE_DEPTH)
+    return ROB_GENERAL_ERROR;
+  switch (c)
+    {
+    case '{':
+      return restore_array (str, sv, T_ARRAY, depth);
+    case '/':
+      return restore_array (str, sv, T_CLASS, depth);
+    case '[':
+      return restore_mapping (str, sv, depth);
+    default:
+      return ROB_GENERAL_ERROR;
+    }
+}
+
+int restore_string (char *val, svalue_t * sv) {
+  register char *cp = val;
+  char *start = cp;
+  char c;
+  size_t len;
 
-      switch (c = *cp++)
+  while ((c = *cp++) != '"')
+    {
+      switch (c)
         {
-        case '"':
+        case '\r':
           {
-            *str = cp;
-            if ((err = restore_interior_string (str, &value)))
-              goto value_error;
-            cp = *str;
-            cp++;
+            *(cp - 1) = '\n';
             break;
           }
 
-        case '(':
+        case '\\':
           {
-            save_svalue_depth++;
-            if (*cp == '[')
-              {
-                *str = ++cp;
-                if ((err = restore_mapping (str, &value)))
-                  goto value_error;
-              }
-            else if (*cp == '{')
-              {
-                *str = ++cp;
-                if ((err = restore_array (str, &value)))
-                  goto value_error;
-              }
-            else if (*cp == '/')
+            char *newp = cp - 1;
+
+            if ((*newp++ = *cp++))
               {
-                *str = ++cp;
-                if ((err = restore_class (str, &value)))
-                  goto value_error;
+                while ((c = *cp++) != '"')
+                  {
+                    if (c == '\\')
+                      {
+                        if (!(*newp++ = *cp++))
+                          return ROB_STRING_ERROR;
+                      }
+                    else
+                      {
+                        if (c == '\r')
+                          *newp++ = '\n';
+                        else
+                          *newp++ = c;
+                      }
+                  }
+                if ((c == '\0') || (*cp != '\0'))
+                  return ROB_STRING_ERROR;
+                *newp = '\0';
+                sv->u.string = new_string (newp - start, "restore_string");
+                strcpy (sv->u.string, start);
+                sv->type = T_STRING;
+                sv->subtype = STRING_MALLOC;
+                return 0;
               }
             else
-              goto generic_value_error;
-            cp = *str;
-            cp++;
-            break;
-          }
-
-        case '-':
-        case '0':
-        case '1':
-        case '2':
-        case '3':
-        case '4':
-        case '5':
-        case '6':
-        case '7':
-        case '8':
-        case '9':
-          if (!parse_numeric (&cp, c, &value))
-            goto value_numeral_error;
-          break;
-
-        case ',':
-          {
-            value.u.number = 0;
-            value.type = T_NUMBER;
-            break;
-          }
-
-        default:
-          goto generic_value_error;
-        }
-
-      /* both key and value are valid, referenced svalues */
-
-      oi = (int)MAP_POINTER_HASH (key.u.number);
-      i = oi & mask;
-      if ((elt2 = elt = a[i]))
-        {
-          do
-            {
-              /* This should never happen, but don't bail on it */
-              if (msameval (&key, elt->values))
-                {
-                  free_svalue (&key, "restore_mapping: duplicate key");
-                  free_svalue (elt->values + 1,
-                               "restore_mapping: replaced value");
-                  *(elt->values + 1) = value;
-                  break;
-                }
-            }
-          while ((elt = elt->next));
-          if (elt)
-            continue;
-        }
-      else if (!(--m->unfilled))
-        {
-          if (growMap (m))
-            {
-              a = m->table;
-              if (oi & ++mask)
-                elt2 = a[i |= mask];
-              mask <<= 1;
-              mask--;
-            }
-          else
-            {
-              add_map_stats (m, count);
-              free_mapping (m);
-              free_svalue (&key, "restore_mapping: out of memory");
-              free_svalue (&value, "restore_mapping: out of memory");
-              error ("Out of memory\n");
-            }
-        }
-
-      if (++count > CONFIG_INT (__MAX_MAPPING_SIZE__))
-        {
-          add_map_stats (m, count - 1);
-          free_mapping (m);
-          free_svalue (&key, "restore_mapping: mapping too large");
-          free_svalue (&value, "restore_mapping: mapping too large");
-          mapping_too_large ();
-        }
-
-      elt = new_map_node ();
-      *elt->values = key;
-      *(elt->values + 1) = value;
-      (a[i] = elt)->next = elt2;
-    }
-
-  /* something went wrong */
-value_numeral_error:
-  free_svalue (&key, "restore_mapping: numeral value error");
-key_numeral_error:
-  add_map_stats (m, count);
-  free_mapping (m);
-  return ROB_NUMERAL_ERROR;
-generic_value_error:
-  free_svalue (&key, "restore_mapping: generic value error");
-generic_key_error:
-  add_map_stats (m, count);
-  free_mapping (m);
-  return ROB_MAPPING_ERROR;
-value_error:
-  free_svalue (&key, "restore_mapping: value error");
-key_error:
-  add_map_stats (m, count);
-  free_mapping (m);
-  return err;
-}
-
-
-static int restore_class (char **str, svalue_t * ret) {
-  int size;
-  char c;
-  array_t *v;
-  svalue_t *sv;
-  char *cp = *str;
-  int err;
-
-  if (save_svalue_depth)
-    size = save_svalue_sizes[save_svalue_depth - 1];
-  else if ((size = restore_size (str, 0)) < 0)
-    return ROB_CLASS_ERROR;
-
-  v = allocate_class_by_size (size);	/* after this point we have to clean up
-                                           or we'll leak */
-  sv = v->item;
-
-  while (size--)
-    {
-      switch (c = *cp++)
-        {
-        case '"':
-          *str = cp;
-          if ((err = restore_interior_string (str, sv)))
-            goto generic_error;
-          cp = *str;
-          cp++;
-          sv++;
-          break;
-
-        case ',':
-          sv++;
-          break;
-
-        case '(':
-          {
-            save_svalue_depth++;
-            if (*cp == '[')
-              {
-                *str = ++cp;
-                if ((err = restore_mapping (str, sv)))
-                  goto error;
-              }
-            else if (*cp == '{')
-              {
-                *str = ++cp;
-                if ((err = restore_array (str, sv)))
-                  goto error;
-              }
-            else if (*cp == '/')
-              {
-                *str = ++cp;
-                if ((err = restore_class (str, sv)))
-                  goto error;
-              }
-            else
-              goto generic_error;
-            sv++;
-            cp = *str;
-            cp++;
-            break;
-          }
-
-        case '-':
-        case '0':
-        case '1':
-        case '2':
-        case '3':
-        case '4':
-        case '5':
-        case '6':
-        case '7':
-        case '8':
-        case '9':
-          if (parse_numeric (&cp, c, sv))
-            sv++;
-          else
-            goto numeral_error;
-          break;
-
-        default:
-          goto generic_error;
-        }
-    }
-
-  cp += 2;
-  *str = cp;
-  ret->u.arr = v;
-  ret->type = T_CLASS;
-  return 0;
-  /* something went wrong */
-numeral_error:
-  err = ROB_NUMERAL_ERROR;
-  goto error;
-generic_error:
-  err = ROB_CLASS_ERROR;
-error:
-  free_class (v);
-  return err;
-}
-
-static int restore_array (char **str, svalue_t * ret) {
-  int size;
-  char c;
-  array_t *v;
-  svalue_t *sv;
-  char *cp = *str;
-  int err;
-
-  if (save_svalue_depth)
-    size = save_svalue_sizes[save_svalue_depth - 1];
-  else if ((size = restore_size (str, 0)) < 0)
-    return ROB_ARRAY_ERROR;
-
-  v = allocate_array (size);	/* after this point we have to clean up
-                                   or we'll leak */
-  sv = v->item;
-
-  while (size--)
-    {
-      switch (c = *cp++)
-        {
-        case '"':
-          *str = cp;
-          if ((err = restore_interior_string (str, sv)))
-            goto generic_error;
-          cp = *str;
-          cp++;
-          sv++;
-          break;
-
-        case ',':
-          sv++;
-          break;
-
-        case '(':
-          {
-            save_svalue_depth++;
-            if (*cp == '[')
-              {
-                *str = ++cp;
-                if ((err = restore_mapping (str, sv)))
-                  goto error;
-              }
-            else if (*cp == '{')
-              {
-                *str = ++cp;
-                if ((err = restore_array (str, sv)))
-                  goto error;
-              }
-            else if (*cp == '/')
-              {
-                *str = ++cp;
-                if ((err = restore_class (str, sv)))
-                  goto error;
-              }
-            else
-              goto generic_error;
-            sv++;
-            cp = *str;
-            cp++;
-            break;
-          }
-
-        case '-':
-        case '0':
-        case '1':
-        case '2':
-        case '3':
-        case '4':
-        case '5':
-        case '6':
-        case '7':
-        case '8':
-        case '9':
-          if (parse_numeric (&cp, c, sv))
-            sv++;
-          else
-            goto numeral_error;
-          break;
-
-        default:
-          goto generic_error;
-        }
-    }
-
-  cp += 2;
-  *str = cp;
-  ret->u.arr = v;
-  ret->type = T_ARRAY;
-  return 0;
-  /* something went wrong */
-numeral_error:
-  err = ROB_NUMERAL_ERROR;
-  goto error;
-generic_error:
-  err = ROB_ARRAY_ERROR;
-error:
-  free_array (v);
-  return err;
-}
-
-int restore_string (char *val, svalue_t * sv) {
-  register char *cp = val;
-  char *start = cp;
-  char c;
-  size_t len;
-
-  while ((c = *cp++) != '"')
-    {
-      switch (c)
-        {
-        case '\r':
-          {
-            *(cp - 1) = '\n';
-            break;
-          }
-
-        case '\\':
-          {
-            char *newp = cp - 1;
-
-            if ((*newp++ = *cp++))
-              {
-                while ((c = *cp++) != '"')
-                  {
-                    if (c == '\\')
-                      {
-                        if (!(*newp++ = *cp++))
-                          return ROB_STRING_ERROR;
-                      }
-                    else
-                      {
-                        if (c == '\r')
-                          *newp++ = '\n';
-                        else
-                          *newp++ = c;
-                      }
-                  }
-                if ((c == '\0') || (*cp != '\0'))
-                  return ROB_STRING_ERROR;
-                *newp = '\0';
-                sv->u.string = new_string (newp - start, "restore_string");
-                strcpy (sv->u.string, start);
-                sv->type = T_STRING;
-                sv->subtype = STRING_MALLOC;
-                return 0;
-              }
-            else
-              return ROB_STRING_ERROR;
+              return ROB_STRING_ERROR;
           }
 
         case '\0':
@@ -1250,39 +716,15 @@ int restore_string (char *val, svalue_t * sv) {
 /* for this case, the variable in question has been set to zero already,
    and we don't have to worry about preserving it */
 int restore_svalue (char *cp, svalue_t * v) {
-  int ret;
   char c;
 
+  restore_unwind (0); /* left over from an error */
   switch (c = *cp++)
     {
     case '"':
       return restore_string (cp, v);
     case '(':
-      if (*cp == '{')
-        {
-          cp++;
-          ret = restore_array (&cp, v);
-        }
-      else if (*cp == '[')
-        {
-          cp++;
-          ret = restore_mapping (&cp, v);
-        }
-      else if (*cp++ == '/')
-        {
-          ret = restore_class (&cp, v);
-        }
-      else
-        ret = ROB_GENERAL_ERROR;
-
-      if (save_svalue_depth)
-        {
-          save_svalue_depth = save_max_depth = 0;
-          if (save_svalue_sizes)
-            FREE ((char *) save_svalue_sizes);
-          save_svalue_sizes = (int *) 0;
-        }
-      return ret;
+      return restore_container (&cp, v, 1);
 
     case '-':
     case '0':
@@ -1312,65 +754,9 @@ int restore_svalue (char *cp, svalue_t * v) {
 int safe_restore_svalue (char *cp, svalue_t * v) {
   int ret;
   svalue_t val;
-  char c;
-
-  val.type = T_NUMBER;
-  switch (c = *cp++)
-    {
-    case '"':
-      if ((ret = restore_string (cp, &val)))
-        return ret;
-      break;
-    case '(':
-      {
-        if (*cp == '{')
-          {
-            cp++;
-            ret = restore_array (&cp, &val);
-          }
-        else if (*cp == '[')
-          {
-            cp++;
-            ret = restore_mapping (&cp, &val);
-          }
-        else if (*cp++ == '/')
-          {
-            ret = restore_class (&cp, &val);
-          }
-        else
-          return ROB_GENERAL_ERROR;
-
-        if (save_svalue_depth)
-          {
-            save_svalue_depth = save_max_depth = 0;
-            if (save_svalue_sizes)
-              FREE ((char *) save_svalue_sizes);
-            save_svalue_sizes = (int *) 0;
-          }
-        if (ret)
-          return ret;
-        break;
-      }
-
-    case '-':
-    case '0':
-    case '1':
-    case '2':
-    case '3':
-    case '4':
-    case '5':
-    case '6':
-    case '7':
-    case '8':
-    case '9':
-      if (!parse_numeric (&cp, c, &val))
-        return ROB_NUMERAL_ERROR;
-      break;
 
-    default:
-      val.type = T_NUMBER;
-      val.u.number = 0;
-    }
+  if ((ret = restore_svalue (cp, &val)))
+    return ret;
   free_svalue (v, "safe_restore_svalue");
   *v = val;
   return 0;
@@ -1429,6 +815,8 @@ void restore_object_from_buff (object_t * ob, char *theBuff, int noclear) {
         {
           *tmp = '\0';
           nextBuff = tmp + 1;
+          if (tmp > buff && tmp[-1] == '\r') /* written on Windows */
+            tmp[-1] = '\0';
         }
       else
         {
@@ -1473,71 +861,565 @@ void restore_object_from_buff (object_t * ob, char *theBuff, int noclear) {
     }
 }
 
-/*
- * Save an object to a file.
- * The routine checks with the function "valid_write()" in /obj/master.c
- * to assertain that the write is legal.
- * If 'save_zeros' is set, 0 valued variables will be saved
- */
-static int save_object_recurse (program_t * prog, svalue_t ** svp, int type, int save_zeros, FILE * f) {
-  int i;
-  size_t theSize;
-  char *new_str, *p;
+/*
+ * Save an object to a file.
+ * The routine checks with the function "valid_write()" in /obj/master.c
+ * to assertain that the write is legal.
+ * If SAVE_ZEROS is set in the flags, 0 valued variables will be saved.
+ * SAVE_BINARY selects the binary format below instead of the text format.
+ *
+ * The save data is formatted into memory first (save_object_snapshot()),
+ * so that async_save_object() can hand the writing to a worker thread.
+ */
+static void save_object_size (program_t * prog, svalue_t ** svp, int type, size_t * size) {
+  int i;
+
+  for (i = 0; i < prog->num_inherited; i++)
+    save_object_size (prog->inherit[i].prog, svp, prog->inherit[i].type_mod | type, size);
+  if (type & NAME_STATIC)
+    {
+      (*svp) += prog->num_variables_defined;
+      return;
+    }
+  for (i = 0; i < prog->num_variables_defined; i++)
+    {
+      if (prog->variable_types[i] & NAME_STATIC)
+        {
+          (*svp)++;
+          continue;
+        }
+      save_svalue_depth = 0;
+      /* "name value\n" */
+      *size += strlen (prog->variable_table[i]) + 1 + svalue_save_size ((*svp)++) + 1;
+    }
+}
+
+static void save_object_recurse (program_t * prog, svalue_t ** svp, int type, int save_zeros, char **buf) {
+  int i;
+  char *line, *value;
+
+  for (i = 0; i < prog->num_inherited; i++)
+    {
+      save_object_recurse (prog->inherit[i].prog, svp,
+                           prog->inherit[i].type_mod | type,
+                           save_zeros, buf);
+    }
+  if (type & NAME_STATIC)
+    {
+      (*svp) += prog->num_variables_defined;
+      return;
+    }
+  for (i = 0; i < prog->num_variables_defined; i++)
+    {
+      if (prog->variable_types[i] & NAME_STATIC)
+        {
+          (*svp)++;
+          continue;
+        }
+      line = *buf;
+      strcpy (line, prog->variable_table[i]);
+      *buf = line + strlen (line);
+      *(*buf)++ = ' ';
+      *(value = *buf) = '\0'; /* objects etc. save as nothing */
+      save_svalue ((*svp)++, buf);
+      if (!save_zeros && value[0] == '0' && value[1] == 0)	/* Armidale */
+        *buf = line;
+      else
+        *(*buf)++ = '\n';
+    }
+}
+
+static char *save_text_snapshot (object_t * ob, int save_zeros, size_t * len) {
+
+  size_t size;
+  char *buf, *p;
+  svalue_t *v;
+
+  /* size everything first: errors for nesting too deep are raised before allocating */
+  size = strlen (ob->prog->name) + 4; /* "#/name\n" */
+  v = ob->variables;
+  save_object_size (ob->prog, &v, 0, &size);
+
+  buf = (char *) DXALLOC (size, TAG_TEMPORARY, "save_object_snapshot");
+  p = buf + sprintf (buf, "#/%s\n", ob->prog->name);
+  v = ob->variables;
+  save_object_recurse (ob->prog, &v, 0, save_zeros, &p);
+  *p = '\0';
+  *len = p - buf;
+  return buf;
+}
+
+/*
+ * Binary save format (SAVE_BINARY)
+ *
+ *   magic "\177NSO" and a version byte
+ *   program name: varint length, bytes
+ *   string table: varint count, then varint length, bytes and '\0' of each
+ *   variables up to the end: varint name index, value
+ *
+ * A value is a tag byte followed by:
+ *   SB_ZERO              nothing
+ *   SB_INT               zigzag varint
+ *   SB_REAL              8 bytes of IEEE 754 double, little-endian
+ *   SB_STRING            varint index into the string table
+ *   SB_ARRAY, SB_CLASS   varint size, then the elements
+ *   SB_MAPPING           varint number of pairs, then key and value of each
+ *
+ * Every distinct string, variable names included, is stored once.  On
+ * restore it becomes a shared string once, and each use adds a reference;
+ * nothing is tokenized or hashed per value.
+ */
+#define SAVE_BINARY_MAGIC "\177NSO"
+#define SAVE_BINARY_VERSION 1
+
+enum {
+  SB_ZERO, SB_INT, SB_REAL, SB_STRING, SB_ARRAY, SB_CLASS, SB_MAPPING
+};
+
+typedef struct {
+  char *buf;
+  size_t len, size;
+} save_buf_t;
+
+typedef struct {
+  const char *str;
+  uint64_t hash;
+  uint32_t len, index, gen;	/* empty unless gen == sb_gen */
+} save_str_slot_t;
+
+/* kept between saves, so a save usually doesn't allocate until the end */
+static save_buf_t sb_body, sb_strings;
+static save_str_slot_t *sb_table = 0;
+static uint32_t sb_table_size = 0, sb_count = 0, sb_gen = 0;
+
+static char *sb_reserve (save_buf_t * b, size_t n) {
+  if (b->len + n > b->size)
+    {
+      b->size = b->size ? b->size * 2 : 4096;
+      if (b->size < b->len + n)
+        b->size = b->len + n;
+      b->buf = (char *) DREALLOC (b->buf, b->size, TAG_TEMPORARY, "sb_reserve");
+    }
+  return b->buf + b->len;
+}
+
+static void sb_varint (save_buf_t * b, uint64_t v) {
+  unsigned char *p = (unsigned char *) sb_reserve (b, 10);
+
+  while (v >= 0x80)
+    {
+      *p++ = (unsigned char) (v | 0x80);
+      v >>= 7;
+    }
+  *p++ = (unsigned char) v;
+  b->len = (char *) p - b->buf;
+}
+
+static void sb_byte (save_buf_t * b, int c) {
+  *sb_reserve (b, 1) = (char) c;
+  b->len++;
+}
+
+static uint32_t sb_string_index (const char *str, size_t len) {
+  uint64_t hash = strhash64 (str, len);
+  uint32_t i, mask;
+  save_str_slot_t *slot;
+
+  if ((sb_count + 1) * 2 > sb_table_size)
+    {
+      /* grow and re-insert the strings of this save */
+      save_str_slot_t *old = sb_table;
+      uint32_t old_size = sb_table_size, j;
+
+      sb_table_size = sb_table_size ? sb_table_size * 2 : 256;
+      sb_table = CALLOCATE (sb_table_size, save_str_slot_t, TAG_TEMPORARY, "sb_string_index");
+      for (j = 0; j < sb_table_size; j++)
+        sb_table[j].gen = sb_gen - 1;
+      for (j = 0; j < old_size; j++)
+        {
+          if (old[j].gen != sb_gen)
+            continue;
+          for (i = (uint32_t) old[j].hash & (sb_table_size - 1); sb_table[i].gen == sb_gen; i = (i + 1) & (sb_table_size - 1))
+            ;
+          sb_table[i] = old[j];
+        }
+      if (old)
+        FREE (old);
+    }
+
+  mask = sb_table_size - 1;
+  for (i = (uint32_t) hash & mask; (slot = &sb_table[i])->gen == sb_gen; i = (i + 1) & mask)
+    {
+      if (slot->hash == hash && slot->len == len && memcmp (slot->str, str, len) == 0)
+        return slot->index;
+    }
+
+  slot->str = str;
+  slot->hash = hash;
+  slot->len = (uint32_t) len;
+  slot->index = sb_count++;
+  slot->gen = sb_gen;
+  sb_varint (&sb_strings, len);
+  memcpy (sb_reserve (&sb_strings, len + 1), str, len + 1);
+  sb_strings.len += len + 1;
+  return slot->index;
+}
+
+static void save_binary_svalue (svalue_t * v) {
+  int i;
+
+  switch (v->type)
+    {
+    case T_STRING:
+      sb_byte (&sb_body, SB_STRING);
+      sb_varint (&sb_body, sb_string_index (v->u.string, SVALUE_STRLEN (v)));
+      return;
+
+    case T_NUMBER:
+      if (!v->u.number)
+        break;
+      sb_byte (&sb_body, SB_INT);
+      sb_varint (&sb_body, ((uint64_t) v->u.number << 1) ^ (uint64_t) (v->u.number >> 63));
+      return;
+
+    case T_REAL:
+      {
+        uint64_t bits;
+        unsigned char *p;
+
+        memcpy (&bits, &v->u.real, sizeof (bits));
+        sb_byte (&sb_body, SB_REAL);
+        p = (unsigned char *) sb_reserve (&sb_body, 8);
+        for (i = 0; i < 8; i++, bits >>= 8)
+          p[i] = (unsigned char) bits;
+        sb_body.len += 8;
+        return;
+      }
+
+    case T_ARRAY:
+    case T_CLASS:
+      if (++save_svalue_depth > MAX_SAVE_SVALUE_DEPTH)
+        too_deep_save_error ();
+      sb_byte (&sb_body, v->type == T_CLASS ? SB_CLASS : SB_ARRAY);
+      sb_varint (&sb_body, v->u.arr->size);
+      for (i = 0; i < v->u.arr->size; i++)
+        save_binary_svalue (&v->u.arr->item[i]);
+      save_svalue_depth--;
+      return;
+
+    case T_MAPPING:
+      {
+        mapping_t *m = v->u.map;
+        mapping_node_t *elt;
+        uint32_t j;
+
+        if (++save_svalue_depth > MAX_SAVE_SVALUE_DEPTH)
+          too_deep_save_error ();
+        sb_byte (&sb_body, SB_MAPPING);
+        sb_varint (&sb_body, m->count);
+        for (j = 0; j < m->fill; j++)
+          {
+            elt = map_node (m, j);
+            if (elt->values[0].type == T_INVALID)
+              continue;
+            save_binary_svalue (elt->values);
+            save_binary_svalue (elt->values + 1);
+          }
+        save_svalue_depth--;
+        return;
+      }
+    }
+  /* objects, functions and buffers save as 0, as in the text format */
+  sb_byte (&sb_body, SB_ZERO);
+}
+
+static void save_binary_recurse (program_t * prog, svalue_t ** svp, int type, int save_zeros) {
+  int i;
+
+  for (i = 0; i < prog->num_inherited; i++)
+    save_binary_recurse (prog->inherit[i].prog, svp, prog->inherit[i].type_mod | type, save_zeros);
+  if (type & NAME_STATIC)
+    {
+      (*svp) += prog->num_variables_defined;
+      return;
+    }
+  for (i = 0; i < prog->num_variables_defined; i++, (*svp)++)
+    {
+      if (prog->variable_types[i] & NAME_STATIC)
+        continue;
+      /* the text format skips whatever prints as "0" */
+      if (!save_zeros && (((*svp)->type == T_NUMBER && !(*svp)->u.number) ||
+                          ((*svp)->type == T_REAL && (*svp)->u.real == 0.0)))
+        continue;
+      sb_varint (&sb_body, sb_string_index (prog->variable_table[i], SHARED_STRLEN (prog->variable_table[i])));
+      save_svalue_depth = 0;
+      save_binary_svalue (*svp);
+    }
+}
+
+static char *save_binary_snapshot (object_t * ob, int save_zeros, size_t * len) {
+
+  save_buf_t out = { 0, 0, 0 };
+  size_t name_len = strlen (ob->prog->name);
+  svalue_t *v;
+
+  sb_body.len = sb_strings.len = 0;
+  sb_count = 0;
+  if (++sb_gen == 0)
+    {
+      uint32_t j;
+      for (j = 0; j < sb_table_size; j++)
+        sb_table[j].gen = UINT32_MAX;
+      sb_gen = 1;
+    }
+  v = ob->variables;
+  save_binary_recurse (ob->prog, &v, 0, save_zeros);
+
+  /* assemble everything in a buffer of the exact size */
+  out.size = 5 + 10 + name_len + 10 + sb_strings.len + sb_body.len;
+  out.buf = (char *) DXALLOC (out.size, TAG_TEMPORARY, "save_object_snapshot");
+  memcpy (out.buf, SAVE_BINARY_MAGIC, 4);
+  out.buf[4] = SAVE_BINARY_VERSION;
+  out.len = 5;
+  sb_varint (&out, name_len);
+  memcpy (out.buf + out.len, ob->prog->name, name_len);
+  out.len += name_len;
+  sb_varint (&out, sb_count);
+  memcpy (out.buf + out.len, sb_strings.buf, sb_strings.len);
+  out.len += sb_strings.len;
+  memcpy (out.buf + out.len, sb_body.buf, sb_body.len);
+  out.len += sb_body.len;
+  *len = out.len;
+  return out.buf;
+}
+
+typedef struct {
+  const unsigned char *p, *end;
+  svalue_t *strings;
+  uint32_t num_strings;
+} save_reader_t;
+
+static int sb_read_varint (save_reader_t * r, uint64_t * v) {
+  int shift;
+
+  *v = 0;
+  for (shift = 0; shift < 64 && r->p < r->end; shift += 7)
+    {
+      *v |= (uint64_t) (*r->p & 0x7f) << shift;
+      if (!(*r->p++ & 0x80))
+        return 1;
+    }
+  return 0;
+}
+
+static int restore_binary_svalue (save_reader_t * r, svalue_t * sv, int depth) {
+  uint64_t n, i;
+  int err;
+
+  if (r->p >= r->end)
+    return ROB_GENERAL_ERROR;
+  switch (*r->p++)
+    {
+    case SB_ZERO:
+      *sv = const0;
+      return 0;
+
+    case SB_INT:
+      if (!sb_read_varint (r, &n))
+        return ROB_NUMERAL_ERROR;
+      sv->type = T_NUMBER;
+      sv->subtype = 0;
+      sv->u.number = (int64_t) (n >> 1) ^ -(int64_t) (n & 1);
+      return 0;
+
+    case SB_REAL:
+      if (r->end - r->p < 8)
+        return ROB_NUMERAL_ERROR;
+      for (n = 0, i = 0; i < 8; i++)
+        n |= (uint64_t) r->p[i] << (8 * i);
+      r->p += 8;
+      sv->type = T_REAL;
+      memcpy (&sv->u.real, &n, sizeof (n));
+      return 0;
+
+    case SB_STRING:
+      if (!sb_read_varint (r, &n) || n >= r->num_strings)
+        return ROB_STRING_ERROR;
+      assign_svalue_no_free (sv, &r->strings[n]);
+      return 0;
+
+    case SB_ARRAY:
+    case SB_CLASS:
+      {
+        int is_class = r->p[-1] == SB_CLASS;
+        int code = is_class ? ROB_CLASS_ERROR : ROB_ARRAY_ERROR;
+        array_t *v;
+
+        /* every element takes a byte at least */
+        if (depth > MAX_SAVE_SVALUE_DEPTH || !sb_read_varint (r, &n) ||
+            n > (uint64_t) (r->end - r->p) || n > (uint64_t) CONFIG_INT (__MAX_ARRAY_SIZE__))
+          return code;
+        v = is_class ? allocate_class_by_size ((int) n) : allocate_array ((size_t) n);
+        for (i = 0; i < n; i++)
+          {
+            if ((err = restore_binary_svalue (r, &v->item[i], depth + 1)))
+              {
+                if (is_class)
+                  free_class (v);
+                else
+                  free_array (v);
+                return err;
+              }
+          }
+        sv->type = is_class ? T_CLASS : T_ARRAY;
+        sv->u.arr = v;
+        return 0;
+      }
+
+    case SB_MAPPING:
+      {
+        mapping_t *m;
+        svalue_t key, value, *ret;
+
+        if (depth > MAX_SAVE_SVALUE_DEPTH || !sb_read_varint (r, &n) ||
+            n > (uint64_t) (r->end - r->p) / 2 || n > (uint64_t) CONFIG_INT (__MAX_MAPPING_SIZE__))
+          return ROB_MAPPING_ERROR;
+        m = allocate_mapping ((size_t) n);
+        for (i = 0; i < n; i++)
+          {
+            if ((err = restore_binary_svalue (r, &key, depth + 1)))
+              {
+                free_mapping (m);
+                return err;
+              }
+            if ((err = restore_binary_svalue (r, &value, depth + 1)))
+              {
+                free_svalue (&key, "restore_binary_svalue");
+                free_mapping (m);
+                return err;
+              }
+            /* frees the earlier value of a duplicate key */
+            ret = find_for_insert (m, &key, 1);
+            free_svalue (&key, "restore_binary_svalue");
+            *ret = value;
+          }
+        sv->type = T_MAPPING;
+        sv->u.map = m;
+        return 0;
+      }
+    }
+  return ROB_GENERAL_ERROR;
+}
+
+static void free_save_reader (save_reader_t * r) {
+  uint32_t i;
 
-  for (i = 0; i < prog->num_inherited; i++)
-    {
-      if (!save_object_recurse (prog->inherit[i].prog, svp,
-                                prog->inherit[i].type_mod | type,
-                                save_zeros, f))
-        return 0;
-    }
-  if (type & NAME_STATIC)
-    {
-      (*svp) += prog->num_variables_defined;
-      return 1;
+  for (i = 0; i < r->num_strings; i++)
+    free_string_svalue (&r->strings[i]);
+  if (r->strings)
+    FREE (r->strings);
+  r->strings = 0;
+  r->num_strings = 0;
+}
+
+/**
+ * @brief Restore the variables of an object from binary save data.
+ * @returns 0 on success, otherwise a ROB_* error code.
+ */
+static int restore_object_binary (object_t * ob, const char *buf, size_t len) {
+  save_reader_t r;
+  uint64_t n, i;
+  unsigned short t;
+  svalue_t val;
+  int idx, err;
+
+  r.p = (const unsigned char *) buf + 5;
+  r.end = (const unsigned char *) buf + len;
+  r.strings = 0;
+  r.num_strings = 0;
+  if (len < 5 || buf[4] != SAVE_BINARY_VERSION)
+    return ROB_GENERAL_ERROR;
+
+  /* program name: not needed */
+  if (!sb_read_varint (&r, &n) || n > (uint64_t) (r.end - r.p))
+    return ROB_GENERAL_ERROR;
+  r.p += n;
+
+  /* string table */
+  if (!sb_read_varint (&r, &n) || n > (uint64_t) (r.end - r.p))
+    return ROB_GENERAL_ERROR;
+  r.strings = CALLOCATE ((size_t) n + 1, svalue_t, TAG_TEMPORARY, "restore_object_binary");
+  for (i = 0; i < n; i++)
+    {
+      uint64_t slen;
+      uint32_t len;
+
+      if (!sb_read_varint (&r, &slen) || slen >= (uint64_t) (r.end - r.p) || r.p[slen] != '\0'
+          || slen > UINT32_MAX)
+        {
+          free_save_reader (&r);
+          return ROB_STRING_ERROR;
+        }
+      /* the string may contain '\0' */
+      len = (uint32_t) slen;
+      r.strings[i].type = T_STRING;
+      r.strings[i].subtype = STRING_SHARED;
+      make_shared_strings (&r.strings[i].u.string, (const char *) r.p, &len, 1);
+      r.num_strings++;
+      r.p += slen + 1;
     }
-  for (i = 0; i < prog->num_variables_defined; i++)
+
+  /* variables */
+  while (r.p < r.end)
     {
-      if (prog->variable_types[i] & NAME_STATIC)
+      if (!sb_read_varint (&r, &n) || n >= r.num_strings)
         {
-          (*svp)++;
+          free_save_reader (&r);
+          return ROB_GENERAL_ERROR;
+        }
+      if ((err = restore_binary_svalue (&r, &val, 1)))
+        {
+          free_save_reader (&r);
+          return err;
+        }
+
+      /* names are shared strings already: look them up by address */
+      idx = 0;
+      if (!fgv_recurse (ob->prog, &idx, r.strings[n].u.string, &t) || (t & NAME_STATIC))
+        {
+          free_svalue (&val, "restore_object_binary");
           continue;
         }
-      save_svalue_depth = 0;
-      theSize = svalue_save_size (*svp);
-      new_str = (char *) DXALLOC (theSize, TAG_TEMPORARY, "save_object: 2");
-      *new_str = '\0';
-      p = new_str;
-      save_svalue ((*svp)++, &p);
-      /* FIXME: shouldn't use fprintf() */
-      if (save_zeros || new_str[0] != '0' || new_str[1] != 0)	/* Armidale */
-        if (fprintf (f, "%s %s\n", prog->variable_table[i], new_str) < 0)
-          {
-            debug_perror ("save_object: fprintf", 0);
-            return 0;
-          }
-      FREE (new_str);
+      free_svalue (&ob->variables[idx], "restore_object_binary");
+      ob->variables[idx] = val;
     }
-  return 1;
+
+  free_save_reader (&r);
+  return 0;
+}
+
+/**
+ * @brief Format the variables of an object the way save_object() writes them.
+ * @param flags SAVE_ZEROS, SAVE_BINARY
+ * @param len Returns the length of the save data.
+ * @returns The save data, allocated with DXALLOC().
+ */
+char *save_object_snapshot (object_t * ob, int flags, size_t * len) {
+  if (flags & SAVE_BINARY)
+    return save_binary_snapshot (ob, flags & SAVE_ZEROS, len);
+  return save_text_snapshot (ob, flags & SAVE_ZEROS, len);
 }
 
 static size_t sel = (size_t)-1; /* save extension length */
 
 /**
- * @brief Save an object to a file.
- * @returns 1 on success, 0 on failure.
+ * @brief Check write permission for the save file of an object.
+ * @returns The save file path (valid until the next apply), or NULL if denied.
  */
-int save_object (object_t * ob, const char *file, int save_zeros) {
+char *save_object_path (object_t * ob, const char *file) {
 
-  char *name;
-  static char tmp_name[256];
+  char *name, *path;
   size_t len;
-  FILE *f;
-  int success;
-  svalue_t *v;
-
-  if (ob->flags & O_DESTRUCTED)
-    return 0;
 
   len = strlen (file);
   if (file[len - 2] == '.' && file[len - 1] == 'c')
@@ -1553,69 +1435,90 @@ int save_object (object_t * ob, const char *file, int save_zeros) {
   strcpy (name + len, SAVE_EXTENSION);
   push_malloced_string (name);	/* errors */
 
-  file = check_valid_path (name, ob, "save_object", 1);
-  if (!file)
-    {
-      /* error ("Denied write permission in save_object().\n"); */
-      free_string_svalue (sp--);
-      return 0;
-    }
+  path = check_valid_path (name, ob, "save_object", 1);
+  free_string_svalue (sp--);
+  return path;
+}
+
+/**
+ * @brief Write save data through a temporary file renamed over the save file.
+ * Touches no driver state, so it can be called from a worker thread.
+ * @param serial Makes the temporary file name unique among the writers
+ *   running at the same time: 0 for the backend, a job number for workers.
+ * @returns 0 on success, otherwise an errno value.
+ */
+int write_save_file (const char *file, const char *data, size_t len, unsigned int serial) {
+
+  char tmp_name[PATH_MAX];
+  FILE *f;
+  int err = 0;
 
   /*
    * Write the save-files to different directories, just in case
    * they are on different file systems.
    */
-  snprintf (tmp_name, sizeof(tmp_name), "%.250s.tmp", file);
-  tmp_name[sizeof(tmp_name) - 1] = '\0';
+  if ((size_t)snprintf (tmp_name, sizeof(tmp_name), "%s.%ld.%u.tmp", file, (long) getpid (), serial)
+      >= sizeof(tmp_name))
+    return ENAMETOOLONG;
 
-  opt_trace (TT_EVAL|1, "creating tmp file: %s", tmp_name);
-  f = fopen (tmp_name, "w");
+  f = fopen (tmp_name, "wb");
   if (!f)
-    {
-      debug_perror ("fopen()", tmp_name);
-      free_string_svalue (sp--);
-      return 0;  
-    }
+    return errno;
+
+  if (fwrite (data, 1, len, f) != len)
+    err = errno ? errno : EIO;
+  if (fclose (f) < 0 && !err)
+    err = errno;
 
-  if (fprintf (f, "#/%s\n", ob->prog->name) < 0)
+  if (!err)
     {
-      debug_perror ("Could not write save_object() header", tmp_name);
-      free_string_svalue (sp--);
-      return 0;
+#ifdef WIN32
+      /* Need to erase it to write over it. */
+      unlink (file);
+#endif
+      if (rename (tmp_name, file) < 0)
+        err = errno;
     }
+  if (err)
+    unlink (tmp_name);
+  return err;
+}
 
-  v = ob->variables;
-  success = save_object_recurse (ob->prog, &v, 0, save_zeros, f);
+/**
+ * @brief Save an object to a file.
+ * @param flags SAVE_ZEROS, SAVE_BINARY
+ * @returns 1 on success, 0 on failure.
+ */
+int save_object (object_t * ob, const char *file, int flags) {
+
+  char *path, *data;
+  size_t len;
+  int err;
+
+  if (ob->flags & O_DESTRUCTED)
+    return 0;
 
-  if (fclose (f) < 0)
+  path = save_object_path (ob, file);
+  if (!path)
     {
-      debug_perror ("fclose()", tmp_name);
-      success = 0;
+      /* error ("Denied write permission in save_object().\n"); */
+      return 0;
     }
+  /* the path lives in apply_ret_value, which the snapshot doesn't touch */
+  data = save_object_snapshot (ob, flags, &len);
 
-  if (!success)
+  opt_trace (TT_EVAL|1, "writing %zu bytes to %s", len, path);
+  async_file_wait_path (path);	/* don't let an older async save land on top */
+  err = write_save_file (path, data, len, 0);
+  FREE (data);
+  if (err)
     {
+      errno = err;
+      debug_perror ("save_object()", path);
       debug_message ("Failed to completely save file. Disk could be full.\n");
-      unlink (tmp_name);
-    }
-  else
-    {
-#ifdef WIN32
-      /* Need to erase it to write over it. */
-      unlink (file);
-#endif
-      opt_trace (TT_EVAL|1, "renaming %s to %s", tmp_name, file);
-      if (rename (tmp_name, file) < 0)
-        {
-          debug_perror ("rename()", file);
-          debug_message ("save_obecjt(): Failed to rename /%s to /%s", tmp_name, file);
-          unlink (tmp_name);
-          success = 0;
-        }
+      return 0;
     }
-
-  free_string_svalue (sp--);
-  return success ? 1 : 0;
+  return 1;
 }
 
 
@@ -1706,7 +1609,7 @@ int restore_object (object_t * ob, const char *file, int noclear) {
     }
 
   opt_trace (TT_EVAL|1, "restoring object from file: %s", file);
-  f = fopen (file, "r");
+  f = fopen (file, "rb");
   if (!f || fstat (fileno (f), &st) == -1)
     {
       if (f)
@@ -1725,12 +1628,7 @@ int restore_object (object_t * ob, const char *file, int noclear) {
   opt_trace (TT_EVAL|1, "reading %d bytes of saved data", i);
   n_read = fread (theBuff, 1, i, f);
   fclose (f);
-#ifdef _WIN32
-  /* On Windows, fread may read less than requested even at EOF */
-  if (n_read > 0 && feof(f))
-#else
   if (n_read != (size_t)i)
-#endif
     {
       FREE (theBuff);
       debug_perror ("restore_object()", file);
@@ -1747,7 +1645,19 @@ int restore_object (object_t * ob, const char *file, int noclear) {
   if (!noclear)
     clear_non_statics (ob);
 
-  restore_object_from_buff (ob, theBuff, noclear);
+  if (n_read >= 4 && memcmp (theBuff, SAVE_BINARY_MAGIC, 4) == 0)
+    {
+      int rc = restore_object_binary (ob, theBuff, n_read);
+      if (rc)
+        {
+          FREE (theBuff);
+          current_object = save;
+          free_string_svalue (sp--);
+          error ("restore_object(): Illegal binary format (error %d).\n", rc);
+        }
+    }
+  else
+    restore_object_from_buff (ob, theBuff, noclear);
   current_object = save;
 
   FREE (theBuff);
@@ -1834,6 +1744,8 @@ sentence_t* alloc_sentence () {
   p->flags = 0;
   p->next = 0;
   p->args = NULL;  /* initialize carryover args */
+  p->next_verb = 0;
+  p->seq = 0;
   return p;
 }
 
@@ -1876,6 +1788,352 @@ void free_sentence (sentence_t * p) {
   sent_free = p;
 }
 
+/*
+ * The verb index.  Verbs are shared strings, so a plain verb is hashed and
+ * compared by address.
+ */
+
+#define VERB_HASH(v) ((unsigned int) (((uint64_t) (uintptr_t) (v) * 0x9e3779b97f4a7c15ULL) >> 32))
+#define VERB_INDEX_MIN 8
+
+static uint64_t sentence_seq = 0;
+
+/* Link a sentence into a chain, keeping the chain ordered by seq. */
+static void link_verb (sentence_t ** chain, sentence_t * p) {
+  while (*chain && (*chain)->seq > p->seq)
+    chain = &(*chain)->next_verb;
+  p->next_verb = *chain;
+  *chain = p;
+}
+
+static void unlink_verb (sentence_t ** chain, sentence_t * p) {
+  for (; *chain; chain = &(*chain)->next_verb)
+    if (*chain == p)
+      {
+        *chain = p->next_verb;
+        p->next_verb = 0;
+        return;
+      }
+}
+
+static void grow_verb_index (verb_index_t * vi) {
+  sentence_t **old = vi->table, *p, *next;
+  unsigned int i, size = (vi->mask + 1) * 2;
+
+  vi->table = CALLOCATE (size, sentence_t *, TAG_SENTENCE, "grow_verb_index");
+  memset (vi->table, 0, size * sizeof (sentence_t *));
+  vi->mask = size - 1;
+  for (i = 0; i < size / 2; i++)
+    for (p = old[i]; p; p = next)
+      {
+        next = p->next_verb;
+        link_verb (&vi->table[VERB_HASH (p->verb) & vi->mask], p);
+      }
+  FREE (old);
+}
+
+/**
+ * @brief Add a sentence to the sentence list of a living object.
+ * It goes first, and so takes precedence over the older ones.
+ */
+void add_sentence (object_t * user, sentence_t * p) {
+  verb_index_t *vi = user->verb_index;
+
+  if (!vi)
+    {
+      vi = user->verb_index = ALLOCATE (verb_index_t, TAG_SENTENCE, "add_sentence");
+      vi->table = CALLOCATE (VERB_INDEX_MIN, sentence_t *, TAG_SENTENCE, "add_sentence");
+      memset (vi->table, 0, VERB_INDEX_MIN * sizeof (sentence_t *));
+      vi->mask = VERB_INDEX_MIN - 1;
+      vi->count = 0;
+      vi->special = 0;
+    }
+
+  p->seq = ++sentence_seq;
+  p->next = user->sent;
+  user->sent = p;
+  if (SENTENCE_IS_SPECIAL (p))
+    link_verb (&vi->special, p);
+  else
+    {
+      if (++vi->count > (int) (vi->mask + 1) * 2)
+        grow_verb_index (vi);
+      link_verb (&vi->table[VERB_HASH (p->verb) & vi->mask], p);
+    }
+}
+
+static void free_verb_index (object_t * user) {
+  if (user->verb_index)
+    {
+      FREE (user->verb_index->table);
+      FREE (user->verb_index);
+      user->verb_index = 0;
+    }
+}
+
+/**
+ * @brief Remove a sentence from the sentence list of a living object,
+ * and free it.
+ * @param s The link to the sentence in the list.
+ */
+void remove_sentence (object_t * user, sentence_t ** s) {
+  sentence_t *p = *s;
+  verb_index_t *vi = user->verb_index;
+
+  *s = p->next;
+  if (vi)
+    {
+      if (SENTENCE_IS_SPECIAL (p))
+        unlink_verb (&vi->special, p);
+      else
+        {
+          unlink_verb (&vi->table[VERB_HASH (p->verb) & vi->mask], p);
+          vi->count--;
+        }
+    }
+  free_sentence (p);
+  if (!user->sent)
+    free_verb_index (user);
+}
+
+/** @brief Free all sentences of a living object. */
+void free_sentences (object_t * user) {
+  sentence_t *s, *next;
+
+  for (s = user->sent; s; s = next)
+    {
+      next = s->next;
+      free_sentence (s);
+    }
+  user->sent = NULL;
+  free_verb_index (user);
+}
+
+/**
+ * @brief Find the sentences with a plain verb that may match a verb.
+ * @param verb A shared string.
+ * @return The chain of the verb, newest first.  Follow next_verb, and
+ *   skip the sentences with other verbs.
+ */
+sentence_t *find_verb_chain (object_t * user, const char *verb) {
+  verb_index_t *vi = user->verb_index;
+
+  return vi ? vi->table[VERB_HASH (verb) & vi->mask] : 0;
+}
+
+/*
+ * The id index.  An object that called set_ids() has its ids indexed in
+ * the id_index of its environment, which is kept up to date by
+ * move_object() and destruct_object().  The entries of each chain are in
+ * the order of the inventory, and the entries of one object are next to
+ * each other, so that "sword 2" finds the same object as asking id().
+ */
+
+#define ID_INDEX_MIN 8
+
+/* Link an entry for an object in the inventory of env into its chain. */
+static void link_id (id_index_t * ix, object_t * env, id_entry_t * e) {
+  id_entry_t **chain = &ix->table[VERB_HASH (e->id) & ix->mask];
+  object_t *o;
+
+  /* skip the entries of the objects before it; none if it was just moved in */
+  for (o = env->contains; o && o != e->ob; o = o->next_inv)
+    while (*chain && (*chain)->ob == o)
+      chain = &(*chain)->next;
+  e->next = *chain;
+  *chain = e;
+}
+
+static void grow_id_index (id_index_t * ix) {
+  id_entry_t **old = ix->table, *e, *next, **tails[2];
+  unsigned int i, size = (ix->mask + 1) * 2;
+
+  ix->table = CALLOCATE (size, id_entry_t *, TAG_OBJECT, "grow_id_index");
+  memset (ix->table, 0, size * sizeof (id_entry_t *));
+  ix->mask = size - 1;
+  /* chain i splits into chains i and i + size / 2, keeping the order */
+  for (i = 0; i < size / 2; i++)
+    {
+      tails[0] = &ix->table[i];
+      tails[1] = &ix->table[i + size / 2];
+      for (e = old[i]; e; e = next)
+        {
+          int upper = (VERB_HASH (e->id) & ix->mask) != i;
+
+          next = e->next;
+          e->next = 0;
+          *tails[upper] = e;
+          tails[upper] = &e->next;
+        }
+    }
+  FREE (old);
+}
+
+/**
+ * @brief Index the ids of an object in the id index of its environment.
+ * The object must be in the inventory of ob->super already.
+ */
+void add_to_id_index (object_t * ob) {
+  object_t *env = ob->super, *o;
+  id_index_t *ix;
+  int i;
+
+  if (!env)
+    return;
+  ix = env->id_index;
+  if (!ob->ids)
+    {
+      if (ix)
+        ix->others++;
+      return;
+    }
+
+  if (!ix)
+    {
+      ix = env->id_index = ALLOCATE (id_index_t, TAG_OBJECT, "add_to_id_index");
+      ix->table = CALLOCATE (ID_INDEX_MIN, id_entry_t *, TAG_OBJECT, "add_to_id_index");
+      memset (ix->table, 0, ID_INDEX_MIN * sizeof (id_entry_t *));
+      ix->mask = ID_INDEX_MIN - 1;
+      ix->count = 0;
+      ix->others = 0;
+      for (o = env->contains; o; o = o->next_inv)
+        if (!o->ids)
+          ix->others++;
+    }
+
+  for (i = 0; i < ob->ids->size; i++)
+    {
+      id_entry_t *e = ALLOCATE (id_entry_t, TAG_OBJECT, "add_to_id_index");
+
+      e->id = ob->ids->item[i].u.string;
+      e->ob = ob;
+      if (++ix->count > (int) (ix->mask + 1) * 2)
+        grow_id_index (ix);
+      link_id (ix, env, e);
+    }
+}
+
+/**
+ * @brief Remove an object from the id index of its environment.
+ * Call this before it leaves the inventory of ob->super.
+ */
+void remove_from_id_index (object_t * ob) {
+  id_index_t *ix;
+  id_entry_t **chain, *e;
+  int i;
+
+  if (!ob->super || !(ix = ob->super->id_index))
+    return;
+  if (!ob->ids)
+    {
+      ix->others--;
+      return;
+    }
+
+  for (i = 0; i < ob->ids->size; i++)
+    {
+      char *id = ob->ids->item[i].u.string;
+
+      for (chain = &ix->table[VERB_HASH (id) & ix->mask]; (e = *chain); chain = &e->next)
+        if (e->ob == ob && e->id == id)
+          {
+            *chain = e->next;
+            FREE (e);
+            ix->count--;
+            break;
+          }
+    }
+}
+
+/** @brief Free the id index of an object, once its inventory is empty. */
+void free_id_index (object_t * env) {
+  id_index_t *ix = env->id_index;
+  id_entry_t *e, *next;
+  unsigned int i;
+
+  if (!ix)
+    return;
+  for (i = 0; i <= ix->mask; i++)
+    for (e = ix->table[i]; e; e = next)
+      {
+        next = e->next;
+        FREE (e);
+      }
+  FREE (ix->table);
+  FREE (ix);
+  env->id_index = 0;
+}
+
+/**
+ * @brief Set the ids that present() finds an object by, instead of calling
+ * id() in it.
+ * @param ob The object.
+ * @param ids An array of strings, or NULL or an empty array to call id()
+ *   again.  Repeated ids are dropped.
+ */
+void set_object_ids (object_t * ob, array_t * ids) {
+  array_t *v = 0;
+  int i, j, n = 0;
+
+  if (ids && ids->size)
+    {
+      for (i = 0; i < ids->size; i++)
+        if (ids->item[i].type != T_STRING)
+          error ("*Ids must be strings.");
+
+      v = allocate_array (ids->size);
+      for (i = 0; i < ids->size; i++)
+        {
+          char *id = make_shared_string (ids->item[i].u.string);
+
+          for (j = 0; j < n && v->item[j].u.string != id; j++)
+            ;
+          if (j < n)
+            {
+              free_string (id);
+              continue;
+            }
+          v->item[n].type = T_STRING;
+          v->item[n].subtype = STRING_SHARED;
+          v->item[n++].u.string = id;
+        }
+      if (n < v->size)
+        v = slice_array (v, 0, n - 1);
+    }
+
+  remove_from_id_index (ob);
+  if (ob->ids)
+    free_array (ob->ids);
+  ob->ids = v;
+  add_to_id_index (ob);
+}
+
+/**
+ * @brief Check whether an object has an id given with set_ids().
+ * @param id A shared string.
+ */
+int object_has_id (object_t * ob, const char *id) {
+  int i;
+
+  if (ob->ids)
+    for (i = 0; i < ob->ids->size; i++)
+      if (ob->ids->item[i].u.string == id)
+        return 1;
+  return 0;
+}
+
+/**
+ * @brief Find the objects in an inventory that may have an id.
+ * @param id A shared string.
+ * @return The chain of the id, in the order of the inventory.  Follow next,
+ *   and skip the entries of other ids.
+ */
+id_entry_t *find_id_chain (object_t * env, const char *id) {
+  id_index_t *ix = env->id_index;
+
+  return ix ? ix->table[VERB_HASH (id) & ix->mask] : 0;
+}
+
 /**
  * @brief Deallocate an object structure.
  * 
@@ -1885,8 +2143,6 @@ void free_sentence (sentence_t * p) {
  * @param from A string indicating where the deallocation was initiated from.
  */
 void dealloc_object (object_t * ob, const char *from) {
-  sentence_t *s;
-
   if (!(ob->flags & O_DESTRUCTED))
     {
       /* This is fatal, and should never happen. */
@@ -1909,15 +2165,13 @@ void dealloc_object (object_t * ob, const char *from) {
    * With the fix to free sentences earlier, ob->sent should already be NULL.
    * This code remains as a safety net for backwards compatibility. */
   if (ob->sent)
+    free_sentences (ob);
+  if (ob->ids)
     {
-      for (s = ob->sent; s;)
-        {
-          sentence_t *next = s->next;
-          free_sentence (s);
-          s = next;
-        }
-      ob->sent = NULL;
+      free_array (ob->ids);
+      ob->ids = 0;
     }
+  free_id_index (ob);
 #ifdef PRIVS
   if (ob->privs)
     free_string (ob->privs);
@@ -2209,6 +2463,21 @@ void deinit_objects () {
       FREE (sent_free);
       sent_free = next;
     }
+  restore_unwind (0);
+  if (restore_stack)
+    FREE (restore_stack);
+  restore_stack = 0;
+  restore_stack_size = 0;
+  if (sb_body.buf)
+    FREE (sb_body.buf);
+  if (sb_strings.buf)
+    FREE (sb_strings.buf);
+  if (sb_table)
+    FREE (sb_table);
+  memset (&sb_body, 0, sizeof (sb_body));
+  memset (&sb_strings, 0, sizeof (sb_strings));
+  sb_table = 0;
+  sb_table_size = sb_count = 0;
   if (tot_alloc_object)
     debug_warn ("Memory leak: %zu objects still allocated at shutdown.\n", tot_alloc_object);
 }
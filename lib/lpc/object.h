@@ -42,13 +42,51 @@ struct sentence_s {
     string_or_func_t function;
     int flags;
     array_t *args;  /* carryover arguments for input_to() and add_action() */
+    struct sentence_s *next_verb;	/* next in verb_index_t chain */
+    uint64_t seq;	/* order of add_action(), newer is larger */
 };
 
+/*
+ * Index of the sentences of a living object, so user_parser() only has to
+ * look at the sentences that can match a command.  The sentence list
+ * (object_t.sent) stays the master copy and gives the order of precedence;
+ * each chain is ordered like it, newest first.
+ */
+typedef struct verb_index_s {
+    sentence_t **table;		/* sentences with a plain verb, by verb */
+    unsigned int mask;		/* # of chains in table minus one */
+    int count;			/* # of sentences in table */
+    sentence_t *special;	/* V_NOSPACE, V_SHORT and "" verbs */
+} verb_index_t;
+
+/*
+ * Index of the ids that the objects in an inventory gave with set_ids(), so
+ * present() finds them without calling id() in each.  Ids are shared
+ * strings, and each chain is in the order of the inventory.
+ */
+typedef struct id_entry_s {
+    char *id;			/* shared string, one of ob->ids */
+    object_t *ob;
+    struct id_entry_s *next;	/* next in chain */
+} id_entry_t;
+
+typedef struct id_index_s {
+    id_entry_t **table;
+    unsigned int mask;		/* # of chains in table minus one */
+    int count;			/* # of entries in table */
+    int others;			/* # of objects in the inventory without ids */
+} id_index_t;
+
+#define SENTENCE_IS_SPECIAL(s) (((s)->flags & (V_NOSPACE | V_SHORT)) || !(s)->verb[0])
+
 struct object_s {
-    unsigned short ref;		/* Reference count. */
+    uint32_t ref;		/* Reference count. */
     unsigned short flags;	/* Bits or'ed together from above */
+    int heart_beat_index;	/* slot in heart_beats[] if O_HEART_BEAT */
     char *name;
     struct object_s *next_hash;
+    struct object_s *next_clone;	/* clones of the same blueprint, newest first */
+    struct object_s *prev_clone;
     time_t load_time;		/* time when this object was created */
     time_t next_reset;		/* time of next reset of this object */
     time_t time_of_ref;		/* time when last referenced. Used by swap */
@@ -59,6 +97,10 @@ struct object_s {
     struct object_s *super;	/* Which object surround us ? */
     struct interactive_s *interactive;	/* Data about an interactive user */
     sentence_t *sent;
+    verb_index_t *verb_index;	/* index of sent, or NULL */
+    array_t *ids;		/* ids from set_ids(), or NULL to call id() */
+    id_index_t *id_index;	/* index of the ids in our inventory, or NULL */
+    struct pending_call_s *call_outs;	/* call_outs owned by this object */
     struct object_s *next_hashed_living;
     char *living_name;		/* Name of living object if in hash */
     userid_t *uid;		/* the "owner" of this object */
@@ -86,11 +128,24 @@ void init_objects();
 void deinit_objects();
 sentence_t* alloc_sentence ();
 void free_sentence(sentence_t *);
+void add_sentence(object_t *, sentence_t *);
+void remove_sentence(object_t *, sentence_t **);
+void free_sentences(object_t *);
+sentence_t *find_verb_chain(object_t *, const char *);
+void set_object_ids(object_t *, array_t *);
+void add_to_id_index(object_t *);
+void remove_from_id_index(object_t *);
+void free_id_index(object_t *);
+int object_has_id(object_t *, const char *);
+id_entry_t *find_id_chain(object_t *, const char *);
 void bufcat(char **, char *);
 size_t svalue_save_size(const svalue_t *);
 void save_svalue(svalue_t *, char **);
 int restore_svalue(char *, svalue_t *);
 int save_object(object_t *, const char *, int);
+char *save_object_snapshot(object_t *, int, size_t *);
+char *save_object_path(object_t *, const char *);
+int write_save_file(const char *, const char *, size_t, unsigned int);
 char *save_variable(svalue_t *);
 int restore_object(object_t *, const char *, int);
 void restore_variable(svalue_t *, char *);
@@ -93,6 +93,27 @@ char *add_slash (const char *str) {
 static object_t **obj_table = 0;
 static int objs_in_table = 0;
 
+/*
+ * Clones, by blueprint name.  Each entry heads a list of the clones of one
+ * blueprint, linked through next_clone and prev_clone, so children() and
+ * clone_count() don't have to look at every object.  Objects enter and
+ * leave the lists along with the object name hash table.
+ */
+
+typedef struct clone_list_s {
+  struct clone_list_s *next;	/* next entry in hash chain */
+  object_t *clones;		/* newest clone first */
+  int count;
+  int hidden;			/* clones with O_HIDDEN set */
+  size_t len;
+  char name[1];			/* blueprint name, not null terminated */
+} clone_list_t;
+
+static clone_list_t **clone_table = 0;
+static int clone_lists = 0;
+
+#define CloneHash(s, len) ((int) strhash64 (s, len) & otable_size_minus_one)
+
 /**
  * @brief Initialize the object name hash table.
  * @param sz Desired size of the hash table; will be rounded up to the next power of two.
@@ -109,6 +130,9 @@ void init_otable (size_t sz) {
 
   for (x = 0; x < otable_size; x++)
     obj_table[x] = 0;
+  clone_table = CALLOCATE (otable_size, clone_list_t *, TAG_OBJ_TBL, "init_otable");
+  for (x = 0; x < otable_size; x++)
+    clone_table[x] = 0;
 }
 
 void deinit_otable () {
@@ -118,6 +142,10 @@ void deinit_otable () {
     FREE (obj_table);
     obj_table = NULL;
   }
+  if (clone_table) {
+    FREE (clone_table);
+    clone_table = NULL;
+  }
 }
 
 /*
@@ -168,6 +196,114 @@ static object_t *find_obj_n (const char *s, int* hash)
   return (0);			/* not found */
 }
 
+static clone_list_t **find_clone_list (const char *name, size_t len) {
+  clone_list_t **lp;
+
+  for (lp = &clone_table[CloneHash (name, len)]; *lp; lp = &(*lp)->next)
+    if ((*lp)->len == len && !memcmp ((*lp)->name, name, len))
+      break;
+  return lp;
+}
+
+/* Add a clone to the list of its blueprint. */
+static void enter_clone (object_t * ob, const char *p) {
+  size_t len = p - ob->name;
+  clone_list_t **lp = find_clone_list (ob->name, len), *l;
+
+  if (!(l = *lp))
+    {
+      l = (clone_list_t *) DXALLOC (sizeof (clone_list_t) + len, TAG_OBJ_TBL, "enter_clone");
+      l->next = 0;
+      l->clones = 0;
+      l->count = 0;
+      l->hidden = 0;
+      l->len = len;
+      memcpy (l->name, ob->name, len);
+      *lp = l;
+      clone_lists++;
+    }
+  ob->prev_clone = 0;
+  if ((ob->next_clone = l->clones))
+    l->clones->prev_clone = ob;
+  l->clones = ob;
+  l->count++;
+  if (ob->flags & O_HIDDEN)
+    l->hidden++;
+}
+
+/* Find the clone list that \p ob is in, if it is a clone and in the list. */
+static clone_list_t **find_clone_list_of (object_t * ob) {
+  const char *p = strrchr (ob->name, '#');
+  clone_list_t **lp;
+
+  if (!p)
+    return NULL;
+  lp = find_clone_list (ob->name, p - ob->name);
+  if (!*lp || (!ob->prev_clone && (*lp)->clones != ob))
+    return NULL;		/* not in the list */
+  return lp;
+}
+
+static void remove_clone (object_t * ob) {
+  clone_list_t **lp = find_clone_list_of (ob), *l;
+
+  if (!lp)
+    return;
+  l = *lp;
+  if (ob->next_clone)
+    ob->next_clone->prev_clone = ob->prev_clone;
+  if (ob->prev_clone)
+    ob->prev_clone->next_clone = ob->next_clone;
+  else
+    l->clones = ob->next_clone;
+  ob->next_clone = ob->prev_clone = 0;
+  if (ob->flags & O_HIDDEN)
+    l->hidden--;
+  if (!--l->count)
+    {
+      *lp = l->next;
+      FREE (l);
+      clone_lists--;
+    }
+}
+
+/**
+ * @brief Find the clones of a blueprint.
+ * @param name The blueprint name, without leading slash or ".c".
+ * @param count If not NULL, the number of clones is stored here.
+ * @param hidden If not NULL, the number of clones with O_HIDDEN set is stored here.
+ * @return The newest clone, or NULL if there are none.  The others
+ *   follow through next_clone.
+ */
+object_t *lookup_clones (const char *name, int *count, int *hidden) {
+  clone_list_t *l = *find_clone_list (name, strlen (name));
+
+  if (count)
+    *count = l ? l->count : 0;
+  if (hidden)
+    *hidden = l ? l->hidden : 0;
+  return l ? l->clones : 0;
+}
+
+/**
+ * @brief Set or clear O_HIDDEN of an object.
+ *
+ * The clone lists count their hidden clones, so the flag must be changed
+ * here rather than directly.
+ */
+void set_object_hidden (object_t * ob, int hide) {
+  clone_list_t **lp;
+
+  if (!hide == !(ob->flags & O_HIDDEN))
+    return;
+  if ((lp = find_clone_list_of (ob)))
+    (*lp)->hidden += hide ? 1 : -1;
+  if (hide)
+    ob->flags |= O_HIDDEN;
+  else
+    ob->flags &= ~O_HIDDEN;
+}
+
 /**
  * @brief Add an object to the table - can't have duplicate names.
  * 
@@ -182,9 +318,13 @@ void enter_object_hash (object_t * ob) {
   object_t* found = find_obj_n (ob->name, &h);
   if (!found)
     {
+      const char *p;
+
       ob->next_hash = obj_table[h];
       obj_table[h] = ob;
       objs_in_table++;
+      if ((p = strrchr (ob->name, '#')))
+        enter_clone (ob, p);
     }
 }
 
@@ -225,6 +365,7 @@ void remove_object_hash (object_t * ob) {
   obj_table[h] = ob->next_hash;
   ob->next_hash = 0;
   objs_in_table--;
+  remove_clone (ob);
 }
 
 /*
@@ -268,6 +409,7 @@ show_otable_status (outbuffer_t * out, int verbose)
                    objs_found - user_obj_found);
       outbuf_addv (out, "External lookups (succeeded):    %u (%u)\n",
                    user_obj_lookups, user_obj_found);
+      outbuf_addv (out, "Blueprints with clones:          %d\n", clone_lists);
     }
   starts = otable_size * sizeof (object_t *) + objs_in_table * sizeof (object_t);
 
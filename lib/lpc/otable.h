@@ -14,4 +14,6 @@ void enter_object_hash(object_t *);
 void enter_object_hash_at_end(object_t *);
 void remove_object_hash(object_t *);
 object_t *lookup_object_hash(const char *);
+object_t *lookup_clones(const char *, int *, int *);
+void set_object_hidden(object_t *, int);
 int show_otable_status(outbuffer_t *, int);
@@ -4,6 +4,7 @@
 
 #include "src/std.h"
 #include "program.h"
+#include "src/apply.h"
 
 size_t total_num_prog_blocks, total_prog_block_size;
 
@@ -18,6 +19,8 @@ void deallocate_program (program_t * progp) {
   total_prog_block_size -= progp->total_size;
   total_num_prog_blocks--;
 
+  free_call_sites (progp);
+
   /* Free all function names. */
   for (i = 0; i < (int) progp->num_functions_defined; i++)
     if (progp->function_table[i].name)
@@ -57,6 +60,7 @@ void free_prog (program_t * progp, int free_sub_strings) {
     deallocate_program (progp);
   else
     {
+      free_call_sites (progp);
       total_prog_block_size -= progp->total_size;
       total_num_prog_blocks--;
       FREE ((char *) progp);
@@ -199,6 +199,7 @@ typedef struct program_s
     int id_number;              /* used to associate information with this
                                  * prog block without needing to increase the
                                  * reference count     */
+    struct call_site_table_s *call_sites; /* call_other() inline caches (see apply.c) */
     unsigned char *line_info;   /* Line number information (A_LINENUMBERS area) */
     unsigned short *file_info;  /* File information (A_FILE_INFO area)*/
     compiler_function_t *function_table; /* function definitions (A_COMPILER_FUNCTIONS area), indexed by function_number_t */
@@ -15,6 +15,16 @@
 #include <assert.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#endif
 
 #define SUPPRESS_COMPILER_INLINES
 #include "src/std.h"
@@ -28,17 +38,92 @@
 #include "hash.h"
 
 static char *magic_id = "NEOL";
-static uint32_t driver_id = 0x20260113; /* increment when driver changes */
+static uint32_t driver_id = 0x20261019; /* increment when driver changes */
 static uint64_t config_id = 0;
 
+int save_all_binaries = 0;
+
 static FILE *crdir_fopen(char *);
 static void patch_out (program_t *, short *, size_t);
 static void patch_in (program_t *, short *, size_t);
 static int str_case_cmp (char *, char *);
 static int check_times (time_t, const char *);
+static void forget_times (const char *);
 static int locate_in (program_t *);
 static int locate_out (program_t *);
 
+/*
+ * Layout of a saved binary.  The file starts with this header, followed by
+ * the sections it points at.  Every section starts at a multiple of 8 from
+ * the start of the file, so a mapped file can be used in place: the program
+ * block is copied out in one piece and the names are interned from where
+ * they are.  Offsets and sizes are in bytes.
+ */
+typedef struct {
+  uint32_t offset, size;
+} binary_section_t;
+
+typedef struct {
+  char magic[4];
+  uint32_t driver_id;
+  uint64_t config_id;
+  uint32_t file_size;
+  uint32_t unused;
+  binary_section_t includes;	/* include file names, each followed by '\0' */
+  binary_section_t name;	/* program name, followed by '\0' */
+  binary_section_t program;	/* program_t block, with relative pointers */
+  binary_section_t inherits;	/* inherited program names, each followed by '\0' */
+  binary_section_t name_lengths;	/* uint32_t length of each of the names below */
+  binary_section_t names;	/* strings, variable names and function names, each followed by '\0' */
+  binary_section_t line_info;	/* file_info and line_info */
+  binary_section_t patches;	/* offsets of instructions for patch_in() */
+} binary_header_t;
+
+#define BINARY_ALIGN(x) (((x) + 7) & ~(size_t) 7)
+
+typedef struct {
+  char *buf;
+  size_t len, size;
+} binary_buf_t;
+
+static void binary_reserve (binary_buf_t * out, size_t n) {
+  if (out->len + n <= out->size)
+    return;
+  while (out->len + n > out->size)
+    out->size *= 2;
+  out->buf = DREALLOC (out->buf, out->size, TAG_TEMPORARY, "binary_reserve");
+}
+
+/* Start a new section at the next aligned offset. */
+static void binary_begin (binary_buf_t * out, binary_section_t * sect) {
+  size_t pad = BINARY_ALIGN (out->len) - out->len;
+
+  binary_reserve (out, pad);
+  memset (out->buf + out->len, 0, pad);
+  out->len += pad;
+  sect->offset = (uint32_t) out->len;
+  sect->size = 0;
+}
+
+static void binary_append (binary_buf_t * out, const void *data, size_t len) {
+  binary_reserve (out, len);
+  memcpy (out->buf + out->len, data, len);
+  out->len += len;
+}
+
+static void binary_end (binary_buf_t * out, binary_section_t * sect) {
+  sect->size = (uint32_t) (out->len - sect->offset);
+}
+
+/* Append a shared string and its terminator; remember its length if asked. */
+static void binary_append_name (binary_buf_t * out, binary_buf_t * lens, const char *name) {
+  uint32_t len = (uint32_t) SHARED_STRLEN (name);
+
+  binary_append (out, name, (size_t) len + 1);
+  if (lens)
+    binary_append (lens, &len, sizeof (len));
+}
+
 /**
  * Save the binary version of a program.
  * @param prog the program to save
@@ -47,15 +132,15 @@ static int locate_out (program_t *);
  */
 void save_binary (program_t * prog, mem_block_t * includes, mem_block_t * patches) {
 
-  char file_name_buf[200];
+  char file_name_buf[200], tmp_name[256];
   char *file_name = file_name_buf;
   FILE *f;
-  int i;
-  uint16_t bin_count;
-  uint32_t bin_size;
+  int i, written;
   size_t len;
   program_t *p;
   struct stat st;
+  binary_header_t hdr;
+  binary_buf_t out, lens;
 
   svalue_t *ret;
   char *nm;
@@ -93,47 +178,43 @@ void save_binary (program_t * prog, mem_block_t * includes, mem_block_t * patche
   len = strlen (file_name);
   file_name[len - 1] = 'b';	/* change .c ending to .b */
 
-  opt_trace (TT_COMPILE|1, "writing to: /%s", file_name);
-  if (!(f = crdir_fopen (file_name)))
-    {
-      debug_perror ("crdir_fopen() failed", file_name);
-      return;
-    }
-
-  /*
-   * [WRITE_BINARY_PREAMBLE]
-   * Includes magic id, driver id and config id. All of which must match while loading:
-   * - 4 characters magic id
-   * - 4 bytes driver id
-   * - 8 bytes config id
-   */
-  if (fwrite (magic_id, strlen (magic_id), 1, f) != 1 ||
-      fwrite ((char *) &driver_id, sizeof (driver_id), 1, f) != 1 ||
-      fwrite ((char *) &config_id, sizeof (config_id), 1, f) != 1)
-    {
-      debug_perror ("fwrite()", file_name);
-      fclose (f);
-      return;
-    }
-
   /*
-   * [WRITE_INCLUDE_LIST]
-   * Write out list of include files:
-   * - 16-bit length of include list
-   * - include list (null-terminated strings)
+   * The whole file is put together in memory and written at once.  The
+   * header is filled in last.
    */
-  assert (includes->current_size <= USHRT_MAX);
-  bin_count = (uint16_t) includes->current_size;
-  fwrite ((char *) &bin_count, sizeof (bin_count), 1, f);
-  fwrite (includes->block, includes->current_size, 1, f);
+  memset (&hdr, 0, sizeof (hdr));
+  memcpy (hdr.magic, magic_id, sizeof (hdr.magic));
+  hdr.driver_id = driver_id;
+  hdr.config_id = config_id;
+
+  out.size = BINARY_ALIGN (sizeof (hdr) + includes->current_size + prog->total_size) + 1024;
+  out.buf = DXALLOC (out.size, TAG_TEMPORARY, "save_binary");
+  out.len = sizeof (hdr);
+  lens.size = 256;
+  lens.buf = DXALLOC (lens.size, TAG_TEMPORARY, "save_binary");
+  lens.len = 0;
+
+  /* [WRITE_INCLUDE_LIST] */
+  binary_begin (&out, &hdr.includes);
+  binary_append (&out, includes->block, includes->current_size);
+  binary_end (&out, &hdr.includes);
+
+  /* [WRITE_PROGRAM_NAME] */
+  binary_begin (&out, &hdr.name);
+  binary_append_name (&out, NULL, prog->name);
+  binary_end (&out, &hdr.name);
 
   /*
-   * Make a copy and patch program
+   * [WRITE_PROGRAM_STRUCTURE]
+   * A copy of the program block with relative pointers, and string switch
+   * tables holding string table indices.
    */
-  p = (program_t *) DXALLOC (prog->total_size, TAG_TEMPORARY, "save_binary");
-  /* convert to relative pointers, copy, then convert back */
+  binary_begin (&out, &hdr.program);
+  binary_reserve (&out, prog->total_size);
+  p = (program_t *) (out.buf + out.len);
   locate_out (prog);
   memcpy (p, prog, prog->total_size);
+  p->call_sites = NULL;		/* runtime only */
   locate_in (prog);
   if (patches->current_size)
     {
@@ -141,120 +222,79 @@ void save_binary (program_t * prog, mem_block_t * includes, mem_block_t * patche
       patch_out (p, (short *) patches->block, patches->current_size / sizeof (short));
       locate_out (p);
     }
-
-  /*
-   * [WRITE_PROGRAM_NAME]
-   * Write out program name:
-   * - 16-bit length of program name
-   * - program name
-   */
-  bin_count = (uint16_t)SHARED_STRLEN (p->name);
-  fwrite ((char *) &bin_count, sizeof (bin_count), 1, f);
-  fwrite (p->name, sizeof (char), bin_count, f);
-
-  /*
-   * [WRITE_PROGRAM_STRUCTURE]
-   * Write out program structure:
-   * - 32-bit size of program_t struct
-   * - program_t struct
-   */
-  bin_size = (uint32_t) p->total_size;
-  fwrite ((char *) &bin_size, sizeof (bin_size), 1, f);
-  fwrite ((char *) p, p->total_size, 1, f);
-  FREE (p);
+  out.len += prog->total_size;
+  binary_end (&out, &hdr.program);
   p = prog;
 
-  /*
-   * [WRITE_INHERIT_NAMES]
-   * Write out inherit names (num_inherited already in program_t):
-   * - 16-bit length of inherit name
-   * - inherit name
-   */
+  /* [WRITE_INHERIT_NAMES] (num_inherited already in program_t) */
+  binary_begin (&out, &hdr.inherits);
   for (i = 0; i < (int) p->num_inherited; i++)
-    {
-      bin_count = (uint16_t)SHARED_STRLEN (p->inherit[i].prog->name);
-      fwrite ((char *) &bin_count, sizeof (bin_count), 1, f);
-      fwrite (p->inherit[i].prog->name, sizeof (char), bin_count, f);
-    }
+    binary_append_name (&out, NULL, p->inherit[i].prog->name);
+  binary_end (&out, &hdr.inherits);
 
   /*
-   * [WRITE_STRING_TABLE]
-   * Write out string table (num_strings already in program_t):
-   * - 16-bit length of string
-   * - string
-   * 
-   * TODO: allow strings longer than 65535 characters
+   * [WRITE_STRING_TABLE] [WRITE_VARIABLE_NAMES] [WRITE_FUNCTION_NAMES]
+   * The counts are already in program_t.
    */
+  binary_begin (&out, &hdr.names);
   for (i = 0; i < (int) p->num_strings; i++)
-    {
-      size_t length = SHARED_STRLEN (p->strings[i]);
-      if (length >= USHRT_MAX)
-        {
-          fclose (f);
-          /* TODO: remove the incomplete binary file */
-          error ("String too long for save_binary.\n");
-        }
-      bin_count = (uint16_t)length;
-      fwrite ((char *) &bin_count, sizeof (bin_count), 1, f);
-      fwrite (p->strings[i], sizeof (char), bin_count, f);
-    }
-
-  /*
-   * [WRITE_VARIABLE_NAMES]
-   * Write out variable names (num_variables_defined already in program_t):
-   * - 16-bit length of variable name
-   * - variable name
-   */
+    binary_append_name (&out, &lens, p->strings[i]);
   for (i = 0; i < (int) p->num_variables_defined; i++)
-    {
-      bin_count = (uint16_t)SHARED_STRLEN (p->variable_table[i]);
-      fwrite ((char *) &bin_count, sizeof (bin_count), 1, f);
-      fwrite (p->variable_table[i], sizeof (char), bin_count, f);
-    }
+    binary_append_name (&out, &lens, p->variable_table[i]);
+  for (i = 0; i < (int) p->num_functions_defined; i++)
+    binary_append_name (&out, &lens, p->function_table[i].name);
+  binary_end (&out, &hdr.names);
+
+  binary_begin (&out, &hdr.name_lengths);
+  binary_append (&out, lens.buf, lens.len);
+  binary_end (&out, &hdr.name_lengths);
+  FREE (lens.buf);
+
+  /* [WRITE_LINE_NUMBERS] */
+  binary_begin (&out, &hdr.line_info);
+  if (p->line_info)
+    binary_append (&out, p->file_info, p->file_info[0]);
+  binary_end (&out, &hdr.line_info);
+
+  /* [WRITE_PATCHES] */
+  binary_begin (&out, &hdr.patches);
+  binary_append (&out, patches->block, patches->current_size);
+  binary_end (&out, &hdr.patches);
+
+  hdr.file_size = (uint32_t) out.len;
+  memcpy (out.buf, &hdr, sizeof (hdr));
 
   /*
-   * [WRITE_FUNCTION_NAMES]
-   * Write out function names (num_functions_defined already in program_t):
-   * - 16-bit length of function name
-   * - function name
+   * Write to a temporary file and rename it over the binary, so a loader
+   * never sees a partial file, even with several compilers at work.
    */
-  for (i = 0; i < (int) p->num_functions_defined; i++)
+  snprintf (tmp_name, sizeof (tmp_name), "%s.%ld", file_name, (long) getpid ());
+  opt_trace (TT_COMPILE|1, "writing to: /%s", file_name);
+  if (!(f = crdir_fopen (tmp_name)))
     {
-      bin_count = (uint16_t)SHARED_STRLEN (p->function_table[i].name);
-      fwrite ((char *) &bin_count, sizeof (bin_count), 1, f);
-      fwrite (p->function_table[i].name, sizeof (char), bin_count, f);
+      debug_perror ("crdir_fopen() failed", tmp_name);
+      FREE (out.buf);
+      return;
     }
-
-  /*
-   * [WRITE_LINE_NUMBERS]
-   * Write out line numbers (line_info already in program_t):
-   * - 16-bit length of line info
-   * - line info
-   */
-  if (p->line_info)
+  written = fwrite (out.buf, out.len, 1, f) == 1;
+  if (fclose (f) != 0 || !written)
     {
-      bin_count = (uint16_t)p->file_info[0];
-      fwrite ((char *) &bin_count, sizeof (bin_count), 1, f);
-      fwrite ((char *) p->file_info, bin_count, 1, f);
+      debug_perror ("fwrite()", tmp_name);
+      unlink (tmp_name);
+      FREE (out.buf);
+      return;
     }
-  else
+  FREE (out.buf);
+#ifdef _WIN32
+  unlink (file_name);		/* rename() doesn't replace files */
+#endif
+  if (rename (tmp_name, file_name) == -1)
     {
-      bin_count = 0;
-      fwrite ((char *) &bin_count, sizeof (bin_count), 1, f);
+      debug_perror ("rename()", file_name);
+      unlink (tmp_name);
+      return;
     }
-
-  /*
-   * [WRITE_PATCHES]
-   * Write out patch information:
-   * - 16-bit length of patch info
-   * - patch info
-   */
-  assert (patches->current_size <= USHRT_MAX);
-  bin_count = (uint16_t)patches->current_size;
-  fwrite ((char *) &bin_count, sizeof (bin_count), 1, f);
-  fwrite (patches->block, patches->current_size, 1, f);
-
-  fclose (f);
+  forget_times (file_name);
   opt_trace (TT_COMPILE|1, "done: /%s", file_name);
 }				/* save_binary() */
 
@@ -400,12 +440,176 @@ sort_function_table (program_t * prog)
   FREE (inverse);
 }
 
-#define ALLOC_BUF(size) \
-    if ((size) > buf_size) { FREE(buf); buf = DXALLOC(buf_size = size, TAG_TEMPORARY, "ALLOC_BUF"); }
-
 /* crude hack to check both .B and .b */
 #define OUT_OF_DATE 0
 
+/*
+ * The contents of a binary file, mapped where the platform allows it and
+ * read with a single read() otherwise.  Small files are read as well: for
+ * a few pages, setting up and tearing down a mapping costs more than the
+ * copy.
+ */
+#define BINARY_MMAP_THRESHOLD 65536
+
+typedef struct {
+  char *data;
+  size_t size;
+  int mapped;
+} binary_image_t;
+
+static int map_binary (binary_image_t * img, int fd, size_t size) {
+  img->size = size;
+  img->mapped = 0;
+#ifdef HAVE_MMAP
+  img->data = size >= BINARY_MMAP_THRESHOLD ? mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  if (img->data != MAP_FAILED)
+    {
+      img->mapped = 1;
+      return 1;
+    }
+#endif
+  img->data = DXALLOC (size, TAG_TEMPORARY, "map_binary");
+  if ((size_t) FILE_READ (fd, img->data, (unsigned int) size) != size)
+    {
+      FREE (img->data);
+      return 0;
+    }
+  return 1;
+}
+
+static void unmap_binary (binary_image_t * img) {
+#ifdef HAVE_MMAP
+  if (img->mapped)
+    {
+      munmap (img->data, img->size);
+      return;
+    }
+#endif
+  FREE (img->data);
+}
+
+/* Does the section lie within the file, and start aligned? */
+static int valid_section (const binary_image_t * img, const binary_section_t * sect) {
+  return (sect->offset & 7) == 0 && sect->offset <= img->size &&
+    sect->size <= img->size - sect->offset;
+}
+
+/* Does the section hold exactly n strings, each followed by '\0'? */
+static int valid_names (const binary_image_t * img, const binary_section_t * sect, size_t n) {
+  const char *s = img->data + sect->offset, *end = s + sect->size;
+
+  for (; n > 0; n--, s++)
+    {
+      s = memchr (s, '\0', (size_t) (end - s));
+      if (!s)
+        return 0;
+    }
+  return s == end;
+}
+
+/**
+ * Check a mapped binary for consistency before anything is allocated from
+ * it: the header, that every section lies within the file, and that the
+ * names and their lengths add up.
+ * @returns The program block in the image, or NULL if the file is unusable.
+ */
+static const program_t *validate_binary (const binary_image_t * img) {
+  const binary_header_t *hdr = (const binary_header_t *) img->data;
+  const program_t *p;
+  const uint32_t *lens;
+  const unsigned short *file_info;
+  const short *patches;
+  const char *s, *end;
+  size_t i, num_names;
+
+  if (memcmp (hdr->magic, magic_id, sizeof (hdr->magic)) != 0)
+    {
+      opt_trace (TT_COMPILE|3, "out of date. (bad magic number)");
+      return NULL;
+    }
+  if (hdr->driver_id != driver_id)
+    {
+      opt_trace (TT_COMPILE|3, "out of date. (driver changed)");
+      return NULL;
+    }
+  if (hdr->config_id != config_id)
+    {
+      opt_trace (TT_COMPILE|3, "out of date. (config file changed)");
+      return NULL;
+    }
+  if (hdr->file_size != img->size ||
+      !valid_section (img, &hdr->includes) || !valid_section (img, &hdr->name) ||
+      !valid_section (img, &hdr->program) || !valid_section (img, &hdr->inherits) ||
+      !valid_section (img, &hdr->name_lengths) || !valid_section (img, &hdr->names) ||
+      !valid_section (img, &hdr->line_info) || !valid_section (img, &hdr->patches))
+    {
+      opt_trace (TT_COMPILE|1, "binary file truncated or corrupted.");
+      return NULL;
+    }
+
+  p = (const program_t *) (img->data + hdr->program.offset);
+  if (hdr->program.size < sizeof (program_t) || p->total_size < 0 ||
+      (size_t) p->total_size != hdr->program.size)
+    {
+      opt_trace (TT_COMPILE|1, "program structure corrupted.");
+      return NULL;
+    }
+  if ((hdr->includes.size && img->data[hdr->includes.offset + hdr->includes.size - 1] != '\0') ||
+      !valid_names (img, &hdr->name, 1) ||
+      !valid_names (img, &hdr->inherits, p->num_inherited))
+    {
+      opt_trace (TT_COMPILE|1, "name tables corrupted.");
+      return NULL;
+    }
+
+  /* the lengths must agree with the terminators */
+  num_names = (size_t) p->num_strings + p->num_variables_defined + p->num_functions_defined;
+  if (hdr->name_lengths.size != num_names * sizeof (uint32_t))
+    {
+      opt_trace (TT_COMPILE|1, "string table corrupted.");
+      return NULL;
+    }
+  lens = (const uint32_t *) (img->data + hdr->name_lengths.offset);
+  s = img->data + hdr->names.offset;
+  end = s + hdr->names.size;
+  for (i = 0; i < num_names; i++)
+    {
+      if (lens[i] >= (size_t) (end - s) || s[lens[i]] != '\0')
+        {
+          opt_trace (TT_COMPILE|1, "string table corrupted.");
+          return NULL;
+        }
+      s += lens[i] + 1;
+    }
+  if (s != end)
+    {
+      opt_trace (TT_COMPILE|1, "string table corrupted.");
+      return NULL;
+    }
+
+  file_info = (const unsigned short *) (img->data + hdr->line_info.offset);
+  if (hdr->line_info.size && (hdr->line_info.size < 2 * sizeof (unsigned short) ||
+      file_info[0] != hdr->line_info.size || file_info[1] * sizeof (unsigned short) > hdr->line_info.size))
+    {
+      opt_trace (TT_COMPILE|1, "line number info corrupted.");
+      return NULL;
+    }
+
+  /* patch_in() looks at a switch instruction and its two offsets */
+  patches = (const short *) (img->data + hdr->patches.offset);
+  for (i = 0; i < hdr->patches.size / sizeof (short); i++)
+    {
+      if (patches[i] < 0 || patches[i] + 6 > p->program_size)
+        break;
+    }
+  if (hdr->patches.size % sizeof (short) || i < hdr->patches.size / sizeof (short))
+    {
+      opt_trace (TT_COMPILE|1, "patch info corrupted.");
+      return NULL;
+    }
+  return p;
+}
+
 /**
  * Load the binary version of a program.
  * @param name the name of the program to load
@@ -414,17 +618,17 @@ sort_function_table (program_t * prog)
 program_t *load_binary (const char *name) {
 
   char file_name_buf[400];
-  char *buf, *iname, *file_name = file_name_buf, *file_name_two = &file_name_buf[200];
+  char *file_name = file_name_buf, *file_name_two = &file_name_buf[200];
+  const char *iname, *names;
   int fd;
-  FILE *f;
   int i;
-  uint32_t bin_driver_id; /* saved driver_id */
-  uint64_t bin_config_id; /* saved config_id */
   time_t mtime;
-  uint16_t bin_count;
-  uint32_t bin_size;
-  size_t buf_size, len;
+  size_t len;
   program_t *p, *prog;
+  const program_t *image_prog;
+  const binary_header_t *hdr;
+  const uint32_t *lens;
+  binary_image_t img;
   object_t *ob;
   struct stat st;
 
@@ -459,166 +663,81 @@ program_t *load_binary (const char *name) {
     }
   mtime = st.st_mtime;
 
-  /* Open file stream */
-  if (!(f = FILE_FDOPEN (fd, "rb"))) {
-    opt_trace (TT_COMPILE|3, "unable to open expected binary: %s", file_name);
-    FILE_CLOSE (fd);
-    return OUT_OF_DATE;
-  }
-
   opt_trace (TT_COMPILE|3, "found saved binary: %s", file_name);
 
   /* Check if the source file is newer. */
   if (check_times (mtime, name) <= 0)
     {
       opt_trace (TT_COMPILE|3, "out of date (source file newer).");
-      fclose (f);
+      FILE_CLOSE (fd);
       return OUT_OF_DATE;
     }
 
-  buf_size = SMALL_STRING_SIZE;
-  buf = DXALLOC (buf_size, TAG_TEMPORARY, "ALLOC_BUF");
-
   /*
    * [READ_BINARY_PREAMBLE]
-    * Check magic id, driver id and config id.
+   * Map the file and check it as a whole: magic id, driver id, config id
+   * and the bounds of every section.
    */
-  if (fread (buf, strlen (magic_id), 1, f) != 1 ||
-      strncmp (buf, magic_id, strlen (magic_id)) != 0)
+  if ((size_t) st.st_size < sizeof (binary_header_t))
     {
-      opt_trace (TT_COMPILE|3, "out of date. (bad magic number)\n");
-      fclose (f);
-      FREE (buf);
+      opt_trace (TT_COMPILE|1, "binary file truncated: %s", file_name);
+      FILE_CLOSE (fd);
       return OUT_OF_DATE;
     }
-  if ((fread ((char *) &bin_driver_id, sizeof (bin_driver_id), 1, f) != 1) ||
-      (driver_id != bin_driver_id))
+  if (!map_binary (&img, fd, (size_t) st.st_size))
     {
-      opt_trace (TT_COMPILE|3, "out of date. (driver changed)\n");
-      fclose (f);
-      FREE (buf);
+      opt_trace (TT_COMPILE|1, "unable to read expected binary: %s", file_name);
+      FILE_CLOSE (fd);
       return OUT_OF_DATE;
     }
-  if ((fread ((char *) &bin_config_id, sizeof (bin_config_id), 1, f) != 1) ||
-      (config_id != bin_config_id))
+  FILE_CLOSE (fd);
+  if (!(image_prog = validate_binary (&img)))
     {
-      opt_trace (TT_COMPILE|3, "out of date. (config file changed)\n");
-      fclose (f);
-      FREE (buf);
+      unmap_binary (&img);
       return OUT_OF_DATE;
     }
+  hdr = (const binary_header_t *) img.data;
 
   /*
    * [READ_INCLUDE_LIST]
    * Check include file times. If any are newer, binary is out of date.
    */
-  if (fread ((char *) &bin_count, sizeof (bin_count), 1, f) != 1)
-    {
-      opt_trace (TT_COMPILE|1, "failed reading include list size.");
-      fclose (f);
-      FREE (buf);
-      return OUT_OF_DATE;
-    }
-  len = (size_t) bin_count;
-  ALLOC_BUF (len);
-  if (fread (buf, sizeof (char), len, f) != len)
-    {
-      opt_trace (TT_COMPILE|1, "failed reading include list.");
-      fclose (f);
-      FREE (buf);
-      return OUT_OF_DATE;
-    }
-  for (iname = buf; iname < buf + len; iname += strlen (iname) + 1)
+  iname = img.data + hdr->includes.offset;
+  for (i = 0; iname < img.data + hdr->includes.offset + hdr->includes.size; iname += strlen (iname) + 1, i++)
     {
       if (check_times (mtime, iname) <= 0)
         {
           opt_trace (TT_COMPILE|3, "out of date (include file is newer).");
-          fclose (f);
-          FREE (buf);
+          unmap_binary (&img);
           return OUT_OF_DATE;
         }
     }
-  opt_trace (TT_COMPILE|3, "include files (%d) modification check ok.", bin_count);
+  opt_trace (TT_COMPILE|3, "include files (%d) modification check ok.", i);
 
   /*
    * [READ_PROGRAM_NAME]
    * Check program name. If it doesn't match, binary is probably moved or out of date.
    */
-  if (fread ((char *) &bin_count, sizeof (bin_count), 1, f) != 1)
+  iname = img.data + hdr->name.offset;
+  if (*iname && strcmp (name, iname) != 0)
     {
-      opt_trace (TT_COMPILE|1, "failed reading binary name length.");
-      fclose (f);
-      FREE (buf);
+      opt_trace (TT_COMPILE|1, "binary name %s inconsistent with file (%s).", iname, name);
+      unmap_binary (&img);
       return OUT_OF_DATE;
     }
-  len = (size_t) bin_count;
-  if (len > 0)
-    {
-      ALLOC_BUF (len + 1);
-      if (fread (buf, sizeof (char), len, f) != len)
-        {
-          opt_trace (TT_COMPILE|1, "failed reading binary name.");
-          fclose (f);
-          FREE (buf);
-          return OUT_OF_DATE;
-        }
-      buf[len] = '\0';
-      if (strcmp (name, buf) != 0)
-        {
-          opt_trace (TT_COMPILE|1, "binary name [%zd]%s inconsistent with file (%s).", len, buf, name);
-          fclose (f);
-          FREE (buf);
-          return OUT_OF_DATE;
-        }
-    }
-
-  /*
-   * [READ_PROGRAM_STRUCTURE]
-   * Read program structure.
-   * - 32-bit size of program_t struct
-   * - program_t struct
-   */
-  if (fread ((char *) &bin_size, sizeof (bin_size), 1, f) != 1)
-    {
-      opt_trace (TT_COMPILE|1, "failed reading program struct size");
-      fclose (f);
-      FREE (buf);
-      return OUT_OF_DATE;
-    }
-  len = (size_t) bin_size;
-  p = (program_t *) DXALLOC (len, TAG_PROGRAM, "load_binary");
-  if (fread ((char *) p, len, 1, f) != 1)
-    {
-      opt_trace (TT_COMPILE|1, "failed reading program struct");
-      fclose (f);
-      FREE (buf);
-      return OUT_OF_DATE;
-    }
-  locate_in (p);		/* from swap.c */
-  p->name = make_shared_string (name);
-  opt_trace (TT_COMPILE|3, "loaded program structure ok. size = %zu bytes.", len);
 
   /*
    * [READ_INHERIT_NAMES]
-   * Read inherit names and find prog.  Check mod times also.
+   * Find inherited programs.  Check mod times also.  Nothing has been
+   * allocated yet, so giving up is cheap.
    */
-  for (i = 0; i < (int) p->num_inherited; i++)
+  iname = img.data + hdr->inherits.offset;
+  for (i = 0; i < (int) image_prog->num_inherited; iname += strlen (iname) + 1, i++)
     {
-      buf[0] = '\0';
-      if (fread ((char *) &bin_count, sizeof (bin_count), 1, f) == 1)
-        {
-          len = (size_t) bin_count;
-          ALLOC_BUF (len + 1);
-          if (fread (buf, sizeof (char), len, f) == len)
-            buf[len] = '\0';
-        }
-      if (!buf[0])
+      if (!*iname)
         {
           opt_trace (TT_COMPILE|1, "inherited program name corrupted.");
-          fclose (f);
-          free_string (p->name);
-          FREE (p);
-          FREE (buf);
+          unmap_binary (&img);
           return OUT_OF_DATE;
         }
 
@@ -626,200 +745,95 @@ program_t *load_binary (const char *name) {
        * Check times against inherited source.  If saved binary of
        * inherited prog exists, check against it also.
        */
-      sprintf (file_name_two, "%s/%s", CONFIG_STR (__SAVE_BINARIES_DIR__), buf);
+      snprintf (file_name_two, 200, "%s/%s", CONFIG_STR (__SAVE_BINARIES_DIR__), iname);
       if (file_name_two[0] == '/')
         file_name_two++;
       len = strlen (file_name_two);
       file_name_two[len - 1] = 'b';
-      if (check_times (mtime, buf) <= 0 ||
+      if (check_times (mtime, iname) <= 0 ||
           check_times (mtime, file_name_two) == 0)
         {			/* ok if -1 */
           opt_trace (TT_COMPILE|1, "out of date (inherited source is newer).");
-          fclose (f);
-          free_string (p->name);
-          FREE (p);
-          FREE (buf);
+          unmap_binary (&img);
           return OUT_OF_DATE;
         }
       /* find inherited program (maybe load it here?) */
-      ob = find_object_by_name (buf);
-      if (!ob)
+      if (!find_object_by_name (iname))
         {
-          opt_trace (TT_COMPILE|1, "saved binary inherits: /%s", buf);
-          fclose (f);
-          free_string (p->name);
-          FREE (p);
-          inherit_file = buf;	/* freed elsewhere */
+          opt_trace (TT_COMPILE|1, "saved binary inherits: /%s", iname);
+          inherit_file = alloc_cstring (iname, "load_binary");	/* freed elsewhere */
+          unmap_binary (&img);
           return 0;
         }
-      p->inherit[i].prog = ob->prog;
     }
-  opt_trace (TT_COMPILE|3, "loaded inherit names ok. num_inherited = %d.", p->num_inherited);
+  opt_trace (TT_COMPILE|3, "checked inherit names ok. num_inherited = %d.", image_prog->num_inherited);
 
   /*
-   * [READ_STRING_TABLE]
-   * Read string table. (num_strings already in program_t)
+   * [READ_PROGRAM_STRUCTURE]
+   * Copy the program block out and relocate its pointers.
    */
-  for (i = 0; i < (int) p->num_strings; i++)
+  len = hdr->program.size;
+  p = (program_t *) DXALLOC (len, TAG_PROGRAM, "load_binary");
+  memcpy (p, image_prog, len);
+  locate_in (p);		/* from swap.c */
+  p->call_sites = NULL;		/* runtime only */
+  p->name = make_shared_string (name);
+  iname = img.data + hdr->inherits.offset;
+  for (i = 0; i < (int) p->num_inherited; iname += strlen (iname) + 1, i++)
     {
-      if (fread ((char *) &bin_count, sizeof (bin_count), 1, f) == 1)
-        {
-          len = (size_t) bin_count;
-          ALLOC_BUF (len + 1);
-          if (fread (buf, sizeof (char), len, f) == len)
-            {
-              buf[len] = '\0';
-              p->strings[i] = make_shared_string (buf);
-              continue;
-            }
-        }
-      opt_trace (TT_COMPILE|1, "string table corrupted.");
-      while (i-- > 0)
-        {
-          free_string (p->strings[i]);
-        }
-      fclose (f);
-      free_string (p->name);
-      FREE (p);
-      FREE (buf);
-      return OUT_OF_DATE;
+      ob = find_object_by_name (iname);
+      p->inherit[i].prog = ob->prog;
     }
-  opt_trace (TT_COMPILE|3, "loaded string table ok. num_strings = %d.", p->num_strings);
+  opt_trace (TT_COMPILE|3, "loaded program structure ok. size = %zu bytes.", len);
 
   /*
-   * [READ_VARIABLE_NAMES]
-   * Read variable names. (num_variables_defined already in program_t)
+   * [READ_STRING_TABLE] [READ_VARIABLE_NAMES] [READ_FUNCTION_NAMES]
+   * Intern the names straight from the image, a table at a time.
    */
+  names = img.data + hdr->names.offset;
+  lens = (const uint32_t *) (img.data + hdr->name_lengths.offset);
+  make_shared_strings (p->strings, names, lens, p->num_strings);
+  for (i = 0; i < (int) p->num_strings; i++)
+    names += lens[i] + 1;
+  lens += p->num_strings;
+  make_shared_strings (p->variable_table, names, lens, p->num_variables_defined);
   for (i = 0; i < (int) p->num_variables_defined; i++)
+    names += lens[i] + 1;
+  lens += p->num_variables_defined;
+  if (p->num_functions_defined)
     {
-      if (fread ((char *) &bin_count, sizeof (bin_count), 1, f) == 1)
-        {
-          len = (size_t) bin_count;
-          ALLOC_BUF (len + 1);
-          if (fread (buf, sizeof (char), len, f) == len)
-            {
-              buf[len] = '\0';
-              p->variable_table[i] = make_shared_string (buf);
-              continue;
-            }
-        }
-      opt_trace (TT_COMPILE|1, "variable table corrupted.");
-      while (i-- > 0)
-        {
-          free_string (p->variable_table[i]);
-        }
-      i = p->num_strings;
-      while (i-- > 0)
-        {
-          free_string (p->strings[i]);
-        }
-      fclose (f);
-      free_string (p->name);
-      FREE (p);
-      FREE (buf);
-      return OUT_OF_DATE;
-    }
-  opt_trace (TT_COMPILE|3, "loaded variable table ok. num_variables_defined = %d.", p->num_variables_defined);
+      char **function_names = CALLOCATE (p->num_functions_defined, char *, TAG_TEMPORARY, "load_binary");
 
-  /*
-   * [READ_FUNCTION_NAMES]
-   * Read function names. (num_functions_defined already in program_t)
-   */
-  for (i = 0; i < (int) p->num_functions_defined; i++)
-    {
-      if (fread ((char *) &bin_count, sizeof (bin_count), 1, f) == 1)
-        {
-          len = (size_t) bin_count;
-          ALLOC_BUF (len + 1);
-          if (fread (buf, sizeof (char), len, f) == len)
-            {
-              buf[len] = '\0';
-              p->function_table[i].name = make_shared_string (buf);
-              continue;
-            }
-        }
-      opt_trace (TT_COMPILE|1, "function table corrupted.");
-      while (i-- > 0)
-        {
-          free_string (p->function_table[i].name);
-        }
-      i = p->num_variables_defined;
-      while (i-- > 0)
-        {
-          free_string (p->variable_table[i]);
-        }
-      i = p->num_strings;
-      while (i-- > 0)
-        {
-          free_string (p->strings[i]);
-        }
-      fclose (f);
-      free_string (p->name);
-      FREE (p);
-      FREE (buf);
-      return OUT_OF_DATE;
+      make_shared_strings (function_names, names, lens, p->num_functions_defined);
+      for (i = 0; i < (int) p->num_functions_defined; i++)
+        p->function_table[i].name = function_names[i];
+      FREE (function_names);
     }
   sort_function_table (p);
-  opt_trace (TT_COMPILE|3, "loaded function table ok. num_functions_defined = %d.", p->num_functions_defined);
+  opt_trace (TT_COMPILE|3, "loaded names ok. num_strings = %d, num_variables_defined = %d, num_functions_defined = %d.",
+             p->num_strings, p->num_variables_defined, p->num_functions_defined);
 
   /*
    * [READ_LINE_NUMBERS]
-   * Read line numbers.
    */
-  if (fread ((char *) &bin_count, sizeof (bin_count), 1, f) == 1)
+  p->file_info = NULL;
+  p->line_info = NULL;
+  if (hdr->line_info.size)
     {
-      len = (size_t) bin_count;
-      p->file_info = (unsigned short *) DXALLOC (len, TAG_LINENUMBERS, "load binary");
-      if (fread ((char *) p->file_info, len, 1, f) == 1)
-        {
-          p->line_info = (unsigned char *) &p->file_info[p->file_info[1]];
-        }
-      else
-        {
-          opt_trace (TT_COMPILE|1, "line number info corrupted.");
-          i = p->num_functions_defined;
-          while (i-- > 0)
-            {
-              free_string (p->function_table[i].name);
-            }
-          i = p->num_variables_defined;
-          while (i-- > 0)
-            {
-              free_string (p->variable_table[i]);
-            }
-          i = p->num_strings;
-          while (i-- > 0)
-            {
-              free_string (p->strings[i]);
-            }
-          fclose (f);
-          free_string (p->name);
-          FREE (p->file_info);
-          FREE (p);
-          FREE (buf);
-          return OUT_OF_DATE;
-        }
+      p->file_info = (unsigned short *) DXALLOC (hdr->line_info.size, TAG_LINENUMBERS, "load binary");
+      memcpy (p->file_info, img.data + hdr->line_info.offset, hdr->line_info.size);
+      p->line_info = (unsigned char *) &p->file_info[p->file_info[1]];
     }
-  opt_trace (TT_COMPILE|3, "loaded line number info ok.");
 
   /*
    * [READ_PATCHES]
-   * Read patch information and fix up program.
+   * Fix up string switch tables in one pass over the patch list.
    */
-  if (fread ((char *) &bin_count, sizeof (bin_count), 1, f) == 1)
-    {
-      len = (size_t) bin_count;
-      ALLOC_BUF (len);
-      if (fread (buf, len, 1, f) == 1)
-        {
-          /* fix up some stuff */
-          patch_in (p, (short *) buf, len / sizeof (short));
-        }
-    }
+  if (hdr->patches.size)
+    patch_in (p, (short *) (img.data + hdr->patches.offset), hdr->patches.size / sizeof (short));
   opt_trace (TT_COMPILE|3, "applied patches ok.");
 
-  fclose (f);
-  FREE (buf);
+  unmap_binary (&img);
 
   /*
    * Now finish everything up.  (stuff from epilog())
@@ -868,6 +882,23 @@ void init_binaries () {
     }
 }
 
+/*
+ * Results of stat() for check_times().  Every binary checks the source it
+ * was compiled from plus its includes and inherited sources, and a cold
+ * boot checks the same few headers thousands of times.  An entry is only
+ * used within the second it was taken in; file times have a resolution of
+ * one second, so this doesn't change which binaries are out of date.
+ */
+#define STAT_CACHE_SIZE 256	/* must be a power of 2 */
+
+typedef struct {
+  time_t checked;		/* when stat() was called, 0 if empty */
+  time_t mtime;			/* -1 if the file doesn't exist */
+  char name[256];		/* longer names are not cached */
+} stat_cache_entry_t;
+
+static stat_cache_entry_t stat_cache[STAT_CACHE_SIZE];
+
 /*
  * Test against modification times.  -1 if file doesn't exist,
  * 0 if out of date, and 1 if it's ok.
@@ -876,16 +907,40 @@ static int
 check_times (time_t mtime, const char *nm)
 {
   struct stat st;
+  size_t len = strlen (nm);
+  time_t now = time (NULL);
+  stat_cache_entry_t *entry = &stat_cache[strhash64 (nm, len) & (STAT_CACHE_SIZE - 1)];
 
-  if (stat (nm, &st) == -1)
+  if (entry->checked != now || strcmp (entry->name, nm) != 0)
+    {
+      entry->mtime = (stat (nm, &st) == -1) ? -1 : st.st_mtime;
+      if (len < sizeof (entry->name))
+        {
+          memcpy (entry->name, nm, len + 1);
+          entry->checked = now;
+        }
+      else
+        entry->checked = 0;
+    }
+  if (entry->mtime == -1)
     return -1;
-  if (st.st_mtime > mtime)
+  if (entry->mtime > mtime)
     {
       return 0;
     }
   return 1;
 }				/* check_times() */
 
+/* Drop the cached time of a file that was just written. */
+static void
+forget_times (const char *nm)
+{
+  stat_cache_entry_t *entry = &stat_cache[strhash64 (nm, strlen (nm)) & (STAT_CACHE_SIZE - 1)];
+
+  if (strcmp (entry->name, nm) == 0)
+    entry->checked = 0;
+}
+
 /*
  * Routines to do some hacking on the program being saved/loaded.
  * Basically to fix up string switch tables, since the alternative
@@ -1,6 +1,9 @@
 #pragma once
 #include "lpc/compiler.h"
 
+/* save a binary of every program compiled, not just #pragma save_binary ones */
+extern int save_all_binaries;
+
 void init_binaries();
 
 program_t *load_binary(const char *);
@@ -286,9 +286,24 @@ void disassemble (FILE *f, char *code, ptrdiff_t start, ptrdiff_t end, program_t
         case F_LOCAL:
         case F_LOCAL_LVALUE:
         case F_VOID_ASSIGN_LOCAL:
+        case F_RETURN_LOCAL:
+        case F_LOCAL_INDEX_LVALUE:
           sprintf (buff, "LV%d", EXTRACT_UCHAR (p));
           p++;
           break;
+        case F_ADD_LOCALS:
+          sprintf (buff, "LV%d + LV%d", EXTRACT_UCHAR (p), EXTRACT_UCHAR (p + 1));
+          p += 2;
+          break;
+        case F_GLOBAL_BRANCH_WHEN_ZERO:
+          iarg = EXTRACT_UCHAR (p);
+          COPY_SHORT (&sarg, p + 1);
+          offset = (unsigned short)(p + 1 - code + sarg);
+          sprintf (buff, "%s, branch_when_zero %04x (%04x)",
+                   (unsigned) iarg < NUM_VARS ? variable_name (prog, iarg) : "<out of range>",
+                   (unsigned) sarg, (unsigned) offset);
+          p += 3;
+          break;
         case F_LOOP_COND_NUMBER:
           i = EXTRACT_UCHAR (p++);
           COPY_INT (&iarg, p);
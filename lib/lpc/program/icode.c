@@ -28,6 +28,9 @@ static void i_generate_loop (int, parse_node_t *, parse_node_t *,
 static void i_update_branch_list (parse_node_t *);
 static int try_to_push (int, int);
 
+/* a local variable read, possibly marked as its last use by the optimizer */
+#define IS_LOCAL(x) (IS_NODE (x, NODE_OPCODE_1, F_LOCAL) || IS_NODE (x, NODE_OPCODE_1, F_TRANSFER_LOCAL))
+
 /*
    this variable is used to properly adjust the 'break_sp' stack in
    the event a 'continue' statement is issued from inside a 'switch'.
@@ -453,6 +456,24 @@ void i_generate_node (parse_node_t * expr) {
       expr = expr->r.expr;
       /* fall through */
     case NODE_BINARY_OP:
+      if (expr->v.number == F_ADD && IS_LOCAL (expr->l.expr) && IS_LOCAL (expr->r.expr))
+        {
+          /* superinstruction: local + local */
+          end_pushes ();
+          ins_byte (F_ADD_LOCALS);
+          ins_byte ((BYTE)expr->l.expr->l.number);
+          ins_byte ((BYTE)expr->r.expr->l.number);
+          break;
+        }
+      if (expr->v.number == F_INDEX_LVALUE && IS_NODE (expr->r.expr, NODE_OPCODE_1, F_LOCAL_LVALUE))
+        {
+          /* superinstruction: local_lvalue + index_lvalue */
+          i_generate_node (expr->l.expr);
+          end_pushes ();
+          ins_byte (F_LOCAL_INDEX_LVALUE);
+          ins_byte ((BYTE)expr->r.expr->l.number);
+          break;
+        }
       i_generate_node (expr->l.expr);
       /* fall through */
     case NODE_UNARY_OP:
@@ -508,7 +529,13 @@ void i_generate_node (parse_node_t * expr) {
         while (n--)
           ins_byte (F_EXIT_FOREACH);
 
-        if (expr->r.expr)
+        if (expr->r.expr && IS_LOCAL (expr->r.expr))
+          {
+            /* superinstruction: local + return */
+            ins_byte (F_RETURN_LOCAL);
+            ins_byte ((BYTE)expr->r.expr->l.number);
+          }
+        else if (expr->r.expr)
           {
             i_generate_node (expr->r.expr);
             end_pushes ();
@@ -982,6 +1009,16 @@ i_generate_if_branch (parse_node_t * node, int invert)
       i_generate_node (node->l.expr);
       i_generate_node (node->r.expr);
     }
+  else if (branch == F_BRANCH_WHEN_ZERO && IS_NODE (node, NODE_OPCODE_1, F_GLOBAL))
+    {
+      /* superinstruction: global + branch_when_zero */
+      end_pushes ();
+      ins_byte (F_GLOBAL_BRANCH_WHEN_ZERO);
+      ins_byte ((BYTE)node->l.number);
+      ins_short ((short)current_forward_branch);
+      current_forward_branch = CURRENT_PROGRAM_SIZE - 2;
+      return;
+    }
   else
     {
       i_generate_node (node);
@@ -1270,7 +1307,11 @@ void optimize_icode (char *start, char *p, char *end) {
             break;
           }
 #endif
+        case F_GLOBAL_BRANCH_WHEN_ZERO:
+          p += 3;
+          break;
         case F_CATCH:
+        case F_ADD_LOCALS:
         case F_AGGREGATE:
         case F_AGGREGATE_ASSOC:
         case F_STRING:
@@ -1285,6 +1326,8 @@ void optimize_icode (char *start, char *p, char *end) {
           break;
         case F_GLOBAL_LVALUE:
         case F_GLOBAL:
+        case F_RETURN_LOCAL:
+        case F_LOCAL_INDEX_LVALUE:
         case F_SHORT_STRING:
         case F_LOOP_INCR:
         case F_WHILE_DEC:
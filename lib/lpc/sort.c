@@ -0,0 +1,132 @@
+#ifdef	HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "src/std.h"
+#include "types.h"
+#include "sort.h"
+
+/*
+ * Sorting of svalue arrays, for sort_array().
+ *
+ * Unstable sorts use pattern-defeating quicksort: an introsort which runs
+ * in O(n) on sorted, reversed and all-equal input and falls back to heap
+ * sort instead of going quadratic.  Stable sorts use a bottom-up merge sort.
+ * Elements are moved as whole svalues, and the comparison is inlined for
+ * arrays of one basic type.  See sort_impl.c for the algorithms.
+ */
+
+#define INSERTION_SORT_THRESHOLD	24	/* smaller ranges use insertion sort */
+#define NINTHER_THRESHOLD		128	/* larger ranges pick the pivot from 9 elements */
+#define PARTIAL_INSERTION_LIMIT		8	/* moves before giving up on a nearly sorted range */
+#define MERGE_RUN_LENGTH		16	/* runs insertion sorted before merging */
+
+#define SWAP_SVALUES(a, b) \
+  do { svalue_t swap_tmp_ = *(a); *(a) = *(b); *(b) = swap_tmp_; } while (0)
+
+/* any comparison function */
+#define SORT_NAME(x)		generic_##x
+#define SORT_LESS(a, b)		((*cmp) ((a), (b)) < 0)
+#define SORT_MERGE
+#include "sort_impl.c"
+#undef SORT_NAME
+#undef SORT_LESS
+#undef SORT_MERGE
+
+/* ints; these typed comparisons leave cmp unused */
+#define SORT_NAME(x)		number_##x
+#define SORT_LESS(a, b)		((void) cmp, (a)->u.number < (b)->u.number)
+#include "sort_impl.c"
+#undef SORT_NAME
+#undef SORT_LESS
+
+/* floats */
+#define SORT_NAME(x)		real_##x
+#define SORT_LESS(a, b)		((void) cmp, (a)->u.real < (b)->u.real)
+#include "sort_impl.c"
+#undef SORT_NAME
+#undef SORT_LESS
+
+/* strings; shared strings that are equal are the same pointer */
+#define SORT_NAME(x)		string_##x
+#define SORT_LESS(a, b)		((void) cmp, (a)->u.string != (b)->u.string && strcmp ((a)->u.string, (b)->u.string) < 0)
+#include "sort_impl.c"
+#undef SORT_NAME
+#undef SORT_LESS
+
+/* allowed number of bad partitions before falling back to heap sort */
+static int
+bad_partitions_allowed (size_t n)
+{
+  int log2 = 0;
+
+  while (n >>= 1)
+    log2++;
+  return log2;
+}
+
+/**
+ * @brief Sort svalues in ascending order of a comparison function.
+ *
+ * The comparison function returns less than, equal to or greater than zero
+ * like strcmp().  It need not be a consistent ordering: the result is then
+ * in no particular order, but nothing is lost or read out of bounds.
+ * With SORT_STABLE, a temporary copy of the svalues is allocated, so the
+ * comparison function must not raise an error.
+ * @param v The svalues to sort.
+ * @param n The number of svalues.
+ * @param cmp The comparison function.
+ * @param flags SORT_STABLE to keep svalues that compare equal in order.
+ */
+void
+sort_svalues (svalue_t * v, size_t n, svalue_cmp_t cmp, int flags)
+{
+  if (n < 2)
+    return;
+
+  if (flags & SORT_STABLE)
+    {
+      svalue_t *tmp = CALLOCATE (n, svalue_t, TAG_TEMPORARY, "sort_svalues");
+
+      generic_merge_sort (v, v + n, tmp, cmp);
+      FREE (tmp);
+    }
+  else
+    generic_quick_sort (v, v + n, bad_partitions_allowed (n), 1, cmp);
+}
+
+/**
+ * @brief Sort svalues that are all T_NUMBER in ascending order.
+ * @param v The svalues to sort.
+ * @param n The number of svalues.
+ */
+void
+sort_numbers (svalue_t * v, size_t n)
+{
+  if (n >= 2)
+    number_quick_sort (v, v + n, bad_partitions_allowed (n), 1, NULL);
+}
+
+/**
+ * @brief Sort svalues that are all T_REAL in ascending order.
+ * @param v The svalues to sort.
+ * @param n The number of svalues.
+ */
+void
+sort_reals (svalue_t * v, size_t n)
+{
+  if (n >= 2)
+    real_quick_sort (v, v + n, bad_partitions_allowed (n), 1, NULL);
+}
+
+/**
+ * @brief Sort svalues that are all T_STRING in ascending order of strcmp().
+ * @param v The svalues to sort.
+ * @param n The number of svalues.
+ */
+void
+sort_strings (svalue_t * v, size_t n)
+{
+  if (n >= 2)
+    string_quick_sort (v, v + n, bad_partitions_allowed (n), 1, NULL);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "types.h"
+
+typedef int (*svalue_cmp_t) (svalue_t *, svalue_t *);
+
+/* flags for sort_svalues() */
+#define SORT_STABLE	1	/* keep elements that compare equal in order */
+
+/*
+ * sort.c
+ */
+void sort_svalues(svalue_t *, size_t, svalue_cmp_t, int);
+void sort_numbers(svalue_t *, size_t);
+void sort_reals(svalue_t *, size_t);
+void sort_strings(svalue_t *, size_t);
@@ -0,0 +1,302 @@
+/*
+ * sort_impl.c - sorting routines for one way of comparing svalues.
+ *
+ * This file is included by sort.c once for each element kind, with
+ *   SORT_NAME(x)   giving the names of the functions for this kind, and
+ *   SORT_LESS(a,b) true if svalue *a sorts before svalue *b; it may use
+ *                  the comparison function `cmp' passed to every function,
+ *   SORT_MERGE     defined if the stable merge sort is needed too.
+ *
+ * Every loop checks its bounds instead of relying on sentinels, so that a
+ * comparison function which isn't a consistent ordering (LPC callbacks,
+ * NaN) gives a useless order but never reads outside the array.
+ */
+
+/* Insertion sort [begin, end). */
+static void
+SORT_NAME (insertion_sort) (svalue_t * begin, svalue_t * end, svalue_cmp_t cmp)
+{
+  svalue_t *cur, *sift, tmp;
+
+  for (cur = begin + 1; cur < end; cur++)
+    {
+      if (!SORT_LESS (cur, cur - 1))
+        continue;
+      tmp = *cur;
+      sift = cur;
+      do
+        {
+          *sift = sift[-1];
+          sift--;
+        }
+      while (sift > begin && SORT_LESS (&tmp, sift - 1));
+      *sift = tmp;
+    }
+}
+
+/*
+ * Insertion sort that gives up after moving PARTIAL_INSERTION_LIMIT
+ * elements.  Returns 1 if [begin, end) got sorted.
+ */
+static int
+SORT_NAME (partial_insertion_sort) (svalue_t * begin, svalue_t * end, svalue_cmp_t cmp)
+{
+  svalue_t *cur, *sift, tmp;
+  size_t moves = 0;
+
+  for (cur = begin + 1; cur < end; cur++)
+    {
+      if (!SORT_LESS (cur, cur - 1))
+        continue;
+      tmp = *cur;
+      sift = cur;
+      do
+        {
+          *sift = sift[-1];
+          sift--;
+        }
+      while (sift > begin && SORT_LESS (&tmp, sift - 1));
+      *sift = tmp;
+      moves += cur - sift;
+      if (moves > PARTIAL_INSERTION_LIMIT)
+        return 0;
+    }
+  return 1;
+}
+
+/* Put the median of *a, *b and *c in *b. */
+static void
+SORT_NAME (sort3) (svalue_t * a, svalue_t * b, svalue_t * c, svalue_cmp_t cmp)
+{
+  if (SORT_LESS (b, a))
+    SWAP_SVALUES (a, b);
+  if (SORT_LESS (c, b))
+    {
+      SWAP_SVALUES (b, c);
+      if (SORT_LESS (b, a))
+        SWAP_SVALUES (a, b);
+    }
+}
+
+/*
+ * Partition [begin, end) around the pivot at *begin: elements less than the
+ * pivot go left of it, the others right.  Returns the final position of the
+ * pivot and whether no element had to be moved.
+ */
+static svalue_t *
+SORT_NAME (partition_right) (svalue_t * begin, svalue_t * end, int *already_partitioned, svalue_cmp_t cmp)
+{
+  svalue_t pivot = *begin;
+  svalue_t *i = begin + 1, *j = end - 1;
+
+  while (i <= j && SORT_LESS (i, &pivot))
+    i++;
+  while (i <= j && !SORT_LESS (j, &pivot))
+    j--;
+  *already_partitioned = i > j;
+  while (i < j)
+    {
+      SWAP_SVALUES (i, j);
+      i++;
+      j--;
+      while (i <= j && SORT_LESS (i, &pivot))
+        i++;
+      while (i <= j && !SORT_LESS (j, &pivot))
+        j--;
+    }
+  *begin = *j;
+  *j = pivot;
+  return j;
+}
+
+/*
+ * Like partition_right(), but elements equal to the pivot go left.  Used
+ * when the pivot equals the element before the range, so that all of the
+ * left part equals the pivot and needs no more sorting.
+ */
+static svalue_t *
+SORT_NAME (partition_left) (svalue_t * begin, svalue_t * end, svalue_cmp_t cmp)
+{
+  svalue_t pivot = *begin;
+  svalue_t *i = begin + 1, *j = end - 1;
+
+  while (i <= j && !SORT_LESS (&pivot, i))
+    i++;
+  while (i <= j && SORT_LESS (&pivot, j))
+    j--;
+  while (i < j)
+    {
+      SWAP_SVALUES (i, j);
+      i++;
+      j--;
+      while (i <= j && !SORT_LESS (&pivot, i))
+        i++;
+      while (i <= j && SORT_LESS (&pivot, j))
+        j--;
+    }
+  *begin = *j;
+  *j = pivot;
+  return j;
+}
+
+static void
+SORT_NAME (sift_down) (svalue_t * heap, size_t root, size_t size, svalue_cmp_t cmp)
+{
+  size_t child;
+
+  while ((child = 2 * root + 1) < size)
+    {
+      if (child + 1 < size && SORT_LESS (&heap[child], &heap[child + 1]))
+        child++;
+      if (!SORT_LESS (&heap[root], &heap[child]))
+        return;
+      SWAP_SVALUES (&heap[root], &heap[child]);
+      root = child;
+    }
+}
+
+/* Heap sort [begin, end), for when quicksort keeps choosing bad pivots. */
+static void
+SORT_NAME (heap_sort) (svalue_t * begin, svalue_t * end, svalue_cmp_t cmp)
+{
+  size_t size = end - begin, i;
+
+  for (i = size / 2; i-- > 0;)
+    SORT_NAME (sift_down) (begin, i, size, cmp);
+  while (--size > 0)
+    {
+      SWAP_SVALUES (begin, begin + size);
+      SORT_NAME (sift_down) (begin, 0, size, cmp);
+    }
+}
+
+/*
+ * Pattern-defeating quicksort (Orson Peters): introsort that recognizes
+ * already sorted runs and many equal elements.  The smaller part is sorted
+ * recursively and the larger one by looping, so the recursion depth is at
+ * most log2(n).
+ */
+static void
+SORT_NAME (quick_sort) (svalue_t * begin, svalue_t * end, int bad_allowed, int leftmost, svalue_cmp_t cmp)
+{
+  for (;;)
+    {
+      size_t size = end - begin, half = size / 2, l_size, r_size;
+      svalue_t *pivot;
+      int already_partitioned;
+
+      if (size < INSERTION_SORT_THRESHOLD)
+        {
+          SORT_NAME (insertion_sort) (begin, end, cmp);
+          return;
+        }
+
+      /* move the median of 3 (or the pseudo-median of 9) to *begin */
+      if (size > NINTHER_THRESHOLD)
+        {
+          SORT_NAME (sort3) (begin, begin + half, end - 1, cmp);
+          SORT_NAME (sort3) (begin + 1, begin + (half - 1), end - 2, cmp);
+          SORT_NAME (sort3) (begin + 2, begin + (half + 1), end - 3, cmp);
+          SORT_NAME (sort3) (begin + (half - 1), begin + half, begin + (half + 1), cmp);
+          SWAP_SVALUES (begin, begin + half);
+        }
+      else
+        SORT_NAME (sort3) (begin + half, begin, end - 1, cmp);
+
+      /*
+       * The element before the range is no greater than anything in it; if
+       * it equals the pivot, so does everything partition_left() puts left.
+       */
+      if (!leftmost && !SORT_LESS (begin - 1, begin))
+        {
+          begin = SORT_NAME (partition_left) (begin, end, cmp) + 1;
+          continue;
+        }
+
+      pivot = SORT_NAME (partition_right) (begin, end, &already_partitioned, cmp);
+      l_size = pivot - begin;
+      r_size = end - (pivot + 1);
+
+      if (l_size < size / 8 || r_size < size / 8)
+        {
+          /* too many bad pivots, fall back to heap sort */
+          if (--bad_allowed == 0)
+            {
+              SORT_NAME (heap_sort) (begin, end, cmp);
+              return;
+            }
+          /* shuffle some elements around to break patterns */
+          if (l_size >= INSERTION_SORT_THRESHOLD)
+            {
+              SWAP_SVALUES (begin, begin + l_size / 4);
+              SWAP_SVALUES (pivot - 1, pivot - l_size / 4);
+            }
+          if (r_size >= INSERTION_SORT_THRESHOLD)
+            {
+              SWAP_SVALUES (pivot + 1, pivot + (1 + r_size / 4));
+              SWAP_SVALUES (end - 1, end - r_size / 4);
+            }
+        }
+      else if (already_partitioned &&
+               SORT_NAME (partial_insertion_sort) (begin, pivot, cmp) &&
+               SORT_NAME (partial_insertion_sort) (pivot + 1, end, cmp))
+        return;			/* probably sorted already */
+
+      if (l_size < r_size)
+        {
+          SORT_NAME (quick_sort) (begin, pivot, bad_allowed, leftmost, cmp);
+          begin = pivot + 1;
+          leftmost = 0;
+        }
+      else
+        {
+          SORT_NAME (quick_sort) (pivot + 1, end, bad_allowed, 0, cmp);
+          end = pivot;
+        }
+    }
+}
+
+#ifdef SORT_MERGE
+/*
+ * Stable merge sort of [begin, end) using tmp, which has room for as many
+ * elements.  Runs are insertion sorted first, and two runs already in order
+ * are not merged.
+ */
+static void
+SORT_NAME (merge_sort) (svalue_t * begin, svalue_t * end, svalue_t * tmp, svalue_cmp_t cmp)
+{
+  size_t size = end - begin, width, lo;
+
+  for (lo = 0; lo < size; lo += MERGE_RUN_LENGTH)
+    SORT_NAME (insertion_sort) (begin + lo, begin + (lo + MERGE_RUN_LENGTH < size ? lo + MERGE_RUN_LENGTH : size), cmp);
+
+  for (width = MERGE_RUN_LENGTH; width < size; width *= 2)
+    {
+      for (lo = 0; lo + width < size; lo += 2 * width)
+        {
+          svalue_t *left = begin + lo, *mid = left + width;
+          svalue_t *right_end = begin + (lo + 2 * width < size ? lo + 2 * width : size);
+          svalue_t *l, *l_end, *r, *out;
+
+          if (!SORT_LESS (mid, mid - 1))
+            continue;		/* already in order */
+
+          /* move the left run out of the way and merge back */
+          memcpy (tmp, left, width * sizeof (svalue_t));
+          l = tmp;
+          l_end = tmp + width;
+          r = mid;
+          out = left;
+          while (l < l_end && r < right_end)
+            {
+              if (SORT_LESS (r, l))
+                *out++ = *r++;
+              else
+                *out++ = *l++;
+            }
+          while (l < l_end)
+            *out++ = *l++;
+        }
+    }
+}
+#endif /* SORT_MERGE */
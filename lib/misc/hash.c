@@ -2,6 +2,9 @@
 #include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <string.h>
+#include "hash.h"
+
 /*
 ** A simple and fast generic string hasher based on Peter K. Pearson's
 ** article in CACM 33-6, pp. 677.
@@ -83,3 +86,47 @@ whashstr (const char *s, int maxn)
 
   return (oh << 8) + h;
 }
+
+/*
+ * strhash64 hashes the full length of a string, eight bytes at a time.
+ * This is MurmurHash64A by Austin Appleby (public domain).  The final
+ * avalanche makes the low bits usable as a power-of-2 table index.
+ */
+
+uint64_t
+strhash64 (const char *s, size_t len)
+{
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+  const unsigned char *p = (const unsigned char *) s;
+  const unsigned char *end = p + (len & ~(size_t) 7);
+  uint64_t h = 0x8445d61a4e774912ULL ^ (len * m);
+  uint64_t k;
+
+  for (; p != end; p += 8)
+    {
+      memcpy (&k, p, sizeof (k));	/* unaligned load */
+      k *= m;
+      k ^= k >> r;
+      k *= m;
+      h ^= k;
+      h *= m;
+    }
+
+  switch (len & 7)
+    {
+    case 7: h ^= (uint64_t) p[6] << 48; /* FALLTHROUGH */
+    case 6: h ^= (uint64_t) p[5] << 40; /* FALLTHROUGH */
+    case 5: h ^= (uint64_t) p[4] << 32; /* FALLTHROUGH */
+    case 4: h ^= (uint64_t) p[3] << 24; /* FALLTHROUGH */
+    case 3: h ^= (uint64_t) p[2] << 16; /* FALLTHROUGH */
+    case 2: h ^= (uint64_t) p[1] << 8; /* FALLTHROUGH */
+    case 1: h ^= (uint64_t) p[0];
+      h *= m;
+    }
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
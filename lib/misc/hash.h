@@ -1,4 +1,8 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 int hashstr(const char *, int, int);
 int whashstr(const char *, int);
+uint64_t strhash64(const char *, size_t);
@@ -9,6 +9,7 @@
 #include "lpc/object.h"
 #include "lpc/program.h"
 #include "lpc/include/origin.h"
+#include "outbuf.h"
 
 /*
  * Apply a fun 'fun' to the program in object 'ob', with
@@ -196,6 +197,114 @@ static int function_visible (int origin, int func_flags) {
   return 1;
 }
 
+/*
+ * Bookkeeping common to every apply: mark the object as used and give it a
+ * lazy reset.  Returns 0 (with the arguments popped) if the reset destructed it.
+ */
+static int prepare_apply (object_t * ob, int num_arg) {
+
+  ob->time_of_ref = current_time;	/* Used by the swapper */
+
+  /*
+   * This object will now be used, and is thus a target for reset later on
+   * (when time due).
+   */
+#ifdef LAZY_RESETS
+  try_reset (ob);
+  if (ob->flags & O_DESTRUCTED)
+    {
+      pop_n_elems (num_arg);
+      return 0;
+    }
+#else
+  (void) num_arg;		/* unused */
+#endif
+  ob->flags &= ~O_RESET_STATE;
+  return 1;
+}
+
+/*
+ * Search function 'fun' in the program of 'ob' and fill in the cache entry.
+ * If the function isn't defined, entry->progp is set to zero so that the
+ * entry tells us the function isn't there.  Visibility is checked by the
+ * caller, as it depends on the origin of the call.
+ */
+static void lookup_function (object_t * ob, const char *fun, cache_entry_t * entry) {
+  char *sfun = (char *) fun;
+  program_t *prog;
+  int index, fio, vio;
+
+  prog = find_function_by_name2 (ob, &sfun, &index, &fio, &vio);
+
+  entry->id = ob->prog->id_number;
+  entry->oprogp = ob->prog;
+  entry->name = sfun ? ref_string (sfun) : make_shared_string (fun);
+  entry->progp = prog;
+  if (prog)
+    {
+      runtime_defined_t *fundefp = &(FIND_FUNC_ENTRY (prog, prog->function_table[index].runtime_index)->def);
+
+      entry->index = index;
+      entry->function_index_offset = fio;
+      entry->variable_index_offset = vio;
+      entry->num_arg = fundefp->num_arg;
+      entry->num_local = fundefp->num_local;
+    }
+}
+
+/*
+ * Call the function described by a cache entry in 'ob'.  On failure the
+ * arguments are popped and 0 is returned.
+ */
+static int call_cache_entry (cache_entry_t * entry, object_t * ob, int num_arg, int origin, const char *fun) {
+
+  if (entry->progp)
+    {
+      compiler_function_t *funp = entry->progp->function_table + entry->index;
+      int funflags = entry->oprogp->function_flags[funp->runtime_index + entry->function_index_offset];
+
+      if (function_visible (origin, funflags))
+        {
+          /* push a frame onto control stack */
+          push_control_stack (FRAME_FUNCTION | FRAME_OB_CHANGE);
+          csp->num_local_variables = num_arg;
+          csp->fr.table_index = entry->index;
+
+          current_prog = entry->progp;
+          caller_type = origin;
+          function_index_offset = entry->function_index_offset;
+          variable_index_offset = entry->variable_index_offset;
+
+#ifdef PROFILE_FUNCTIONS
+          get_cpu_times (&(csp->entry_secs), &(csp->entry_usecs));
+          current_prog->function_table[entry->index].calls++;
+#endif
+
+          if (funflags & NAME_TRUE_VARARGS)
+            setup_varargs_variables (csp->num_local_variables, entry->num_local, entry->num_arg);
+          else
+            setup_variables (csp->num_local_variables, entry->num_local, entry->num_arg);
+
+          previous_ob = current_object;
+          current_object = ob;
+          opt_trace (TT_EVAL, "calling \"%s\": offset %+d", fun, funp->address);
+          call_program (current_prog, funp->address);
+
+          /*
+           * Arguments and local variables are now removed. One
+           * resulting value is always returned on the stack.
+           */
+          return 1;
+        }
+    }
+
+  /* Failure. Deallocate stack. */
+  pop_n_elems (num_arg);
+
+  opt_trace (TT_EVAL, "not defined or not visible to caller: \"%s\"", fun);
+  return 0;
+}
+
 /**
  *  @brief Low-level apply of a function to an object.
  *  @param fun The function name.
@@ -206,10 +315,9 @@ static int function_visible (int origin, int func_flags) {
  */
 int apply_low (const char *fun, object_t * ob, int num_arg) {
 
-  char *sfun;
   cache_entry_t *entry;
-  program_t *progp, *prog;
-  int ix, fio, vio;
+  program_t *progp;
+  int ix;
   static int cache_mask = APPLY_CACHE_SIZE - 1;
   int local_call_origin = call_origin;
 
@@ -217,21 +325,8 @@ int apply_low (const char *fun, object_t * ob, int num_arg) {
     local_call_origin = ORIGIN_DRIVER;
   call_origin = 0;
 
-  ob->time_of_ref = current_time;	/* Used by the swapper */
-
-  /*
-   * This object will now be used, and is thus a target for reset later on
-   * (when time due).
-   */
-#ifdef LAZY_RESETS
-  try_reset (ob);
-  if (ob->flags & O_DESTRUCTED)
-    {
-      pop_n_elems (num_arg);
-      return 0;
-    }
-#endif
-  ob->flags &= ~O_RESET_STATE;
+  if (!prepare_apply (ob, num_arg))
+    return 0;
 
   progp = ob->prog;
 #ifdef CACHE_STATS
@@ -251,59 +346,12 @@ int apply_low (const char *fun, object_t * ob, int num_arg) {
 #ifdef CACHE_STATS
       apply_low_cache_hits++;
 #endif
-      if (entry->progp)
-        {
-          compiler_function_t *funp = entry->progp->function_table + entry->index;
-          int funflags = entry->oprogp->function_flags[funp->runtime_index + entry->function_index_offset];
-
-          /* if progp is zero, the cache is telling us the function
-           * isn't here */
-          //if (!(funflags & (NAME_STATIC | NAME_PRIVATE))
-          //    || (local_call_origin & (ORIGIN_DRIVER | ORIGIN_CALL_OUT)))
-          if (function_visible(local_call_origin, funflags))
-            {
-              /* push a frame onto control stack */
-              push_control_stack (FRAME_FUNCTION | FRAME_OB_CHANGE);
-              csp->num_local_variables = num_arg;
-              csp->fr.table_index = entry->index;
-
-              current_prog = entry->progp;
-              caller_type = local_call_origin;
-              function_index_offset = entry->function_index_offset;
-              variable_index_offset = entry->variable_index_offset;
-
-#ifdef PROFILE_FUNCTIONS
-              get_cpu_times (&(csp->entry_secs), &(csp->entry_usecs));
-              current_prog->function_table[entry->index].calls++;
-#endif
-
-              if (funflags & NAME_TRUE_VARARGS)
-                setup_varargs_variables (csp->num_local_variables, entry->num_local, entry->num_arg);
-              else
-                setup_variables (csp->num_local_variables, entry->num_local, entry->num_arg);
-
-              previous_ob = current_object;
-              current_object = ob;
-              opt_trace (TT_EVAL, "(cached) calling \"%s\": offset %+d", fun, funp->address);
-              call_program (current_prog, funp->address);
-              return 1;
-            }
-        }
-       /* when we come here, the cache has told us that the function isn't defined in the object */
     }
   else
     {
-      /* entry is not found in APPLY_CACHE  */
-      int index;
-
+      /* entry is not found in APPLY_CACHE, we have to search the function */
       opt_trace (TT_EVAL, "APPLY_CACHE miss for \"%s\"", fun);
 
-      /* we have to search the function
-       * The old entry was for a nonexistent function and had to
-       * be allocated
-       *
-      if (!entry->progp && entry->id)
-       */
       if (entry->id && entry->name)
         free_string (entry->name);
 #ifdef CACHE_STATS
@@ -316,71 +364,262 @@ int apply_low (const char *fun, object_t * ob, int num_arg) {
           apply_low_collisions++;
         }
 #endif
-      sfun = (char *) fun;
-      prog = find_function_by_name2 (ob, &sfun, &index, &fio, &vio);
+      lookup_function (ob, fun, entry);
+    }
 
-      if (prog)
-        {
-          compiler_function_t *funp = &prog->function_table[index];
-          runtime_defined_t *fundefp = &(FIND_FUNC_ENTRY (prog, funp->runtime_index)->def);
-          int funflags = ob->prog->function_flags[funp->runtime_index + fio];
+  return call_cache_entry (entry, ob, num_arg, local_call_origin, fun);
+}
 
-          //if (!(funflags & (NAME_STATIC | NAME_PRIVATE))
-          //    || (local_call_origin & (ORIGIN_DRIVER | ORIGIN_CALL_OUT)))
-          if (function_visible(local_call_origin, funflags))
-            {
-              push_control_stack (FRAME_FUNCTION | FRAME_OB_CHANGE);
-              current_prog = prog;
-              caller_type = local_call_origin;
-
-              /* The searched function is found, add to APPLY_CACHE */
-              entry->oprogp = ob->prog;
-              entry->id = progp->id_number;
-              entry->name = ref_string (sfun);
-              entry->index = index;
-
-              csp->fr.table_index = index;
-              csp->num_local_variables = num_arg;
-              entry->variable_index_offset = variable_index_offset = vio;
-              entry->function_index_offset = function_index_offset = fio;
-              if (funflags & NAME_TRUE_VARARGS)
-                setup_varargs_variables (csp->num_local_variables, fundefp->num_local, fundefp->num_arg);
-              else
-                setup_variables (csp->num_local_variables, fundefp->num_local, fundefp->num_arg);
-              entry->num_arg = fundefp->num_arg;
-              entry->num_local = fundefp->num_local;
-              entry->progp = current_prog;
-              previous_ob = current_object;
-              current_object = ob;
-              opt_trace (TT_EVAL, "calling \"%s\": offset %+d", fun, funp->address);
-              call_program (current_prog, funp->address);
-
-              /*
-               * Arguments and local variables are now removed. One
-               * resulting value is always returned on the stack.
-               */
-              return 1;
-            }
-        }
-      /* We have to mark a function not to be in the object */
-      entry->id = progp->id_number;
-      entry->oprogp = progp;
-      if (sfun)
-        {
-          ref_string (sfun);
-          entry->name = sfun;
-        }
-      else
-        entry->name = make_shared_string (fun);
-      entry->progp = (program_t *) 0;
+/*
+ * Inline caches for call_other().
+ *
+ * Every call_other() site in a compiled program gets a small cache of the
+ * last CALL_SITE_CACHE_ENTRIES (program -> function) lookups made from it,
+ * so that hot sites do not evict each other in the global APPLY_CACHE.
+ * Sites are found by the offset of the call in the program; they live in a
+ * hash table hanging off the program and go away with it.
+ *
+ * Entries are validated against the id_number of the target program, which
+ * is never reused, the same as in the APPLY_CACHE.  An entry for a program
+ * that was freed or replaced can't match anymore and is just replaced on a
+ * later miss, so freeing a program leaves the other entries alone.
+ */
+struct call_site_s {
+  int offset;			/* offset of the call in its program, -1 if the slot is free */
+  unsigned int hits;
+  unsigned int misses;
+  int victim;			/* entry to replace on the next miss */
+  cache_entry_t entries[CALL_SITE_CACHE_ENTRIES];
+};
+
+typedef struct call_site_table_s {
+  program_t *prog;
+  int size;			/* number of slots, a power of 2 */
+  int used;
+  call_site_t *sites;
+  struct call_site_table_s *next;	/* all tables, for cache_stats() */
+  struct call_site_table_s **pprev;
+} call_site_table_t;
+
+static call_site_table_t *call_site_tables = NULL;
+
+#ifdef CACHE_STATS
+unsigned int call_site_hits = 0;
+unsigned int call_site_misses = 0;
+#endif
+
+static void clear_call_site (call_site_t * site) {
+  int i;
+
+  for (i = 0; i < CALL_SITE_CACHE_ENTRIES; i++)
+    {
+      if (site->entries[i].name)
+        free_string (site->entries[i].name);
+      site->entries[i].id = 0;
+      site->entries[i].oprogp = NULL;
+      site->entries[i].progp = NULL;
+      site->entries[i].name = NULL;
     }
+  site->victim = 0;
+}
 
-  /* Failure. Deallocate stack. */
-  pop_n_elems (num_arg);
+static call_site_t *allocate_call_sites (int size) {
+  call_site_t *sites = CALLOCATE (size, call_site_t, TAG_CACHE, "allocate_call_sites");
+  int i;
 
-  opt_trace (TT_EVAL, "not defined or not visible to caller: \"%s\"", fun);
-  return 0;
+  memset (sites, 0, sizeof (call_site_t) * size);
+  for (i = 0; i < size; i++)
+    sites[i].offset = -1;
+  return sites;
+}
+
+static call_site_t *probe_call_site (call_site_table_t * table, int offset) {
+  int i = (int)(((unsigned int) offset * 2654435761u) >> 8) & (table->size - 1);
+
+  while (table->sites[i].offset != offset && table->sites[i].offset != -1)
+    i = (i + 1) & (table->size - 1);
+  return &table->sites[i];
+}
+
+/**
+ * @brief Find (or create) the inline cache of a call_other() site.
+ * @param prog The program containing the call.
+ * @param pc Address of the call in the program code.
+ * @return The call site.
+ */
+call_site_t *find_call_site (program_t * prog, const char *pc) {
+  call_site_table_t *table = prog->call_sites;
+  call_site_t *site;
+  int offset = (int)(pc - prog->program);
+
+  if (!table)
+    {
+      table = ALLOCATE (call_site_table_t, TAG_CACHE, "find_call_site");
+      table->prog = prog;
+      table->size = 8;
+      table->used = 0;
+      table->sites = allocate_call_sites (table->size);
+      if ((table->next = call_site_tables))
+        call_site_tables->pprev = &table->next;
+      table->pprev = &call_site_tables;
+      call_site_tables = table;
+      prog->call_sites = table;
+    }
+
+  site = probe_call_site (table, offset);
+  if (site->offset == offset)
+    return site;
+
+  if (2 * (table->used + 1) > table->size)
+    {
+      /* keep the load factor below 1/2 */
+      call_site_t *old = table->sites;
+      int i, old_size = table->size;
+
+      table->size *= 2;
+      table->sites = allocate_call_sites (table->size);
+      for (i = 0; i < old_size; i++)
+        if (old[i].offset != -1)
+          *probe_call_site (table, old[i].offset) = old[i];
+      FREE (old);
+      site = probe_call_site (table, offset);
+    }
+
+  table->used++;
+  site->offset = offset;
+  site->hits = site->misses = 0;
+  clear_call_site (site);
+  return site;
+}
+
+/**
+ * @brief Release the call_other() inline caches of a program that is being freed.
+ */
+void free_call_sites (program_t * prog) {
+  call_site_table_t *table = prog->call_sites;
+  int i;
+
+  if (!table)
+    return;
+  for (i = 0; i < table->size; i++)
+    if (table->sites[i].offset != -1)
+      clear_call_site (&table->sites[i]);
+  if ((*table->pprev = table->next))
+    table->next->pprev = table->pprev;
+  FREE (table->sites);
+  FREE (table);
+  prog->call_sites = NULL;
+}
+
+/**
+ * @brief Apply a function to an object from a call_other() site.
+ *
+ * Same as apply_low() with ORIGIN_CALL_OTHER, but the function is looked
+ * up in the inline cache of the call site before searching the program.
+ */
+int apply_call_site (call_site_t * site, const char *fun, object_t * ob, int num_arg) {
+  cache_entry_t *entry;
+  program_t *progp;
+  int i;
+
+  if (!prepare_apply (ob, num_arg))
+    return 0;
+
+  progp = ob->prog;
+  for (i = 0, entry = site->entries; i < CALL_SITE_CACHE_ENTRIES; i++, entry++)
+    {
+      if (entry->oprogp == progp && entry->id == progp->id_number &&
+          (entry->name == fun || strcmp (entry->name, fun) == 0))
+        break;
+    }
+
+  if (i < CALL_SITE_CACHE_ENTRIES)
+    {
+      site->hits++;
+#ifdef CACHE_STATS
+      call_site_hits++;
+#endif
+    }
+  else
+    {
+      site->misses++;
+#ifdef CACHE_STATS
+      call_site_misses++;
+#endif
+      entry = &site->entries[site->victim];
+      site->victim = (site->victim + 1) % CALL_SITE_CACHE_ENTRIES;
+      if (entry->name)
+        free_string (entry->name);
+      lookup_function (ob, fun, entry);
+    }
+
+  return call_cache_entry (entry, ob, num_arg, ORIGIN_CALL_OTHER, fun);
+}
+
+#ifdef CACHE_STATS
+static int compare_call_site_traffic (const void *a, const void *b) {
+  const call_site_t *x = ((const call_site_t *const *) a)[0];
+  const call_site_t *y = ((const call_site_t *const *) b)[0];
+  unsigned int tx = x->hits + x->misses, ty = y->hits + y->misses;
+
+  return (tx < ty) - (tx > ty);
+}
+
+/**
+ * @brief Print call_other() inline cache statistics, with the busiest sites.
+ * @param ob The output buffer.
+ * @param max_sites How many of the busiest sites to list.
+ */
+void print_call_site_stats (outbuffer_t * ob, int max_sites) {
+  call_site_table_t *table;
+  call_site_t **busiest;
+  program_t **owner;
+  int i, j, num_sites = 0, n = 0;
+
+  for (table = call_site_tables; table; table = table->next)
+    num_sites += table->used;
+
+  outbuf_add (ob, "call_other() call site caches\n");
+  outbuf_add (ob, "-------------------------------\n");
+  outbuf_addv (ob, "call sites:      %10d\n", num_sites);
+  outbuf_addv (ob, "entries per site:%10d\n", CALL_SITE_CACHE_ENTRIES);
+  outbuf_addv (ob, "hits:            %10u\n", call_site_hits);
+  outbuf_addv (ob, "misses:          %10u\n", call_site_misses);
+  outbuf_addv (ob, "%% hits:          %10.2f\n",
+               100 * ((double) call_site_hits / (call_site_hits + call_site_misses)));
+  if (!num_sites || max_sites <= 0)
+    return;
+
+  /* keep the max_sites busiest sites, by insertion */
+  busiest = CALLOCATE (max_sites, call_site_t *, TAG_TEMPORARY, "print_call_site_stats");
+  owner = CALLOCATE (max_sites, program_t *, TAG_TEMPORARY, "print_call_site_stats");
+  for (table = call_site_tables; table; table = table->next)
+    for (i = 0; i < table->size; i++)
+      {
+        call_site_t *site = &table->sites[i];
+
+        if (site->offset == -1)
+          continue;
+        if (n == max_sites && compare_call_site_traffic (&site, &busiest[n - 1]) >= 0)
+          continue;
+        j = (n < max_sites) ? n++ : n - 1;
+        for (; j > 0 && compare_call_site_traffic (&site, &busiest[j - 1]) < 0; j--)
+          {
+            busiest[j] = busiest[j - 1];
+            owner[j] = owner[j - 1];
+          }
+        busiest[j] = site;
+        owner[j] = table->prog;
+      }
+
+  outbuf_add (ob, "busiest sites:          hits     misses\n");
+  for (i = 0; i < n; i++)
+    outbuf_addv (ob, "  %10u %10u  %s\n", busiest[i]->hits, busiest[i]->misses,
+                 get_line_number (owner[i]->program + busiest[i]->offset, owner[i]));
+  FREE (busiest);
+  FREE (owner);
 }
+#endif /* CACHE_STATS */
 
 /**
  * @brief Clear the apply() cache.
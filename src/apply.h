@@ -1,6 +1,7 @@
 #pragma once
 
 #include "lpc/types.h"
+#include "outbuf.h"
 
 #define APPLY_CACHE_SIZE (1 << APPLY_CACHE_BITS)
 
@@ -27,6 +28,16 @@ svalue_t *safe_apply_master_ob(const char *, int);
 
 void clear_apply_cache(void);
 
+typedef struct call_site_s call_site_t;
+call_site_t *find_call_site(program_t *, const char *);
+int apply_call_site(call_site_t *, const char *, object_t *, int);
+void free_call_sites(program_t *);
+#ifdef CACHE_STATS
+extern unsigned int call_site_hits;
+extern unsigned int call_site_misses;
+void print_call_site_stats(outbuffer_t *, int);
+#endif
+
 program_t *find_function (program_t * prog, const char *name, int *index, int *fio, int *vio);
 
 char *function_exists(const char *, object_t *, int);
@@ -7,6 +7,7 @@
 #include "std.h"
 #include "lpc/types.h"
 #include "lpc/array.h"
+#include "lpc/mapping.h"
 #include "lpc/object.h"
 #include "lpc/program.h"
 #include "lpc/include/origin.h"
@@ -277,6 +278,7 @@ void backend () {
 
       /* Performs housekeeping tasks and garbage collection */
       remove_destructed_objects ();
+      compact_mappings ();
 
       if (slow_shutdown_to_do)
         {
@@ -298,7 +300,8 @@ void backend () {
               all_users[i]->iflags |= HAS_CMD_TURN;
               connected_users++;
 
-              if (!has_pending_commands && (all_users[i]->iflags & CMD_IN_BUF))
+              /* input received but not yet in the buffer counts, too (see process_io()) */
+              if (!has_pending_commands && ((all_users[i]->iflags & CMD_IN_BUF) || all_users[i]->input_pending_len))
                 {
                   has_pending_commands = 1;
                 }
@@ -316,7 +319,18 @@ void backend () {
           /* When heart beat is not active and no pending commands, wait up to 60 seconds */
           timeout.tv_sec = 60;
           timeout.tv_usec = 0;
+          if (MAIN_OPTION(timer_flags) & TIMER_FLAG_CALLOUT)
+            {
+              /* wake up in time for call_outs due between heart beats */
+              int64_t wait = call_out_wait_time ();
+              if (wait >= 0 && wait < 60 * 1000000)
+                {
+                  timeout.tv_sec = (long)(wait / 1000000);
+                  timeout.tv_usec = (long)(wait % 1000000);
+                }
+            }
         }
+      flush_pending_output (); /* write what this cycle produced */
       nb = do_comm_polling (&timeout); /* blocks until timeout or event */
       if (nb == -1)
         {
@@ -329,7 +343,7 @@ void backend () {
        * This includes new user connections, TELNET negotiation, and user input (buffering).
        * flush_message() is called for each user to ensure outgoing messages are sent.
        */
-      if (nb > 0)
+      if (nb > 0 || has_pending_commands)
         process_io ();
 
       /*
@@ -350,6 +364,8 @@ void backend () {
        */
       if (heart_beat_flag)
         call_heart_beat ();
+      else if (MAIN_OPTION(timer_flags) & TIMER_FLAG_CALLOUT)
+        call_out (); /* sub-second call_outs do not wait for the heart beat */
     }
   pop_context (&econ);
 
@@ -457,34 +473,83 @@ static void look_for_objects_to_swap () {
 
 /* Call all heart_beat() functions in all objects.  Also call the next reset,
  * and the call out.
- * We do heart beats by moving each object done to the end of the heart beat
- * list before we call its function, and always using the item at the head
- * of the list as our function to call.  We keep calling heart beats until
- * a timeout or we have done num_heart_objs calls.  It is done this way so
- * that objects can delete heart beating objects from the list from within
- * their heart beat without truncating the current round of heart beats.
+ *
+ * Heart beating objects are kept in the dense heart_beats[] array, and each
+ * object remembers its slot in ob->heart_beat_index so that enabling,
+ * disabling and querying the heart beat are O(1).  Disabling a heart beat
+ * moves the last slot into the freed one.
+ *
+ * Every slot is also linked (by array index) into one of HB_BUCKETS lists
+ * keyed by the tick of its next heart beat.  On each tick, the bucket of the
+ * tick is appended to the due list and only due objects are visited.  If the
+ * time slice runs out (heart_beat_flag raised again), the rest of the due
+ * list is kept and served first on the next tick.  Objects are relinked
+ * before their heart_beat() is called, so they can delete heart beating
+ * objects (including themselves) from within their heart beat.
  *
  * Set command_giver to current_object if it is a living object. If the object
  * is shadowed, check the shadowed object if living. There is no need to save
  * the value of the command_giver, as the caller resets it to 0 anyway.  */
 
+#define HB_BUCKETS      64      /* power of 2 */
+#define HB_DUE_LIST     HB_BUCKETS
+
 typedef struct
 {
   object_t *ob;
-  short heart_beat_ticks; /* ticks until next heart beat */
-  short time_to_heart_beat; /* configured heart beat interval (tick counts) */
+  int time_to_heart_beat; /* configured heart beat interval (tick counts) */
+  unsigned int next_tick; /* tick of the next heart beat */
+  int list;               /* bucket index or HB_DUE_LIST */
+  int next, prev;         /* neighbors in the list, -1 if none */
 }
 heart_beat_t;
 
 static heart_beat_t *heart_beats = 0;
 static int max_heart_beats = 0;
-static int heart_beat_index = 0;
 static int num_hb_objs = 0;
-static int num_hb_to_do = 0;
+static unsigned int hb_tick = 0;        /* the current heart beat tick */
+static int hb_head[HB_BUCKETS + 1];
+static int hb_tail[HB_BUCKETS + 1];
+static int hb_list_length[HB_BUCKETS + 1];
 
 static int num_hb_calls = 0;	/* starts */
 static float perc_hb_probes = 100.0;	/* decaying avge of how many complete */
 
+static void hb_link (int index, int list) {
+  heart_beat_t *hb = &heart_beats[index];
+
+  if (!hb_list_length[list]++)
+    hb_head[list] = index;
+  else
+    heart_beats[hb_tail[list]].next = index;
+  hb->prev = hb_list_length[list] > 1 ? hb_tail[list] : -1;
+  hb->next = -1;
+  hb->list = list;
+  hb_tail[list] = index;
+}
+
+static void hb_unlink (int index) {
+  heart_beat_t *hb = &heart_beats[index];
+
+  if (hb->prev >= 0)
+    heart_beats[hb->prev].next = hb->next;
+  else
+    hb_head[hb->list] = hb->next;
+  if (hb->next >= 0)
+    heart_beats[hb->next].prev = hb->prev;
+  else
+    hb_tail[hb->list] = hb->prev;
+  hb_list_length[hb->list]--;
+}
+
+/* schedule the next heart beat, counted from the current tick */
+static void hb_schedule (int index, int ticks) {
+  heart_beat_t *hb = &heart_beats[index];
+
+  hb->next_tick = hb_tick + (unsigned int)ticks;
+  hb_link (index, (int)(hb->next_tick & (HB_BUCKETS - 1)));
+}
+
 /**
  * @brief Call all heart_beat() functions in all objects.
  * Also process invocation of LPC reset() and LPC call_out().
@@ -496,43 +561,52 @@ static void call_heart_beat () {
   time (&current_time);
   opt_trace (TT_BACKEND|1, "tick: current_time=%u", current_time);
   current_interactive = 0;
-  num_hb_to_do = num_hb_objs;
 
-  if ((MAIN_OPTION(timer_flags) & TIMER_FLAG_HEARTBEAT) && (num_hb_to_do > 0))
+  if ((MAIN_OPTION(timer_flags) & TIMER_FLAG_HEARTBEAT) && (num_hb_objs > 0))
     {
-      heart_beat_t *curr_hb;
-      num_hb_calls++;
-      heart_beat_index = 0;
-      while (!heart_beat_flag)
+      int bucket, index, num_hb_to_do, num_hb_done = 0;
+
+      /* queue up the heart beats of this tick after those left over from the last one */
+      bucket = (int)(++hb_tick & (HB_BUCKETS - 1));
+      index = hb_head[bucket];
+      while (index >= 0)
         {
-          ob = (curr_hb = &heart_beats[heart_beat_index])->ob;
-          /* is it time to do a heart beat ? */
-          curr_hb->heart_beat_ticks--;
+          int next = heart_beats[index].next;
+          if (heart_beats[index].next_tick == hb_tick)
+            {
+              hb_unlink (index);
+              hb_link (index, HB_DUE_LIST);
+            }
+          index = next; /* not due in this turn of the buckets */
+        }
+
+      num_hb_to_do = hb_list_length[HB_DUE_LIST];
+      if (num_hb_to_do > 0)
+        num_hb_calls++;
+      while (!heart_beat_flag && (index = hb_head[HB_DUE_LIST]) >= 0)
+        {
+          ob = heart_beats[index].ob;
+          hb_unlink (index);
+          hb_schedule (index, heart_beats[index].time_to_heart_beat);
+          num_hb_done++;
 
           if (ob->prog->heart_beat != -1)
             {
-              if (curr_hb->heart_beat_ticks < 1)
-                {
-                  curr_hb->heart_beat_ticks = curr_hb->time_to_heart_beat;
-                  current_heart_beat = ob;
-                  command_giver = ob;
-                  if (!(command_giver->flags & O_ENABLE_COMMANDS))
-                    command_giver = 0;
-                  eval_cost = CONFIG_INT (__MAX_EVAL_COST__);
-                  opt_trace (TT_BACKEND|3, "calling heart beat #%d/%d: %s", heart_beat_index + 1, num_hb_to_do, ob->name);
-                  call_function (ob->prog, ob->prog->heart_beat, 0, 0);
-                  command_giver = 0;
-                  current_object = 0;
-                }
+              current_heart_beat = ob;
+              command_giver = ob;
+              if (!(command_giver->flags & O_ENABLE_COMMANDS))
+                command_giver = 0;
+              eval_cost = CONFIG_INT (__MAX_EVAL_COST__);
+              opt_trace (TT_BACKEND|3, "calling heart beat #%d/%d: %s", num_hb_done, num_hb_to_do, ob->name);
+              call_function (ob->prog, ob->prog->heart_beat, 0, 0);
+              command_giver = 0;
+              current_object = 0;
             }
-          if (++heart_beat_index == num_hb_to_do)
-            break;
         }
-      if (heart_beat_index < num_hb_to_do)
-        perc_hb_probes = 100 * (float) heart_beat_index / num_hb_to_do;
+      if (num_hb_done < num_hb_to_do)
+        perc_hb_probes = 100 * (float) num_hb_done / num_hb_to_do;
       else
         perc_hb_probes = 100.0;
-      heart_beat_index = num_hb_to_do = 0;
     }
   current_prog = 0;
   current_heart_beat = 0;
@@ -545,24 +619,16 @@ static void call_heart_beat () {
 }
 
 int query_heart_beat (object_t * ob) {
-  int index;
 
   if (!(ob->flags & O_HEART_BEAT))
     return 0;
-  index = num_hb_objs;
-  while (index--)
-    {
-      if (heart_beats[index].ob == ob)
-        return heart_beats[index].time_to_heart_beat;
-    }
-  return 0;
+  return heart_beats[ob->heart_beat_index].time_to_heart_beat;
 }				/* query_heart_beat() */
 
 /**
- * Add or remove an object from the heart beat list; does the major check...
- * If an object removes something from the list from within a heart beat,
- * various pointers in call_heart_beat could be stuffed, so we must
- * check current_heart_beat and adjust pointers.
+ * Add or remove an object from the heart beat list.
+ * Objects can be removed from within a heart beat, call_heart_beat() does
+ * not keep any pointer into the list while calling heart_beat().
  * @param ob The object to modify.
  * @param to If zero, disable heart beat. If positive, enable/set heart beat
  * @return 1 if successful, 0 on failure (e.g., trying to disable non-enabled heart beat).
@@ -576,29 +642,32 @@ int set_heart_beat (object_t * ob, int to) {
   if (!to)
     {
       /* remove from heart beat list */
-      int num;
+      int last;
 
-      index = num_hb_objs;
-      while (index--)
-        {
-          if (heart_beats[index].ob == ob)
-            break;
-        }
-      if (index < 0)
+      if (!(ob->flags & O_HEART_BEAT))
         return 0;
+      index = ob->heart_beat_index;
+      DEBUG_CHECK (heart_beats[index].ob != ob, "Heart beat slot of object is corrupted!\n");
+      hb_unlink (index);
 
-      if (num_hb_to_do)
+      /* fill the hole with the last slot */
+      last = --num_hb_objs;
+      if (index != last)
         {
-          if (index <= heart_beat_index)
-            heart_beat_index--;
-          if (index < num_hb_to_do)
-            num_hb_to_do--;
+          int list = heart_beats[last].list;
+          heart_beat_t *hb = &heart_beats[index];
+
+          *hb = heart_beats[last];
+          hb->ob->heart_beat_index = index;
+          if (hb->prev >= 0)
+            heart_beats[hb->prev].next = index;
+          else
+            hb_head[list] = index;
+          if (hb->next >= 0)
+            heart_beats[hb->next].prev = index;
+          else
+            hb_tail[list] = index;
         }
-
-      if ((num = (num_hb_objs - (index + 1))))
-        memmove (heart_beats + index, heart_beats + (index + 1), num * sizeof (heart_beat_t));
-
-      num_hb_objs--;
       ob->flags &= ~O_HEART_BEAT;
       return 1;
     }
@@ -608,39 +677,35 @@ int set_heart_beat (object_t * ob, int to) {
       if (to < 0)
         return 0;
 
-      index = num_hb_objs;
-      while (index--)
-        {
-          if (heart_beats[index].ob == ob)
-            {
-              heart_beats[index].time_to_heart_beat =
-                heart_beats[index].heart_beat_ticks = (short)to;
-              break;
-            }
-        }
-      DEBUG_CHECK (index < 0, "Couldn't find enabled object in heart_beat list!\n");
+      index = ob->heart_beat_index;
+      heart_beats[index].time_to_heart_beat = to;
+      hb_unlink (index);
+      hb_schedule (index, to);
     }
   else
     {
-      heart_beat_t *hb;
-
       if (!max_heart_beats)
-        heart_beats = CALLOCATE (max_heart_beats = HEART_BEAT_CHUNK,
-                                 heart_beat_t, TAG_HEART_BEAT,
-                                 "set_heart_beat: 1");
+        {
+          heart_beats = CALLOCATE (max_heart_beats = HEART_BEAT_CHUNK,
+                                   heart_beat_t, TAG_HEART_BEAT,
+                                   "set_heart_beat: 1");
+          memset (hb_list_length, 0, sizeof (hb_list_length));
+        }
       else if (num_hb_objs == max_heart_beats)
         {
-          max_heart_beats += HEART_BEAT_CHUNK;
+          max_heart_beats *= 2;
           heart_beats = RESIZE (heart_beats, max_heart_beats,
                                 heart_beat_t, TAG_HEART_BEAT,
                                 "set_heart_beat: 1");
         }
 
-      hb = &heart_beats[num_hb_objs++];
-      hb->ob = ob;
+      index = num_hb_objs++;
+      heart_beats[index].ob = ob;
       if (to < 0)
         to = 1;
-      hb->time_to_heart_beat = hb->heart_beat_ticks = (short)to;
+      heart_beats[index].time_to_heart_beat = to;
+      hb_schedule (index, to);
+      ob->heart_beat_index = index;
       ob->flags |= O_HEART_BEAT;
     }
 
@@ -664,6 +729,8 @@ heart_beat_status (outbuffer_t * ob, int verbose)
       sprintf (buf, "%.2f", perc_hb_probes);
       outbuf_addv (ob, "Percentage of HB calls completed last time: %s\n",
                    buf);
+      outbuf_addv (ob, "Heart beats left over from last time: %d\n",
+                   hb_list_length[HB_DUE_LIST]);
     }
   return (0);
 }				/* heart_beat_status() */
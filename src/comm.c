@@ -13,6 +13,7 @@
 #include "interpret.h"
 #include "socket/socket_efuns.h"
 #include "efuns/ed.h"
+#include "efuns/async_file.h"
 
 #include "lpc/include/origin.h"
 
@@ -27,6 +28,17 @@
 #include <termios.h>
 #endif
 
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#else
+struct iovec {                  /* only used to gather output for send() */
+  void *iov_base;
+  size_t iov_len;
+};
+#endif
+
+#define FLUSH_IOV_MAX   16      /* most segments handed to a single writev() */
+
 #ifdef WINSOCK
 #pragma comment(lib, "ws2_32.lib")
 #endif
@@ -63,6 +75,7 @@ static void sigpipe_handler (int);
 #endif
 static void hname_handler (void);
 static void get_user_data (interactive_t *, io_event_t *);
+static void free_pending_input (interactive_t *);
 static void query_addr_name (object_t *);
 static void got_addr_number (char *, char *);
 static void add_ip_entry (unsigned long, const char *);
@@ -82,6 +95,10 @@ int num_hidden;			/* for the O_HIDDEN flag.  This counter must
 int add_message_calls = 0;
 int inet_packets = 0;
 int inet_volume = 0;
+int comm_write_calls = 0;	/* writes to user sockets */
+int comm_interest_calls = 0;	/* changes of write interest */
+int comm_cycles = 0;		/* calls to flush_pending_output() */
+int comm_message_blocks = 0;	/* shared message blocks created */
 interactive_t **all_users = 0;
 int max_users = 0;
 
@@ -92,6 +109,8 @@ static int g_num_io_events = 0;
 
 static socket_fd_t addr_server_fd = INVALID_SOCKET_FD;
 
+static interactive_t *dirty_users = NULL;	/* see flush_pending_output() */
+
 /* implementations */
 
 /* Context identification helpers for event dispatch */
@@ -224,6 +243,9 @@ void init_user_conn () {
         }
       opt_trace (TT_BACKEND|1, "registered listening socket for port %d with async runtime\n",
                  external_port[i].port);
+      /* let the runtime accept connections itself where it can (IOCP, io_uring) */
+      if (async_runtime_post_accept (g_runtime, external_port[i].fd) == 0)
+        opt_trace (TT_BACKEND|1, "async accept enabled for port %d\n", external_port[i].port);
     }
 
   /* Register console if enabled */
@@ -253,6 +275,10 @@ void init_user_conn () {
         }
     }
 
+  /* Start the workers of the async file efuns */
+  if (!async_file_init (g_runtime))
+    debug_message ("Warning: Failed to start async file workers\n");
+
 #ifndef _WIN32
   /* register signal handler for SIGPIPE. */
   if (signal (SIGPIPE, sigpipe_handler) == SIG_ERR)
@@ -302,58 +328,237 @@ int do_comm_polling (struct timeval *timeout) {
   return g_num_io_events;
 }
 
-/*
- * Send a message to an interactive object.
+/* a reference to a shared message block, queued on an interactive */
+typedef struct message_ref_s {
+  struct message_ref_s *next;
+  message_block_t *block;
+  int offset;                   /* bytes of the block already sent */
+  int ring_before;              /* bytes of message_buf that go out before the block */
+} message_ref_t;
+
+static message_ref_t *free_message_refs = 0;
+
+/**
+ * @brief Make room for at least \p need more bytes in the output ring of \p ip.
+ *
+ * The ring starts out unallocated and is doubled on demand, up to MESSAGE_BUF_LIMIT.
+ * Pending output is unwrapped to the front of the new buffer.
+ * @return Non-zero if the room is available, zero if the limit would be exceeded.
  */
-void add_message (object_t * who, char *data) {
+static int reserve_message_buf (interactive_t *ip, size_t need) {
+  int size, first;
+  char *buf;
 
-  interactive_t *ip;
-  char *cp;
+  if ((size_t)(ip->message_size - ip->message_length) >= need)
+    return 1;
+  if (need > (size_t)(MESSAGE_BUF_LIMIT - ip->message_length))
+    return 0;
 
-  /* check destination of message */
-  if (!who || (who->flags & O_DESTRUCTED) || !who->interactive ||
-      (who->interactive->iflags & (NET_DEAD | CLOSING)))
+  size = ip->message_size ? ip->message_size : MESSAGE_BUF_SIZE;
+  while ((size_t)(size - ip->message_length) < need)
+    size *= 2;
+  if (size > MESSAGE_BUF_LIMIT)
+    size = MESSAGE_BUF_LIMIT;
+
+  buf = (char *)DXALLOC (size, TAG_INTERACTIVE, "reserve_message_buf");
+  if (ip->message_length)
     {
-      if (who == master_ob || who == simul_efun_ob)
-        debug_message ("%s", data);
-      return;
+      first = ip->message_size - ip->message_consumer;
+      if (first > ip->message_length)
+        first = ip->message_length;
+      memcpy (buf, ip->message_buf + ip->message_consumer, first);
+      memcpy (buf + first, ip->message_buf, ip->message_length - first);
     }
+  if (ip->message_buf)
+    FREE (ip->message_buf);
+  ip->message_buf = buf;
+  ip->message_size = size;
+  ip->message_consumer = 0;
+  ip->message_producer = ip->message_length;
+  return 1;
+}
 
-  ip = who->interactive;
+/**
+ * @brief Make room for \p need bytes in the output ring, flushing it once if it has
+ * reached its limit.
+ * @return 1 if the room is available, 0 if it is not (the user is not reading),
+ *   -1 if the connection broke while flushing.
+ */
+static int make_room (interactive_t *ip, size_t need) {
+  if (reserve_message_buf (ip, need))
+    return 1;
+  if (!flush_message (ip))
+    return -1;
+  return reserve_message_buf (ip, need);
+}
 
-  /* write message into ip->message_buf. */
-  for (cp = data; *cp; cp++)
+/* Copy \p n bytes into the output ring, which must have room for them. */
+static void copy_to_message_buf (interactive_t *ip, const char *src, int n) {
+  int first = ip->message_size - ip->message_producer;
+
+  if (n <= 0)
+    return;
+  if (first > n)
+    first = n;
+  memcpy (ip->message_buf + ip->message_producer, src, first);
+  memcpy (ip->message_buf, src + first, n - first);
+  ip->message_producer = (ip->message_producer + n) % ip->message_size;
+  ip->message_length += n;
+}
+
+/* The user is not reading: keep as much of \p src as fits and drop the rest. */
+static void fill_message_buf (interactive_t *ip, const char *src, size_t n) {
+  size_t room;
+
+  reserve_message_buf (ip, MESSAGE_BUF_LIMIT - ip->message_length);
+  room = ip->message_size - ip->message_length;
+  copy_to_message_buf (ip, src, (int)(n < room ? n : room));
+}
+
+/**
+ * @brief Append \p len bytes of text to the output ring of \p ip.
+ *
+ * Every newline is written as CR LF, to make some crappy terminal happy.  The text
+ * between newlines is located with memchr() and copied in bulk.  Whenever the ring
+ * reaches MESSAGE_BUF_LIMIT it is flushed and copying goes on; the rest of the text
+ * is dropped only if the flush could not send anything (the user is not reading).
+ * @return Zero if the connection broke while flushing, otherwise non-zero.
+ */
+static int append_message (interactive_t *ip, const char *data, size_t len) {
+  const char *end = data + len, *nl;
+  size_t seg, n;
+  int rc;
+
+  while (data < end)
     {
-      if (ip->message_length == MESSAGE_BUF_SIZE)
-        {
-          if (!flush_message (ip))
-            {
-              debug_message ("Broken connection during add_message.\n");
-              return;
-            }
-          if (ip->message_length == MESSAGE_BUF_SIZE)
-            break;
-        }
-      if (*cp == '\n')
+      nl = memchr (data, '\n', end - data);
+      seg = (size_t)((nl ? nl : end) - data);
+      while (seg)
         {
-          if (ip->message_length == (MESSAGE_BUF_SIZE - 1))
+          n = (size_t)(MESSAGE_BUF_LIMIT - ip->message_length);
+          if (n == 0)
             {
               if (!flush_message (ip))
-                {
-                  debug_message ("Broken connection during add_message.\n");
-                  return;
-                }
-              if (ip->message_length == (MESSAGE_BUF_SIZE - 1))
-                break;
+                return 0;
+              if (ip->message_length == MESSAGE_BUF_LIMIT)
+                return 1; /* the user is not reading: drop the rest */
+              continue;
             }
-          ip->message_buf[ip->message_producer] = '\r';
-          ip->message_producer = (ip->message_producer + 1) % MESSAGE_BUF_SIZE;
-          ip->message_length++;
+          if (n > seg)
+            n = seg;
+          reserve_message_buf (ip, n);
+          copy_to_message_buf (ip, data, (int)n);
+          data += n;
+          seg -= n;
         }
-      ip->message_buf[ip->message_producer] = *cp;
-      ip->message_producer = (ip->message_producer + 1) % MESSAGE_BUF_SIZE;
-      ip->message_length++;
+      if (!nl)
+        break;
+      rc = make_room (ip, 2);
+      if (rc < 0)
+        return 0;
+      if (rc == 0)
+        return 1;
+      copy_to_message_buf (ip, "\r\n", 2);
+      data = nl + 1;
     }
+  return 1;
+}
+
+/**
+ * @brief Create a shared message block holding \p str with every newline written as CR LF.
+ *
+ * The text is translated once and can then be sent to any number of interactives
+ * with add_message_block().  The caller owns one reference.
+ */
+message_block_t* new_message_block (const char *str) {
+  const char *p, *nl, *end = str + strlen (str);
+  message_block_t *mb;
+  size_t lines = 0;
+  char *to;
+
+  for (p = str; (nl = memchr (p, '\n', end - p)); p = nl + 1)
+    lines++;
+  mb = (message_block_t *)DXALLOC (sizeof (message_block_t) + (end - str) + lines,
+                                   TAG_INTERACTIVE, "new_message_block");
+  mb->ref = 1;
+  to = mb->data;
+  for (p = str; (nl = memchr (p, '\n', end - p)); p = nl + 1)
+    {
+      memcpy (to, p, nl - p);
+      to += nl - p;
+      *to++ = '\r';
+      *to++ = '\n';
+    }
+  memcpy (to, p, end - p);
+  to += end - p;
+  mb->length = (int)(to - mb->data);
+  comm_message_blocks++;
+  return mb;
+}
+
+void free_message_block (message_block_t *mb) {
+  if (--mb->ref == 0)
+    FREE (mb);
+}
+
+/**
+ * @brief Queue a reference to \p mb behind the text already in the output ring.
+ * @return Zero if the connection broke while flushing, otherwise non-zero.
+ */
+static int queue_message_block (interactive_t *ip, message_block_t *mb) {
+  message_ref_t *ref;
+
+  if (ip->message_block_bytes + mb->length > MESSAGE_BUF_LIMIT)
+    {
+      if (!flush_message (ip))
+        return 0;
+      if (ip->message_block_bytes + mb->length > MESSAGE_BUF_LIMIT)
+        return 1; /* the user is not reading: drop it */
+    }
+
+  if ((ref = free_message_refs))
+    free_message_refs = ref->next;
+  else
+    ref = ALLOCATE (message_ref_t, TAG_INTERACTIVE, "queue_message_block");
+  ref->next = NULL;
+  ref->block = mb;
+  mb->ref++;
+  ref->offset = 0;
+  ref->ring_before = ip->message_length - ip->message_queued;
+  ip->message_queued = ip->message_length;
+  ip->message_block_bytes += mb->length;
+  if (ip->message_blocks_tail)
+    ip->message_blocks_tail->next = ref;
+  else
+    ip->message_blocks = ref;
+  ip->message_blocks_tail = ref;
+  return 1;
+}
+
+static void release_message_ref (interactive_t *ip) {
+  message_ref_t *ref = ip->message_blocks;
+
+  ip->message_block_bytes -= ref->block->length - ref->offset;
+  ip->message_queued -= ref->ring_before;
+  if (!(ip->message_blocks = ref->next))
+    ip->message_blocks_tail = NULL;
+  free_message_block (ref->block);
+  ref->next = free_message_refs;
+  free_message_refs = ref;
+}
+
+/* Release the output buffers of an interactive that is going away. */
+static void free_message_buf (interactive_t *ip) {
+  while (ip->message_blocks)
+    release_message_ref (ip);
+  if (ip->message_buf)
+    FREE (ip->message_buf);
+  ip->message_buf = NULL;
+  ip->message_size = ip->message_length = 0;
+}
+
+/* Bookkeeping shared by add_message() and add_message_block() once the text is queued. */
+static void message_added (interactive_t *ip, char *data) {
 
   /* snoop handling. */
   if (ip->snoop_by)
@@ -366,16 +571,90 @@ void add_message (object_t * who, char *data) {
     {
       flush_message (ip);
     }
-  else
+  else if (!(ip->iflags & (OUTPUT_DIRTY | WRITE_INTEREST)))
     {
-      /* Request write notification from async runtime */
-      async_runtime_modify (g_runtime, ip->fd, EVENT_READ | EVENT_WRITE, ip);
+      /* Written at the end of the backend cycle, or when the socket
+       * becomes writable if it is full. */
+      ip->iflags |= OUTPUT_DIRTY;
+      ip->next_dirty = dirty_users;
+      dirty_users = ip;
     }
 #endif
 
   add_message_calls++;
+}
+
+/*
+ * Send a message to an interactive object.
+ */
+void add_message (object_t * who, char *data) {
+
+  interactive_t *ip;
+
+  /* check destination of message */
+  if (!who || (who->flags & O_DESTRUCTED) || !who->interactive ||
+      (who->interactive->iflags & (NET_DEAD | CLOSING)))
+    {
+      if (who == master_ob || who == simul_efun_ob)
+        debug_message ("%s", data);
+      return;
+    }
+
+  ip = who->interactive;
+
+  /* write message into ip->message_buf. */
+  if (!append_message (ip, data, strlen (data)))
+    {
+      debug_message ("Broken connection during add_message.\n");
+      return;
+    }
+
+  message_added (ip, data);
 }				/* add_message() */
 
+/**
+ * @brief Send a shared message block to an interactive object.
+ *
+ * Used for broadcasts: the text is translated once by new_message_block() and the
+ * same block goes to every recipient.  Short blocks are copied into message_buf,
+ * which is cheaper than queueing a reference; longer ones are queued by reference
+ * and go out together with message_buf in one scatter-gather send.
+ * @param who The recipient.
+ * @param mb The shared message block.
+ * @param data The untranslated text of \p mb, for snoopers.
+ */
+void add_message_block (object_t * who, message_block_t * mb, char *data) {
+
+  interactive_t *ip;
+  int rc;
+
+  /* check destination of message */
+  if (!who || (who->flags & O_DESTRUCTED) || !who->interactive ||
+      (who->interactive->iflags & (NET_DEAD | CLOSING)))
+    {
+      if (who == master_ob || who == simul_efun_ob)
+        debug_message ("%s", data);
+      return;
+    }
+
+  ip = who->interactive;
+  if (mb->length > MESSAGE_BLOCK_INLINE)
+    rc = queue_message_block (ip, mb);
+  else if ((rc = make_room (ip, mb->length)) > 0)
+    copy_to_message_buf (ip, mb->data, mb->length);
+  else if (rc == 0)
+    {
+      fill_message_buf (ip, mb->data, mb->length);
+      rc = 1;
+    }
+  if (rc <= 0)
+    {
+      debug_message ("Broken connection during add_message.\n");
+      return;
+    }
+
+  message_added (ip, data);
+}				/* add_message_block() */
 
 /**
  * add_vmessage() is mainly used by the efun ed().
@@ -383,7 +662,7 @@ void add_message (object_t * who, char *data) {
 void add_vmessage (object_t * who, char *format, ...) {
   int ret = -1;
   interactive_t *ip;
-  char *cp, *str = NULL;
+  char *str = NULL;
   va_list args;
 
   va_start (args, format);
@@ -419,41 +698,9 @@ void add_vmessage (object_t * who, char *format, ...) {
 
   /* write message into ip->message_buf. */
   ip = who->interactive;
-  for (cp = str; *cp; cp++)
-    {
-      if (ip->message_length == MESSAGE_BUF_SIZE)
-        {
-          if (!flush_message (ip))
-            {
-              debug_message ("Broken connection during add_message.\n");
-              break;
-            }
-          if (ip->message_length == MESSAGE_BUF_SIZE)
-            break;
-        }
-      if (*cp == '\n')
-        {
-          if (ip->message_length == (MESSAGE_BUF_SIZE - 1))
-            {
-              if (!flush_message (ip))
-                {
-                  debug_message ("Broken connection during add_message.\n");
-                  break;
-                }
-              if (ip->message_length == (MESSAGE_BUF_SIZE - 1))
-                break;
-            }
-          /* write CR LF for every newline, to make some crappy terminal happy */
-          ip->message_buf[ip->message_producer] = '\r';
-          ip->message_producer = (ip->message_producer + 1) % MESSAGE_BUF_SIZE;
-          ip->message_length++;
-        }
-      ip->message_buf[ip->message_producer] = *cp;
-      ip->message_producer = (ip->message_producer + 1) % MESSAGE_BUF_SIZE;
-      ip->message_length++;
-    }
-
-  if ((ip->message_length != 0) && !flush_message (ip))
+  if (!append_message (ip, str, (size_t)ret))
+    debug_message ("Broken connection during add_message.\n");
+  else if (MESSAGE_PENDING (ip) && !flush_message (ip))
     debug_message ("Broken connection during add_message.\n");
 
   /* snoop handling. */
@@ -470,45 +717,161 @@ void add_vmessage (object_t * who, char *format, ...) {
 }				/* add_message() */
 
 
+/*
+ * Gather the pending output of ip into iov[] in the order it was added: text in
+ * message_buf (at most two segments, consumer..end and 0..producer) interleaved
+ * with the queued message blocks.
+ */
+static int add_ring_iov (interactive_t *ip, struct iovec *iov, int n, int *pos, int length) {
+  int first;
+
+  if (length <= 0)
+    return n;
+  first = ip->message_size - *pos;
+  if (first > length)
+    first = length;
+  iov[n].iov_base = ip->message_buf + *pos;
+  iov[n++].iov_len = first;
+  if (length > first)
+    {
+      iov[n].iov_base = ip->message_buf;
+      iov[n++].iov_len = length - first;
+    }
+  *pos = (*pos + length) % ip->message_size;
+  return n;
+}
+
+static int collect_output (interactive_t *ip, struct iovec *iov, int max_iov) {
+  message_ref_t *ref;
+  int n = 0, pos = ip->message_consumer;
+
+  /* each block takes up to three entries, the trailing text up to two */
+  for (ref = ip->message_blocks; ref && n + 5 <= max_iov; ref = ref->next)
+    {
+      n = add_ring_iov (ip, iov, n, &pos, ref->ring_before);
+      iov[n].iov_base = ref->block->data + ref->offset;
+      iov[n++].iov_len = ref->block->length - ref->offset;
+    }
+  if (!ref)
+    n = add_ring_iov (ip, iov, n, &pos, ip->message_length - ip->message_queued);
+  return n;
+}
+
+/* Drop num_bytes of sent output from the front of the queue. */
+static void consume_output (interactive_t *ip, int num_bytes) {
+  message_ref_t *ref;
+  int n;
+
+  while (num_bytes > 0)
+    {
+      ref = ip->message_blocks;
+      n = ref ? ref->ring_before : ip->message_length - ip->message_queued;
+      if (n > num_bytes)
+        n = num_bytes;
+      if (n)
+        {
+          ip->message_consumer = (ip->message_consumer + n) % ip->message_size;
+          ip->message_length -= n;
+          num_bytes -= n;
+          if (ref)
+            {
+              ref->ring_before -= n;
+              ip->message_queued -= n;
+            }
+        }
+      if (!ref || !num_bytes)
+        break;
+
+      n = ref->block->length - ref->offset;
+      if (n > num_bytes)
+        n = num_bytes;
+      ref->offset += n;
+      ip->message_block_bytes -= n;
+      num_bytes -= n;
+      if (ref->offset == ref->block->length)
+        release_message_ref (ip);
+    }
+}
+
+/*
+ * Register or drop write interest with the async runtime, if it changes.
+ */
+static void set_write_interest (interactive_t * ip, int on) {
+  if (!on == !(ip->iflags & WRITE_INTEREST))
+    return;
+  ip->iflags ^= WRITE_INTEREST;
+  async_runtime_modify (g_runtime, ip->fd, on ? (EVENT_READ | EVENT_WRITE) : EVENT_READ, ip);
+  comm_interest_calls++;
+}
+
+/*
+ * Write the output queued by add_message() during this backend cycle,
+ * directly.  Write interest is only registered for sockets that are full.
+ */
+void flush_pending_output (void) {
+  interactive_t *ip;
+
+  comm_cycles++;
+  while ((ip = dirty_users))
+    {
+      dirty_users = ip->next_dirty;
+      ip->next_dirty = NULL;
+      ip->iflags &= ~OUTPUT_DIRTY;
+      flush_message (ip);
+    }
+}
+
+/*
+ * Take a user that is going away off the list of pending output.
+ */
+static void forget_pending_output (interactive_t * ip) {
+  interactive_t **pp;
+
+  if (!(ip->iflags & OUTPUT_DIRTY))
+    return;
+  for (pp = &dirty_users; *pp != ip; pp = &(*pp)->next_dirty)
+    ;
+  *pp = ip->next_dirty;
+  ip->iflags &= ~OUTPUT_DIRTY;
+}
+
 /*
  * Flush outgoing message buffer of current interactive object.
  */
 int flush_message (interactive_t * ip) {
-  int length, num_bytes;
+  struct iovec iov[FLUSH_IOV_MAX];
+  int iovcnt, num_bytes;
 
   /* if ip is not valid, do nothing. */
   if (!ip || (ip->iflags & (CLOSING | NET_DEAD)))
     return 0;
 
   /*
-   * write ip->message_buf[] to socket.
+   * write ip->message_buf[] and the queued message blocks to socket.
    */
-  while (ip->message_length != 0)
+  while (MESSAGE_PENDING (ip))
     {
-      if (ip->message_consumer < ip->message_producer)
-        {
-          length = ip->message_producer - ip->message_consumer;
-        }
+      iovcnt = collect_output (ip, iov, FLUSH_IOV_MAX);
+#ifdef HAVE_SYS_UIO_H
+      if (!ip->out_of_band)
+        num_bytes = writev ((ip == all_users[0]) ? STDOUT_FILENO : ip->fd, iov, iovcnt);
       else
-        {
-          length = MESSAGE_BUF_SIZE - ip->message_consumer;
-        }
+#endif /* HAVE_SYS_UIO_H */
       /* Need to use send to get Out-Of-Band data
        * num_bytes = write(ip->fd,ip->message_buf + ip->message_consumer,length);
        * [NEOLITH-EXTENSION] if ip is the console user, use write to STDOUT_FILENO
        */
       num_bytes = (ip == all_users[0]) ?
-        FILE_WRITE (STDOUT_FILENO, ip->message_buf + ip->message_consumer, length) :
-        SOCKET_SEND (ip->fd, ip->message_buf + ip->message_consumer, length, ip->out_of_band);
+        FILE_WRITE (STDOUT_FILENO, iov[0].iov_base, (int)iov[0].iov_len) :
+        SOCKET_SEND (ip->fd, iov[0].iov_base, iov[0].iov_len, ip->out_of_band);
+      comm_write_calls++;
       if (num_bytes == -1)
         {
           if (SOCKET_ERRNO == EWOULDBLOCK || SOCKET_ERRNO == EINTR)
             {
               /* Socket would block - request write notification from async runtime */
               if (ip != all_users[0])
-                {
-                  async_runtime_modify (g_runtime, ip->fd, EVENT_READ | EVENT_WRITE, ip);
-                }
+                set_write_interest (ip, 1);
               return 1;
             }
 
@@ -517,19 +880,25 @@ int flush_message (interactive_t * ip) {
           ip->iflags |= NET_DEAD;
           return 0;
         }
-      ip->message_consumer = (ip->message_consumer + num_bytes) % MESSAGE_BUF_SIZE;
-      ip->message_length -= num_bytes;
+      consume_output (ip, num_bytes);
       ip->out_of_band = 0;
       inet_packets++;
       inet_volume += num_bytes;
     }
-  
-  /* All data sent - remove write notification if it was set */
-  if (ip != all_users[0])
+
+  /* Drained: restart at the front of the ring and give back what a burst of output grew */
+  ip->message_producer = ip->message_consumer = 0;
+  if (ip->message_size > MESSAGE_BUF_SIZE)
     {
-      async_runtime_modify (g_runtime, ip->fd, EVENT_READ, ip);
+      FREE (ip->message_buf);
+      ip->message_buf = NULL;
+      ip->message_size = 0;
     }
-  
+
+  /* All data sent - remove write notification if it was set */
+  if (ip != all_users[0])
+    set_write_interest (ip, 0);
+
   return 1;
 }				/* flush_message() */
 
@@ -1079,6 +1448,10 @@ void process_io () {
               /* On Windows, accept worker has already called accept() and posted
                * the accepted socket FD. The FD is in evt->fd. */
               if (evt->fd != INVALID_SOCKET)
+#else
+              /* With io_uring, a multishot accept has done it. */
+              if (evt->event_type & EVENT_ACCEPT)
+#endif
                 {
                   opt_trace (TT_COMM|1, "incoming connection on port %d (accepted fd=%d)\n", port->port, (int)evt->fd);
                   
@@ -1097,17 +1470,11 @@ void process_io () {
                 }
               else
                 {
-                  /* Fallback: call accept() synchronously (shouldn't happen with accept worker) */
+                  /* Readiness: the listening socket is ready, call accept().
+                   * (Windows: shouldn't happen with the accept worker) */
                   opt_trace (TT_COMM|1, "incoming connection on port %d\n", port->port);
                   new_user_handler (port);
                 }
-#else
-              /* On POSIX, listening socket is ready - call accept()
-               * TODO: do asynchronous accept() in worker thread to avoid blocking here?
-               */
-              opt_trace (TT_COMM|1, "incoming connection on port %d\n", port->port);
-              new_user_handler (port);
-#endif
             }
           
           if (evt->event_type & EVENT_ERROR)
@@ -1145,6 +1512,11 @@ void process_io () {
                 }
             }
         }
+      else if (evt->completion_key == ASYNC_FILE_COMPLETION_KEY)
+        {
+          /* A file job of async_read_file() etc. has finished on a worker */
+          async_file_complete (evt);
+        }
       else if (is_interactive_user (evt->context))
         {
           /* Interactive user socket */
@@ -1210,6 +1582,21 @@ void process_io () {
             }
         }
     }
+
+  /* Take in input that was received earlier but didn't fit, as the commands
+   * ahead of it are used up (see take_user_data()) */
+  for (i = 0; all_users && i < max_users; i++)
+    {
+      interactive_t *ip = all_users[i];
+      size_t pending;
+
+      while (ip && (pending = ip->input_pending_len) && !(ip->iflags & (CMD_IN_BUF | CLOSING)))
+        {
+          get_user_data (ip, NULL);
+          if (all_users[i] != ip || ip->input_pending_len == pending)
+            break;
+        }
+    }
   
   /* Flush console user output if connected (console is always writable) */
   if (all_users && all_users[0])
@@ -1275,9 +1662,12 @@ void new_interactive (socket_fd_t socket_fd) {
   master_ob->interactive->ob = master_ob;
   master_ob->interactive->input_to = 0;
   master_ob->interactive->iflags = 0;
+  master_ob->interactive->next_dirty = NULL;
   master_ob->interactive->text[0] = '\0';
   master_ob->interactive->text_end = 0;
   master_ob->interactive->text_start = 0;
+  master_ob->interactive->input_pending = NULL;
+  master_ob->interactive->input_pending_len = 0;
   master_ob->interactive->snoop_on = 0;
   master_ob->interactive->snoop_by = 0;
   master_ob->interactive->last_time = current_time;
@@ -1291,6 +1681,12 @@ void new_interactive (socket_fd_t socket_fd) {
   master_ob->interactive->message_producer = 0;
   master_ob->interactive->message_consumer = 0;
   master_ob->interactive->message_length = 0;
+  master_ob->interactive->message_size = 0;
+  master_ob->interactive->message_buf = NULL;
+  master_ob->interactive->message_blocks = NULL;
+  master_ob->interactive->message_blocks_tail = NULL;
+  master_ob->interactive->message_queued = 0;
+  master_ob->interactive->message_block_bytes = 0;
   master_ob->interactive->state = TS_DATA; /* initial telnet state when connection is established */
   master_ob->interactive->out_of_band = 0;
   all_users[i] = master_ob->interactive;
@@ -1358,9 +1754,12 @@ interactive_t* create_test_interactive (object_t *ob) {
   ip->input_to = NULL;
   ip->fd = STDIN_FILENO; /* Mark as console-like to avoid network operations */
   ip->iflags = 0;
+  ip->next_dirty = NULL;
   ip->text_end = 0;
   ip->text_start = 0;
   ip->text[0] = '\0';
+  ip->input_pending = NULL;
+  ip->input_pending_len = 0;
   ip->prompt = NULL;
   ip->snoop_on = NULL;
   ip->snoop_by = NULL;
@@ -1369,6 +1768,12 @@ interactive_t* create_test_interactive (object_t *ob) {
   ip->message_producer = 0;
   ip->message_consumer = 0;
   ip->message_length = 0;
+  ip->message_size = 0;
+  ip->message_buf = NULL;
+  ip->message_blocks = NULL;
+  ip->message_blocks_tail = NULL;
+  ip->message_queued = 0;
+  ip->message_block_bytes = 0;
   ip->state = TS_DATA;
   ip->out_of_band = 0;
   ip->sb_pos = 0;
@@ -1434,6 +1839,9 @@ void remove_test_interactive (interactive_t *ip) {
   }
   
   /* Free the structure */
+  forget_pending_output (ip);
+  free_message_buf (ip);
+  free_pending_input (ip);
   FREE (ip);
   
   /* Note: total_users was not incremented, so don't decrement it */
@@ -1509,10 +1917,10 @@ static void setup_accepted_connection (port_def_t *port, socket_fd_t new_socket_
   opt_info (1, "connection established for %s (fd=%d, ob=%s)\n",
             addr_str, (int)new_socket_fd, user_ob->name);
 
-#ifdef _WIN32
-  /* On Windows IOCP, async_runtime_add() does NOT post an initial read for connected sockets.
-   * We must post the first read here after mudlib_connect() transfers the interactive
-   * and user object setup completes. This avoids race conditions. */
+  /* On Windows IOCP and Linux io_uring, async_runtime_add() does NOT post an initial read
+   * for connected sockets. We must post the first read here after mudlib_connect() transfers
+   * the interactive and user object setup completes. This avoids race conditions.
+   * With readiness-based runtimes this is a no-op. */
   if (user_ob->interactive)
     {
       opt_trace (TT_COMM|3, "Posting initial async read for user socket (fd=%d, ob=%s)",
@@ -1532,7 +1940,6 @@ static void setup_accepted_connection (port_def_t *port, socket_fd_t new_socket_
       debug_message("ERROR: user_ob->interactive is NULL after mudlib_connect() for fd=%d, ob=%s\n",
                     (int)new_socket_fd, user_ob->name);
     }
-#endif
 }
 
 /**
@@ -1658,6 +2065,52 @@ static void hname_handler () {
 
 
 
+/**
+ * @brief Keep received input that can't go into the input buffer yet.
+ *
+ * Completion I/O (IOCP, io_uring) hands over whole receive buffers, more
+ * than there may be room for in the input buffer, and several of them per
+ * cycle.  What can't be taken in now waits in ip->input_pending, and is
+ * taken in by process_io() as the commands ahead of it are used up, like
+ * readiness I/O leaves it in the kernel.
+ */
+static void queue_user_data (interactive_t *ip, const char *data, size_t len) {
+
+  if (ip->input_pending_len + len > INPUT_PENDING_LIMIT)
+    {
+      debug_message ("get_user_data: (fd %d) input flood, %zu bytes dropped\n", ip->fd, len);
+      return;
+    }
+  ip->input_pending = RESIZE (ip->input_pending, ip->input_pending_len + len, char,
+                              TAG_TEMPORARY, "queue_user_data");
+  memcpy (ip->input_pending + ip->input_pending_len, data, len);
+  ip->input_pending_len += len;
+}
+
+/**
+ * @brief Take up to \p space bytes of the pending input into \p buf.
+ * @return The number of bytes taken.
+ */
+static size_t take_user_data (interactive_t *ip, char *buf, size_t space) {
+
+  size_t n = ip->input_pending_len < space ? ip->input_pending_len : space;
+
+  memcpy (buf, ip->input_pending, n);
+  ip->input_pending_len -= n;
+  if (ip->input_pending_len)
+    memmove (ip->input_pending, ip->input_pending + n, ip->input_pending_len);
+  else
+    free_pending_input (ip);
+  return n;
+}
+
+static void free_pending_input (interactive_t *ip) {
+  if (ip->input_pending)
+    FREE (ip->input_pending);
+  ip->input_pending = NULL;
+  ip->input_pending_len = 0;
+}
+
 /**
  * @brief This is the user data handler. This function is called from
  * the backend when a user has transmitted data to us.
@@ -1730,25 +2183,30 @@ static void get_user_data (interactive_t* ip, io_event_t* evt) {
    *   - Socket is ready to read, perform synchronous recv()/read()
    *   - Used on Linux, BSD, macOS
    *
-   * Completion notification (Windows IOCP):
+   * Completion notification (Windows IOCP, Linux io_uring):
    *   - evt->buffer contains data already read asynchronously
    *   - evt->bytes_transferred indicates how many bytes were read
    *   - Must post next async read operation to continue receiving data
-   *   - Used on Windows
+   *     (a no-op with io_uring, whose multishot recv stays armed)
+   *   - Used on Windows, and on Linux when io_uring is available
    */
   if (evt && evt->buffer && evt->bytes_transferred > 0)
     {
-      /* Completion notification: use data already in event buffer (Windows IOCP) */
+      /* Completion notification: use data already in event buffer (IOCP, io_uring).
+       * What doesn't fit, or arrives while complete commands are waiting, is
+       * kept for process_io() to take in later.
+       */
       num_bytes = evt->bytes_transferred;
-      if (num_bytes > text_space)
+      opt_trace (TT_COMM|3, "Number of bytes received: %d. Posting next async read for fd %d\n", num_bytes, ip->fd);
+      if (ip->input_pending_len || num_bytes > text_space || (ip->iflags & CMD_IN_BUF))
         {
-          num_bytes = text_space;  /* Truncate if buffer overflow */
+          queue_user_data (ip, evt->buffer, num_bytes);
+          num_bytes = (ip->iflags & CMD_IN_BUF) ? 0 : take_user_data (ip, buf, text_space);
         }
-      memcpy(buf, evt->buffer, num_bytes);
+      else
+        memcpy (buf, evt->buffer, num_bytes);
 
       /* Post next async read to continue receiving data */
-      opt_trace (TT_COMM|3, "Number of bytes received: %d. Posting next async read for fd %d\n", num_bytes, ip->fd);
-      
       if (async_runtime_post_read(g_runtime, ip->fd, NULL, 0) != 0)
         {
           debug_message("get_user_data: failed to post next read for fd %d\n", ip->fd);
@@ -1757,6 +2215,15 @@ static void get_user_data (interactive_t* ip, io_event_t* evt) {
           remove_interactive(ip->ob, 0);
           return;
         }
+      if (!num_bytes)
+        return;
+    }
+  else if (ip->input_pending_len)
+    {
+      /* Completion notification: data received earlier, see process_io() */
+      num_bytes = take_user_data (ip, buf, text_space);
+      if (!num_bytes)
+        return;
     }
   else
     {
@@ -1980,6 +2447,9 @@ void remove_interactive (object_t * ob, int dested) {
     if (all_users[idx] == ip)
       break;
   DEBUG_CHECK (idx == max_users, "remove_interactive: could not find and remove user!\n");
+  forget_pending_output (ip);
+  free_message_buf (ip);
+  free_pending_input (ip);
   FREE (ip);
   total_users--;
   ob->interactive = 0;
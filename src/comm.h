@@ -7,7 +7,10 @@
 #define MAX_SOCKET_PACKET_SIZE     1024
 #define DESIRED_SOCKET_PACKET_SIZE 800
 #define MESSAGE_BUF_SIZE           MESSAGE_BUFFER_SIZE	/* from options.h */
+#define MESSAGE_BUF_LIMIT          MESSAGE_BUFFER_LIMIT	/* from options.h */
+#define MESSAGE_BLOCK_INLINE       128	/* shared blocks up to this size are copied */
 #define OUT_BUF_SIZE               2048
+#define INPUT_PENDING_LIMIT        (32 * MAX_TEXT)	/* received input waiting for room in text */
 #define DFAULT_PROTO               0	/* use the appropriate protocol */
 #define I_NOECHO                   0x1	/* input_to flag */
 #define I_NOESC                    0x2	/* input_to flag */
@@ -33,9 +36,18 @@ enum msgtypes {
 #define USING_TELNET        0x0400
 #define	USING_LINEMODE      0x0800
 #define HAS_CMD_TURN        0x1000	/* user has command processing turn this cycle */
+#define WRITE_INTEREST      0x2000	/* EVENT_WRITE is registered with the async runtime */
+#define OUTPUT_DIRTY        0x4000	/* queued for flush_pending_output()       */
 
 typedef struct interactive_s interactive_t;
 
+/* A pre-translated message shared by all recipients of a broadcast. */
+typedef struct message_block_s {
+    int ref;                    /* reference count */
+    int length;                 /* length of data[] */
+    char data[1];               /* text with newlines written as CR LF */
+} message_block_t;
+
 struct interactive_s {
     object_t *ob;               /* points to the associated object         */
     sentence_t *input_to;       /* to be called with next input line       */
@@ -49,6 +61,8 @@ struct interactive_s {
     char text[MAX_TEXT];        /* input buffer for interactive object     */
     ptrdiff_t text_end;         /* first free char in buffer               */
     ptrdiff_t text_start;       /* where we are up to in user command buffer */
+    char *input_pending;        /* input already received that didn't fit in text */
+    size_t input_pending_len;
     interactive_t *snoop_on;
     interactive_t *snoop_by;
     time_t last_time;           /* time of last command executed           */
@@ -59,8 +73,14 @@ struct interactive_s {
     int message_producer;       /* message buffer producer index */
     int message_consumer;       /* message buffer consumer index */
     int message_length;         /* message buffer length */
-    char message_buf[MESSAGE_BUF_SIZE]; /* message buffer */
+    int message_size;           /* allocated size of message_buf */
+    char *message_buf;          /* message buffer (ring), grown on demand */
+    struct message_ref_s *message_blocks;      /* shared blocks queued behind message_buf */
+    struct message_ref_s *message_blocks_tail;
+    int message_queued;         /* bytes of message_buf due before the last queued block */
+    int message_block_bytes;    /* unsent bytes in the queued blocks */
     int iflags;                 /* interactive flags */
+    interactive_t *next_dirty;  /* next user with output to write at the end of the cycle */
     int out_of_band;            /* Send a telnet sync operation            */
     int state;                  /* Current telnet state.  Bingly wop       */
     int sb_pos;                 /* Telnet suboption negotiation stuff      */
@@ -77,6 +97,10 @@ extern int inet_volume;
 extern int num_user;
 extern int num_hidden;
 extern int add_message_calls;
+extern int comm_write_calls;
+extern int comm_interest_calls;
+extern int comm_cycles;
+extern int comm_message_blocks;
 
 extern interactive_t **all_users;
 extern int max_users;
@@ -100,8 +124,13 @@ int do_comm_polling (struct timeval* timeout);
 
 int is_console_user (void *context);
 
+#define MESSAGE_PENDING(ip)  ((ip)->message_length || (ip)->message_blocks)
+
 void add_vmessage (object_t *, char *, ...);
 void add_message (object_t *, char *);
+message_block_t* new_message_block (const char *);
+void free_message_block (message_block_t *);
+void add_message_block (object_t *, message_block_t *, char *);
 
 void init_user_conn (void);
 void ipc_remove (void);
@@ -116,6 +145,7 @@ void set_telnet_single_char (interactive_t *, int);
 int replace_interactive (object_t *, object_t *);
 void remove_interactive (object_t *, int);
 int flush_message (interactive_t *);
+void flush_pending_output (void);
 int query_addr_number (char *, char *);
 char *query_ip_name (object_t *);
 char *query_ip_number (object_t *);
@@ -404,7 +404,7 @@ static char* get_user_command () {
   for (i = 0; i < max_users; i++)
     {
       ip = all_users[s_next_user];
-      if (ip && ip->message_length)
+      if (ip && MESSAGE_PENDING (ip))
         {
           object_t *ob = ip->ob;
           flush_message (ip);
@@ -727,6 +727,134 @@ static void do_loop_cond_number () {
     error ("*Right side of < is a number, left side is not.");
 }
 
+/**
+ *  @brief Push the value of a local variable, like F_LOCAL.
+ *  A destructed object in the variable is replaced with 0.
+ */
+static inline void push_local (svalue_t * s) {
+
+  if ((s->type == T_OBJECT) && (s->u.ob->flags & O_DESTRUCTED))
+    {
+      *++sp = const0;
+      assign_svalue (s, &const0);
+    }
+  else
+    {
+      assign_svalue_no_free (++sp, s);
+    }
+}
+
+/*
+ * Opcode dispatch.
+ *
+ * Where the compiler supports computed goto (labels as values, a GNU C
+ * extension), every opcode handler is also reachable through a label in a
+ * dispatch table.  The cheap handlers that can neither branch nor call out
+ * (pushes, arithmetic, comparisons, assignments) then end with DISPATCH_NEXT
+ * and jump straight to the handler of the next opcode, instead of going
+ * through the bounds check and the single indirect jump of the switch.
+ *
+ * eval_cost is charged at the top of the loop only: the instructions
+ * dispatched directly since the last visit (ticks) are charged in one go
+ * when the basic block ends with a branch, a call, a return or an efun.
+ */
+#if defined(__GNUC__) && !defined(NO_COMPUTED_GOTO) && !defined(OPCODE_PAIR_PROFILE)
+#define COMPUTED_GOTO
+#endif
+
+#ifdef COMPUTED_GOTO
+#define CASE(op)	case op: L_##op
+#define CASE_DEFAULT	default: L_default
+#define OP(op)		[op] = &&L_##op
+#define DISPATCH_NEXT \
+  do { \
+    DEBUG_CHECK1 (sp < fp + csp->num_local_variables - 1, "Bad stack after evaluation. Instruction %d\n", instruction); \
+    ticks++; \
+    instruction = EXTRACT_UCHAR (pc++); \
+    goto *dispatch_table[instruction]; \
+  } while (0)
+#else
+#define CASE(op)	case op
+#define CASE_DEFAULT	default
+#define DISPATCH_NEXT	break
+#endif
+
+/* a fall through comment is not seen by the compiler in front of CASE () */
+#if defined(__GNUC__) && __GNUC__ >= 7
+#define FALLTHROUGH	__attribute__ ((fallthrough))
+#else
+#define FALLTHROUGH	do { } while (0)
+#endif
+
+#ifdef OPCODE_PAIR_PROFILE
+static unsigned int opcode_pairs[256][256];
+static int last_opcode = 0;
+
+/**
+ *  @brief Print the most frequent pairs of consecutive opcodes.
+ *  These are the candidates for new superinstructions.
+ *  @param ob The output buffer.
+ *  @param max_pairs How many pairs to list.
+ */
+void print_opcode_pairs (outbuffer_t * ob, int max_pairs) {
+  int *top;
+  unsigned int total = 0;
+  int i, j, n = 0;
+
+  if (max_pairs <= 0)
+    return;
+  top = CALLOCATE (max_pairs, int, TAG_TEMPORARY, "print_opcode_pairs");
+  for (i = 0; i < 256 * 256; i++)
+    {
+      unsigned int count = opcode_pairs[i >> 8][i & 0xff];
+
+      if (!count)
+        continue;
+      total += count;
+      if (n == max_pairs && count <= opcode_pairs[top[n - 1] >> 8][top[n - 1] & 0xff])
+        continue;
+      j = (n < max_pairs) ? n++ : n - 1;
+      for (; j > 0 && count > opcode_pairs[top[j - 1] >> 8][top[j - 1] & 0xff]; j--)
+        top[j] = top[j - 1];
+      top[j] = i;
+    }
+
+  outbuf_addv (ob, "%u opcode pairs executed\n", total);
+  for (i = 0; i < n; i++)
+    {
+      unsigned int count = opcode_pairs[top[i] >> 8][top[i] & 0xff];
+
+      outbuf_addv (ob, "%10u %5.2f%% ", count, 100.0 * count / total);
+      for (j = 0; j < 2; j++)
+        {
+          int op = j ? (top[i] & 0xff) : (top[i] >> 8);
+
+          if (instrs[op].name)
+            outbuf_addv (ob, " %s", instrs[op].name);
+          else
+            outbuf_addv (ob, " <%d>", op);
+        }
+      outbuf_add (ob, "\n");
+    }
+  FREE (top);
+}
+
+/**
+ *  @brief Clear the opcode pair counters.
+ */
+void clear_opcode_pairs (void) {
+  memset (opcode_pairs, 0, sizeof (opcode_pairs));
+  last_opcode = 0;
+}
+#endif /* OPCODE_PAIR_PROFILE */
+
+#ifdef COMPUTED_GOTO
+/* labels as values and case ranges are GNU C */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#pragma GCC diagnostic ignored "-Woverride-init"
+#endif
+
 /**
  *  @brief Evaluate instructions at address \p p.
  *  All program offsets are relative to \p current_prog->program.
@@ -744,7 +872,45 @@ void eval_instruction (const char *p) {
   svalue_t *lval;
   int instruction;
   unsigned short offset;
+  int64_t ticks = 0;		/* instructions dispatched directly, not charged yet */
   static instr_t *instrs2 = instrs + ONEARG_MAX;
+#ifdef COMPUTED_GOTO
+  static const void *const dispatch_table[256] = {
+    [0 ... 255] = &&L_default,
+    OP (F_PUSH), OP (F_INC), OP (F_WHILE_DEC), OP (F_LOCAL_LVALUE), OP (F_NUMBER), OP (F_LONG),
+    OP (F_REAL), OP (F_BYTE), OP (F_NBYTE), OP (F_BRANCH), OP (F_BBRANCH), OP (F_BRANCH_NE),
+    OP (F_BRANCH_GE), OP (F_BRANCH_LE), OP (F_BRANCH_EQ), OP (F_BBRANCH_LT),
+    OP (F_BRANCH_WHEN_ZERO), OP (F_BRANCH_WHEN_NON_ZERO), OP (F_BBRANCH_WHEN_ZERO),
+    OP (F_BBRANCH_WHEN_NON_ZERO), OP (F_LOR), OP (F_LAND), OP (F_LOOP_INCR),
+    OP (F_LOOP_COND_LOCAL), OP (F_LOOP_COND_NUMBER), OP (F_TRANSFER_LOCAL), OP (F_LOCAL),
+    OP (F_ADD_LOCALS), OP (F_RETURN_LOCAL), OP (F_GLOBAL_BRANCH_WHEN_ZERO),
+    OP (F_LOCAL_INDEX_LVALUE), OP (F_LT),
+    OP (F_ADD), OP (F_VOID_ADD_EQ), OP (F_ADD_EQ), OP (F_AND), OP (F_AND_EQ),
+    OP (F_FUNCTION_CONSTRUCTOR), OP (F_FOREACH), OP (F_NEXT_FOREACH), OP (F_EXIT_FOREACH),
+    OP (F_EXPAND_VARARGS), OP (F_NEW_CLASS), OP (F_NEW_EMPTY_CLASS), OP (F_AGGREGATE),
+    OP (F_AGGREGATE_ASSOC), OP (F_ASSIGN), OP (F_VOID_ASSIGN_LOCAL), OP (F_VOID_ASSIGN),
+    OP (F_CALL_FUNCTION_BY_ADDRESS), OP (F_CALL_INHERITED), OP (F_COMPL), OP (F_CONST0),
+    OP (F_CONST1), OP (F_PRE_DEC), OP (F_DEC), OP (F_DIVIDE), OP (F_DIV_EQ), OP (F_EQ),
+    OP (F_GE), OP (F_GT), OP (F_GLOBAL), OP (F_PRE_INC), OP (F_MEMBER), OP (F_MEMBER_LVALUE),
+    OP (F_INDEX), OP (F_RINDEX), OP (F_LE), OP (F_LSH), OP (F_LSH_EQ), OP (F_MOD),
+    OP (F_MOD_EQ), OP (F_MULTIPLY), OP (F_MULT_EQ), OP (F_NE), OP (F_NEGATE), OP (F_NOT),
+    OP (F_OR), OP (F_OR_EQ), OP (F_PARSE_COMMAND), OP (F_POP_VALUE), OP (F_POST_DEC),
+    OP (F_POST_INC), OP (F_GLOBAL_LVALUE), OP (F_INDEX_LVALUE), OP (F_RINDEX_LVALUE),
+    OP (F_NN_RANGE_LVALUE), OP (F_RN_RANGE_LVALUE), OP (F_RR_RANGE_LVALUE),
+    OP (F_NR_RANGE_LVALUE), OP (F_NN_RANGE), OP (F_RN_RANGE), OP (F_NR_RANGE), OP (F_RR_RANGE),
+    OP (F_NE_RANGE), OP (F_RE_RANGE), OP (F_RETURN_ZERO), OP (F_RETURN), OP (F_RSH),
+    OP (F_RSH_EQ), OP (F_SSCANF), OP (F_STRING), OP (F_SHORT_STRING), OP (F_SUBTRACT),
+    OP (F_SUB_EQ), OP (F_SIMUL_EFUN), OP (F_SWITCH), OP (F_XOR), OP (F_XOR_EQ), OP (F_CATCH),
+    OP (F_END_CATCH), OP (F_TIME_EXPRESSION), OP (F_END_TIME_EXPRESSION), OP (F_EFUN0),
+    OP (F_EFUN1), OP (F_EFUN2), OP (F_EFUN3), OP (F_EFUNV),
+#ifdef F_JUMP_WHEN_ZERO
+    OP (F_JUMP_WHEN_ZERO), OP (F_JUMP_WHEN_NON_ZERO),
+#endif
+#ifdef F_JUMP
+    OP (F_JUMP),
+#endif
+  };
+#endif
 
   /* Next F_RETURN at this level will return out of eval_instruction() */
   csp->framekind |= FRAME_EXTERNAL;
@@ -752,7 +918,13 @@ void eval_instruction (const char *p) {
   while (1)
     {
       instruction = EXTRACT_UCHAR (pc++);
-      if (!--eval_cost)
+#ifdef OPCODE_PAIR_PROFILE
+      opcode_pairs[last_opcode][instruction]++;
+      last_opcode = instruction;
+#endif
+      eval_cost -= ticks + 1;
+      ticks = 0;
+      if (eval_cost <= 0)
         {
           /* [NEOLITH-EXTENSION] allows eval_instruction without current_object */
           if (current_object)
@@ -767,9 +939,12 @@ void eval_instruction (const char *p) {
        * LPC must return a value. This does not apply to control
        * instructions, like F_JUMP.
        */
+#ifdef COMPUTED_GOTO
+      goto *dispatch_table[instruction];
+#endif
       switch (instruction)
         {
-        case F_PUSH:		/* Push a number of things onto the stack */
+        CASE (F_PUSH):		/* Push a number of things onto the stack */
           n = EXTRACT_UCHAR (pc++);
           while (n--)
             {
@@ -809,8 +984,8 @@ void eval_instruction (const char *p) {
                   break;
                 }
             }
-          break;
-        case F_INC:
+          DISPATCH_NEXT;
+        CASE (F_INC):
           lval = (sp--)->u.lvalue;
           switch (lval->type)
             {
@@ -829,7 +1004,7 @@ void eval_instruction (const char *p) {
               error ("*Increment (++) on non-numeric argument.");
             }
           break;
-        case F_WHILE_DEC:
+        CASE (F_WHILE_DEC):
           {
             svalue_t *s;
 
@@ -858,33 +1033,33 @@ void eval_instruction (const char *p) {
               }
           }
           break;
-        case F_LOCAL_LVALUE:
+        CASE (F_LOCAL_LVALUE):
           (++sp)->type = T_LVALUE;
           sp->u.lvalue = fp + EXTRACT_UCHAR (pc++);
-          break;
-        case F_NUMBER:
+          DISPATCH_NEXT;
+        CASE (F_NUMBER):
           LOAD_INT (i, pc);
           push_number (i);
-          break;
-        case F_LONG:
+          DISPATCH_NEXT;
+        CASE (F_LONG):
           {
             int64_t long_val;
             LOAD_LONG (long_val, pc);
             push_number (long_val);
           }
           break;
-        case F_REAL:
+        CASE (F_REAL):
           LOAD_FLOAT (real, pc);
           push_real (real);
           break;
-        case F_BYTE:
+        CASE (F_BYTE):
           push_number (EXTRACT_UCHAR (pc++));
-          break;
-        case F_NBYTE:
+          DISPATCH_NEXT;
+        CASE (F_NBYTE):
           push_number (-((int) EXTRACT_UCHAR (pc++)));
-          break;
+          DISPATCH_NEXT;
 #ifdef F_JUMP_WHEN_NON_ZERO
-        case F_JUMP_WHEN_NON_ZERO:
+        CASE (F_JUMP_WHEN_NON_ZERO):
           if ((i = (sp->type == T_NUMBER)) && (sp->u.number == 0))
             pc += 2;
           else
@@ -903,15 +1078,15 @@ void eval_instruction (const char *p) {
             }
           break;
 #endif
-        case F_BRANCH:		/* relative offset */
+        CASE (F_BRANCH):		/* relative offset */
           COPY_SHORT (&offset, pc);
           pc += offset;
           break;
-        case F_BBRANCH:	/* relative offset */
+        CASE (F_BBRANCH):	/* relative offset */
           COPY_SHORT (&offset, pc);
           pc -= offset;
           break;
-        case F_BRANCH_NE:
+        CASE (F_BRANCH_NE):
           f_ne ();
           if ((sp--)->u.number)
             {
@@ -921,7 +1096,7 @@ void eval_instruction (const char *p) {
           else
             pc += 2;
           break;
-        case F_BRANCH_GE:
+        CASE (F_BRANCH_GE):
           f_ge ();
           if ((sp--)->u.number)
             {
@@ -931,7 +1106,7 @@ void eval_instruction (const char *p) {
           else
             pc += 2;
           break;
-        case F_BRANCH_LE:
+        CASE (F_BRANCH_LE):
           f_le ();
           if ((sp--)->u.number)
             {
@@ -941,7 +1116,7 @@ void eval_instruction (const char *p) {
           else
             pc += 2;
           break;
-        case F_BRANCH_EQ:
+        CASE (F_BRANCH_EQ):
           f_eq ();
           if ((sp--)->u.number)
             {
@@ -951,7 +1126,7 @@ void eval_instruction (const char *p) {
           else
             pc += 2;
           break;
-        case F_BBRANCH_LT:
+        CASE (F_BBRANCH_LT):
           f_lt ();
           if ((sp--)->u.number)
             {
@@ -961,7 +1136,7 @@ void eval_instruction (const char *p) {
           else
             pc += 2;
           break;
-        case F_BRANCH_WHEN_ZERO:	/* relative offset */
+        CASE (F_BRANCH_WHEN_ZERO):	/* relative offset */
           if (sp->type == T_NUMBER)
             {
               if (!((sp--)->u.number))
@@ -975,7 +1150,23 @@ void eval_instruction (const char *p) {
             pop_stack ();
           pc += 2;		/* skip over the offset */
           break;
-        case F_BRANCH_WHEN_NON_ZERO:	/* relative offset */
+        CASE (F_GLOBAL_BRANCH_WHEN_ZERO):	/* superinstruction: global, branch_when_zero */
+          {
+            svalue_t *s;
+
+            s = find_value ((int)(EXTRACT_UCHAR (pc++) + variable_index_offset));
+            if ((s->type == T_OBJECT) && (s->u.ob->flags & O_DESTRUCTED))
+              assign_svalue (s, &const0);
+            if (s->type == T_NUMBER && !s->u.number)
+              {
+                COPY_SHORT (&offset, pc);
+                pc += offset;
+              }
+            else
+              pc += 2;
+            break;
+          }
+        CASE (F_BRANCH_WHEN_NON_ZERO):	/* relative offset */
           if (sp->type == T_NUMBER)
             {
               if (!((sp--)->u.number))
@@ -989,7 +1180,7 @@ void eval_instruction (const char *p) {
           COPY_SHORT (&offset, pc);
           pc += offset;
           break;
-        case F_BBRANCH_WHEN_ZERO:	/* relative backwards offset */
+        CASE (F_BBRANCH_WHEN_ZERO):	/* relative backwards offset */
           if (sp->type == T_NUMBER)
             {
               if (!((sp--)->u.number))
@@ -1003,7 +1194,7 @@ void eval_instruction (const char *p) {
             pop_stack ();
           pc += 2;
           break;
-        case F_BBRANCH_WHEN_NON_ZERO:	/* relative backwards offset */
+        CASE (F_BBRANCH_WHEN_NON_ZERO):	/* relative backwards offset */
           if (sp->type == T_NUMBER)
             {
               if (!((sp--)->u.number))
@@ -1017,7 +1208,7 @@ void eval_instruction (const char *p) {
           COPY_SHORT (&offset, pc);
           pc -= offset;
           break;
-        case F_LOR:
+        CASE (F_LOR):
           /* replaces F_DUP; F_BRANCH_WHEN_NON_ZERO; F_POP */
           if (sp->type == T_NUMBER)
             {
@@ -1031,7 +1222,7 @@ void eval_instruction (const char *p) {
           COPY_SHORT (&offset, pc);
           pc += offset;
           break;
-        case F_LAND:
+        CASE (F_LAND):
           /* replaces F_DUP; F_BRANCH_WHEN_ZERO; F_POP */
           if (sp->type == T_NUMBER)
             {
@@ -1047,7 +1238,7 @@ void eval_instruction (const char *p) {
             pop_stack ();
           pc += 2;
           break;
-        case F_LOOP_INCR:	/* this case must be just prior to
+        CASE (F_LOOP_INCR):	/* this case must be just prior to
                                  * F_LOOP_COND */
           {
             svalue_t *s;
@@ -1077,13 +1268,13 @@ void eval_instruction (const char *p) {
               do_loop_cond_number ();
             }
           break;
-        case F_LOOP_COND_LOCAL:
+        CASE (F_LOOP_COND_LOCAL):
           do_loop_cond_local ();
           break;
-        case F_LOOP_COND_NUMBER:
+        CASE (F_LOOP_COND_NUMBER):
           do_loop_cond_number ();
           break;
-        case F_TRANSFER_LOCAL:
+        CASE (F_TRANSFER_LOCAL):
           {
             svalue_t *s;
 
@@ -1101,9 +1292,9 @@ void eval_instruction (const char *p) {
             /* The optimizer has asserted this won't be used again.  Make
              * it look like a number to avoid double frees. */
             s->type = T_NUMBER;
-            break;
+            DISPATCH_NEXT;
           }
-        case F_LOCAL:
+        CASE (F_LOCAL):
           {
             svalue_t *s;
 
@@ -1123,12 +1314,28 @@ void eval_instruction (const char *p) {
               {
                 assign_svalue_no_free (++sp, s);
               }
-            break;
+            DISPATCH_NEXT;
           }
-        case F_LT:
+        CASE (F_LT):
           f_lt ();
-          break;
-        case F_ADD:
+          DISPATCH_NEXT;
+        CASE (F_ADD_LOCALS):	/* superinstruction: local, local, add */
+          {
+            svalue_t *s1 = fp + EXTRACT_UCHAR (pc++);
+            svalue_t *s2 = fp + EXTRACT_UCHAR (pc++);
+
+            if (s1->type == T_NUMBER && s2->type == T_NUMBER)
+              {
+                (++sp)->type = T_NUMBER;
+                sp->subtype = 0;
+                sp->u.number = s1->u.number + s2->u.number;
+                DISPATCH_NEXT;
+              }
+            push_local (s1);
+            push_local (s2);
+          }
+          FALLTHROUGH;
+        CASE (F_ADD):
           {
             switch (sp->type)
               {
@@ -1263,10 +1470,10 @@ void eval_instruction (const char *p) {
               default:
                 error ("*Bad type argument to +.  Had %s and %s.", type_name ((sp - 1)->type), type_name (sp->type));
               }
-            break;
+            DISPATCH_NEXT;
           }
-        case F_VOID_ADD_EQ:
-        case F_ADD_EQ:
+        CASE (F_VOID_ADD_EQ):
+        CASE (F_ADD_EQ):
           DEBUG_CHECK (sp->type != T_LVALUE, "non-lvalue argument to +=\n");
           lval = sp->u.lvalue;
           sp--;			/* points to the RHS */
@@ -1275,22 +1482,22 @@ void eval_instruction (const char *p) {
             case T_STRING:
               if (sp->type == T_STRING)
                 {
-                  SVALUE_STRING_JOIN (lval, sp, "f_add_eq: 1");
                   opt_trace (TT_EVAL|3, "f_add_eq: \"%s\"", sp->u.string);
+                  SVALUE_STRING_APPEND (lval, sp, "f_add_eq: 1");
                 }
               else if (sp->type == T_NUMBER)
                 {
                   char buff[30];
 
                   sprintf (buff, "%" PRId64, sp->u.number);
-                  EXTEND_SVALUE_STRING (lval, buff, "f_add_eq: 2");
+                  EXTEND_SVALUE_STRING_APPEND (lval, buff, "f_add_eq: 2");
                 }
               else if (sp->type == T_REAL)
                 {
                   char buff[40];
 
                   sprintf (buff, "%lf", sp->u.real);
-                  EXTEND_SVALUE_STRING (lval, buff, "f_add_eq: 2");
+                  EXTEND_SVALUE_STRING_APPEND (lval, buff, "f_add_eq: 2");
                 }
               else
                 {
@@ -1396,17 +1603,17 @@ void eval_instruction (const char *p) {
               sp--;
             }
           break;
-        case F_AND:
+        CASE (F_AND):
           f_and ();
           break;
-        case F_AND_EQ:
+        CASE (F_AND_EQ):
           f_and_eq ();
           break;
-        case F_FUNCTION_CONSTRUCTOR:
+        CASE (F_FUNCTION_CONSTRUCTOR):
           f_function_constructor ();
           break;
 
-        case F_FOREACH: /* start iteration of string/array/mapping svalue */
+        CASE (F_FOREACH): /* start iteration of string/array/mapping svalue */
           {
             int flags = EXTRACT_UCHAR (pc++);
 
@@ -1454,7 +1661,7 @@ void eval_instruction (const char *p) {
               sp->u.lvalue = fp + EXTRACT_UCHAR (pc++);
             break;
           }
-        case F_NEXT_FOREACH: /* assign next foreach lvalue(s) */
+        CASE (F_NEXT_FOREACH): /* assign next foreach lvalue(s) */
           if ((sp - 1)->type == T_LVALUE)
             {
               /* mapping
@@ -1543,8 +1750,8 @@ void eval_instruction (const char *p) {
                 }
             }
           pc += 2;
-          /* fallthrough */
-        case F_EXIT_FOREACH:
+          FALLTHROUGH;
+        CASE (F_EXIT_FOREACH):
           if ((sp - 1)->type == T_LVALUE)
             {
               /* mapping */
@@ -1563,7 +1770,7 @@ void eval_instruction (const char *p) {
             }
           break;
 
-        case F_EXPAND_VARARGS:
+        CASE (F_EXPAND_VARARGS):
           {
             svalue_t *s, *t;
             array_t *arr;
@@ -1617,7 +1824,7 @@ void eval_instruction (const char *p) {
             break;
           }
 
-        case F_NEW_CLASS:
+        CASE (F_NEW_CLASS):
           {
             array_t *cl;
 
@@ -1625,7 +1832,7 @@ void eval_instruction (const char *p) {
             push_refed_class (cl);
           }
           break;
-        case F_NEW_EMPTY_CLASS:
+        CASE (F_NEW_EMPTY_CLASS):
           {
             array_t *cl;
 
@@ -1633,7 +1840,7 @@ void eval_instruction (const char *p) {
             push_refed_class (cl);
           }
           break;
-        case F_AGGREGATE:
+        CASE (F_AGGREGATE):
           {
             array_t *v;
 
@@ -1650,7 +1857,7 @@ void eval_instruction (const char *p) {
             sp->u.arr = v;
           }
           break;
-        case F_AGGREGATE_ASSOC:
+        CASE (F_AGGREGATE_ASSOC):
           {
             mapping_t *m;
 
@@ -1663,7 +1870,7 @@ void eval_instruction (const char *p) {
             sp->u.map = m;
             break;
           }
-        case F_ASSIGN:
+        CASE (F_ASSIGN):
           switch (sp->u.lvalue->type)
             {
             case T_LVALUE_BYTE:
@@ -1693,7 +1900,7 @@ void eval_instruction (const char *p) {
           sp--;			/* ignore lvalue */
           /* rvalue is already in the correct place */
           break;
-        case F_VOID_ASSIGN_LOCAL:
+        CASE (F_VOID_ASSIGN_LOCAL):
           if (sp->type != T_INVALID)
             {
               lval = fp + EXTRACT_UCHAR (pc++);
@@ -1705,8 +1912,8 @@ void eval_instruction (const char *p) {
               sp--;
               pc++;
             }
-          break;
-        case F_VOID_ASSIGN:
+          DISPATCH_NEXT;
+        CASE (F_VOID_ASSIGN):
           lval = (sp--)->u.lvalue;
           if (sp->type != T_INVALID)
             {
@@ -1744,7 +1951,7 @@ void eval_instruction (const char *p) {
           else
             sp--;
           break;
-        case F_CALL_FUNCTION_BY_ADDRESS:
+        CASE (F_CALL_FUNCTION_BY_ADDRESS):
           {
             compiler_function_t *funp;
             const char* name;
@@ -1782,7 +1989,7 @@ void eval_instruction (const char *p) {
             opt_trace (TT_EVAL, "call_function_by_address \"%s\": offset %+d", name, funp->address);
           }
           break;
-        case F_CALL_INHERITED:
+        CASE (F_CALL_INHERITED):
           {
             inherit_t *ip = current_prog->inherit + EXTRACT_UCHAR (pc++);
             program_t *temp_prog = ip->prog;
@@ -1807,19 +2014,19 @@ void eval_instruction (const char *p) {
             opt_trace (TT_EVAL, "call_inherited \"%s\": offset %+d", funp->name, funp->address);
           }
           break;
-        case F_COMPL:
+        CASE (F_COMPL):
           if (sp->type != T_NUMBER)
             error ("*Bad argument to ~");
           sp->u.number = ~sp->u.number;
           sp->subtype = 0;
           break;
-        case F_CONST0:
+        CASE (F_CONST0):
           push_number (0);
-          break;
-        case F_CONST1:
+          DISPATCH_NEXT;
+        CASE (F_CONST1):
           push_number (1);
-          break;
-        case F_PRE_DEC:
+          DISPATCH_NEXT;
+        CASE (F_PRE_DEC):
           DEBUG_CHECK (sp->type != T_LVALUE, "non-lvalue argument to --\n");
           lval = sp->u.lvalue;
           switch (lval->type)
@@ -1844,7 +2051,7 @@ void eval_instruction (const char *p) {
               error ("Decrement (--) on non-numeric argument");
             }
           break;
-        case F_DEC:
+        CASE (F_DEC):
           DEBUG_CHECK (sp->type != T_LVALUE, "non-lvalue argument to --\n");
           lval = (sp--)->u.lvalue;
           switch (lval->type)
@@ -1864,7 +2071,7 @@ void eval_instruction (const char *p) {
               error ("Decrement (--) on non-numeric argument");
             }
           break;
-        case F_DIVIDE:
+        CASE (F_DIVIDE):
           {
             switch ((sp - 1)->type | sp->type)
               {
@@ -1913,19 +2120,19 @@ void eval_instruction (const char *p) {
               }
           }
           break;
-        case F_DIV_EQ:
+        CASE (F_DIV_EQ):
           f_div_eq ();
           break;
-        case F_EQ:
+        CASE (F_EQ):
           f_eq ();
-          break;
-        case F_GE:
+          DISPATCH_NEXT;
+        CASE (F_GE):
           f_ge ();
-          break;
-        case F_GT:
+          DISPATCH_NEXT;
+        CASE (F_GT):
           f_gt ();
-          break;
-        case F_GLOBAL:
+          DISPATCH_NEXT;
+        CASE (F_GLOBAL):
           {
             svalue_t *s;
 
@@ -1944,9 +2151,9 @@ void eval_instruction (const char *p) {
               {
                 assign_svalue_no_free (++sp, s);
               }
-            break;
+            DISPATCH_NEXT;
           }
-        case F_PRE_INC:
+        CASE (F_PRE_INC):
           DEBUG_CHECK (sp->type != T_LVALUE, "non-lvalue argument to ++\n");
           lval = sp->u.lvalue;
           switch (lval->type)
@@ -1971,7 +2178,7 @@ void eval_instruction (const char *p) {
               error ("Increment (++) on non-numeric argument.");
             }
           break;
-        case F_MEMBER:
+        CASE (F_MEMBER):
           {
             array_t *arr;
 
@@ -1997,7 +2204,7 @@ void eval_instruction (const char *p) {
               }
             break;
           }
-        case F_MEMBER_LVALUE:
+        CASE (F_MEMBER_LVALUE):
           {
             array_t *arr;
 
@@ -2012,7 +2219,7 @@ void eval_instruction (const char *p) {
             free_class (arr);
             break;
           }
-        case F_INDEX:
+        CASE (F_INDEX):
           switch (sp->type)
             {
             case T_MAPPING:
@@ -2087,7 +2294,7 @@ void eval_instruction (const char *p) {
               sp->u.number = 0;
             }
           break;
-        case F_RINDEX:
+        CASE (F_RINDEX):
           switch (sp->type)
             {
             case T_BUFFER:
@@ -2152,7 +2359,7 @@ void eval_instruction (const char *p) {
             }
           break;
 #ifdef F_JUMP_WHEN_ZERO
-        case F_JUMP_WHEN_ZERO:
+        CASE (F_JUMP_WHEN_ZERO):
           if ((i = (sp->type == T_NUMBER)) && sp->u.number == 0)
             {
               COPY_SHORT (&offset, pc);
@@ -2174,21 +2381,21 @@ void eval_instruction (const char *p) {
           break;
 #endif
 #ifdef F_JUMP
-        case F_JUMP:
+        CASE (F_JUMP):
           COPY_SHORT (&offset, pc);
           pc = current_prog->program + offset; // F_JUMP
           break;
 #endif
-        case F_LE:
+        CASE (F_LE):
           f_le ();
-          break;
-        case F_LSH:
+          DISPATCH_NEXT;
+        CASE (F_LSH):
           f_lsh ();
           break;
-        case F_LSH_EQ:
+        CASE (F_LSH_EQ):
           f_lsh_eq ();
           break;
-        case F_MOD:
+        CASE (F_MOD):
           {
             CHECK_TYPES (sp - 1, T_NUMBER, 1, instruction);
             CHECK_TYPES (sp, T_NUMBER, 2, instruction);
@@ -2197,10 +2404,10 @@ void eval_instruction (const char *p) {
             sp->u.number %= (sp + 1)->u.number;
           }
           break;
-        case F_MOD_EQ:
+        CASE (F_MOD_EQ):
           f_mod_eq ();
           break;
-        case F_MULTIPLY:
+        CASE (F_MULTIPLY):
           {
             switch ((sp - 1)->type | sp->type)
               {
@@ -2251,13 +2458,13 @@ void eval_instruction (const char *p) {
               }
           }
           break;
-        case F_MULT_EQ:
+        CASE (F_MULT_EQ):
           f_mult_eq ();
           break;
-        case F_NE:
+        CASE (F_NE):
           f_ne ();
-          break;
-        case F_NEGATE:
+          DISPATCH_NEXT;
+        CASE (F_NEGATE):
           if (sp->type == T_NUMBER)
             {
               sp->subtype = 0;
@@ -2268,7 +2475,7 @@ void eval_instruction (const char *p) {
           else
             error ("*Bad argument to unary minus");
           break;
-        case F_NOT:
+        CASE (F_NOT):
           if (sp->type == T_NUMBER)
             {
               sp->subtype = 0;
@@ -2277,19 +2484,19 @@ void eval_instruction (const char *p) {
           else
             assign_svalue (sp, &const0);
           break;
-        case F_OR:
+        CASE (F_OR):
           f_or ();
           break;
-        case F_OR_EQ:
+        CASE (F_OR_EQ):
           f_or_eq ();
           break;
-        case F_PARSE_COMMAND:
+        CASE (F_PARSE_COMMAND):
           f_parse_command ();
           break;
-        case F_POP_VALUE:
+        CASE (F_POP_VALUE):
           pop_stack ();
-          break;
-        case F_POST_DEC:
+          DISPATCH_NEXT;
+        CASE (F_POST_DEC):
           DEBUG_CHECK (sp->type != T_LVALUE, "non-lvalue argument to --\n");
           lval = sp->u.lvalue;
           switch (lval->type)
@@ -2313,7 +2520,7 @@ void eval_instruction (const char *p) {
               error ("DEcrement (--) on non-numeric argument.");
             }
           break;
-        case F_POST_INC:
+        CASE (F_POST_INC):
           DEBUG_CHECK (sp->type != T_LVALUE, "non-lvalue argument to ++\n");
           lval = sp->u.lvalue;
           switch (lval->type)
@@ -2337,47 +2544,51 @@ void eval_instruction (const char *p) {
               error ("Increment (++) on non-numeric argument.");
             }
           break;
-        case F_GLOBAL_LVALUE:
+        CASE (F_GLOBAL_LVALUE):
           (++sp)->type = T_LVALUE;
           sp->u.lvalue = find_value ((int) (EXTRACT_UCHAR (pc++) + variable_index_offset));
-          break;
-        case F_INDEX_LVALUE:
+          DISPATCH_NEXT;
+        CASE (F_LOCAL_INDEX_LVALUE):	/* superinstruction: local_lvalue, index_lvalue */
+          (++sp)->type = T_LVALUE;
+          sp->u.lvalue = fp + EXTRACT_UCHAR (pc++);
+          FALLTHROUGH;
+        CASE (F_INDEX_LVALUE):
           push_indexed_lvalue (0);
           break;
-        case F_RINDEX_LVALUE:
+        CASE (F_RINDEX_LVALUE):
           push_indexed_lvalue (1);
           break;
-        case F_NN_RANGE_LVALUE:
+        CASE (F_NN_RANGE_LVALUE):
           push_lvalue_range (0x00);
           break;
-        case F_RN_RANGE_LVALUE:
+        CASE (F_RN_RANGE_LVALUE):
           push_lvalue_range (0x10);
           break;
-        case F_RR_RANGE_LVALUE:
+        CASE (F_RR_RANGE_LVALUE):
           push_lvalue_range (0x11);
           break;
-        case F_NR_RANGE_LVALUE:
+        CASE (F_NR_RANGE_LVALUE):
           push_lvalue_range (0x01);
           break;
-        case F_NN_RANGE:
+        CASE (F_NN_RANGE):
           f_range (0x00);
           break;
-        case F_RN_RANGE:
+        CASE (F_RN_RANGE):
           f_range (0x10);
           break;
-        case F_NR_RANGE:
+        CASE (F_NR_RANGE):
           f_range (0x01);
           break;
-        case F_RR_RANGE:
+        CASE (F_RR_RANGE):
           f_range (0x11);
           break;
-        case F_NE_RANGE:
+        CASE (F_NE_RANGE):
           f_extract_range (0);
           break;
-        case F_RE_RANGE:
+        CASE (F_RE_RANGE):
           f_extract_range (1);
           break;
-        case F_RETURN_ZERO:
+        CASE (F_RETURN_ZERO):
           {
             /*
              * Deallocate frame and return.
@@ -2389,11 +2600,14 @@ void eval_instruction (const char *p) {
             pop_control_stack ();
             /* The control stack was popped just before */
             if (csp[1].framekind & FRAME_EXTERNAL)
-              return;
+              {
+                eval_cost -= ticks;
+                return;
+              }
             break;
           }
           break;
-        case F_RETURN:
+        CASE (F_RETURN):
           {
             svalue_t sv;
 
@@ -2412,28 +2626,57 @@ void eval_instruction (const char *p) {
             pop_control_stack ();
             /* The control stack was popped just before */
             if (csp[1].framekind & FRAME_EXTERNAL)
-              return;
+              {
+                eval_cost -= ticks;
+                return;
+              }
+            break;
+          }
+        CASE (F_RETURN_LOCAL):	/* superinstruction: local, return */
+          {
+            svalue_t sv, *s;
+
+            s = fp + EXTRACT_UCHAR (pc++);
+            if ((s->type == T_OBJECT) && (s->u.ob->flags & O_DESTRUCTED))
+              sv = const0;
+            else
+              {
+                /* the frame is going away, so the value can be moved out */
+                sv = *s;
+                s->type = T_NUMBER;
+              }
+            pop_n_elems (csp->num_local_variables);
+            sp++;
+            DEBUG_CHECK (sp != fp, "Bad stack at F_RETURN_LOCAL\n");
+            *sp = sv;
+            pop_control_stack ();
+            /* The control stack was popped just before */
+            if (csp[1].framekind & FRAME_EXTERNAL)
+              {
+                eval_cost -= ticks;
+                return;
+              }
             break;
           }
-        case F_RSH:
+        CASE (F_RSH):
           f_rsh ();
           break;
-        case F_RSH_EQ:
+        CASE (F_RSH_EQ):
           f_rsh_eq ();
           break;
-        case F_SSCANF:
+        CASE (F_SSCANF):
           f_sscanf ();
           break;
-        case F_STRING:
+        CASE (F_STRING):
           LOAD_SHORT (offset, pc);
           DEBUG_CHECK1 (offset >= current_prog->num_strings, "string %d out of range in F_STRING!\n", offset);
           push_shared_string (current_prog->strings[offset]);
-          break;
-        case F_SHORT_STRING:
+          DISPATCH_NEXT;
+        CASE (F_SHORT_STRING):
           DEBUG_CHECK1 (EXTRACT_UCHAR (pc) >= current_prog->num_strings, "string %d out of range in F_STRING!\n", EXTRACT_UCHAR (pc));
           push_shared_string (current_prog->strings[EXTRACT_UCHAR (pc++)]);
-          break;
-        case F_SUBTRACT:
+          DISPATCH_NEXT;
+        CASE (F_SUBTRACT):
           {
             i = (sp--)->type;
             switch (i | sp->type)
@@ -2476,10 +2719,10 @@ void eval_instruction (const char *p) {
               }
             break;
           }
-        case F_SUB_EQ:
+        CASE (F_SUB_EQ):
           f_sub_eq ();
           break;
-        case F_SIMUL_EFUN:
+        CASE (F_SIMUL_EFUN):
           {
             unsigned short index;
             int num_args;
@@ -2490,16 +2733,16 @@ void eval_instruction (const char *p) {
             call_simul_efun (index, num_args);
           }
           break;
-        case F_SWITCH:
+        CASE (F_SWITCH):
           f_switch ();
           break;
-        case F_XOR:
+        CASE (F_XOR):
           f_xor ();
           break;
-        case F_XOR_EQ:
+        CASE (F_XOR_EQ):
           f_xor_eq ();
           break;
-        case F_CATCH:
+        CASE (F_CATCH):
           {
             /*
              * Compute address of next instruction after the CATCH
@@ -2514,16 +2757,17 @@ void eval_instruction (const char *p) {
             pc = current_prog->program + offset; // F_CATCH
             break;
           }
-        case F_END_CATCH:
+        CASE (F_END_CATCH):
           {
             free_svalue (&catch_value, "F_END_CATCH");
             catch_value = const0;
             /* We come here when no longjmp() was executed */
             pop_control_stack ();
             push_number (0);
+            eval_cost -= ticks;
             return;		/* return to do_catch */
           }
-        case F_TIME_EXPRESSION:
+        CASE (F_TIME_EXPRESSION):
           {
             struct timeval tv;
 
@@ -2532,7 +2776,7 @@ void eval_instruction (const char *p) {
             push_number (tv.tv_usec);
             break;
           }
-        case F_END_TIME_EXPRESSION:
+        CASE (F_END_TIME_EXPRESSION):
           {
             struct timeval tv;
             long usec;
@@ -2545,25 +2789,25 @@ void eval_instruction (const char *p) {
           }
 #define Instruction (instruction + ONEARG_MAX)
 #define CALL_THE_EFUN(i) (*efun_table[i - BASE + ONEARG_MAX])() 
-        case F_EFUN0:
+        CASE (F_EFUN0):
           st_num_arg = 0;
           instruction = EXTRACT_UCHAR (pc++);
           CALL_THE_EFUN(instruction);
           continue;
-        case F_EFUN1:
+        CASE (F_EFUN1):
           st_num_arg = 1;
           instruction = EXTRACT_UCHAR (pc++);
           CHECK_TYPES (sp, instrs2[instruction].type[0], 1, Instruction);
           CALL_THE_EFUN(instruction);
           continue;
-        case F_EFUN2:
+        CASE (F_EFUN2):
           st_num_arg = 2;
           instruction = EXTRACT_UCHAR (pc++);
           CHECK_TYPES (sp - 1, instrs2[instruction].type[0], 1, Instruction);
           CHECK_TYPES (sp, instrs2[instruction].type[1], 2, Instruction);
           CALL_THE_EFUN(instruction);
           continue;
-        case F_EFUN3:
+        CASE (F_EFUN3):
           st_num_arg = 3;
           instruction = EXTRACT_UCHAR (pc++);
           CHECK_TYPES (sp - 2, instrs2[instruction].type[0], 1, Instruction);
@@ -2571,7 +2815,7 @@ void eval_instruction (const char *p) {
           CHECK_TYPES (sp, instrs2[instruction].type[2], 3, Instruction);
           CALL_THE_EFUN(instruction);
           continue;
-        case F_EFUNV:
+        CASE (F_EFUNV):
           {
             int num;
             st_num_arg = EXTRACT_UCHAR (pc++) + num_varargs;
@@ -2585,7 +2829,7 @@ void eval_instruction (const char *p) {
             CALL_THE_EFUN(instruction);
             continue;
           }
-        default:
+        CASE_DEFAULT:
           /* optimized 1 arg efun */
           st_num_arg = 1;
           CHECK_TYPES (sp, instrs[instruction].type[0], 1, instruction);
@@ -2595,6 +2839,9 @@ void eval_instruction (const char *p) {
       DEBUG_CHECK1 (sp < fp + csp->num_local_variables - 1, "Bad stack after evaluation. Instruction %d\n", instruction);
     }				/* while (1) */
 }
+#ifdef COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
 
 void call_efun(int instruction) {
   (*efun_table[instruction - BASE]) ();
@@ -117,6 +117,29 @@ typedef struct {
         (x)->u.string = ssj_res; \
         } while(0)
 
+/* string += string; leaves room to append again if the lvalue holds the only reference */
+#define SVALUE_STRING_APPEND(x, y, z) do {\
+        if ((x)->subtype == STRING_MALLOC && MSTR_REF((x)->u.string) == 1) { \
+            size_t ssa_r = MSTR_SIZE((x)->u.string); \
+            size_t ssa_n = SVALUE_STRLEN(y); \
+            (x)->u.string = grow_string((x)->u.string, ssa_r + ssa_n); \
+            memcpy((x)->u.string + ssa_r, (y)->u.string, ssa_n + 1); \
+            free_string_svalue(y); \
+        } else \
+            SVALUE_STRING_JOIN(x, y, z); \
+        } while(0)
+
+/* string += C string, as above */
+#define EXTEND_SVALUE_STRING_APPEND(x, y, z) do {\
+        if ((x)->subtype == STRING_MALLOC && MSTR_REF((x)->u.string) == 1) { \
+            size_t esa_r = MSTR_SIZE((x)->u.string); \
+            size_t esa_n = strlen(y); \
+            (x)->u.string = grow_string((x)->u.string, esa_r + esa_n); \
+            memcpy((x)->u.string + esa_r, (y), esa_n + 1); \
+        } else \
+            EXTEND_SVALUE_STRING(x, y, z); \
+        } while(0)
+
 #define STACK_CHECK(n)		do {\
         if (sp + n >= end_of_stack) \
           { set_error_state(ES_STACK_FULL); error("***Stack overflow!"); } \
@@ -213,6 +236,10 @@ void eval_instruction(const char *p);
 void call_function (program_t *progp, int runtime_index, int num_args, svalue_t *ret_value);
 
 void call_efun(int);
+#ifdef OPCODE_PAIR_PROFILE
+void print_opcode_pairs (outbuffer_t *, int);
+void clear_opcode_pairs (void);
+#endif
 void process_efun_callback(int, function_to_call_t *, int);
 svalue_t *call_efun_callback(function_to_call_t *, int);
 #ifndef NO_SHADOWS
@@ -0,0 +1,495 @@
+#ifdef	HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+/*  precompile.c
+
+    Ahead-of-time compiler for the mudlib.  Compiles the objects found under
+    the given paths (the whole mudlib by default) to saved binaries in
+    __SAVE_BINARIES_DIR__, so that the driver loads binaries instead of
+    compiling on the first load_object() of every object.
+
+    The compiler is not thread-safe, so the work is spread over a pool of
+    worker processes.  Each worker takes the next file from a counter shared
+    by all of them, and reports what it did in a shared result table that
+    the parent summarizes when all workers are done.
+
+    Rebuilds are incremental: a file whose binary load_binary() accepts is
+    not compiled again.  load_binary() checks the binary against the source,
+    the include files recorded by save_binary(), and the sources and binaries
+    of inherited programs, so touching a header or a base class recompiles
+    exactly the programs that depend on it.
+*/
+
+#include <locale.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SUPPRESS_COMPILER_INLINES
+#include "std.h"
+#include "rc.h"
+#include "main.h"
+#include "simul_efun.h"
+#include "lpc/object.h"
+#include "lpc/otable.h"
+#include "lpc/program/binaries.h"
+#include "lpc/include/runtime_config.h"
+
+enum {
+  PRECOMPILE_PENDING,		/* not done, or the worker died on it */
+  PRECOMPILE_COMPILED,
+  PRECOMPILE_UP_TO_DATE,
+  PRECOMPILE_FAILED
+};
+
+typedef struct {
+  int status;			/* set once, see set_status() */
+  int lines;			/* lines compiled, includes counted */
+  double ms;			/* compile time, without inherited programs */
+} precompile_result_t;
+
+typedef struct {
+  int next_file;		/* next file for a worker to take */
+  precompile_result_t results[1];
+} precompile_shared_t;
+
+static char **files = NULL;	/* sorted mudlib file names, without leading '/' */
+static int num_files = 0, max_files = 0;
+static precompile_shared_t *shared = NULL;
+static const char *binaries_dir = NULL;
+
+static int num_jobs = 0;
+static int num_hotspots = 10;
+static int verbose = 0;
+
+static double elapsed_ms (const struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (double) (now.tv_sec - start->tv_sec) * 1000.0 + (double) (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static void add_file (const char *name) {
+  if (num_files == max_files)
+    {
+      max_files = max_files ? max_files * 2 : 256;
+      files = RESIZE (files, max_files, char *, TAG_TEMPORARY, "add_file");
+    }
+  files[num_files++] = alloc_cstring (name, "add_file");
+}
+
+/**
+ * Collect the .c files under a mudlib directory.  Hidden directories and
+ * the binaries directory are skipped.
+ */
+static void walk_dir (const char *dir) {
+  DIR *dirp;
+  struct dirent *de;
+  struct stat st;
+  char path[PATH_MAX];
+  size_t len;
+
+  if (!(dirp = opendir (*dir ? dir : ".")))
+    {
+      debug_perror ("opendir", dir);
+      return;
+    }
+  while ((de = readdir (dirp)))
+    {
+      if (de->d_name[0] == '.')
+        continue;
+      if ((size_t) snprintf (path, sizeof (path), "%s%s%s", dir, *dir ? "/" : "", de->d_name) >= sizeof (path))
+        continue;
+      if (stat (path, &st) == -1)
+        continue;
+      if (S_ISDIR (st.st_mode))
+        {
+          if (binaries_dir && strcmp (path, binaries_dir) == 0)
+            continue;
+          walk_dir (path);
+        }
+      else if (S_ISREG (st.st_mode) && (len = strlen (path)) > 2 && strcmp (path + len - 2, ".c") == 0)
+        add_file (path);
+    }
+  closedir (dirp);
+}
+
+/**
+ * Record what became of a file.  A file can be done by two workers at once,
+ * one taking it from the counter and another one compiling it as an inherited
+ * program; the first result stays, so a binary that one worker compiled is not
+ * reported up to date because the other one loaded it.
+ * @returns Non-zero if this result was recorded.
+ */
+static int set_status (precompile_result_t *res, int status) {
+  int pending = PRECOMPILE_PENDING;
+
+  return __atomic_compare_exchange_n (&res->status, &pending, status, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static int compare_files (const void *a, const void *b) {
+  return strcmp (*(char *const *) a, *(char *const *) b);
+}
+
+/* Find the result slot of a file, if it is one we were asked to compile. */
+static precompile_result_t *find_result (const char *real_name) {
+  char **found = bsearch (&real_name, files, num_files, sizeof (char *), compare_files);
+
+  return found ? &shared->results[found - files] : NULL;
+}
+
+/**
+ * Load a program from its binary, or compile it (which saves the binary),
+ * and put it in an object so that programs inheriting it can be compiled.
+ * Unlike load_object(), no LPC code is run: the object is never created.
+ * @param name The object name, without leading '/' and ".c".
+ * @param depth The length of the inherit chain so far.
+ * @returns The object holding the program.  Errors are raised with error().
+ */
+static object_t *precompile_object (const char *name, int depth) {
+  char real_name[PATH_MAX], inherit_name[MAX_OBJECT_NAME_SIZE];
+  struct timespec start;
+  precompile_result_t *res;
+  program_t *prog;
+  object_t *ob;
+  double ms = 0;
+  int fd, status, lines = 0;
+
+  if ((ob = lookup_object_hash (name)))
+    return ob;
+  if (depth > CONFIG_INT (__INHERIT_CHAIN_SIZE__))
+    error ("*Inherit chain too deep: > %d when trying to load '%s'.", CONFIG_INT (__INHERIT_CHAIN_SIZE__), name);
+  snprintf (real_name, sizeof (real_name), "%s.c", name);
+  res = find_result (real_name);
+
+  /* an inherited program that isn't loaded yet stops both the loader and
+   * the compiler; load it and start over */
+  for (;;)
+    {
+      status = PRECOMPILE_UP_TO_DATE;
+      if (!(prog = load_binary (real_name)) && !inherit_file)
+        {
+          if ((fd = FILE_OPEN (real_name, O_RDONLY)) == -1)
+            error ("*Could not read the file '/%s'.", real_name);
+          clock_gettime (CLOCK_MONOTONIC, &start);
+          prog = compile_file (fd, real_name, NULL);
+          ms += elapsed_ms (&start);
+          FILE_CLOSE (fd);
+          lines = total_lines;
+          total_lines = 0;
+          status = PRECOMPILE_COMPILED;
+        }
+      if (!inherit_file)
+        break;
+
+      if (!strip_name (inherit_file, inherit_name, sizeof (inherit_name)))
+        strcpy (inherit_name, inherit_file);
+      FREE (inherit_file);
+      inherit_file = 0;
+      if (prog)
+        free_prog (prog, 1);
+      if (strcmp (inherit_name, name) == 0)
+        error ("*Illegal to inherit self.");
+      precompile_object (inherit_name, depth + 1);
+    }
+
+  if (num_parse_error > 0 || !prog)
+    {
+      if (prog)
+        free_prog (prog, 1);
+      error ("*Error in loading object '/%s':", name);
+    }
+
+  ob = get_empty_object (prog->num_variables_total);
+  ob->name = alloc_cstring (name, "precompile_object");
+  ob->prog = prog;
+  ob->next_all = obj_list;
+  obj_list = ob;
+  enter_object_hash (ob);
+
+  if (res && set_status (res, status))
+    {
+      res->ms = ms;
+      res->lines = lines;
+    }
+  if (verbose)
+    printf ("%s /%s%s\n", status == PRECOMPILE_COMPILED ? "compiled" : "up to date", real_name,
+            res ? "" : " (inherited)");
+  return ob;
+}
+
+static void precompile_file (int i) {
+  error_context_t econ;
+  char name[PATH_MAX];
+  size_t len = strlen (files[i]);
+
+  if (__atomic_load_n (&shared->results[i].status, __ATOMIC_RELAXED) != PRECOMPILE_PENDING)
+    return;			/* done already, as an inherited program */
+
+  memcpy (name, files[i], len - 2);	/* strip ".c" */
+  name[len - 2] = '\0';
+  save_context (&econ);
+  if (setjmp (econ.context))
+    {
+      restore_context (&econ);
+      set_status (&shared->results[i], PRECOMPILE_FAILED);
+      printf ("failed /%s\n", files[i]);
+    }
+  else
+    precompile_object (name, 0);
+  pop_context (&econ);
+}
+
+/**
+ * Programs are compiled against the simul_efuns, so their object is loaded
+ * first, like the driver does.  It's not created either.
+ */
+static int load_simul_efuns (void) {
+  error_context_t econ;
+  char name[PATH_MAX];
+  const char *file = CONFIG_STR (__SIMUL_EFUN_FILE__);
+  size_t len;
+
+  if (!file || !*file)
+    return 1;
+  if (!strip_name (file, name, sizeof (name)))
+    return 0;
+  if ((len = strlen (name)) > 2 && strcmp (name + len - 2, ".c") == 0)
+    name[len - 2] = '\0';
+
+  save_context (&econ);
+  if (setjmp (econ.context))
+    {
+      restore_context (&econ);
+      pop_context (&econ);
+      simul_efun_is_loading = 0;
+      return 0;
+    }
+  simul_efun_is_loading = 1;
+  set_simul_efun (precompile_object (name, 0));
+  simul_efun_is_loading = 0;
+  pop_context (&econ);
+  return 1;
+}
+
+static void run_worker (void) {
+  int i;
+
+  while ((i = __atomic_fetch_add (&shared->next_file, 1, __ATOMIC_RELAXED)) < num_files)
+    {
+      precompile_file (i);
+      fflush (stdout);
+    }
+}
+
+static int compare_hotspots (const void *a, const void *b) {
+  double x = shared->results[*(const int *) a].ms, y = shared->results[*(const int *) b].ms;
+
+  return (x < y) - (x > y);
+}
+
+static int report (double wall_ms) {
+  int i, n, compiled = 0, up_to_date = 0, failed = 0, lines = 0;
+  int *order;
+  double total_ms = 0;
+
+  for (i = 0; i < num_files; i++)
+    {
+      precompile_result_t *res = &shared->results[i];
+
+      switch (res->status)
+        {
+        case PRECOMPILE_COMPILED:
+          compiled++;
+          lines += res->lines;
+          total_ms += res->ms;
+          break;
+        case PRECOMPILE_UP_TO_DATE:
+          up_to_date++;
+          break;
+        case PRECOMPILE_PENDING:
+          printf ("crashed /%s\n", files[i]);
+          /* fall through */
+        default:
+          failed++;
+          break;
+        }
+    }
+  printf ("%d files: %d compiled, %d up to date, %d failed\n", num_files, compiled, up_to_date, failed);
+  printf ("compiled %d lines in %.1f ms (%.1f ms wall clock, %d jobs)\n", lines, total_ms, wall_ms, num_jobs);
+
+  if (compiled && num_hotspots > 0)
+    {
+      order = CALLOCATE (num_files, int, TAG_TEMPORARY, "report");
+      for (i = n = 0; i < num_files; i++)
+        if (shared->results[i].status == PRECOMPILE_COMPILED)
+          order[n++] = i;
+      qsort (order, n, sizeof (int), compare_hotspots);
+      printf ("slowest files:\n");
+      for (i = 0; i < n && i < num_hotspots; i++)
+        printf ("%10.2f ms %7d lines  /%s\n", shared->results[order[i]].ms,
+                shared->results[order[i]].lines, files[order[i]]);
+      FREE (order);
+    }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void usage (const char *prog) {
+  fprintf (stderr,
+           "usage: %s -f config-file [-j jobs] [-n hotspots] [-D macro[=definition]] [-d debug-level] [-t trace-flags] [-v] [path ...]\n"
+           "Compiles the objects under each mudlib path (default: the whole mudlib) to saved binaries.\n",
+           prog);
+  exit (EXIT_FAILURE);
+}
+
+static void parse_command_line (int argc, char **argv) {
+  int c;
+
+  while ((c = getopt (argc, argv, "D:d:f:j:n:t:v")) != -1)
+    {
+      switch (c)
+        {
+        case 'D':
+          {
+            lpc_predef_t *def;
+
+            def = (lpc_predef_t *) xcalloc (1, sizeof (lpc_predef_t));
+            def->expression = optarg;
+            def->next = lpc_predefs;
+            lpc_predefs = def;
+            break;
+          }
+        case 'd':
+          MAIN_OPTION(debug_level) = atoi (optarg);
+          break;
+        case 'f':
+          if (!realpath (optarg, MAIN_OPTION(config_file)))
+            {
+              debug_perror ("configuration file", optarg);
+              exit (EXIT_FAILURE);
+            }
+          break;
+        case 'j':
+          num_jobs = atoi (optarg);
+          break;
+        case 'n':
+          num_hotspots = atoi (optarg);
+          break;
+        case 't':
+          MAIN_OPTION(trace_flags) = strtoul (optarg, NULL, 0);
+          break;
+        case 'v':
+          verbose = 1;
+          break;
+        default:
+          usage (argv[0]);
+        }
+    }
+  if (!*MAIN_OPTION(config_file))
+    usage (argv[0]);
+}
+
+int main (int argc, char **argv) {
+  struct timespec start;
+  struct stat st;
+  pid_t *workers;
+  int i, status;
+
+  setlocale (LC_ALL, PLATFORM_UTF8_LOCALE);
+  init_stem (0, 0, NULL);
+  parse_command_line (argc, argv);
+  init_config (MAIN_OPTION(config_file));
+
+  if (!CONFIG_STR (__SAVE_BINARIES_DIR__))
+    {
+      fprintf (stderr, "%s: no binaries directory (__SAVE_BINARIES_DIR__) configured.\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  if (-1 == CHDIR (CONFIG_STR (__MUD_LIB_DIR__)))
+    {
+      debug_perror ("chdir", CONFIG_STR (__MUD_LIB_DIR__));
+      return EXIT_FAILURE;
+    }
+  binaries_dir = CONFIG_STR (__SAVE_BINARIES_DIR__);
+  while (*binaries_dir == '/')
+    binaries_dir++;
+
+  /* collect and sort the files to compile */
+  if (optind == argc)
+    walk_dir ("");
+  for (i = optind; i < argc; i++)
+    {
+      const char *path = argv[i];
+
+      while (*path == '/')
+        path++;
+      if (stat (*path ? path : ".", &st) == -1)
+        debug_perror ("stat", argv[i]);
+      else if (S_ISDIR (st.st_mode))
+        walk_dir (path);
+      else
+        add_file (path);
+    }
+  if (!num_files)
+    {
+      fprintf (stderr, "%s: no files to compile.\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  qsort (files, num_files, sizeof (char *), compare_files);
+
+  init_strings (CONFIG_INT (__SHARED_STRING_HASH_TABLE_SIZE__), CONFIG_INT (__MAX_STRING_LENGTH__));
+  init_lpc_compiler (CONFIG_INT (__MAX_LOCAL_VARIABLES__), CONFIG_STR (__INCLUDE_DIRS__));
+  setup_simulate ();
+  save_all_binaries = 1;
+
+  shared = mmap (NULL, sizeof (precompile_shared_t) + sizeof (precompile_result_t) * num_files,
+                 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED)
+    {
+      debug_perror ("mmap", "result table");
+      return EXIT_FAILURE;
+    }
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  if (!load_simul_efuns ())
+    {
+      fprintf (stderr, "%s: failed loading the simul_efun file.\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  if (num_jobs <= 0)
+    num_jobs = (int) sysconf (_SC_NPROCESSORS_ONLN);
+  if (num_jobs <= 0)
+    num_jobs = 1;
+  if (num_jobs > num_files)
+    num_jobs = num_files;
+
+  fflush (stdout);
+  fflush (stderr);
+  workers = CALLOCATE (num_jobs, pid_t, TAG_TEMPORARY, "main");
+  for (i = 0; i < num_jobs; i++)
+    {
+      if ((workers[i] = fork ()) == 0)
+        {
+          run_worker ();
+          fflush (stdout);
+          _exit (EXIT_SUCCESS);
+        }
+      if (workers[i] == -1)
+        {
+          debug_perror ("fork", NULL);
+          run_worker ();	/* do the rest ourselves */
+          break;
+        }
+    }
+  while (i-- > 0)
+    {
+      if (waitpid (workers[i], &status, 0) > 0 && !(WIFEXITED (status) && WEXITSTATUS (status) == 0))
+        fprintf (stderr, "%s: worker %d died unexpectedly.\n", argv[0], (int) workers[i]);
+    }
+  FREE (workers);
+
+  return report (elapsed_ms (&start));
+}
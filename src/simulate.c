@@ -23,10 +23,12 @@
 #include "lpc/include/origin.h"
 #include "lpc/include/runtime_config.h"
 #include "socket/socket_efuns.h"
+#include "efuns/async_file.h"
 #include "efuns/call_out.h"
 #include "efuns/ed.h"
 #include "efuns/file_utils.h"
 #include "efuns/replace_program.h"
+#include "efuns/sprintf.h"
 
 #include <assert.h>
 #include <sys/stat.h>
@@ -790,7 +792,7 @@ object_t* object_present (svalue_t * v, object_t * ob) {
       return 0;
     }
 
-  ret_ob = object_present2 (v->u.string, ob->contains);
+  ret_ob = object_present2 (v->u.string, ob);
 
   if (ret_ob)
     return ret_ob;
@@ -800,16 +802,26 @@ object_t* object_present (svalue_t * v, object_t * ob) {
 
   if (ob->super)
     {
-      push_svalue (v);
-      ret = apply (APPLY_ID, ob->super, 1, ORIGIN_DRIVER);
+      if (ob->super->ids)
+        {
+          char *id = findstring (v->u.string);
 
-      if (ob->super->flags & O_DESTRUCTED)
-        return 0;
+          if (id && object_has_id (ob->super, id))
+            return ob->super;
+        }
+      else
+        {
+          push_svalue (v);
+          ret = apply (APPLY_ID, ob->super, 1, ORIGIN_DRIVER);
 
-      if (!IS_ZERO (ret))
-        return ob->super;
+          if (ob->super->flags & O_DESTRUCTED)
+            return 0;
 
-      return object_present2 (v->u.string, ob->super->contains);
+          if (!IS_ZERO (ret))
+            return ob->super;
+        }
+
+      return object_present2 (v->u.string, ob->super);
     }
 
   return 0;
@@ -817,17 +829,22 @@ object_t* object_present (svalue_t * v, object_t * ob) {
 
 /**
  * Help function for object_present().
- * Looks for an object named 'str' in the inventory 'ob'.
+ * Looks for an object named 'str' in the inventory of 'env'.
  * An optional number following the object name indicates which one to find.
  * For example, "sword 2" finds the second sword in the inventory.
+ *
+ * Objects that gave their ids with set_ids() are matched without calling
+ * id() in them.  If all of the inventory did, only the id index of 'env'
+ * is looked at.
  * @param str The name of the object to find, possibly with a number suffix.
- * @param ob The inventory to search in.
+ * @param env The object whose inventory to search in.
  * @return The found object, or NULL if not found.
  */
-static object_t* object_present2 (char *str, object_t * ob) {
+static object_t* object_present2 (char *str, object_t * env) {
 
-  svalue_t *ret;
-  char *p;
+  svalue_t *ret, *name;
+  object_t *ob;
+  char *p, *id;
   size_t count = 0, length;
 
   if ((length = strlen (str)))
@@ -849,27 +866,58 @@ static object_t* object_present2 (char *str, object_t * ob) {
         }
     }
 
-  for (; ob; ob = ob->next_inv)
+  /* the id as a shared string, kept on the stack while id() is called */
+  p = new_string (length, "object_present2");
+  memcpy (p, str, length);
+  p[length] = 0;
+  push_malloced_string (p);
+  name = sp;
+  id = findstring (p);	/* NULL if no object has this id in its ids */
+
+  if (env->id_index && !env->id_index->others)
     {
-      p = new_string (length, "object_present2");
-      memcpy (p, str, length);
-      p[length] = 0;
+      id_entry_t *e;
 
-      push_malloced_string (p);
-      ret = apply (APPLY_ID, ob, 1, ORIGIN_DRIVER);
+      for (e = id ? find_id_chain (env, id) : 0; e; e = e->next)
+        if (e->id == id && count-- == 0)
+          {
+            pop_stack ();
+            return e->ob;
+          }
+      pop_stack ();
+      return 0;
+    }
 
-      if (ob->flags & O_DESTRUCTED)
-        return 0;
+  for (ob = env->contains; ob; ob = ob->next_inv)
+    {
+      if (ob->ids)
+        {
+          if (!id || !object_has_id (ob, id))
+            continue;
+        }
+      else
+        {
+          push_svalue (name);
+          ret = apply (APPLY_ID, ob, 1, ORIGIN_DRIVER);
 
-      if (IS_ZERO (ret))
-        continue;
+          if (ob->flags & O_DESTRUCTED)
+            {
+              pop_stack ();
+              return 0;
+            }
+
+          if (IS_ZERO (ret))
+            continue;
+        }
 
       if (count-- > 0)
         continue;
 
+      pop_stack ();
       return ob;
     }
 
+  pop_stack ();
   return 0;
 }
 
@@ -1042,6 +1090,7 @@ void destruct_object (object_t * ob) {
       */
       if (ob->super)
         {
+          remove_from_id_index (ob);
           if (ob->super->flags & O_ENABLE_COMMANDS)
             remove_sent (ob, ob->super);
 
@@ -1161,14 +1210,8 @@ void destruct_object (object_t * ob) {
    * that add_action to each other) will trigger ref count warnings. */
   if (ob->sent)
     {
-      sentence_t *s, *next;
       opt_trace (TT_EVAL|1, "freeing sentences for /%s", ob->name);
-      for (s = ob->sent; s; s = next)
-        {
-          next = s->next;
-          free_sentence (s);
-        }
-      ob->sent = NULL;
+      free_sentences (ob);
     }
 
   /* Clean up any input_to references pointing to this object.
@@ -1203,10 +1246,12 @@ void destruct_object (object_t * ob) {
   ob->super = 0;
   ob->next_inv = 0;
   ob->contains = 0;
+  free_id_index (ob);
   ob->next_all = obj_list_destruct;
   obj_list_destruct = ob;
 
   set_heart_beat (ob, 0);
+  remove_all_call_out (ob); /* cancel pending call_outs, including bound function pointers */
   ob->flags |= O_DESTRUCTED; /* mark as destructed */
 
   /* moved this here from destruct2() -- see comments in destruct2() */
@@ -1274,6 +1319,60 @@ void remove_destructed_objects () {
   obj_list_destruct = 0;
 }				/* remove_destructed_objects() */
 
+/*
+ * Broadcasts (say(), tell_room(), shout()) translate their message once into a
+ * shared message block, and every interactive recipient gets a reference to it.
+ * The block is only made for the first interactive recipient, so a message heard
+ * by NPCs alone is never translated.  catch_tell() may start another broadcast,
+ * so the broadcasts in progress form a stack.  An error handler on the value
+ * stack ends the broadcast if an error unwinds it.
+ */
+typedef struct broadcast_s {
+  message_block_t *block;	/* NULL until an interactive recipient is found */
+  struct broadcast_s *next;
+} broadcast_t;
+
+static broadcast_t *broadcasts = 0, *free_broadcasts = 0;
+
+static void end_broadcast (void) {
+  broadcast_t *b = broadcasts;
+
+  broadcasts = b->next;
+  if (b->block)
+    free_message_block (b->block);
+  b->next = free_broadcasts;
+  free_broadcasts = b;
+}
+
+static void begin_broadcast (void) {
+  broadcast_t *b;
+
+  if ((b = free_broadcasts))
+    free_broadcasts = b->next;
+  else
+    b = ALLOCATE (broadcast_t, TAG_INTERACTIVE, "begin_broadcast");
+  b->block = NULL;
+  b->next = broadcasts;
+  broadcasts = b;
+  (++sp)->type = T_ERROR_HANDLER;
+  sp->u.error_handler = end_broadcast;
+}
+
+/* tell_object() for a recipient of the broadcast in progress */
+static void tell_broadcast (object_t * ob, char *str) {
+#ifndef INTERACTIVE_CATCH_TELL
+  if (ob->interactive && !(ob->flags & O_DESTRUCTED) &&
+      ob != master_ob && ob != simul_efun_ob)
+    {
+      if (!broadcasts->block)
+        broadcasts->block = new_message_block (str);
+      add_message_block (ob, broadcasts->block, str);
+      return;
+    }
+#endif
+  tell_object (ob, str);
+}
+
 /*
  * say() efun - send a message to:
  *  all objects in the inventory of the source,
@@ -1305,7 +1404,7 @@ static void send_say (object_t * ob, char *text, array_t * avoid) {
   if (!valid)
     return;
 
-  tell_object (ob, text);
+  tell_broadcast (ob, text);
 }
 
 void say (svalue_t * v, array_t * avoid) {
@@ -1322,6 +1421,8 @@ void say (svalue_t * v, array_t * avoid) {
   else
     origin = current_object;
 
+  begin_broadcast ();
+
   /* To our surrounding object... */
   if ((ob = origin->super))
     {
@@ -1350,6 +1451,8 @@ void say (svalue_t * v, array_t * avoid) {
         }
     }
 
+  sp--;                         /* the error handler */
+  end_broadcast ();
   command_giver = save_command_giver;
 }
 
@@ -1388,6 +1491,7 @@ void tell_room (object_t * room, svalue_t * v, array_t * avoid) {
       return;
     }
 
+  begin_broadcast ();
   for (ob = room->contains; ob; ob = ob->next_inv)
     {
       if (!ob->interactive && !(ob->flags & O_LISTENER))
@@ -1415,11 +1519,13 @@ void tell_room (object_t * room, svalue_t * v, array_t * avoid) {
         }
       else
         {
-          tell_object (ob, buff);
+          tell_broadcast (ob, buff);
           if (ob->flags & O_DESTRUCTED)
             break;
         }
     }
+  sp--;                         /* the error handler */
+  end_broadcast ();
 }
 #endif
 
@@ -1428,12 +1534,15 @@ void shout_string (char *str) {
 
   check_legal_string (str);
 
+  begin_broadcast ();
   for (ob = obj_list; ob; ob = ob->next_all)
     {
       if (!(ob->flags & O_LISTENER) || (ob == command_giver) || !ob->super)
         continue;
-      tell_object (ob, str);
+      tell_broadcast (ob, str);
     }
+  sp--;                         /* the error handler */
+  end_broadcast ();
 }
 
 /**
@@ -1750,6 +1859,7 @@ void move_object (object_t * item, object_t * dest) {
 
   if (item->super)
     {
+      remove_from_id_index (item);
       if (item->flags & O_ENABLE_COMMANDS)
         remove_sent (item->super, item);
 
@@ -1779,6 +1889,7 @@ void move_object (object_t * item, object_t * dest) {
     {
       item->next_inv = dest->contains;
       dest->contains = item;
+      add_to_id_index (item);
     }
   else
     {
@@ -1866,7 +1977,7 @@ void move_object (object_t * item, object_t * dest) {
 
 int user_parser (char *buff) {
   char verb_buff[MAX_VERB_BUFF];
-  sentence_t *s;
+  sentence_t *s, *exact, *special;
   char *p;
   ptrdiff_t length;
   object_t *save_command_giver = command_giver;
@@ -1927,25 +2038,40 @@ int user_parser (char *buff) {
   save_illegal_sentence_action = illegal_sentence_action;
   illegal_sentence_action = 0;
 
-  for (s = save_command_giver->sent; s; s = s->next)
+  /*
+   * The sentences that can match are in two chains of the verb index: the
+   * one of user_verb, and the one of the V_NOSPACE, V_SHORT and "" verbs.
+   * Merge them by seq, so they're tried in the order of the sentence list.
+   */
+  exact = (user_verb != buff) ? find_verb_chain (save_command_giver, user_verb) : 0;
+  special = save_command_giver->verb_index ? save_command_giver->verb_index->special : 0;
+  for (;;)
     {
       svalue_t *ret;
 
-      /* Skip sentences from destructed objects (ref counting keeps memory valid) */
-      if (s->ob->flags & O_DESTRUCTED)
-        continue;
+      while (exact && exact->verb != user_verb)
+        exact = exact->next_verb;
+      /* note: if was add_action(blah, "") then accept it */
+      while (special && (special->flags & (V_NOSPACE | V_SHORT))
+             && strncmp (buff, special->verb, strlen (special->verb)) != 0)
+        special = special->next_verb;
 
-      if (s->flags & (V_NOSPACE | V_SHORT))
+      if (exact && (!special || exact->seq > special->seq))
         {
-          if (strncmp (buff, s->verb, strlen (s->verb)) != 0)
-            continue;
+          s = exact;
+          exact = exact->next_verb;
         }
-      else
+      else if (special)
         {
-          /* note: if was add_action(blah, "") then accept it */
-          if (s->verb[0] && (user_verb != s->verb))
-            continue;
+          s = special;
+          special = special->next_verb;
         }
+      else
+        break;
+
+      /* Skip sentences from destructed objects (ref counting keeps memory valid) */
+      if (s->ob->flags & O_DESTRUCTED)
+        continue;
 
       if (s->flags & V_NOSPACE)
         {
@@ -2122,8 +2248,7 @@ void add_action (svalue_t * str, char *cmd, int flag, int num_carry, svalue_t *c
     }
 
   /* This is ok; adding to the top of the list doesn't harm anything */
-  p->next = command_giver->sent;
-  command_giver->sent = p;
+  add_sentence (command_giver, p);
 }
 
 
@@ -2145,15 +2270,11 @@ int remove_action (char *act, char *verb) {
     {
       for (s = &ob->sent; *s; s = &((*s)->next))
         {
-          sentence_t *tmp;
-
           if (((*s)->ob == current_object) && (!((*s)->flags & V_FUNCTION))
               && !strcmp ((*s)->function.s, act)
               && !strcmp ((*s)->verb, verb))
             {
-              tmp = *s;
-              *s = tmp->next;
-              free_sentence (tmp);
+              remove_sentence (ob, s);
               illegal_sentence_action = 1;
               return 1;
             }
@@ -2171,13 +2292,9 @@ static void remove_sent (object_t * ob, object_t * user) {
 
   for (s = &user->sent; *s;)
     {
-      sentence_t *tmp;
-
       if ((*s)->ob == ob)
         {
-          tmp = *s;
-          *s = tmp->next;
-          free_sentence (tmp);
+          remove_sentence (user, s);
           illegal_sentence_action = 2;
         }
       else
@@ -2322,6 +2439,9 @@ void do_shutdown () {
       g_console_worker = NULL;
     }
 
+  /* finish queued async file writes before exiting */
+  async_file_shutdown (5000);
+
   if (g_console_queue)
     {
       async_queue_destroy(g_console_queue);
@@ -2541,6 +2661,8 @@ void tear_down_simulate() {
     }
   remove_destructed_objects(); // actually free destructed objects
   clear_apply_cache(); // clear shared strings referenced by apply cache
+  clear_regexp_cache(); // free compiled regular expressions
+  clear_sprintf_cache(); // release format strings referenced by the sprintf cache
 
   reset_interpreter ();   // clear stack machine
   if (total_num_prog_blocks)
@@ -11,7 +11,6 @@
 #include <assert.h>
 
 /* block_t only */
-#define NEXT(x)		(x)->next
 #define REFS(x)		(x)->refs
 #define BLOCK(x)	(((block_t *)(x)) - 1)	/* pointer arithmetic */
 
@@ -41,9 +40,10 @@
  * that is, if you want to avoid space leaks...
  *
  * Current overhead:
- *	sizeof(block_t) per string (string pointer, next pointer, and a short
- *  for refs). Strings are nearly all fairly short, so this is a significant
- *  overhead - there is also the 4 byte malloc overhead and the fact that
+ *	sizeof(block_t) per string (the 64-bit hash, a 32-bit length and a
+ *  32-bit reference count), plus a str_slot_t in the hash table that is at most 3/4 full.
+ *  Strings are nearly all fairly short, so this is a significant
+ *  overhead - there is also the malloc overhead and the fact that
  *  malloc generally allocates blocks which are a power of 2 (should write my
  *	own best-fit malloc specialised to strings); then again, GNU malloc
  *	is bug free...
@@ -69,83 +69,191 @@ int search_len = 0;
 int num_str_searches = 0;
 #endif
 
-#define StrHash(s) (whashstr((s), 20) & (htable_size_minus_one))
+/*
+ * The hash table is an array of slots addressed by open addressing with
+ * linear probing.  A slot holds the full 64-bit hash of its string and a
+ * pointer to the block.  An empty slot ends a probe sequence, a freed string
+ * leaves a tombstone (DELETED) behind that probing skips over.
+ *
+ * The table is resized incrementally: when it is more than 3/4 full
+ * (including tombstones) a new table is allocated and the old one is kept
+ * around.  New strings only go to the new table, and every insertion or
+ * removal moves some slots of the old table over, until it is empty and
+ * freed.  Lookups search both tables meanwhile.  At least REHASH_STEP slots
+ * are moved at a time, more if the new table is smaller than the old one, so
+ * that the old table is always empty before the new one gets crowded.  This avoids a long
+ * pause to rehash a table holding hundreds of thousands of strings.
+ */
+#define DELETED		((block_t *) 1)
+#define IS_LIVE(x)	((x)->block > DELETED)
+#define REHASH_STEP	8
+
+typedef struct {
+  str_slot_t *slots;
+  size_t size;			/* always a power of 2 */
+  size_t used;			/* number of strings */
+  size_t deleted;		/* number of tombstones */
+} str_table_t;
+
+static str_table_t table;	/* new strings are added here */
+static str_table_t old_table;	/* being rehashed into table, if slots != NULL */
+static size_t rehash_index;	/* next slot of old_table to move */
+static size_t rehash_rate;	/* slots of old_table moved at a time */
+static size_t min_table_size;
+static size_t max_string_length;
 
-#define hfindblock(s, h) sfindblock(s, h = StrHash(s))
-#define findblock(s) sfindblock(s, StrHash(s))
+static void dealloc_string (const char *str);
 
-static block_t *sfindblock (const char *s, int h);
+static void alloc_table (str_table_t *t, size_t size) {
 
-/*
- * hash table - list of pointers to heads of string chains.
- * Each string in chain has a pointer to the next string and a
- * reference count (char *, int) stored just before the start of the string.
- * HTABLE_SIZE is in config.h, and should be a prime, probably between
- * 1000 and 5000.
+  t->slots = CALLOCATE (size, str_slot_t, TAG_STR_TBL, "alloc_table");
+  memset (t->slots, 0, sizeof (str_slot_t) * size);
+  t->size = size;
+  t->used = 0;
+  t->deleted = 0;
+#ifdef STRING_STATS
+  overhead_bytes += sizeof (str_slot_t) * size;
+#endif
+}
+
+static void free_table (str_table_t *t) {
+
+#ifdef STRING_STATS
+  overhead_bytes -= sizeof (str_slot_t) * t->size;
+#endif
+  FREE (t->slots);
+  t->slots = NULL;
+  t->size = t->used = t->deleted = 0;
+}
+
+/**
+ * Put a block into a free slot of the table.
+ * The caller makes sure that it is not in the table yet and that the table
+ * has room for it.
  */
+static void insert_slot (str_table_t *t, uint64_t hash, block_t *b) {
+
+  size_t mask = t->size - 1;
+  size_t i = (size_t) hash & mask;
+
+  while (IS_LIVE (&t->slots[i]))
+    i = (i + 1) & mask;
+  if (t->slots[i].block == DELETED)
+    t->deleted--;
+  t->slots[i].hash = hash;
+  t->slots[i].block = b;
+  t->used++;
+}
 
-static block_t **base_table = (block_t **) 0;
-static size_t htable_size;
-static size_t htable_size_minus_one;
-static size_t max_string_length;
+/**
+ * Move up to \p n slots of the old table into the current table.
+ * The old table is freed when it has been emptied.
+ */
+static void rehash_step (size_t n) {
 
-static block_t *sfindblock (const char *s, int h);
-static void dealloc_string (const char *str);
-static block_t* alloc_new_string (const char *, int);
+  for (; n > 0 && rehash_index < old_table.size; n--, rehash_index++)
+    {
+      str_slot_t *slot = &old_table.slots[rehash_index];
+
+      if (IS_LIVE (slot))
+        {
+          insert_slot (&table, slot->hash, slot->block);
+          /* leave a tombstone, the probe sequences of other strings may
+           * still pass through here */
+          slot->block = DELETED;
+          old_table.used--;
+          old_table.deleted++;
+        }
+    }
+  if (rehash_index >= old_table.size || !old_table.used)
+    free_table (&old_table);
+}
 
 /**
- * @brief init_strings: Initialize the shared string table.
+ * Make room for \p n more strings in the current table.
+ * If the table is getting crowded, it becomes the old table and a fresh one
+ * is allocated, large enough that all strings of both tables take up at most
+ * half of it.  A table crowded with tombstones thus gets replaced by one of
+ * the same size or smaller.
  */
-void init_strings (size_t hash_size, size_t max_len) {
+static void reserve_slots (size_t n) {
 
-  size_t x;
+  str_table_t t;
+  size_t size, live;
 
-  /* ensure that htable size is a power of 2 */
-  for (htable_size = 1; htable_size < hash_size; htable_size *= 2)
-    ;
-  htable_size_minus_one = htable_size - 1;
-  base_table = CALLOCATE (htable_size, block_t *, TAG_STR_TBL, "init_strings");
-#ifdef STRING_STATS
-  overhead_bytes += (sizeof (block_t *) * htable_size);
-#endif
+  if (old_table.slots)
+    rehash_step (rehash_rate);
+  if ((table.used + table.deleted + n) * 4 <= table.size * 3)
+    return;
 
-  for (x = 0; x < htable_size; x++)
+  live = table.used + old_table.used + n;
+  for (size = min_table_size; size < live * 2; size *= 2)
+    ;
+  opt_trace (TT_MEMORY|1, "resizing string table: %zu strings, %zu -> %zu slots",
+             live - n, table.size, size);
+  alloc_table (&t, size);
+  if (old_table.slots)
     {
-      base_table[x] = 0;
+      /* not emptied by the migration rate below, move the rest right away */
+      for (; rehash_index < old_table.size; rehash_index++)
+        if (IS_LIVE (&old_table.slots[rehash_index]))
+          insert_slot (&t, old_table.slots[rehash_index].hash, old_table.slots[rehash_index].block);
+      free_table (&old_table);
     }
+  old_table = table;
+  table = t;
+  rehash_index = 0;
+  /* at least size/4 more strings can be added before the new table is
+   * crowded, by then every slot of the old table must have been moved */
+  rehash_rate = old_table.size * 4 / size;
+  if (rehash_rate < REHASH_STEP)
+    rehash_rate = REHASH_STEP;
+  rehash_step (rehash_rate);
+}
+
+/**
+ * @brief init_strings: Initialize the shared string table.
+ */
+void init_strings (size_t hash_size, size_t max_len) {
 
-  max_string_length = max_len;
+  /* ensure that table size is a power of 2 */
+  for (min_table_size = 1; min_table_size < hash_size; min_table_size *= 2)
+    ;
+  alloc_table (&table, min_table_size);
+
+  /* sizes are kept in 32 bits */
+  max_string_length = max_len > UINT32_MAX ? UINT32_MAX : max_len;
 }
 
-void deinit_strings(void) {
+static void deinit_table (str_table_t *t) {
   size_t i, s = 0;
-  if (base_table)
+
+  /* dump all strings */
+  for (i = 0; i < t->size; i++)
     {
-      /* dump all strings */
-      for (i = 0; i < htable_size; i++)
-        {
-          block_t *b, *next;
+      block_t *b = t->slots[i].block;
 
-          b = base_table[i];
-          while (b)
-            {
-              next = NEXT (b);
-              if (REFS (b) > 0)
-                {
-                  opt_trace (TT_MEMORY|1, "leaked (ref=%d): \"%s\"", REFS (b), STRING (b));
-                  s++;
-                }
-              else
-                num_distinct_strings--; /* immortal strings, we free them here */
-              FREE (b);
-              b = next;
-            }
+      if (b <= DELETED)
+        continue;
+      if (REFS (b) > 0)
+        {
+          opt_trace (TT_MEMORY|1, "leaked (ref=%d): \"%s\"", REFS (b), STRING (b));
+          s++;
         }
-      if (s)
-        debug_warn ("%d shared strings still allocated.\n", s);
-      FREE (base_table);
-      base_table = 0;
+      else
+        num_distinct_strings--; /* immortal strings, we free them here */
+      FREE (b);
     }
+  if (s)
+    debug_warn ("%d shared strings still allocated.\n", s);
+  free_table (t);
+}
+
+void deinit_strings(void) {
+  if (old_table.slots)
+    deinit_table (&old_table);
+  if (table.slots)
+    deinit_table (&table);
 #ifdef STRING_STATS
   if (num_distinct_strings > 0)
     debug_warn ("%d reference counting strings still allocated.\n", num_distinct_strings);
@@ -153,46 +261,76 @@ void deinit_strings(void) {
 }
 
 /**
- * Looks for a string in the table.  If it finds it, returns a pointer to
- * the start of the string part, and moves the entry for the string to
- * the head of the pointer chain.
+ * Look for a string of length \p len and hash value \p hash in one table.
+ * @return The slot holding the string, or NULL if not found.
+ */
+static str_slot_t *probe_table (str_table_t *t, const char *s, size_t len, uint64_t hash) {
+
+  size_t mask = t->size - 1;
+  size_t i = (size_t) hash & mask;
+  str_slot_t *slot;
+
+  for (; (slot = &t->slots[i])->block; i = (i + 1) & mask)
+    {
+#ifdef STRING_STATS
+      search_len++;
+#endif
+      if (slot->hash == hash && slot->block != DELETED
+          && SIZE (slot->block) == len && !memcmp (STRING (slot->block), s, len))
+        return slot;
+    }
+  return NULL;
+}
+
+/**
+ * Looks for a string in the table.
+ * @return A pointer to the string block, or NULL if not found.
  */
-static block_t *sfindblock (const char *s, int h) {
+static block_t *findblock (const char *s, size_t len, uint64_t hash) {
 
-  block_t *curr, *prev;
+  str_slot_t *slot;
 
-  if (!base_table)
+  if (!table.slots)
     fatal ("stralloc.c: stralloc used before init_strings()\n");
-  curr = base_table[h];
-  prev = NULL;
 #ifdef STRING_STATS
   num_str_searches++;
 #endif
+  slot = probe_table (&table, s, len, hash);
+  if (!slot && old_table.slots)
+    slot = probe_table (&old_table, s, len, hash);
+  return slot ? slot->block : NULL;
+}
 
-  while (curr)
+/**
+ * Remove a string block from the hash table, by address.
+ * @return Non-zero if the block was found.
+ */
+static int remove_block (block_t *b) {
+
+  uint64_t hash = b->hash;
+  str_table_t *t = &table;
+
+  for (;;)
     {
-#ifdef STRING_STATS
-      search_len++;
-#endif
-      if (*(STRING (curr)) == *s && !strcmp (STRING (curr), s))
+      size_t mask = t->size - 1;
+      size_t i = (size_t) hash & mask;
+
+      for (; t->slots[i].block; i = (i + 1) & mask)
         {
-          /* found it */
-          if (prev)
+          if (t->slots[i].block == b)
             {
-              /* Move the found block to the head of the list.
-               * This improves performance for strings that are
-               * looked up frequently.
-               */
-              NEXT (prev) = NEXT (curr);
-              NEXT (curr) = base_table[h];
-              base_table[h] = curr;
+              t->slots[i].block = DELETED;
+              t->used--;
+              t->deleted++;
+              if (old_table.slots)
+                rehash_step (rehash_rate);
+              return 1;
             }
-          return (curr);	/* pointer to string */
         }
-      prev = curr;
-      curr = NEXT (curr);
+      if (t == &old_table || !old_table.slots)
+        return 0;
+      t = &old_table;
     }
-  return ((block_t *) 0);	/* not found */
 }
 
 /**
@@ -200,8 +338,11 @@ static block_t *sfindblock (const char *s, int h) {
  */
 char* findstring (const char *s) {
   block_t *b;
+  size_t len = strlen (s);
 
-  if ((b = findblock (s)))
+  if (len > max_string_length)
+    return NULL; /* shared strings are truncated to max_string_length */
+  if ((b = findblock (s, len, strhash64 (s, len))))
     {
       return STRING (b);
     }
@@ -217,21 +358,17 @@ char* findstring (const char *s) {
  * For external use, see make_shared_string().
  * 
  * @param string The string to add.
- * @param h The hash value of the string.
+ * @param len The length of the string, at most max_string_length.
+ * @param hash The hash value of the first \p len characters of the string.
  * @return A pointer to the newly allocated string block entry.
  * @see make_shared_string
  */
-static block_t* alloc_new_string (const char *string, int h) {
+static block_t* alloc_new_string (const char *string, size_t len, uint64_t hash) {
 
   block_t *b;
-  size_t len = strlen (string);
   size_t size;
 
   opt_trace (TT_MEMORY|2, "first ref: \"%s\"", string);
-  if (len > max_string_length)
-    {
-      len = max_string_length;
-    }
 
   /* A shared string is allocated with a block_t header followed by
    * the string data itself:
@@ -241,18 +378,15 @@ static block_t* alloc_new_string (const char *string, int h) {
    */
   size = sizeof (block_t) + len + 1;
   b = (block_t *) DXALLOC (size, TAG_SHARED_STRING, "alloc_new_string");
-  strncpy (STRING (b), string, len);
+  memcpy (STRING (b), string, len);
   STRING (b)[len] = '\0';	/* truncate string if its length exceeds max_string_length */
 
-  /* The 'size' field stores a 16-bit length of the string.
-   * If the string length exceeds USHRT_MAX (0xffff), the 'size' is set to USHRT_MAX.
-   * Note that the string data itself is always allocated with the full length regardless.
-   */
-  SIZE (b) = (unsigned short)(len > USHRT_MAX ? USHRT_MAX : len);
+  SIZE (b) = (uint32_t) len;
   REFS (b) = 1;
+  b->hash = hash;
   /* add to string hash table */
-  NEXT (b) = base_table[h];
-  base_table[h] = b;
+  reserve_slots (1);
+  insert_slot (&table, hash, b);
   /* update string stats */
   ADD_NEW_STRING (SIZE (b), sizeof (block_t));
   ADD_STRING (SIZE (b));
@@ -271,14 +405,21 @@ static block_t* alloc_new_string (const char *string, int h) {
  */
 char* make_shared_string (const char *str) {
   block_t *b;
-  int h;
+  size_t len;
+  uint64_t hash;
 
   assert(str != NULL);
 
-  b = hfindblock (str, h);	/* hfindblock macro sets h = StrHash(s) */
+  len = strlen (str);
+  if (len > max_string_length)
+    {
+      len = max_string_length;
+    }
+  hash = strhash64 (str, len);
+  b = findblock (str, len, hash);
   if (!b)
     {
-      b = alloc_new_string (str, h);
+      b = alloc_new_string (str, len, hash);
     }
   else
     {
@@ -294,6 +435,38 @@ char* make_shared_string (const char *str) {
   return (STRING (b));
 }
 
+/**
+ * Create or retrieve \p n shared strings at once, like make_shared_string().
+ * The strings are packed back to back in \p data, each followed by '\0', and
+ * their lengths are given in \p lens.  Room for all of them is made in the
+ * hash table up front, so loading a program's strings grows it once at most.
+ * @param out Receives the shared strings.
+ * @param data The packed strings.
+ * @param lens The length of each string.
+ * @param n The number of strings.
+ */
+void make_shared_strings (char **out, const char *data, const uint32_t *lens, size_t n) {
+  block_t *b;
+  size_t i, len;
+  uint64_t hash;
+
+  reserve_slots (n);
+  for (i = 0; i < n; data += lens[i++] + 1)
+    {
+      len = lens[i] > max_string_length ? max_string_length : lens[i];
+      hash = strhash64 (data, len);
+      if (!(b = findblock (data, len, hash)))
+        b = alloc_new_string (data, len, hash);
+      else
+        {
+          if (REFS (b))
+            REFS (b)++;
+          ADD_STRING (SIZE (b));
+        }
+      out[i] = STRING (b);
+    }
+}
+
 /**
  * Increase the reference count of a shared string.
  * It is fatal to call this function on a string that isn't shared.
@@ -303,7 +476,7 @@ char* ref_string (char *str) {
 
   assert (str != NULL);
   b = BLOCK (str);
-  assert (b == findblock (str)); /* ensure it's a shared string */
+  assert (b == findblock (str, SIZE (b), strhash64 (str, SIZE (b)))); /* ensure it's a shared string */
 
   if (REFS (b)) /* if reference count overflown, let it stay zero ... */
     {
@@ -323,15 +496,14 @@ char* ref_string (char *str) {
  * hash table and the memory is freed.
  */
 void free_string (char *str) {
-  block_t **prev, *b;
-  int h;
+  block_t *b;
 
   assert (str != NULL);
   b = BLOCK (str);
-  assert (b == findblock (str)); /* ensure it's a shared string */
+  assert (b == findblock (str, SIZE (b), strhash64 (str, SIZE (b)))); /* ensure it's a shared string */
 
   /*
-   * if a string has been ref'd USHRT_MAX times then we assume that its used
+   * if a string has been ref'd UINT32_MAX times then we assume that its used
    * often enough to justify never freeing it.
    */
   if (!REFS (b)) {
@@ -345,17 +517,7 @@ void free_string (char *str) {
     return;
 
   /* remove from hash table */
-  h = StrHash (str);
-  prev = base_table + h;
-  while ((b = *prev))
-    {
-      if (STRING (b) == str)
-        {
-          *prev = NEXT (b);
-          break;
-        }
-      prev = &(NEXT (b));
-    }
+  remove_block (b);
 
   /* free the shared string */
   SUB_NEW_STRING (SIZE (b), sizeof (block_t));
@@ -373,21 +535,9 @@ void free_string (char *str) {
  */
 static void dealloc_string (const char *str) {
 
-  int h;
-  block_t *b, **prev;
+  block_t *b = BLOCK (str);
 
-  h = StrHash (str);
-  prev = base_table + h;
-  while ((b = *prev))
-    {
-      if (STRING (b) == str)
-        {
-          *prev = NEXT (b);
-          break;
-        }
-      prev = &(NEXT (b));
-    }
-  if (b)
+  if (remove_block (b))
     FREE (b);
 }
 
@@ -411,6 +561,9 @@ size_t add_string_status (outbuffer_t * out, int verbose) {
                     overhead_bytes) * 100 / allocd_bytes);
       outbuf_addv (out, "Searches: %d    Average search length: %6.3f\n",
                    num_str_searches, (double) search_len / num_str_searches);
+      outbuf_addv (out, "Hash table: %zu slots, %zu used, %zu deleted%s\n",
+                   table.size, table.used, table.deleted,
+                   old_table.slots ? " (resizing)" : "");
     }
   return (bytes_distinct_strings + overhead_bytes);
 #else
@@ -429,16 +582,8 @@ char* int_new_string (size_t size) {
   malloc_block_t *mbt;
 
   mbt = (malloc_block_t *) DXALLOC (size + sizeof (malloc_block_t) + 1, TAG_MALLOC_STRING, tag);
-  if (size < USHRT_MAX)
-    {
-      mbt->size = (unsigned short)size;
-      ADD_NEW_STRING (size, sizeof (malloc_block_t));
-    }
-  else
-    {
-      mbt->size = USHRT_MAX;
-      ADD_NEW_STRING (USHRT_MAX, sizeof (malloc_block_t)); /* FIXME: this is probably incorrect ... */
-    }
+  mbt->capacity = mbt->size = (uint32_t)size;
+  ADD_NEW_STRING (size, sizeof (malloc_block_t));
   mbt->ref = 1;
   ADD_STRING (mbt->size);
   return STRING(mbt);
@@ -482,14 +627,37 @@ char *extend_string (char *str, size_t len) {
   int oldsize = MSTR_SIZE (str);
 #endif
   mbt = (malloc_block_t *) DREALLOC (MSTR_BLOCK (str), len + sizeof (malloc_block_t) + 1, TAG_MALLOC_STRING, "extend_string");
-  if (len < USHRT_MAX)
-    {
-      mbt->size = (unsigned short)len;
-    }
-  else
+  mbt->capacity = mbt->size = (uint32_t)len;
+  ADD_STRING_SIZE (mbt->size - oldsize);
+  return STRING(mbt);
+}
+
+/**
+ * Extend a reference counted string (STRING_MALLOC) that is about to be appended to.
+ * Unlike extend_string(), the block grows by half again as much as needed, so
+ * appending to the same string over and over takes amortized linear time.
+ * @param str The string to extend. It must not be referenced elsewhere.
+ * @param len The new length of the string.
+ * @return A pointer to the extended string; the new part is uninitialized.
+ */
+char *grow_string (char *str, size_t len) {
+  malloc_block_t *mbt = MSTR_BLOCK (str);
+  size_t capacity;
+
+  assert (str != NULL);
+  assert (mbt->ref == 1);
+#ifdef STRING_STATS
+  int oldsize = mbt->size;
+#endif
+  if (len > mbt->capacity)
     {
-      mbt->size = USHRT_MAX;
+      capacity = len + (len >> 1);
+      if (capacity > max_string_length)
+        capacity = len > max_string_length ? len : max_string_length;
+      mbt = (malloc_block_t *) DREALLOC (mbt, capacity + sizeof (malloc_block_t) + 1, TAG_MALLOC_STRING, "grow_string");
+      mbt->capacity = (uint32_t)capacity;
     }
+  mbt->size = (uint32_t)len;
   ADD_STRING_SIZE (mbt->size - oldsize);
   return STRING(mbt);
 }
@@ -524,22 +692,10 @@ static char *int_string_unlink (char *str) {
   assert (MSTR_REF (str) > 1);
   MSTR_REF (str)--; /* decrement reference count */
 
-  if (MSTR_SIZE (str) == USHRT_MAX)
-    {
-      size_t len = strlen (str + USHRT_MAX) + USHRT_MAX;	/* ouch */
-
-      newmbt = (malloc_block_t *) DXALLOC (len + sizeof (malloc_block_t) + 1, TAG_MALLOC_STRING, "int_string_unlink");
-      memcpy (STRING(newmbt), str, len + 1);
-      newmbt->size = USHRT_MAX;
-      ADD_NEW_STRING (USHRT_MAX, sizeof (malloc_block_t)); /* FIXME: this is probably incorrect ... */
-    }
-  else
-    {
-      newmbt = (malloc_block_t *) DXALLOC (MSTR_SIZE (str) + sizeof (malloc_block_t) + 1, TAG_MALLOC_STRING, "int_string_unlink");
-      memcpy (STRING(newmbt), str, MSTR_SIZE (str) + 1);
-      newmbt->size = MSTR_SIZE (str);
-      ADD_NEW_STRING (MSTR_SIZE (str), sizeof (malloc_block_t));
-    }
+  newmbt = (malloc_block_t *) DXALLOC (MSTR_SIZE (str) + sizeof (malloc_block_t) + 1, TAG_MALLOC_STRING, "int_string_unlink");
+  memcpy (STRING(newmbt), str, MSTR_SIZE (str) + 1);
+  newmbt->capacity = newmbt->size = MSTR_SIZE (str);
+  ADD_NEW_STRING (MSTR_SIZE (str), sizeof (malloc_block_t));
   newmbt->ref = 1;
   return STRING(newmbt);
 }
@@ -4,18 +4,28 @@
 
 /**
  * Shared string (STRING_SHARED) block header.
- * The string hash table consists of linked lists of these blocks.
+ * The string hash table holds pointers to these blocks, see str_slot_t.
  * - A shared string is reference counted and should be used as right-hand
  *   side of an assignment only.
  * - A shared string is always freed through release of its reference count.
  */
 typedef struct block_s {
-    struct block_s *next;	/* next block in the hash chain */
+    uint64_t hash;		/* strhash64() of the string, as in its slot */
     /* these two must be last */
-    unsigned short size;	/* length of the string */
-    unsigned short refs;	/* reference count    */
+    uint32_t size;		/* length of the string */
+    uint32_t refs;		/* reference count    */
 } block_t;
 
+/**
+ * A slot in the open addressing string hash table.
+ * The full hash value is kept in the slot, so that probing rarely needs to
+ * touch the string block itself.
+ */
+typedef struct str_slot_s {
+    uint64_t hash;		/* strhash64() of the string */
+    block_t *block;		/* NULL if empty */
+} str_slot_t;
+
 /**
  * Malloc block header for STRING_MALLOC and STRING_SHARED strings.
  * The layout is designed to align with block_t for efficient access.
@@ -25,24 +35,27 @@ typedef struct block_s {
  * - A malloc string is *NOT* added to the string hash table. It's reference count is set to 1
  *   when created that allows it to be freed in free_string_svalue(). This allows malloc strings
  *   to be used as left-hand-side string values without worrying about sharing.
+ * - MSTR_CAPACITY is valid for STRING_MALLOC only: the block may have room for a longer
+ *   string than MSTR_SIZE, so that grow_string() can append in place.
  */
 typedef struct malloc_block_s {
-    block_t* unused;		/* to force MSTR_BLOCK align with block_t */
-    unsigned short size;
-    unsigned short ref;
+    uint32_t capacity;		/* room for the string, not counting the '\0' */
+    /* these two must be last */
+    uint32_t size;
+    uint32_t ref;
 } malloc_block_t;
 
 #define MSTR_BLOCK(x) (((malloc_block_t *)(x)) - 1) 
 #define MSTR_REF(x) (MSTR_BLOCK(x)->ref)
 #define MSTR_SIZE(x) (MSTR_BLOCK(x)->size)
+#define MSTR_CAPACITY(x) (MSTR_BLOCK(x)->capacity)
 #define MSTR_UPDATE_SIZE(x, y) do {\
         ADD_STRING_SIZE(y - MSTR_SIZE(x));\
-        MSTR_BLOCK(x)->size = \
-        (y > USHRT_MAX ? USHRT_MAX : y);\
+        MSTR_BLOCK(x)->size = (uint32_t)(y);\
         } while(0)
 
 #define FREE_MSTR(x) do {\
-        unsigned short size_mstr = MSTR_SIZE(x);\
+        uint32_t size_mstr = MSTR_SIZE(x);\
         DEBUG_CHECK(MSTR_REF(x) != 1, "FREE_MSTR used on a multiply referenced string\n");\
         SUB_NEW_STRING(size_mstr, sizeof(malloc_block_t));\
         FREE(MSTR_BLOCK(x));\
@@ -70,13 +83,13 @@ typedef struct malloc_block_s {
  * sv->subtype is STRING_MALLOC or STRING_SHARED, and runs significantly
  * faster.
  */
-#define COUNTED_STRLEN(x) ((MSTR_SIZE(x) == USHRT_MAX) ? (strlen((x)+USHRT_MAX)+USHRT_MAX) : MSTR_SIZE(x))
+#define COUNTED_STRLEN(x) ((size_t) MSTR_SIZE(x))
 
 /* return the number of references to a STRING_MALLOC or STRING_SHARED 
    string */
 #define COUNTED_REF(x)    MSTR_REF(x)
 
-/* ref == 0 means the string has been referenced USHRT_MAX times and is
+/* ref == 0 means the string has been referenced UINT32_MAX times and is
    immortal */
 #define INC_COUNTED_REF(x) if (MSTR_REF(x)) MSTR_REF(x)++;
 /* This is a conditional expression that evaluates to zero if the block
@@ -110,6 +123,7 @@ extern size_t add_string_status(outbuffer_t *, int);
 /* STRING_SHARED */
 extern char *findstring(const char *);
 extern char *make_shared_string(const char *);
+extern void make_shared_strings(char **, const char *, const uint32_t *, size_t);
 extern char *ref_string(char *);
 extern void free_string(char *);
 
@@ -117,4 +131,5 @@ extern void free_string(char *);
 extern char *int_new_string(size_t);
 extern char *int_string_copy(const char *);
 extern char *extend_string(char *, size_t);
+extern char *grow_string(char *, size_t);
 extern char *int_alloc_cstring(const char *);
@@ -0,0 +1,202 @@
+/**
+ * @file test_async_runtime_uring.cpp
+ * @brief Completion-based accept/read/write through the async runtime
+ *
+ * Exercises the io_uring engine of the epoll runtime.  Skipped where the
+ * runtime accepts on readiness only (no io_uring, other platforms).
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "async/async_runtime.h"
+}
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <string>
+
+class AsyncRuntimeUringTest : public ::testing::Test {
+protected:
+    async_runtime_t* runtime = nullptr;
+    socket_fd_t listener = INVALID_SOCKET_FD;
+    int port_context = 0;
+    int user_context = 0;
+
+    void SetUp() override {
+#ifdef _WIN32
+        GTEST_SKIP() << "IOCP has its own accept worker";
+#endif
+        runtime = async_runtime_init();
+        ASSERT_NE(runtime, nullptr);
+
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        ASSERT_NE(listener, INVALID_SOCKET_FD);
+        struct sockaddr_in sin = {};
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ASSERT_EQ(bind(listener, (struct sockaddr*)&sin, sizeof(sin)), 0);
+        ASSERT_EQ(listen(listener, SOMAXCONN), 0);
+        ASSERT_EQ(async_runtime_add(runtime, listener, EVENT_READ, &port_context), 0);
+        if (async_runtime_post_accept(runtime, listener) != 0)
+            GTEST_SKIP() << "runtime accepts on readiness only";
+    }
+
+    void TearDown() override {
+        if (listener != INVALID_SOCKET_FD) {
+            async_runtime_remove(runtime, listener);
+            SOCKET_CLOSE(listener);
+        }
+        if (runtime)
+            async_runtime_deinit(runtime);
+    }
+
+    socket_fd_t connect_client() {
+        struct sockaddr_in sin = {};
+        socklen_t len = sizeof(sin);
+        getsockname(listener, (struct sockaddr*)&sin, &len);
+        socket_fd_t fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(fd, (struct sockaddr*)&sin, sizeof(sin)) != 0) {
+            SOCKET_CLOSE(fd);
+            return INVALID_SOCKET_FD;
+        }
+        return fd;
+    }
+
+    // wait until an event for context shows up
+    bool wait_for(void* context, io_event_t* out, int tries = 50) {
+        io_event_t events[16];
+        while (tries-- > 0) {
+            struct timeval timeout = { 0, 100000 };
+            int n = async_runtime_wait(runtime, events, 16, &timeout);
+            for (int i = 0; i < n; i++) {
+                if (events[i].context == context) {
+                    *out = events[i];
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+};
+
+TEST_F(AsyncRuntimeUringTest, AcceptReadWriteClose) {
+    socket_fd_t client = connect_client();
+    ASSERT_NE(client, INVALID_SOCKET_FD);
+
+    io_event_t evt;
+    ASSERT_TRUE(wait_for(&port_context, &evt));
+    ASSERT_TRUE(evt.event_type & EVENT_ACCEPT);
+    socket_fd_t server = evt.fd;
+    ASSERT_GE(server, 0);
+
+    ASSERT_EQ(async_runtime_add(runtime, server, EVENT_READ, &user_context), 0);
+    ASSERT_EQ(async_runtime_post_read(runtime, server, NULL, 0), 0);
+    ASSERT_EQ(async_runtime_post_read(runtime, server, NULL, 0), 0) << "re-posting is harmless";
+
+    // data arrives already read, in the runtime's buffer
+    ASSERT_EQ(send(client, "hello", 5, 0), 5);
+    ASSERT_TRUE(wait_for(&user_context, &evt));
+    EXPECT_EQ(evt.event_type, (uint32_t)EVENT_READ);
+    ASSERT_NE(evt.buffer, nullptr);
+    EXPECT_EQ(std::string((char*)evt.buffer, evt.bytes_transferred), "hello");
+
+    // queued sends go out in order and complete as EVENT_WRITE
+    ASSERT_EQ(async_runtime_post_write(runtime, server, (void*)"wor", 3), 0);
+    ASSERT_EQ(async_runtime_post_write(runtime, server, (void*)"ld", 2), 0);
+    ASSERT_TRUE(wait_for(&user_context, &evt));
+    EXPECT_EQ(evt.event_type, (uint32_t)EVENT_WRITE);
+    EXPECT_EQ(evt.bytes_transferred, 3u);
+    ASSERT_TRUE(wait_for(&user_context, &evt));
+    EXPECT_EQ(evt.bytes_transferred, 2u);
+    char buf[16];
+    std::string got;
+    while (got.size() < 5) {
+        int n = (int)recv(client, buf, sizeof(buf), 0);
+        ASSERT_GT(n, 0);
+        got.append(buf, n);
+    }
+    EXPECT_EQ(got, "world");
+
+    // write interest still works through epoll while reads go through io_uring
+    ASSERT_EQ(async_runtime_modify(runtime, server, EVENT_READ | EVENT_WRITE, &user_context), 0);
+    ASSERT_TRUE(wait_for(&user_context, &evt));
+    EXPECT_EQ(evt.event_type, (uint32_t)EVENT_WRITE);
+    ASSERT_EQ(async_runtime_modify(runtime, server, EVENT_READ, &user_context), 0);
+
+    SOCKET_CLOSE(client);
+    ASSERT_TRUE(wait_for(&user_context, &evt));
+    EXPECT_TRUE(evt.event_type & EVENT_CLOSE);
+
+    async_runtime_remove(runtime, server);
+    SOCKET_CLOSE(server);
+}
+
+TEST_F(AsyncRuntimeUringTest, RemovedSocketsReportNothing) {
+    socket_fd_t client = connect_client();
+    ASSERT_NE(client, INVALID_SOCKET_FD);
+    io_event_t evt;
+    ASSERT_TRUE(wait_for(&port_context, &evt));
+    socket_fd_t server = evt.fd;
+
+    ASSERT_EQ(async_runtime_add(runtime, server, EVENT_READ, &user_context), 0);
+    ASSERT_EQ(async_runtime_post_read(runtime, server, NULL, 0), 0);
+    async_runtime_remove(runtime, server);
+    SOCKET_CLOSE(server);
+
+    send(client, "late", 4, 0);
+    SOCKET_CLOSE(client);
+    EXPECT_FALSE(wait_for(&user_context, &evt, 5)) << "no events after async_runtime_remove()";
+}
+
+TEST_F(AsyncRuntimeUringTest, ManyConnections) {
+    const int n = 200;
+    socket_fd_t clients[n];
+    int accepted = 0;
+
+    for (int i = 0; i < n; i++) {
+        clients[i] = connect_client();
+        ASSERT_NE(clients[i], INVALID_SOCKET_FD);
+    }
+
+    io_event_t events[64];
+    socket_fd_t servers[n];
+    for (int tries = 0; tries < 50 && accepted < n; tries++) {
+        struct timeval timeout = { 0, 100000 };
+        int got = async_runtime_wait(runtime, events, 64, &timeout);
+        for (int i = 0; i < got; i++) {
+            if (events[i].event_type & EVENT_ACCEPT) {
+                servers[accepted] = events[i].fd;
+                ASSERT_EQ(async_runtime_add(runtime, servers[accepted], EVENT_READ, &user_context), 0);
+                ASSERT_EQ(async_runtime_post_read(runtime, servers[accepted], NULL, 0), 0);
+                accepted++;
+            }
+        }
+    }
+    ASSERT_EQ(accepted, n);
+
+    // every connection's data comes back, through the shared buffer pool
+    for (int i = 0; i < n; i++)
+        ASSERT_EQ(send(clients[i], "0123456789", 10, 0), 10);
+    size_t total = 0;
+    for (int tries = 0; tries < 50 && total < (size_t)n * 10; tries++) {
+        struct timeval timeout = { 0, 100000 };
+        int got = async_runtime_wait(runtime, events, 64, &timeout);
+        for (int i = 0; i < got; i++)
+            if (events[i].event_type == EVENT_READ)
+                total += events[i].bytes_transferred;
+    }
+    EXPECT_EQ(total, (size_t)n * 10);
+
+    for (int i = 0; i < n; i++) {
+        async_runtime_remove(runtime, servers[i]);
+        SOCKET_CLOSE(servers[i]);
+        SOCKET_CLOSE(clients[i]);
+    }
+}
@@ -0,0 +1,261 @@
+/**
+ * @file test_add_message.cpp
+ * @brief Unit tests and benchmark for the output path of add_message()
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+#include <gtest/gtest.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+extern "C" {
+    #include "std.h"
+    #include "rc.h"
+    #include "lpc/object.h"
+    #include "comm.h"
+}
+
+using namespace testing;
+
+class AddMessageTest: public Test {
+protected:
+    std::vector<object_t> users;
+    socket_fd_t fds[2] = { INVALID_SOCKET_FD, INVALID_SOCKET_FD };
+
+    void SetUp() override {
+        debug_set_log_with_date (0);
+        init_stem(1, 0, "m3.conf");
+        ASSERT_EQ(create_test_socket_pair(fds), 0);
+    }
+
+    void TearDown() override {
+        for (auto& ob : users) {
+            if (ob.interactive)
+                remove_test_interactive(ob.interactive);
+        }
+        users.clear();
+        SOCKET_CLOSE(fds[0]);
+        SOCKET_CLOSE(fds[1]);
+    }
+
+    /* create mock interactives writing into fds[0], none of them is the console user */
+    void create_users(size_t n) {
+        users.resize(n); // zero-initialized
+        for (auto& ob : users) {
+            interactive_t* ip = create_test_interactive(&ob);
+            ASSERT_NE(ip, nullptr);
+            ip->fd = fds[0];
+        }
+        all_users[0] = nullptr;
+    }
+
+    /* read back whatever the interactives have sent so far */
+    std::string drain() {
+        std::string out;
+        char buf[8192];
+        int n;
+        while ((n = (int)SOCKET_RECV(fds[1], buf, sizeof(buf), 0)) > 0)
+            out.append(buf, n);
+        return out;
+    }
+
+    static std::string crlf(const std::string& s) {
+        std::string out;
+        for (char c : s) {
+            if (c == '\n')
+                out += '\r';
+            out += c;
+        }
+        return out;
+    }
+
+    static std::string room_description(int lines) {
+        std::string desc = "The Observatory\n";
+        for (int i = 0; i < lines; i++)
+            desc += "A great brass telescope points through a slot in the domed roof, its eyepiece polished by many hands. Line "
+                    + std::to_string(i) + ".\n";
+        desc += "    There are two obvious exits: north and down.\n";
+        return desc;
+    }
+};
+
+TEST_F(AddMessageTest, translatesNewlines) {
+    create_users(1);
+    interactive_t* ip = users[0].interactive;
+
+    char msg[] = "hello\n\nworld\nno newline at end";
+    add_message(&users[0], msg);
+    EXPECT_EQ(ip->message_length, (int)crlf(msg).size());
+    EXPECT_EQ(std::string(ip->message_buf, ip->message_length), crlf(msg));
+
+    ASSERT_EQ(flush_message(ip), 1);
+    EXPECT_EQ(ip->message_length, 0);
+    EXPECT_EQ(drain(), crlf(msg));
+}
+
+TEST_F(AddMessageTest, growsInsteadOfFlushing) {
+    create_users(1);
+    interactive_t* ip = users[0].interactive;
+
+    std::string desc = room_description(200); // well above MESSAGE_BUF_SIZE
+    ASSERT_GT(desc.size(), (size_t)MESSAGE_BUF_SIZE);
+    add_message(&users[0], desc.data());
+    add_message(&users[0], desc.data());
+
+    // nothing is sent until the backend flushes
+    EXPECT_EQ(ip->message_length, (int)(2 * crlf(desc).size()));
+    EXPECT_GT(ip->message_size, MESSAGE_BUF_SIZE);
+    EXPECT_EQ(drain(), "");
+
+    ASSERT_EQ(flush_message(ip), 1);
+    EXPECT_EQ(drain(), crlf(desc) + crlf(desc));
+    EXPECT_LE(ip->message_size, MESSAGE_BUF_SIZE) << "grown buffer should be released once drained";
+}
+
+TEST_F(AddMessageTest, dropsOutputBeyondLimit) {
+    create_users(1);
+    interactive_t* ip = users[0].interactive;
+
+    // fill up the socket so that flush_message() would block
+    std::string junk(65536, 'x');
+    while (SOCKET_SEND(fds[0], junk.data(), junk.size(), 0) > 0)
+        ;
+
+    std::string line(1000, 'a');
+    line += '\n';
+    for (int i = 0; i < 2 * MESSAGE_BUF_LIMIT / (int)line.size(); i++)
+        add_message(&users[0], line.data());
+    EXPECT_EQ(ip->message_size, MESSAGE_BUF_LIMIT);
+    EXPECT_LE(ip->message_length, MESSAGE_BUF_LIMIT);
+    EXPECT_GT(ip->message_length, MESSAGE_BUF_LIMIT - (int)line.size() - 1);
+    EXPECT_EQ(ip->iflags & NET_DEAD, 0);
+}
+
+TEST_F(AddMessageTest, flushesLongLineInsteadOfDropping) {
+    create_users(1);
+    interactive_t* ip = users[0].interactive;
+
+    // a single segment without newline, longer than the ring can ever hold
+    std::string line(MESSAGE_BUF_LIMIT + 50000, 'b');
+    add_message(&users[0], line.data());
+    EXPECT_EQ(ip->iflags & NET_DEAD, 0);
+
+    std::string out = drain();
+    while (MESSAGE_PENDING(ip)) {
+        ASSERT_EQ(flush_message(ip), 1);
+        out += drain();
+    }
+    EXPECT_EQ(out.size(), line.size()) << "the socket was writable, nothing should be dropped";
+    EXPECT_EQ(out, line);
+
+    // with the socket full, the flush cannot send anything and the rest is dropped
+    std::string junk(65536, 'x');
+    while (SOCKET_SEND(fds[0], junk.data(), junk.size(), 0) > 0)
+        ;
+    add_message(&users[0], line.data());
+    EXPECT_EQ(ip->message_length, MESSAGE_BUF_LIMIT);
+    EXPECT_EQ(ip->iflags & NET_DEAD, 0);
+}
+
+TEST_F(AddMessageTest, sharedMessageBlock) {
+    create_users(2);
+    std::string desc = room_description(10);
+    ASSERT_GT(crlf(desc).size(), (size_t)MESSAGE_BLOCK_INLINE);
+
+    message_block_t* mb = new_message_block(desc.data());
+    EXPECT_EQ(std::string(mb->data, mb->length), crlf(desc));
+
+    char before[] = "You look around.\n";
+    char after[] = "> ";
+    for (auto& ob : users) {
+        add_message(&ob, before);
+        add_message_block(&ob, mb, desc.data());
+        add_message(&ob, after);
+    }
+    EXPECT_EQ(mb->ref, 3) << "each recipient should hold a reference instead of a copy";
+
+    for (auto& ob : users) {
+        EXPECT_TRUE(MESSAGE_PENDING(ob.interactive));
+        ASSERT_EQ(flush_message(ob.interactive), 1);
+        EXPECT_FALSE(MESSAGE_PENDING(ob.interactive));
+        EXPECT_EQ(drain(), crlf(before) + crlf(desc) + after);
+    }
+    EXPECT_EQ(mb->ref, 1);
+
+    // short blocks are copied, and blocks still queued are released with the interactive
+    message_block_t* small = new_message_block("Bob says: hi\n");
+    add_message_block(&users[0], small, (char*)"Bob says: hi\n");
+    EXPECT_EQ(small->ref, 1);
+    add_message_block(&users[0], mb, desc.data());
+    EXPECT_EQ(mb->ref, 2);
+    remove_test_interactive(users[0].interactive);
+    EXPECT_EQ(mb->ref, 1);
+    free_message_block(small);
+    free_message_block(mb);
+}
+
+TEST_F(AddMessageTest, DISABLED_benchmarkBroadcast) {
+    const int num_users = 250; // a crowded room
+    const int rounds = 200;
+    create_users(num_users);
+
+    std::string desc = room_description(10);
+    double copy_ms = 0, shared_ms = 0;
+    for (int r = 0; r < rounds; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (auto& ob : users)
+            add_message(&ob, desc.data());
+        auto t1 = std::chrono::steady_clock::now();
+        message_block_t* mb = new_message_block(desc.data());
+        for (auto& ob : users)
+            add_message_block(&ob, mb, desc.data());
+        free_message_block(mb);
+        auto t2 = std::chrono::steady_clock::now();
+        copy_ms += std::chrono::duration<double, std::milli>(t1 - t0).count();
+        shared_ms += std::chrono::duration<double, std::milli>(t2 - t1).count();
+
+        for (auto& ob : users) {
+            ASSERT_EQ(flush_message(ob.interactive), 1);
+            ASSERT_EQ(drain().size(), 2 * crlf(desc).size());
+        }
+    }
+
+    debug_message("[ BENCH    ] %d broadcasts (%zu bytes) to %d users: add_message %.1f ms, add_message_block %.1f ms\n",
+                  rounds, desc.size(), num_users, copy_ms, shared_ms);
+    RecordProperty("add_message_ms", (int)copy_ms);
+    RecordProperty("add_message_block_ms", (int)shared_ms);
+}
+
+TEST_F(AddMessageTest, DISABLED_benchmarkRoomDescriptions) {
+    const int num_users = 1000;
+    const int rounds = 50;
+    create_users(num_users);
+
+    std::string desc = room_description(30);
+    size_t sent = 0;
+    double add_ms = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (auto& ob : users)
+            add_message(&ob, desc.data());
+        add_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+        for (auto& ob : users) {
+            ASSERT_EQ(flush_message(ob.interactive), 1);
+            sent += drain().size();
+        }
+    }
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    EXPECT_EQ(sent, (size_t)num_users * rounds * crlf(desc).size());
+    debug_message("[ BENCH    ] %d room descriptions (%zu bytes each) to %d users: add_message %.1f ms, total %.1f ms\n",
+                  num_users * rounds, desc.size(), num_users, add_ms, elapsed);
+    RecordProperty("messages", num_users * rounds);
+    RecordProperty("add_message_ms", (int)add_ms);
+    RecordProperty("elapsed_ms", (int)elapsed);
+}
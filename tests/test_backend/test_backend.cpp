@@ -3,11 +3,14 @@
 #endif /* HAVE_CONFIG_H */
 #include <gtest/gtest.h>
 #include <filesystem>
+#include <vector>
 
 extern "C" {
     #include "std.h"
     #include "rc.h"
     #include "lpc/compiler.h"
+    #include "lpc/array.h"
+    #include "lpc/object.h"
 }
 
 using namespace testing;
@@ -76,3 +79,37 @@ TEST_F(BackendTest, setHeartBeat) {
     EXPECT_EQ(set_heart_beat(ob, 0), 1);
     EXPECT_EQ(query_heart_beat(ob), 0);
 }
+
+TEST_F(BackendTest, manyHeartBeats) {
+    // set_heart_beat() only touches the flags and the heart beat slot of the object
+    const int n = 3000;
+    std::vector<object_t> obs(n);
+    for (int i = 0; i < n; i++) {
+        memset(&obs[i], 0, sizeof(object_t));
+        EXPECT_EQ(set_heart_beat(&obs[i], 1 + i % 7), 1);
+    }
+
+    // disable every third object; remaining objects keep their intervals
+    for (int i = 0; i < n; i += 3)
+        EXPECT_EQ(set_heart_beat(&obs[i], 0), 1);
+    EXPECT_EQ(set_heart_beat(&obs[0], 0), 0); // already disabled
+    for (int i = 0; i < n; i++)
+        EXPECT_EQ(query_heart_beat(&obs[i]), (i % 3) ? 1 + i % 7 : 0) << "object #" << i;
+
+    // change intervals of enabled objects
+    for (int i = 1; i < n; i += 3)
+        EXPECT_EQ(set_heart_beat(&obs[i], 100), 1);
+    EXPECT_EQ(query_heart_beat(&obs[1]), 100);
+    EXPECT_EQ(query_heart_beat(&obs[2]), 3);
+
+    array_t* arr = get_heart_beats();
+    EXPECT_EQ(arr->size, n - (n + 2) / 3);
+    for (int i = 0; i < arr->size; i++)
+        arr->item[i] = const0; // not real objects, do not release references
+    free_array(arr);
+
+    for (int i = 0; i < n; i++)
+        set_heart_beat(&obs[i], 0);
+    for (int i = 0; i < n; i++)
+        EXPECT_EQ(obs[i].flags & O_HEART_BEAT, 0);
+}
@@ -0,0 +1,195 @@
+/**
+ * @file test_call_out.cpp
+ * @brief Unit tests and benchmark for the call_out() timer wheel
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <thread>
+#include <vector>
+
+extern "C" {
+    #include "std.h"
+    #include "rc.h"
+    #include "lpc/compiler.h"
+    #include "simul_efun.h"
+    #include "lpc/array.h"
+    #include "lpc/object.h"
+    #include "efuns/call_out.h"
+}
+
+using namespace testing;
+
+class CallOutTest: public Test {
+private:
+    std::filesystem::path previous_cwd;
+
+protected:
+    void SetUp() override {
+        debug_set_log_with_date (0);
+        setlocale(LC_ALL, PLATFORM_UTF8_LOCALE); // force UTF-8 locale for consistent string handling
+        init_stem(1, 0, "m3.conf"); // keep trace logs off, the benchmark schedules a lot of call_outs
+
+        init_config(MAIN_OPTION(config_file));
+
+        ASSERT_TRUE(CONFIG_STR(__MUD_LIB_DIR__));
+        namespace fs = std::filesystem;
+        auto mudlib_path = fs::path(CONFIG_STR(__MUD_LIB_DIR__)); // absolute or relative to cwd
+        if (mudlib_path.is_relative()) {
+            mudlib_path = fs::current_path() / mudlib_path;
+        }
+        ASSERT_TRUE(fs::exists(mudlib_path)) << "Mudlib directory does not exist: " << mudlib_path;
+        previous_cwd = fs::current_path();
+        fs::current_path(mudlib_path); // change working directory to mudlib
+
+        init_strings (8192, 1000000); // LPC compiler needs this since prolog()
+        init_lpc_compiler(CONFIG_INT (__MAX_LOCAL_VARIABLES__), CONFIG_STR (__INCLUDE_DIRS__));
+
+        setup_simulate();
+        eval_cost = CONFIG_INT (__MAX_EVAL_COST__); /* simulates calling LPC code from backend */
+
+        init_simul_efun ("/simul_efun.c");
+        init_master ("/master.c");
+        ASSERT_NE(master_ob, nullptr);
+    }
+
+    void TearDown() override {
+        tear_down_simulate();
+        deinit_lpc_compiler();
+        deinit_strings();
+
+        namespace fs = std::filesystem;
+        fs::current_path(previous_cwd);
+        deinit_config();
+    }
+
+    static int schedule(object_t* ob, const char* fun, int64_t delay_usec) {
+        svalue_t sv;
+        sv.type = T_STRING;
+        sv.subtype = STRING_CONSTANT;
+        sv.u.string = (char*)fun;
+        return new_call_out(ob, &sv, delay_usec, 0, nullptr);
+    }
+};
+
+TEST_F(CallOutTest, findAndRemoveByHandle) {
+    int h1 = schedule(master_ob, "no_such_function", 5 * 1000000);
+    int h2 = schedule(master_ob, "no_such_function", 30 * 1000000);
+    EXPECT_GT(h1, 0);
+    EXPECT_NE(h1, h2);
+
+    EXPECT_EQ(find_call_out_by_handle(h1), 5);
+    EXPECT_EQ(find_call_out_by_handle(h2), 30);
+
+    EXPECT_EQ(remove_call_out_by_handle(h1), 5);
+    EXPECT_EQ(find_call_out_by_handle(h1), -1);
+    EXPECT_EQ(remove_call_out_by_handle(h1), -1);
+    EXPECT_EQ(find_call_out_by_handle(h2), 30);
+
+    remove_all_call_out(master_ob);
+    EXPECT_EQ(find_call_out_by_handle(h2), -1);
+    EXPECT_EQ(master_ob->call_outs, nullptr);
+}
+
+TEST_F(CallOutTest, findAndRemoveByName) {
+    schedule(master_ob, "tick", 40 * 1000000);
+    schedule(master_ob, "tick", 10 * 1000000);
+    schedule(master_ob, "tock", 20 * 1000000);
+
+    char name[] = "tick";
+    EXPECT_EQ(find_call_out(master_ob, name), 10); // the one due first
+    EXPECT_EQ(remove_call_out(master_ob, name), 10);
+    EXPECT_EQ(find_call_out(master_ob, name), 40);
+    EXPECT_EQ(remove_call_out(master_ob, name), 40);
+    EXPECT_EQ(find_call_out(master_ob, name), -1);
+
+    char other[] = "tock";
+    EXPECT_EQ(find_call_out(master_ob, other), 20);
+    char unknown[] = "no call_out has this name";
+    EXPECT_EQ(find_call_out(master_ob, unknown), -1);
+    remove_all_call_out(master_ob);
+}
+
+TEST_F(CallOutTest, callOutInfo) {
+    schedule(master_ob, "a", 3 * 1000000);
+    schedule(master_ob, "b", 3600 * 1000000LL); // lands in an outer level of the wheel
+    schedule(master_ob, "c", 90LL * 24 * 3600 * 1000000); // beyond the range of the wheel
+
+    array_t* info = get_all_call_outs();
+    ASSERT_EQ(info->size, 3);
+    int64_t total = 0;
+    for (int i = 0; i < info->size; i++) {
+        array_t* item = info->item[i].u.arr;
+        ASSERT_EQ(item->size, 3);
+        EXPECT_EQ(item->item[0].u.ob, master_ob);
+        EXPECT_EQ(item->item[1].type, T_STRING);
+        total += item->item[2].u.number;
+    }
+    EXPECT_EQ(total, 3 + 3600 + 90LL * 24 * 3600);
+    free_array(info);
+    remove_all_call_out(master_ob);
+}
+
+TEST_F(CallOutTest, subSecondCallOut) {
+    EXPECT_EQ(call_out_wait_time(), -1); // nothing pending
+
+    int h = schedule(master_ob, "no_such_function", 200000);
+    int64_t wait = call_out_wait_time();
+    EXPECT_GE(wait, 0);
+    EXPECT_LE(wait, 200000 + CALLOUT_TICK_INTERVAL);
+
+    call_out(); // too early, nothing happens
+    EXPECT_EQ(find_call_out_by_handle(h), 0);
+
+    std::this_thread::sleep_for(std::chrono::microseconds(200000 + 2 * CALLOUT_TICK_INTERVAL));
+    EXPECT_EQ(call_out_wait_time(), 0);
+    call_out();
+    EXPECT_EQ(find_call_out_by_handle(h), -1) << "call_out should have been executed";
+    EXPECT_EQ(call_out_wait_time(), -1);
+}
+
+TEST_F(CallOutTest, destructCancelsCallOuts) {
+    object_t* ob = load_object("room/observatory.c", 0);
+    ASSERT_NE(ob, nullptr);
+
+    int h = schedule(ob, "no_such_function", 10 * 1000000);
+    int refs = ob->ref;
+    destruct_object(ob);
+    EXPECT_EQ(find_call_out_by_handle(h), -1);
+    EXPECT_EQ(ob->ref, refs - 1) << "reference held by the call_out should be released";
+}
+
+TEST_F(CallOutTest, DISABLED_benchmarkScheduleAndCancel) {
+    // object_t::ref is 16 bits, so schedule in batches below 65535 call_outs
+    const int batch = 50000;
+    const int rounds = 20;
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<int64_t> delays(1, 3600LL * 1000000);
+    std::vector<int> handles(batch);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < batch; i++)
+            handles[i] = schedule(master_ob, "no_such_function", delays(rng));
+        std::shuffle(handles.begin(), handles.end(), rng);
+        if (r % 2) {
+            for (int i = 0; i < batch; i++)
+                ASSERT_GE(remove_call_out_by_handle(handles[i]), 0);
+        }
+        else {
+            remove_all_call_out(master_ob);
+        }
+        ASSERT_EQ(master_ob->call_outs, nullptr);
+    }
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    debug_message("[ BENCH    ] scheduled and cancelled %d call_outs in %.1f ms\n", batch * rounds, elapsed);
+    RecordProperty("call_outs", batch * rounds);
+    RecordProperty("elapsed_ms", (int)elapsed);
+}
@@ -0,0 +1,115 @@
+/**
+ * @file test_user_input.cpp
+ * @brief Unit tests for reading user input through the async runtime
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+#include <gtest/gtest.h>
+#include <string>
+
+extern "C" {
+    #include "std.h"
+    #include "rc.h"
+    #include "lpc/object.h"
+    #include "comm.h"
+    #include "command.h"
+    #include "backend.h"
+}
+
+using namespace testing;
+
+class UserInputTest: public Test {
+protected:
+    object_t ob = {};
+    interactive_t* ip = nullptr;
+    socket_fd_t fds[2] = { INVALID_SOCKET_FD, INVALID_SOCKET_FD };
+    async_runtime_t* save_runtime = nullptr;
+
+    void SetUp() override {
+        debug_set_log_with_date (0);
+        init_stem(1, 0, "m3.conf");
+        ASSERT_EQ(create_test_socket_pair(fds), 0);
+
+        save_runtime = g_runtime;
+        g_runtime = async_runtime_init();
+        ASSERT_NE(g_runtime, nullptr);
+
+        /* a telnet user reading from fds[0], as set up by new_interactive() */
+        ip = create_test_interactive(&ob);
+        ASSERT_NE(ip, nullptr);
+        ip->fd = fds[0];
+        ip->connection_type = PORT_TELNET;
+        ASSERT_EQ(async_runtime_add(g_runtime, fds[0], EVENT_READ, ip), 0);
+        ASSERT_EQ(async_runtime_post_read(g_runtime, fds[0], NULL, 0), 0);
+    }
+
+    void TearDown() override {
+        if (g_runtime) {
+            async_runtime_remove(g_runtime, fds[0]);
+            async_runtime_deinit(g_runtime);
+        }
+        g_runtime = save_runtime;
+        if (ob.interactive)
+            remove_test_interactive(ob.interactive);
+        SOCKET_CLOSE(fds[0]);
+        SOCKET_CLOSE(fds[1]);
+    }
+
+    /* use up one command per cycle, like process_user_command() */
+    bool take_command(std::string& out) {
+        if (!cmd_in_buf(ip))
+            return false;
+        while (ip->text_start < ip->text_end && !ip->text[ip->text_start])
+            ip->text_start++;
+        char* cmd = ip->text + ip->text_start;
+        char buf[MAX_TEXT];
+        ip->text_start += strlen(cmd) + 1;
+        if (!cmd_in_buf(ip))
+            ip->iflags &= ~CMD_IN_BUF;
+        telnet_neg(buf, cmd);
+        out += std::string(buf) + "\n";
+        return true;
+    }
+};
+
+TEST_F(UserInputTest, burstLargerThanReceiveBuffer) {
+    /* one write of many lines, well over a receive buffer and the room in text */
+    std::string sent, expected;
+    for (int i = 0; i < 400; i++) {
+        sent += "say line " + std::to_string(i) + "\r\n";
+        expected += "say line " + std::to_string(i) + "\n";
+    }
+    ASSERT_GT(sent.size(), 4096u);
+    ASSERT_EQ(SOCKET_SEND(fds[1], sent.data(), sent.size(), 0), (ssize_t)sent.size());
+
+    std::string received;
+    for (int cycle = 0; cycle < 5000 && received.size() < expected.size(); cycle++) {
+        struct timeval timeout = { 0, 1000 };
+        int has_pending = (ip->iflags & CMD_IN_BUF) || ip->input_pending_len;
+        if (do_comm_polling(&timeout) > 0 || has_pending)
+            process_io();
+        take_command(received);
+    }
+    EXPECT_EQ(received, expected);
+    EXPECT_EQ(ip->input_pending_len, 0u);
+}
+
+TEST_F(UserInputTest, longLineIsStillDiscarded) {
+    /* a line longer than the input buffer is dropped, the next one gets through */
+    std::string sent = std::string(3 * MAX_TEXT, 'x') + "\r\nlook\r\n";
+    ASSERT_EQ(SOCKET_SEND(fds[1], sent.data(), sent.size(), 0), (ssize_t)sent.size());
+
+    std::string received;
+    for (int cycle = 0; cycle < 1000 && received.find("look\n") == std::string::npos; cycle++) {
+        struct timeval timeout = { 0, 1000 };
+        int has_pending = (ip->iflags & CMD_IN_BUF) || ip->input_pending_len;
+        if (do_comm_polling(&timeout) > 0 || has_pending)
+            process_io();
+        take_command(received);
+    }
+    ASSERT_GE(received.size(), 5u);
+    EXPECT_EQ(received.substr(received.size() - 5), "look\n");
+    EXPECT_LT(received.size(), 3u * MAX_TEXT);
+}
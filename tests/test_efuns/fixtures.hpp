@@ -12,6 +12,7 @@ extern "C" {
     #include "lpc/array.h"
     #include "lpc/object.h"
     #include "lpc/otable.h"
+    #include "efuns/async_file.h"
 }
 
 using namespace testing;
@@ -4,6 +4,16 @@
 
 #include "fixtures.hpp"
 
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+extern "C" {
+    #include "lpc/include/save.h"
+}
+
 TEST_F(EfunsTest, saveObject) {
     namespace fs = std::filesystem;
     char save_file_path[] = "test_save_object.o";
@@ -51,3 +61,367 @@ TEST_F(EfunsTest, saveObject) {
 
     destruct_object(obj);
 }
+
+TEST_F(EfunsTest, asyncSaveObjectAndReadFile) {
+    namespace fs = std::filesystem;
+    char save_file_path[] = "test_async_save_object.o";
+    async_runtime_t* runtime = async_runtime_init();
+    ASSERT_NE(runtime, nullptr);
+    ASSERT_TRUE(async_file_init(runtime));
+
+    object_t* obj = load_object("/tests/efuns/test_async_save_object",
+        "int x;\n"
+        "string *results = ({});\n"
+        "void create() { x = 42; }\n"
+        "void set_x(int n) { x = n; }\n"
+        "void saved(string file, int ok) { results += ({ file + \":\" + ok }); }\n"
+        "void read(string file, string str) { results += ({ str }); }\n"
+        "string *get_results() { return results; }\n"
+    );
+    ASSERT_NE(obj, nullptr) << "Failed to load test object";
+
+    // the save is queued; variables are taken right away
+    current_object = obj;
+    st_num_arg = 2;
+    push_constant_string(save_file_path);
+    push_constant_string("saved");
+    f_async_save_object();
+    ASSERT_EQ(sp->type, T_NUMBER);
+    ASSERT_EQ(sp->u.number, 1) << "Failed to queue the save";
+    pop_stack();
+    push_number(7);
+    apply_low("set_x", obj, 1);
+    pop_stack();
+
+    // callbacks are called from the completion events
+    auto wait_for_callbacks = [runtime]() {
+        io_event_t events[8];
+        for (int tries = 0; tries < 50 && async_file_pending() > 0; tries++) {
+            struct timeval timeout = { 0, 100000 };
+            int n = async_runtime_wait(runtime, events, 8, &timeout);
+            for (int i = 0; i < n; i++)
+                if (events[i].completion_key == ASYNC_FILE_COMPLETION_KEY)
+                    async_file_complete(&events[i]);
+        }
+        return async_file_pending() == 0;
+    };
+    ASSERT_TRUE(wait_for_callbacks());
+    EXPECT_TRUE(fs::exists(save_file_path)) << "Save file was not created";
+
+    current_object = obj;
+    push_constant_string(save_file_path);
+    push_constant_string("read");
+    f_async_read_file();
+    ASSERT_EQ(sp->u.number, 1) << "Failed to queue the read";
+    pop_stack();
+    ASSERT_TRUE(wait_for_callbacks());
+
+    apply_low("get_results", obj, 0);
+    ASSERT_EQ(sp->type, T_ARRAY);
+    ASSERT_EQ(sp->u.arr->size, 2);
+    EXPECT_STREQ(sp->u.arr->item[0].u.string, "test_async_save_object.o:1");
+    ASSERT_EQ(sp->u.arr->item[1].type, T_STRING);
+    EXPECT_STREQ(sp->u.arr->item[1].u.string,
+                 "#/tests/efuns/test_async_save_object.c\nx 42\nresults ({})\n");
+    pop_stack();
+
+    destruct_object(obj);
+    async_file_shutdown(5000);
+    async_runtime_deinit(runtime);
+    fs::remove(save_file_path);
+}
+
+TEST_F(EfunsTest, asyncFileJobsKeepOrderPerPath) {
+    namespace fs = std::filesystem;
+    const char* log_path = "test_async_order.log";
+    const char* save_file_path = "test_async_order.o";
+    fs::remove(log_path);
+    async_runtime_t* runtime = async_runtime_init();
+    ASSERT_NE(runtime, nullptr);
+    ASSERT_TRUE(async_file_init(runtime));
+
+    object_t* obj = load_object("/tests/efuns/test_async_order",
+        "int x;\n"
+        "int done;\n"
+        "void set_x(int n) { x = n; }\n"
+        "void written(string file, int ok) { done += ok; }\n"
+        "int get_done() { return done; }\n"
+    );
+    ASSERT_NE(obj, nullptr);
+    current_object = obj;
+
+    svalue_t file, callback;
+    file.type = T_STRING;
+    file.subtype = STRING_CONSTANT;
+    callback = file;
+    callback.u.string = (char*)"written";
+
+    // appends to one file land in the order they were made
+    std::string expected;
+    for (int i = 0; i < 50; i++) {
+        std::string line = std::to_string(i) + "\n";
+        file.u.string = (char*)log_path;
+        ASSERT_EQ(async_write_file(&file, line.c_str(), &callback, 0), 1);
+        expected += line;
+    }
+
+    // saves of one file too, and a save_object() comes after all of them
+    for (int i = 1; i <= 10; i++) {
+        push_number(i);
+        apply_low("set_x", obj, 1);
+        pop_stack();
+        file.u.string = (char*)save_file_path;
+        ASSERT_EQ(async_save_object(obj, &file, &callback, 0), 1);
+    }
+    push_number(99);
+    apply_low("set_x", obj, 1);
+    pop_stack();
+    current_object = obj;
+    ASSERT_EQ(save_object(obj, save_file_path, 0), 1);
+
+    io_event_t events[8];
+    for (int tries = 0; tries < 50 && async_file_pending() > 0; tries++) {
+        struct timeval timeout = { 0, 100000 };
+        int n = async_runtime_wait(runtime, events, 8, &timeout);
+        for (int i = 0; i < n; i++)
+            if (events[i].completion_key == ASYNC_FILE_COMPLETION_KEY)
+                async_file_complete(&events[i]);
+    }
+    ASSERT_EQ(async_file_pending(), 0);
+    apply_low("get_done", obj, 0);
+    EXPECT_EQ(sp->u.number, 60);
+    pop_stack();
+
+    std::ifstream log(log_path, std::ios::binary);
+    EXPECT_EQ(std::string(std::istreambuf_iterator<char>(log), {}), expected);
+    std::ifstream save(save_file_path, std::ios::binary);
+    std::string saved(std::istreambuf_iterator<char>(save), {});
+    EXPECT_NE(saved.find("\nx 99\n"), std::string::npos) << saved;
+    for (auto& entry : fs::directory_iterator("."))
+        EXPECT_NE(entry.path().extension(), ".tmp") << "temporary file left behind: " << entry.path();
+
+    destruct_object(obj);
+    async_file_shutdown(5000);
+    async_runtime_deinit(runtime);
+    fs::remove(log_path);
+    fs::remove(save_file_path);
+}
+
+// a player-like object: a quest log and an inventory of nested mappings
+static const char* player_source =
+    "string name;\n"
+    "int level, gold;\n"
+    "float weight;\n"
+    "mapping quests;\n"
+    "mixed *inventory;\n"
+    "object last_seen;\n"
+    "void generate(int n) {\n"
+    "    int i;\n"
+    "    name = \"Tester \\\"the\\\" \\\\great\\\\\\nof lines\";\n"
+    "    level = -(1 << 40) - 7;\n"
+    "    gold = 0;\n"
+    "    weight = 3.25;\n"
+    "    last_seen = this_object();\n"
+    "    quests = ([ ]);\n"
+    "    for (i = 0; i < n; i++) quests[\"quest_\" + i] = ({ i, \"done\", i * 1.5, 0 });\n"
+    "    inventory = ({ });\n"
+    "    for (i = 0; i < n; i++)\n"
+    "        inventory += ({ ([ \"name\": \"sword\", \"id\": i, 7: ({ }),\n"
+    "                           \"props\": ([ \"sharp\": 1, \"material\": \"steel\" ]) ]) });\n"
+    "}\n"
+    "void clear() { name = 0; level = 0; gold = 5; weight = 0.0; quests = 0; inventory = 0; }\n"
+    "string dump() { return save_variable(({ name, level, gold, weight, quests, inventory })); }\n"
+    "int seen() { return objectp(last_seen); }\n";
+
+static std::string dump_player(object_t* obj) {
+    apply_low("dump", obj, 0);
+    std::string s = sp->type == T_STRING ? sp->u.string : "";
+    pop_stack();
+    return s;
+}
+
+TEST_F(EfunsTest, saveObjectBinary) {
+    namespace fs = std::filesystem;
+    const char* save_file_path = "test_save_binary.o";
+    object_t* obj = load_object("/tests/efuns/test_save_binary", player_source);
+    ASSERT_NE(obj, nullptr) << "Failed to load test object";
+    push_number(20);
+    apply_low("generate", obj, 1);
+    pop_stack();
+    std::string expected = dump_player(obj);
+
+    for (int flags : { SAVE_BINARY, SAVE_BINARY | SAVE_ZEROS, 0 }) {
+        current_object = obj;
+        ASSERT_EQ(save_object(obj, save_file_path, flags), 1) << "flags " << flags;
+        if (flags & SAVE_BINARY) {
+            std::ifstream in(save_file_path, std::ios::binary);
+            char magic[4] = {};
+            in.read(magic, 4);
+            EXPECT_EQ(std::string(magic, 4), "\177NSO") << "binary save files start with a magic header";
+        }
+
+        // restore detects the format by itself
+        apply_low("clear", obj, 0);
+        pop_stack();
+        ASSERT_EQ(restore_object(obj, save_file_path, 0), 1) << "flags " << flags;
+        EXPECT_EQ(dump_player(obj), expected) << "flags " << flags;
+    }
+
+    // objects are not saved
+    apply_low("seen", obj, 0);
+    EXPECT_EQ(sp->u.number, 0);
+    pop_stack();
+
+    // with noclear, variables missing from the save file are kept
+    ASSERT_EQ(save_object(obj, save_file_path, SAVE_BINARY), 1);
+    apply_low("clear", obj, 0);
+    pop_stack();
+    ASSERT_EQ(restore_object(obj, save_file_path, 1), 1);
+    EXPECT_NE(dump_player(obj).find(",-1099511627783,5,3.25,"), std::string::npos) << "gold was 0 and not saved";
+
+    destruct_object(obj);
+    fs::remove(save_file_path);
+}
+
+TEST_F(EfunsTest, restoreObjectFormatErrors) {
+    namespace fs = std::filesystem;
+    const char* save_file_path = "test_restore_errors.o";
+    object_t* obj = load_object("/tests/efuns/test_restore_errors",
+        "int x;\n"
+        "mixed *a;\n"
+        "mapping m;\n"
+        "int get_x() { return x; }\n"
+        "int get_size() { return sizeof(a) + sizeof(m); }\n"
+    );
+    ASSERT_NE(obj, nullptr);
+
+    // text files written with CRLF line ends restore as well
+    {
+        std::ofstream out(save_file_path, std::ios::binary);
+        out << "#/tests/efuns/test_restore_errors.c\r\nx 5000000000\r\na ({1,\"two\",({}),})\r\nm ([\"k\":1,2:({3,}),])\r\n";
+    }
+    current_object = obj;
+    ASSERT_EQ(restore_object(obj, save_file_path, 0), 1);
+    apply_low("get_x", obj, 0);
+    EXPECT_EQ(sp->u.number, 5000000000LL) << "numbers are 64-bit";
+    pop_stack();
+    apply_low("get_size", obj, 0);
+    EXPECT_EQ(sp->u.number, 5);
+    pop_stack();
+
+    // malformed data raises an error instead of crashing or leaking
+    const std::string bad[] = {
+        "x 1\na ({1,2\n",
+        "a ({1,\"two\"})\n",
+        "m ([\"k\"1,])\n",
+        "a (<1,>)\n",
+        // binary: unterminated string in the string table
+        std::string("\177NSO\001\003abc\002\001x\001y\000", 15),
+        // binary: array larger than the file
+        std::string("\177NSO\001\000\001\001x\000\000\004\377\377\377\377\017", 17),
+    };
+    for (const std::string& data : bad) {
+        {
+            std::ofstream out(save_file_path, std::ios::binary);
+            out << data;
+        }
+        error_context_t econ;
+        save_context(&econ);
+        bool raised = false;
+        if (setjmp(econ.context))
+        {
+            restore_context(&econ);
+            raised = true;
+        }
+        else
+            restore_object(obj, save_file_path, 0);
+        pop_context(&econ);
+        EXPECT_TRUE(raised) << "no error for: " << data;
+    }
+
+    destruct_object(obj);
+    fs::remove(save_file_path);
+}
+
+TEST_F(EfunsTest, restoreMappingDuplicateKeys) {
+    namespace fs = std::filesystem;
+    const char* save_file_path = "test_restore_dups.o";
+    object_t* obj = load_object("/tests/efuns/test_restore_dups",
+        "mapping m;\n"
+        "string s;\n"
+        "void setup() {\n"
+        "    m = ([ this_object(): \"first\" + \" value\", (: 1 :): \"second\" + \" value\" ]);\n"
+        "}\n"
+        "mixed *get() { return ({ sizeof(m), m[0], strlen(s) }); }\n"
+    );
+    ASSERT_NE(obj, nullptr);
+    apply_low("setup", obj, 0);
+    pop_stack();
+    current_object = obj;
+
+    for (int flags : { 0, SAVE_BINARY }) {
+        // objects and functions are saved as 0, the second value replaces the first
+        ASSERT_EQ(save_object(obj, save_file_path, flags), 1) << "flags " << flags;
+        ASSERT_EQ(restore_object(obj, save_file_path, 0), 1) << "flags " << flags;
+        int strings = num_distinct_strings;
+        for (int i = 0; i < 3; i++)
+            ASSERT_EQ(restore_object(obj, save_file_path, 0), 1) << "flags " << flags;
+        EXPECT_EQ(num_distinct_strings, strings) << "replaced values are freed, flags " << flags;
+
+        apply_low("get", obj, 0);
+        ASSERT_EQ(sp->type, T_ARRAY);
+        EXPECT_EQ(sp->u.arr->item[0].u.number, 1);
+        ASSERT_EQ(sp->u.arr->item[1].type, T_STRING);
+        pop_stack();
+    }
+
+    // binary: a string with an embedded '\0'
+    {
+        std::ofstream out(save_file_path, std::ios::binary);
+        out << std::string("\177NSO\001\000\002\001s\000\003a\000b\000\000\003\001", 18);
+    }
+    ASSERT_EQ(restore_object(obj, save_file_path, 1), 1);
+    apply_low("get", obj, 0);
+    EXPECT_EQ(sp->u.arr->item[2].u.number, 3);
+    pop_stack();
+
+    destruct_object(obj);
+    fs::remove(save_file_path);
+}
+
+TEST_F(EfunsTest, DISABLED_benchmarkSaveRestore) {
+    namespace fs = std::filesystem;
+    const int players = 20, rounds = 10;
+    object_t* obj = load_object("/tests/efuns/test_save_player", player_source);
+    ASSERT_NE(obj, nullptr);
+    push_number(300);
+    apply_low("generate", obj, 1);
+    pop_stack();
+    std::string expected = dump_player(obj);
+    current_object = obj;
+
+    for (int flags : { 0, SAVE_BINARY }) {
+        const char* kind = flags ? "binary" : "text";
+        std::vector<std::string> files;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < players; i++) {
+            files.push_back("test_player_" + std::to_string(i) + ".o");
+            ASSERT_EQ(save_object(obj, files.back().c_str(), flags), 1);
+        }
+        auto saved = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++)
+            for (auto& file : files)
+                ASSERT_EQ(restore_object(obj, file.c_str(), 0), 1);
+        auto restored = std::chrono::steady_clock::now();
+        EXPECT_EQ(dump_player(obj), expected) << kind;
+
+        double save_ms = std::chrono::duration<double, std::milli>(saved - start).count();
+        double restore_ms = std::chrono::duration<double, std::milli>(restored - saved).count();
+        debug_message("[ BENCH    ] %s player file (%zu bytes): save %.3f ms, restore %.3f ms\n",
+                      kind, (size_t)fs::file_size(files[0]), save_ms / players, restore_ms / (players * rounds));
+        RecordProperty(std::string(kind) + "_restore_us", (int)(restore_ms * 1000 / (players * rounds)));
+        for (auto& file : files)
+            fs::remove(file);
+    }
+    destruct_object(obj);
+}
@@ -0,0 +1,166 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "fixtures.hpp"
+#include <chrono>
+#include <string>
+#include <vector>
+
+// efuns/regexp.h can't be included here: its regcomp() and regexec() clash
+// with the POSIX ones of <regex.h>, which gtest pulls in
+extern "C" {
+    struct regexp;
+    extern int regexp_user;
+    extern char *regexp_error;
+    extern unsigned long regexp_cache_hits;
+    extern unsigned long regexp_cache_misses;
+    struct regexp *regcomp_cached(const char *, int);
+    void clear_regexp_cache(void);
+    int regexp_cache_size(void);
+}
+#define EFUN_REGEXP 1           /* as in efuns/regexp.h */
+#define REGEXP_CACHE_SIZE 512
+
+TEST_F(EfunsTest, regexpCache) {
+    clear_regexp_cache();
+    char text[] = "hello world";
+    char pattern[] = "wor.d$";
+
+    unsigned long hits = regexp_cache_hits, misses = regexp_cache_misses;
+    EXPECT_EQ(match_single_regexp(text, pattern), 1);
+    EXPECT_EQ(regexp_cache_misses, misses + 1);
+    EXPECT_EQ(match_single_regexp(text, pattern), 1);
+    EXPECT_EQ(regexp_cache_hits, hits + 1);
+    EXPECT_EQ(regexp_cache_size(), 1);
+
+    // the same text with another excompat flag is another program
+    struct regexp *prog = regcomp_cached(pattern, 0);
+    EXPECT_NE(regcomp_cached(pattern, 1), prog);
+    EXPECT_EQ(regcomp_cached(pattern, 0), prog);
+    EXPECT_EQ(regexp_cache_size(), 2);
+
+    // regexp(string *, pattern)
+    array_t *v = allocate_empty_array(3);
+    const char *lines[] = { "world", "word", "a world" };
+    for (int i = 0; i < 3; i++) {
+        v->item[i].type = T_STRING;
+        v->item[i].subtype = STRING_MALLOC;
+        v->item[i].u.string = string_copy(lines[i], "regexpCache");
+    }
+    array_t *r = match_regexp(v, pattern, 0);
+    ASSERT_EQ(r->size, 2);
+    EXPECT_STREQ(r->item[0].u.string, "world");
+    EXPECT_STREQ(r->item[1].u.string, "a world");
+    free_array(r);
+    free_array(v);
+
+    // patterns that don't compile are not cached
+    regexp_user = EFUN_REGEXP;
+    EXPECT_EQ(regcomp_cached("a(b", 0), nullptr);
+    EXPECT_NE(regexp_error, nullptr);
+    EXPECT_EQ(regexp_cache_size(), 2);
+
+    clear_regexp_cache();
+    EXPECT_EQ(regexp_cache_size(), 0);
+}
+
+TEST_F(EfunsTest, regexpCacheEvictsLeastRecentlyUsed) {
+    clear_regexp_cache();
+    std::vector<std::string> patterns;
+    for (int i = 0; i < REGEXP_CACHE_SIZE + 1; i++)
+        patterns.push_back("^say" + std::to_string(i) + " .*");
+
+    for (int i = 0; i < REGEXP_CACHE_SIZE; i++)
+        ASSERT_NE(regcomp_cached(patterns[i].c_str(), 0), nullptr);
+    EXPECT_EQ(regexp_cache_size(), REGEXP_CACHE_SIZE);
+
+    // touch the oldest, then add one more: the second oldest goes
+    regcomp_cached(patterns[0].c_str(), 0);
+    regcomp_cached(patterns[REGEXP_CACHE_SIZE].c_str(), 0);
+    EXPECT_EQ(regexp_cache_size(), REGEXP_CACHE_SIZE);
+
+    unsigned long misses = regexp_cache_misses;
+    regcomp_cached(patterns[0].c_str(), 0);
+    EXPECT_EQ(regexp_cache_misses, misses);
+    regcomp_cached(patterns[1].c_str(), 0);
+    EXPECT_EQ(regexp_cache_misses, misses + 1);
+
+    clear_regexp_cache();
+}
+
+TEST_F(EfunsTest, regAssocCached) {
+    clear_regexp_cache();
+    char text[] = "take sword from chest";
+    array_t *pat = allocate_empty_array(2);
+    array_t *tok = allocate_empty_array(2);
+    const char *pats[] = { "sword|shield", "chest|box" };
+    for (int i = 0; i < 2; i++) {
+        pat->item[i].type = T_STRING;
+        pat->item[i].subtype = STRING_MALLOC;
+        pat->item[i].u.string = string_copy(pats[i], "regAssocCached");
+        tok->item[i].type = T_NUMBER;
+        tok->item[i].u.number = i + 1;
+    }
+
+    for (int round = 0; round < 2; round++) {
+        array_t *r = reg_assoc(text, pat, tok, &const0);
+        ASSERT_EQ(r->item[0].u.arr->size, 5);
+        EXPECT_STREQ(r->item[0].u.arr->item[1].u.string, "sword");
+        EXPECT_STREQ(r->item[0].u.arr->item[3].u.string, "chest");
+        EXPECT_EQ(r->item[1].u.arr->item[1].u.number, 1);
+        EXPECT_EQ(r->item[1].u.arr->item[3].u.number, 2);
+        free_array(r);
+    }
+    EXPECT_EQ(regexp_cache_size(), 2);
+
+    free_array(pat);
+    free_array(tok);
+    clear_regexp_cache();
+}
+
+TEST_F(EfunsTest, DISABLED_benchmarkRegexpCache) {
+    // a chat filter and a command parser: a few hundred patterns, each tried on every line
+    std::vector<std::string> patterns;
+    const char *words[] = { "idiot", "noob", "spam", "scam", "gold", "sell", "buy", "cheap" };
+    for (int i = 0; i < 160; i++)
+        patterns.push_back(std::string("\\<") + words[i % 8] + std::to_string(i / 8) + "\\>");
+    const char *verbs[] = { "get", "take", "drop", "put", "give", "look", "open", "close" };
+    for (int i = 0; i < 8; i++) {
+        patterns.push_back(std::string("^") + verbs[i] + " [a-z]+$");
+        patterns.push_back(std::string("^") + verbs[i] + " [a-z]+ (from|in|on) [a-z]+$");
+        patterns.push_back(std::string("^") + verbs[i] + " (all|every) [a-z]+( [0-9]+)?$");
+        patterns.push_back(std::string("^") + verbs[i] + " [a-z]+ to [A-Z][a-z]*$");
+        patterns.push_back(std::string("^(") + verbs[i] + "|" + verbs[(i + 1) % 8] + ") .*");
+    }
+    std::vector<std::string> lines = {
+        "get sword", "take coin from chest", "give apple to Alice", "drop all torches 3",
+        "hello there, anyone selling gold12 cheap?", "look", "open door on wall",
+        "you are a noob3 lol", "buy4 sell4 cheap4 gold4 now", "put gem in box",
+    };
+
+    int rounds = 50, cached_matches = 0, uncached_matches = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+        for (auto &line : lines)
+            for (auto &p : patterns) {
+                clear_regexp_cache(); // compile every time, as without the cache
+                uncached_matches += match_single_regexp((char *)line.c_str(), (char *)p.c_str());
+            }
+    auto uncached = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+        for (auto &line : lines)
+            for (auto &p : patterns)
+                cached_matches += match_single_regexp((char *)line.c_str(), (char *)p.c_str());
+    auto cached = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    clear_regexp_cache();
+
+    EXPECT_EQ(cached_matches, uncached_matches);
+    EXPECT_GT(cached_matches, 0);
+    debug_message("[ BENCH    ] %zu patterns x %zu lines x %d rounds: uncached %.1f ms, cached %.1f ms\n",
+                  patterns.size(), lines.size(), rounds, uncached, cached);
+    RecordProperty("uncached_ms", (int)uncached);
+    RecordProperty("cached_ms", (int)cached);
+}
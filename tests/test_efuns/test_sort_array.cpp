@@ -0,0 +1,240 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "fixtures.hpp"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+    #include "lpc/sort.h"
+    // the old sort of sort_array(), for comparison
+    void quickSort(void *, int, int, int (*)(svalue_t *, svalue_t *));
+}
+
+static array_t *make_int_array(const std::vector<int64_t> &values) {
+    array_t *v = allocate_empty_array(values.size());
+    for (size_t i = 0; i < values.size(); i++) {
+        v->item[i].type = T_NUMBER;
+        v->item[i].subtype = 0;
+        v->item[i].u.number = values[i];
+    }
+    return v;
+}
+
+static std::vector<int64_t> int_values(array_t *v) {
+    std::vector<int64_t> values;
+    for (int i = 0; i < v->size; i++)
+        values.push_back(v->item[i].u.number);
+    return values;
+}
+
+// the input patterns of the benchmark
+static std::vector<int64_t> make_pattern(const std::string &pattern, size_t n) {
+    std::mt19937 rng(42);
+    std::vector<int64_t> values(n);
+    for (size_t i = 0; i < n; i++) {
+        if (pattern == "sorted")
+            values[i] = i;
+        else if (pattern == "reversed")
+            values[i] = n - i;
+        else if (pattern == "duplicates")
+            values[i] = rng() % 8;
+        else if (pattern == "sawtooth")
+            values[i] = i % 100;
+        else
+            values[i] = rng() % (n * 4);
+    }
+    return values;
+}
+
+static int cmp_number(svalue_t *a, svalue_t *b) {
+    return a->u.number < b->u.number ? -1 : a->u.number > b->u.number;
+}
+
+static int cmp_random(svalue_t *, svalue_t *) {
+    static std::mt19937 rng(7);
+    return (int)(rng() % 3) - 1;
+}
+
+TEST_F(EfunsTest, sortArrayInts) {
+    for (const char *pattern : { "random", "sorted", "reversed", "duplicates", "sawtooth" }) {
+        for (size_t n : { 0, 1, 2, 5, 23, 24, 100, 129, 1000, 10000 }) {
+            std::vector<int64_t> values = make_pattern(pattern, n), expected = values;
+            std::sort(expected.begin(), expected.end());
+
+            array_t *v = builtin_sort_array(make_int_array(values), 1);
+            EXPECT_EQ(int_values(v), expected) << pattern << " " << n;
+            free_array(v);
+
+            std::reverse(expected.begin(), expected.end());
+            v = builtin_sort_array(make_int_array(values), -1);
+            EXPECT_EQ(int_values(v), expected) << pattern << " " << n << " descending";
+            free_array(v);
+        }
+    }
+}
+
+TEST_F(EfunsTest, sortArrayFloatsAndStrings) {
+    array_t *v = allocate_empty_array(5);
+    double reals[] = { 2.5, -1.0, 3.25, 0.0, -7.5 };
+    for (int i = 0; i < 5; i++) {
+        v->item[i].type = T_REAL;
+        v->item[i].u.real = reals[i];
+    }
+    builtin_sort_array(v, -1);
+    EXPECT_EQ(v->item[0].u.real, 3.25);
+    EXPECT_EQ(v->item[4].u.real, -7.5);
+    free_array(v);
+
+    // shared and malloc'ed strings, with duplicates
+    const char *words[] = { "pear", "apple", "fig", "apple", "kiwi", "banana", "fig", "cherry" };
+    v = allocate_empty_array(8);
+    for (int i = 0; i < 8; i++) {
+        v->item[i].type = T_STRING;
+        if (i % 2) {
+            v->item[i].subtype = STRING_SHARED;
+            v->item[i].u.string = make_shared_string(words[i]);
+        } else {
+            v->item[i].subtype = STRING_MALLOC;
+            v->item[i].u.string = string_copy(words[i], "sortArrayFloatsAndStrings");
+        }
+    }
+    builtin_sort_array(v, 0);
+    std::string sorted;
+    for (int i = 0; i < 8; i++)
+        sorted += std::string(v->item[i].u.string) + " ";
+    EXPECT_EQ(sorted, "apple apple banana cherry fig fig kiwi pear ");
+    free_array(v);
+}
+
+TEST_F(EfunsTest, sortArrayStable) {
+    // ({ key, original position }) with many equal keys
+    const int n = 500;
+    std::vector<int64_t> keys = make_pattern("duplicates", n);
+    for (int dir : { 2, -2 }) {
+        array_t *v = allocate_empty_array(n);
+        for (int i = 0; i < n; i++) {
+            array_t *row = make_int_array({ keys[i], i });
+            v->item[i].type = T_ARRAY;
+            v->item[i].u.arr = row;
+        }
+        builtin_sort_array(v, dir);
+        for (int i = 1; i < n; i++) {
+            array_t *prev = v->item[i - 1].u.arr, *cur = v->item[i].u.arr;
+            if (dir > 0) {
+                ASSERT_LE(prev->item[0].u.number, cur->item[0].u.number);
+            } else {
+                ASSERT_GE(prev->item[0].u.number, cur->item[0].u.number);
+            }
+            if (prev->item[0].u.number == cur->item[0].u.number) {
+                ASSERT_LT(prev->item[1].u.number, cur->item[1].u.number) << "dir " << dir;
+            }
+        }
+        free_array(v);
+    }
+}
+
+TEST_F(EfunsTest, sortArrayTypeErrors) {
+    array_t *mixed = allocate_empty_array(3);
+    mixed->item[0].type = T_NUMBER;
+    mixed->item[0].u.number = 1;
+    mixed->item[1].type = T_REAL;
+    mixed->item[1].u.real = 2.0;
+    mixed->item[2].type = T_NUMBER;
+    mixed->item[2].u.number = 0;
+
+    array_t *empty_row = allocate_empty_array(2);
+    empty_row->item[0].type = T_ARRAY;
+    empty_row->item[0].u.arr = make_int_array({ 1 });
+    empty_row->item[1].type = T_ARRAY;
+    empty_row->item[1].u.arr = &the_null_array;
+    the_null_array.ref++;
+
+    for (array_t *v : { mixed, empty_row }) {
+        error_context_t econ;
+        save_context (&econ);
+        if (setjmp(econ.context)) {
+            restore_context (&econ);
+            debug_message("***** expected: caught error raised by sort_array()");
+        }
+        else {
+            builtin_sort_array(v, 1);
+            ADD_FAILURE() << "sort_array() did not raise an error";
+        }
+        pop_context (&econ);
+        free_array(v);
+    }
+}
+
+TEST_F(EfunsTest, sortSvaluesInconsistentComparison) {
+    // a callback that answers at random must not lose or duplicate elements
+    const int n = 2000;
+    std::vector<svalue_t> v(n);
+    for (int i = 0; i < n; i++) {
+        v[i].type = T_NUMBER;
+        v[i].u.number = i;
+    }
+    for (int flags : { 0, SORT_STABLE }) {
+        sort_svalues(v.data(), n, cmp_random, flags);
+        std::vector<bool> seen(n);
+        for (auto &sv : v) {
+            ASSERT_GE(sv.u.number, 0);
+            ASSERT_LT(sv.u.number, n);
+            ASSERT_FALSE(seen[sv.u.number]);
+            seen[sv.u.number] = true;
+        }
+    }
+}
+
+TEST_F(EfunsTest, DISABLED_benchmarkSortArray) {
+    const size_t n = 50000;
+    const int rounds = 5;
+
+    for (const char *pattern : { "random", "sorted", "reversed", "duplicates", "sawtooth" }) {
+        std::vector<int64_t> values = make_pattern(pattern, n);
+        std::vector<svalue_t> input(n), v;
+        for (size_t i = 0; i < n; i++) {
+            input[i].type = T_NUMBER;
+            input[i].u.number = values[i];
+        }
+        double old_ms = 0, generic_ms = 0, stable_ms = 0, ints_ms = 0;
+
+        for (int round = 0; round < rounds; round++) {
+            v = input;
+            auto start = std::chrono::steady_clock::now();
+            quickSort(v.data(), (int)n, sizeof(svalue_t), cmp_number);
+            old_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            v = input;
+            start = std::chrono::steady_clock::now();
+            sort_svalues(v.data(), n, cmp_number, 0);
+            generic_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            for (size_t i = 1; i < n; i++)
+                ASSERT_LE(v[i - 1].u.number, v[i].u.number);
+
+            v = input;
+            start = std::chrono::steady_clock::now();
+            sort_svalues(v.data(), n, cmp_number, SORT_STABLE);
+            stable_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            v = input;
+            start = std::chrono::steady_clock::now();
+            sort_numbers(v.data(), n);
+            ints_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            for (size_t i = 1; i < n; i++)
+                ASSERT_LE(v[i - 1].u.number, v[i].u.number);
+        }
+
+        debug_message("[ BENCH    ] %d x %zu %s ints: old quicksort %.1f ms, introsort %.1f ms, "
+                      "stable %.1f ms, int specialized %.1f ms\n",
+                      rounds, n, pattern, old_ms, generic_ms, stable_ms, ints_ms);
+        RecordProperty(std::string(pattern) + "_old_ms", (int)old_ms);
+        RecordProperty(std::string(pattern) + "_introsort_ms", (int)generic_ms);
+        RecordProperty(std::string(pattern) + "_stable_ms", (int)stable_ms);
+        RecordProperty(std::string(pattern) + "_ints_ms", (int)ints_ms);
+    }
+}
@@ -0,0 +1,226 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "fixtures.hpp"
+#include <chrono>
+#include <string>
+#include <vector>
+
+extern "C" {
+    #include "efuns/sprintf.h"
+}
+
+// an sprintf() argument: a number, a float or a string
+struct Arg {
+    char type;
+    int64_t number;
+    double real;
+    const char *string;
+};
+static Arg N(int64_t n) { return Arg{ 'n', n, 0, nullptr }; }
+static Arg R(double r) { return Arg{ 'r', 0, r, nullptr }; }
+static Arg S(const char *s) { return Arg{ 's', 0, 0, s }; }
+
+static std::vector<svalue_t> make_args(const std::vector<Arg> &args) {
+    std::vector<svalue_t> sv(args.size() + 1);
+    for (size_t i = 0; i < args.size(); i++) {
+        switch (args[i].type) {
+        case 'n':
+            sv[i].type = T_NUMBER;
+            sv[i].subtype = 0;
+            sv[i].u.number = args[i].number;
+            break;
+        case 'r':
+            sv[i].type = T_REAL;
+            sv[i].u.real = args[i].real;
+            break;
+        default:
+            sv[i].type = T_STRING;
+            sv[i].subtype = STRING_CONSTANT;
+            sv[i].u.string = (char *)args[i].string;
+            break;
+        }
+    }
+    return sv;
+}
+
+// formats the arguments, "<error>" if sprintf() raises an error
+static std::string run(char *format_str, bool shared, std::vector<svalue_t> &sv) {
+    int argc = (int)sv.size() - 1;
+    std::string out;
+    error_context_t econ;
+    save_context(&econ);
+    if (setjmp(econ.context)) {
+        restore_context(&econ);
+        out = "<error>";
+    } else {
+        char *s = shared ? string_print_shared_format(format_str, argc, sv.data())
+                         : string_print_formatted(format_str, argc, sv.data());
+        out = s ? s : "<null>";
+        if (s)
+            FREE_MSTR(s);
+    }
+    pop_context(&econ);
+    return out;
+}
+
+// with the format string shared (and cached) if asked
+static std::string format(const char *fmt, const std::vector<Arg> &args, bool shared = false) {
+    std::vector<svalue_t> sv = make_args(args);
+    if (!shared)
+        return run((char *)fmt, false, sv);
+    char *format_str = make_shared_string(fmt);
+    std::string out = run(format_str, true, sv);
+    free_string(format_str);
+    return out;
+}
+
+static const char *text = "The quick brown fox jumps over the lazy dog and keeps running far away into the forest.";
+static const char *words = "apple\nbanana\ncherry\ndate\nelderberry\nfig\ngrape\nhoneydew\nkiwi\nlemon\nmango\nnectarine\norange";
+
+static const struct {
+    const char *format;
+    std::vector<Arg> args;
+    const char *expected;
+} cases[] = {
+    { "hello", {}, "hello" },
+    { "", {}, "<null>" },
+    { "%s", { S("abc") }, "abc" },
+    { "%s", { N(0) }, "0" },
+    { "%d", { N(42) }, "42" },
+    { "%i", { N(-42) }, "-42" },
+    { "%d", { N(1099511627776LL) }, "1099511627776" },
+    { "%d", { N(INT64_MIN) }, "-9223372036854775808" },
+    { "%d", { N(INT64_MAX) }, "9223372036854775807" },
+    { "%d", { S("x") }, "<error>" },
+    { "%5d|", { N(42) }, "   42|" },
+    { "%-5d|", { N(42) }, "42   |" },
+    { "%05d|", { N(-42) }, "00-42|" },
+    { "%+d % d %+d", { N(42), N(42), N(-42) }, "+42  42 -42" },
+    { "%.3d", { N(7) }, "007" },
+    { "%x %X %o %c", { N(255), N(255), N(8), N(65) }, "ff FF 10 A" },
+    { "%x", { N(1099511627776LL) }, "10000000000" },
+    { "%12.4f|%-8x|%08X", { R(123.456), N(3054), N(48879) }, "    123.4560|bee     |0000BEEF" },
+    { "%f", { N(1) }, "<error>" },
+    { "%|9s|", { S("ab") }, "    ab   |" },
+    { "%-10.3s|", { S("abcdef") }, "abc       |" },
+    { "%'ab'-11s|", { S("abc") }, "abcabababab|" },
+    { "%*s|", { N(6), S("abc") }, "   abc|" },
+    { "%-*s|", { N(-6), S("abc") }, "abc|" },
+    { "%*.*s|", { N(6), N(2), S("abc") }, "    ab|" },
+    { "%:*s|", { N(4), S("abcdefgh") }, "abcd|" },
+    { "%0*d|", { N(6), N(12) }, "000012|" },
+    { "%*s|", { S("x"), S("abc") }, "<error>" },
+    { "%%%d%%", { N(1) }, "%1%" },
+    { "%-=20s %-=15s\n", { S(text), S("short column of words here") },
+      "The quick brown fox  short column of\njumps over the lazy  words here\n"
+      "dog and keeps\nrunning far away\ninto the forest.\n" },
+    { "%#40s\n", { S(words) },
+      "        apple          fig        mango\n       banana        grape    nectarine\n"
+      "       cherry     honeydew       orange\n         date         kiwi\n   elderberry        lemon\n" },
+    { "%-10s|", { S("\x1b[1;31mred\x1b[0m") }, "\x1b[1;31mred\x1b[0m       |" },
+    { "%-5s|%5s|\n%|5s|", { S("a"), S("b"), S("c") }, "a    |    b|\n  c  |" },
+    { "%s\n", { S("trailing\n") }, "trailing\n\n" },
+    { "%-4s\n", { S("ab\n") }, "ab\n\n" },
+    { "%-6s|%s|%3s|", { S(""), S(""), S("") }, "      ||   |" },
+    { "%.2s|%-4.1s|%4.3s|", { S("abc"), S("xyz"), S("abcdef") }, "ab|x   | abc|" },
+    { "%d %s", { N(1) }, "<error>" },
+    { "%y", { N(1) }, "<error>" },
+    { "%''s", { S("a") }, "<error>" },
+    { "%5", { N(1) }, "<error>" },
+    { "%.s", { S("abc") }, "<error>" },
+    { "%:s", { S("abc") }, "<error>" },
+};
+
+TEST_F(EfunsTest, sprintfFormats) {
+    for (auto &c : cases) {
+        EXPECT_EQ(format(c.format, c.args), c.expected) << c.format;
+        // the compiled format gives the same output, on a miss and on a hit
+        EXPECT_EQ(format(c.format, c.args, true), c.expected) << c.format;
+        EXPECT_EQ(format(c.format, c.args, true), c.expected) << c.format;
+    }
+}
+
+TEST_F(EfunsTest, sprintfCacheHits) {
+    clear_sprintf_cache();
+    unsigned long hits = sprintf_cache_hits, misses = sprintf_cache_misses;
+    char *fmt = make_shared_string("%-10s %5d\n");
+    std::vector<svalue_t> sv = make_args({ S("sword"), N(12) });
+    for (int i = 0; i < 3; i++) {
+        char *s = string_print_shared_format(fmt, 2, sv.data());
+        EXPECT_STREQ(s, "sword         12\n");
+        FREE_MSTR(s);
+    }
+    EXPECT_EQ(sprintf_cache_misses - misses, 1u);
+    EXPECT_EQ(sprintf_cache_hits - hits, 2u);
+    EXPECT_EQ(sprintf_cache_size(), 1);
+
+    // the cache keeps the format string alive
+    free_string(fmt);
+    EXPECT_EQ(format("%-10s %5d\n", { S("shield"), N(3) }, true), "shield         3\n");
+    EXPECT_EQ(sprintf_cache_hits - hits, 3u);
+
+    // strings that are not shared are compiled for the one call
+    EXPECT_EQ(format("%d", { N(1) }), "1");
+    EXPECT_EQ(sprintf_cache_size(), 1);
+
+    clear_sprintf_cache();
+    EXPECT_EQ(sprintf_cache_size(), 0);
+}
+
+TEST_F(EfunsTest, sprintfCacheEviction) {
+    clear_sprintf_cache();
+    unsigned long misses = sprintf_cache_misses;
+    for (int i = 0; i < SPRINTF_CACHE_SIZE + 10; i++) {
+        std::string fmt = "%d:" + std::to_string(i);
+        EXPECT_EQ(format(fmt.c_str(), { N(i) }, true), std::to_string(i) + ":" + std::to_string(i));
+    }
+    EXPECT_EQ(sprintf_cache_size(), SPRINTF_CACHE_SIZE);
+    EXPECT_EQ(sprintf_cache_misses - misses, (unsigned long)SPRINTF_CACHE_SIZE + 10);
+
+    // the oldest formats were evicted, the newest are still there
+    unsigned long hits = sprintf_cache_hits;
+    format(("%d:" + std::to_string(SPRINTF_CACHE_SIZE + 9)).c_str(), { N(0) }, true);
+    EXPECT_EQ(sprintf_cache_hits - hits, 1u);
+    format("%d:0", { N(0) }, true);
+    EXPECT_EQ(sprintf_cache_hits - hits, 1u);
+    clear_sprintf_cache();
+}
+
+TEST_F(EfunsTest, DISABLED_benchmarkSprintf) {
+    const int rounds = 20000;
+    static const struct {
+        const char *name;
+        const char *format;
+        std::vector<Arg> args;
+    } formats[] = {
+        { "plain", "%s has %d coins\n", { S("Bob"), N(1234) } },
+        { "strings", "%-12s%-12s%-12s%s\n", { S("sword"), S("shield"), S("helmet"), S("boots") } },
+        { "padded", "%-20s|%8d|%10.2f|%|12s|\n", { S("Bob"), N(1234), R(3.5), S("center") } },
+        { "column", "%-=30s %-=30s\n", { S(text), S(text) } },
+        { "table", "%#-60s\n", { S(words) } },
+    };
+
+    for (auto &f : formats) {
+        std::vector<svalue_t> sv = make_args(f.args);
+        char *shared = make_shared_string(f.format);
+        double ms[2];
+        for (int cached : { 0, 1 }) {
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < rounds; i++) {
+                char *s = cached ? string_print_shared_format(shared, (int)f.args.size(), sv.data())
+                                 : string_print_formatted((char *)f.format, (int)f.args.size(), sv.data());
+                FREE_MSTR(s);
+            }
+            ms[cached] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        free_string(shared);
+
+        debug_message("[ BENCH    ] %d x sprintf(%s): compiled per call %.1f ms, cached %.1f ms\n",
+                      rounds, f.name, ms[0], ms[1]);
+        RecordProperty(std::string("sprintf_") + f.name + "_ms", (int)ms[0]);
+        RecordProperty(std::string("sprintf_") + f.name + "_cached_ms", (int)ms[1]);
+    }
+    clear_sprintf_cache();
+}
@@ -0,0 +1,85 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using namespace testing;
+namespace fs = std::filesystem;
+
+/* Runs neolith-precompile on a private copy of the m3 mudlib, so that the
+ * binaries it saves don't get in the way of the other tests. */
+class PrecompileTest: public Test {
+protected:
+    fs::path dir;
+
+    struct Summary {
+        int files = -1, compiled = -1, up_to_date = -1, failed = -1;
+    };
+
+    void SetUp() override {
+        dir = fs::current_path() / "precompile_test";
+        fs::remove_all(dir);
+        fs::create_directories(dir / "m3_mudlib");
+        for (auto& entry : fs::directory_iterator("m3_mudlib")) {
+            if (entry.path().filename() != "bin") // start cold
+                fs::copy(entry.path(), dir / "m3_mudlib" / entry.path().filename(), fs::copy_options::recursive);
+        }
+
+        std::ifstream in("m3.conf");
+        std::ofstream out(dir / "m3.conf");
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.rfind("MudlibDir", 0) == 0)
+                line = "MudlibDir " + (dir / "m3_mudlib").string();
+            out << line << '\n';
+        }
+    }
+
+    void TearDown() override {
+        fs::remove_all(dir);
+    }
+
+    Summary run(int jobs) {
+        Summary sum;
+        std::string cmd = std::string(NEOLITH_PRECOMPILE) + " -f " + (dir / "m3.conf").string()
+                          + " -j " + std::to_string(jobs) + " -n 0 2>&1";
+        FILE* p = popen(cmd.c_str(), "r");
+        if (!p)
+            return sum;
+        char buf[1024];
+        while (fgets(buf, sizeof(buf), p))
+            std::sscanf(buf, "%d files: %d compiled, %d up to date, %d failed",
+                        &sum.files, &sum.compiled, &sum.up_to_date, &sum.failed);
+        pclose(p);
+        return sum;
+    }
+};
+
+TEST_F(PrecompileTest, coldWarmAndIncremental) {
+    // cold: everything is compiled, inherited programs by whichever worker gets there first
+    Summary cold = run(4);
+    ASSERT_GT(cold.files, 0);
+    EXPECT_EQ(cold.compiled, cold.files);
+    EXPECT_EQ(cold.up_to_date, 0) << "a program compiled by one worker was reported up to date by another";
+    EXPECT_EQ(cold.failed, 0);
+
+    // warm: every binary is loaded
+    Summary warm = run(4);
+    EXPECT_EQ(warm.files, cold.files);
+    EXPECT_EQ(warm.compiled, 0);
+    EXPECT_EQ(warm.up_to_date, warm.files);
+
+    // touching an include recompiles exactly the files that include it (user.c)
+    fs::path header = dir / "m3_mudlib" / "config.h";
+    fs::last_write_time(header, fs::file_time_type::clock::now() + std::chrono::seconds(5));
+    Summary incremental = run(4);
+    EXPECT_EQ(incremental.compiled, 1);
+    EXPECT_EQ(incremental.up_to_date, incremental.files - 1);
+    EXPECT_EQ(incremental.failed, 0);
+}
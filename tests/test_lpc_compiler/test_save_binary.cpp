@@ -2,6 +2,10 @@
 #include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <string>
 #include <system_error>
 
 #include "fixtures.hpp"
@@ -41,4 +45,83 @@ TEST_F(LPCCompilerTest, saveBinary) {
     EXPECT_TRUE(prog != nullptr) << "load_binary failed to load saved binary.";
     free_prog(prog, 1);
 }
+
+static std::string binary_path(const char* name) {
+    std::string path = std::string(CONFIG_STR(__SAVE_BINARIES_DIR__)) + "/" + name;
+    if (path[0] == '/')
+        path.erase(0, 1);
+    path.back() = 'b';
+    return path;
+}
+
+static void write_file(const std::string& path, const std::string& data) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << data;
+}
+
+TEST_F(LPCCompilerTest, loadBinaryRejectsDamagedFiles) {
+    init_binaries();
+    int fd = FILE_OPEN("api/unicode.c", O_RDONLY);
+    ASSERT_NE(fd, -1);
+    program_t* prog = compile_file(fd, "api/unicode.c", nullptr);
+    ASSERT_NE(prog, nullptr);
+    total_lines = 0;
+    FILE_CLOSE(fd);
+    int num_strings = prog->num_strings, num_functions = prog->num_functions_defined;
+    free_prog(prog, 1);
+
+    std::string path = binary_path("api/unicode.c");
+    std::ifstream in(path, std::ios::binary);
+    ASSERT_TRUE(in.good()) << "no saved binary at " << path;
+    std::string saved((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+
+    // truncated anywhere: rejected before anything is allocated
+    for (size_t len : { (size_t)0, (size_t)10, saved.size() / 2, saved.size() - 1 }) {
+        write_file(path, saved.substr(0, len));
+        EXPECT_EQ(load_binary("api/unicode.c"), nullptr) << "truncated to " << len;
+    }
+
+    // a name length that disagrees with the terminators: the offset of the
+    // name_lengths section follows magic, ids, file size and three sections
+    std::string damaged = saved;
+    uint32_t lengths_offset;
+    memcpy(&lengths_offset, &damaged[56], sizeof(lengths_offset));
+    ASSERT_LT(lengths_offset, damaged.size());
+    damaged[lengths_offset]++;
+    write_file(path, damaged);
+    EXPECT_EQ(load_binary("api/unicode.c"), nullptr);
+
+    // the intact file still loads, with its names interned
+    write_file(path, saved);
+    prog = load_binary("api/unicode.c");
+    ASSERT_NE(prog, nullptr);
+    EXPECT_EQ(prog->num_strings, num_strings);
+    EXPECT_EQ(prog->num_functions_defined, num_functions);
+    for (int i = 0; i < prog->num_functions_defined; i++)
+        EXPECT_EQ(findstring(prog->function_table[i].name), prog->function_table[i].name);
+    free_prog(prog, 1);
+}
+
+TEST_F(LPCCompilerTest, DISABLED_benchmarkLoadBinary) {
+    const int rounds = 200;
+    init_binaries();
+    int fd = FILE_OPEN("api/unicode.c", O_RDONLY);
+    ASSERT_NE(fd, -1);
+    program_t* prog = compile_file(fd, "api/unicode.c", nullptr);
+    ASSERT_NE(prog, nullptr);
+    total_lines = 0;
+    FILE_CLOSE(fd);
+    free_prog(prog, 1);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        prog = load_binary("api/unicode.c");
+        ASSERT_NE(prog, nullptr);
+        free_prog(prog, 1);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    debug_message("[ BENCH    ] load_binary(api/unicode.c): %.3f ms per load\n", ms / rounds);
+    RecordProperty("load_binary_us", (int)(ms * 1000 / rounds));
+}
 #endif
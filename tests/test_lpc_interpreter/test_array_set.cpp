@@ -0,0 +1,150 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <chrono>
+#include "fixtures.hpp"
+
+extern "C" {
+    #include "apply.h"
+    #include "lpc/include/origin.h"
+}
+
+class ArraySetTest : public LPCInterpreterTest {
+protected:
+    object_t* ob = nullptr;
+
+    void SetUp() override {
+        LPCInterpreterTest::SetUp();
+        current_object = master_ob;
+        ob = load_object("array_set.c",
+            "mixed *make(int n, int seed) {\n"
+            "    mixed *a = allocate(n);\n"
+            "    int i, m = n / 2 + 1;\n"
+            "    for (i = 0; i < n; i++)\n"
+            "        switch ((i * 7 + seed) % 4) {\n"
+            "        case 0: a[i] = (i * 13 + seed) % m; break;\n"
+            "        case 1: a[i] = \"item\" + ((i * 11 + seed) % m); break;\n"
+            "        case 2: a[i] = to_float((i * 5 + seed) % 10) / 4; break;\n"
+            "        default: a[i] = ({ \"sword\", \"shield\", \"torch\" })[i % 3]; break;\n"
+            "        }\n"
+            "    return a;\n"
+            "}\n"
+            "int check_subtract(int n, int m) {\n"
+            "    mixed *a = make(n, 1), *b = make(m, 2), *r = a - b, *e = ({});\n"
+            "    int i;\n"
+            "    foreach (mixed x in a) if (member_array(x, b) < 0) e += ({ x });\n"
+            "    if (sizeof(r) != sizeof(e)) return 0;\n"
+            "    for (i = 0; i < sizeof(r); i++) if (r[i] != e[i]) return 0;\n"
+            "    return 1;\n"
+            "}\n"
+            "int check_intersect(int n, int m) {\n"
+            "    mixed *a = make(n, 1), *b = make(m, 2), *r;\n"
+            "    int count = 0;\n"
+            "    r = b & a;\n"
+            "    foreach (mixed x in b) if (member_array(x, a) >= 0) count++;\n"
+            "    if (sizeof(r) != count) return 0;\n"
+            "    foreach (mixed y in r) if (member_array(y, a) < 0 || member_array(y, b) < 0) return 0;\n"
+            "    return 1;\n"
+            "}\n"
+            "int check_intersect_order(int n) {\n"
+            "    int *a = allocate(n), *b = allocate(n), *r, i;\n"
+            "    for (i = 0; i < n; i++) { a[i] = (i * 7919) % n; b[i] = n - i * 2; }\n"
+            "    r = b & a;\n"
+            "    if (sizeof(r) != n / 2) return 0;\n"
+            "    for (i = 1; i < sizeof(r); i++) if (r[i - 1] >= r[i]) return 0;\n"
+            "    return 1;\n"
+            "}\n"
+            "int check_unique(int n) {\n"
+            "    int *a = allocate(n), i, j;\n"
+            "    mixed *r;\n"
+            "    for (i = 0; i < n; i++) a[i] = i;\n"
+            "    r = unique_array(a, (: \"k\" + ($1 % 37) :), \"k5\");\n"
+            "    if (sizeof(r) != (n < 37 ? n - (n > 5) : 36)) return 0;\n"
+            "    for (i = 0; i < sizeof(r); i++) {\n"
+            "        if (r[i][0] != i + (i >= 5)) return 0;\n"
+            "        for (j = 1; j < sizeof(r[i]); j++) if (r[i][j] != r[i][j - 1] + 37) return 0;\n"
+            "    }\n"
+            "    return 1;\n"
+            "}\n"
+            "int check_member() {\n"
+            "    string *a = ({ \"sword\", \"shield\", \"torch\" });\n"
+            "    string s = \"shi\";\n"
+            "    s += \"eld\";\n"
+            "    return member_array(\"torch\", a) == 2 && member_array(s, a) == 1\n"
+            "        && member_array(\"sw\" + s, a) == -1 && member_array(a[0], a + ({ s })) == 0;\n"
+            "}\n"
+            "int bench(int n) {\n"
+            "    mixed *a = make(n, 1), *b = make(n, 2);\n"
+            "    int *c = allocate(n), i;\n"
+            "    for (i = 0; i < n; i++) c[i] = i;\n"
+            "    return sizeof(a - b) + sizeof(a & b) + sizeof(unique_array(c, (: $1 % 1000 :)));\n"
+            "}\n");
+        ASSERT_NE(ob, nullptr);
+    }
+
+    void TearDown() override {
+        object_t* o = find_object_by_name("array_set");
+        if (o)
+            destruct_object(o);
+        LPCInterpreterTest::TearDown();
+    }
+
+    int call(const char* fun, int num_arg = 0) {
+        svalue_t* ret = apply(fun, ob, num_arg, ORIGIN_DRIVER);
+        return ret && ret->type == T_NUMBER ? (int)ret->u.number : -1;
+    }
+};
+
+TEST_F(ArraySetTest, SubtractMatchesMemberArray) {
+    // small arrays are sorted alists, large ones are hashed
+    int sizes[][2] = { { 10, 5 }, { 10, 15 }, { 100, 16 }, { 20, 200 }, { 2000, 2000 } };
+    for (auto& s : sizes) {
+        push_number(s[0]);
+        push_number(s[1]);
+        EXPECT_EQ(call("check_subtract", 2), 1) << s[0] << " - " << s[1];
+    }
+}
+
+TEST_F(ArraySetTest, IntersectMatchesMemberArray) {
+    int sizes[][2] = { { 10, 5 }, { 10, 15 }, { 100, 16 }, { 20, 200 }, { 2000, 2000 } };
+    for (auto& s : sizes) {
+        push_number(s[0]);
+        push_number(s[1]);
+        EXPECT_EQ(call("check_intersect", 2), 1) << s[0] << " & " << s[1];
+    }
+    // ints come out in ascending order, as from the sorted alists
+    for (int n : { 10, 15, 100, 5000 }) {
+        push_number(n);
+        EXPECT_EQ(call("check_intersect_order", 1), 1) << n;
+    }
+}
+
+TEST_F(ArraySetTest, UniqueArrayGroupsInOrder) {
+    for (int n : { 10, 31, 32, 1000 }) {
+        push_number(n);
+        EXPECT_EQ(call("check_unique", 1), 1) << n;
+    }
+}
+
+TEST_F(ArraySetTest, MemberArrayStrings) {
+    EXPECT_EQ(call("check_member"), 1);
+}
+
+TEST_F(ArraySetTest, DISABLED_benchmarkArraySetOperations) {
+    const int n = 10000, rounds = 10;
+    unsigned long trace_flags = MAIN_OPTION(trace_flags);
+    MAIN_OPTION(trace_flags) = 0;
+    eval_cost = INT64_MAX;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        push_number(n);
+        ASSERT_GT(call("bench", 1), 0);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    eval_cost = CONFIG_INT (__MAX_EVAL_COST__);
+    MAIN_OPTION(trace_flags) = trace_flags;
+
+    debug_message("[ BENCH    ] %d x (a - b, a & b, unique_array) of %d elements: %.1f ms\n", rounds, n, ms);
+    RecordProperty("set_operations_ms", (int)ms);
+}
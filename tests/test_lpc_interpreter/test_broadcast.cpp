@@ -0,0 +1,186 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string>
+#include "fixtures.hpp"
+
+extern "C" {
+    #include "simulate.h"
+}
+
+class BroadcastTest : public LPCInterpreterTest {
+protected:
+    object_t* room = nullptr;
+    object_t* users[2] = { nullptr, nullptr };
+    object_t* npc = nullptr;
+    socket_fd_t fds[2] = { INVALID_SOCKET_FD, INVALID_SOCKET_FD };
+
+    void SetUp() override {
+        LPCInterpreterTest::SetUp();
+        ASSERT_EQ(create_test_socket_pair(fds), 0);
+
+        current_object = master_ob;
+        room = load_object("test_room.c", "void create() { }\n");
+        ASSERT_NE(room, nullptr);
+        const char* user_code = "void create() { }\n";
+        users[0] = load_object("test_user1.c", user_code);
+        users[1] = load_object("test_user2.c", user_code);
+        npc = load_object("test_npc.c",
+            "string heard = \"\";\n"
+            "void create() { enable_commands(); }\n"
+            "void catch_tell(string str) { heard += str; }\n");
+        ASSERT_NE(npc, nullptr);
+
+        for (object_t* ob : users) {
+            ASSERT_NE(ob, nullptr);
+            interactive_t* ip = create_test_interactive(ob);
+            ASSERT_NE(ip, nullptr);
+            ip->fd = fds[0];
+            move_object(ob, room);
+        }
+        all_users[0] = nullptr; // queue output instead of writing it to the console
+        move_object(npc, room);
+    }
+
+    void TearDown() override {
+        for (object_t* ob : users) {
+            if (ob && ob->interactive)
+                remove_test_interactive(ob->interactive);
+        }
+        for (object_t* ob : { npc, users[0], users[1], room }) {
+            if (ob)
+                destruct_object(ob);
+        }
+        command_giver = nullptr;
+        SOCKET_CLOSE(fds[0]);
+        SOCKET_CLOSE(fds[1]);
+        LPCInterpreterTest::TearDown();
+    }
+
+    std::string drain() {
+        std::string out;
+        char buf[4096];
+        int n;
+        while ((n = (int)SOCKET_RECV(fds[1], buf, sizeof(buf), 0)) > 0)
+            out.append(buf, n);
+        return out;
+    }
+
+    std::string heard() {
+        svalue_t* v = find_value_in_object(npc, "heard");
+        return v && v->type == T_STRING ? v->u.string : "";
+    }
+
+    static svalue_t* find_value_in_object(object_t* ob, const char* name) {
+        for (int i = 0; i < ob->prog->num_variables_total; i++)
+            if (strcmp(ob->prog->variable_table[i], name) == 0)
+                return &ob->variables[i];
+        return nullptr;
+    }
+};
+
+TEST_F(BroadcastTest, TellRoomSharesOneBlock) {
+    std::string text;
+    for (int i = 0; i < 5; i++)
+        text += "The wind howls through the broken windows of the observatory.\n";
+
+    svalue_t msg;
+    msg.type = T_STRING;
+    msg.subtype = STRING_CONSTANT;
+    msg.u.string = (char*)text.c_str();
+    tell_room(room, &msg, &the_null_array);
+
+    // both users hold the same pre-translated block, the NPC got it via catch_tell()
+    ASSERT_NE(users[0]->interactive->message_blocks, nullptr);
+    EXPECT_EQ(users[0]->interactive->message_block_bytes, users[1]->interactive->message_block_bytes);
+    EXPECT_EQ(heard(), text);
+
+    std::string expected;
+    for (char c : text) {
+        if (c == '\n')
+            expected += '\r';
+        expected += c;
+    }
+    for (object_t* ob : users) {
+        ASSERT_EQ(flush_message(ob->interactive), 1);
+        EXPECT_EQ(drain(), expected);
+    }
+}
+
+TEST_F(BroadcastTest, BlockIsMadeForInteractivesOnly) {
+    // a room heard by an NPC alone, which echoes into the room of the users
+    object_t* hall = load_object("test_hall.c", "void create() { }\n");
+    ASSERT_NE(hall, nullptr);
+    object_t* echo = load_object("test_echo.c",
+        "void create() { enable_commands(); }\n"
+        "void catch_tell(string str) { tell_room(find_object(\"test_room\"), \"echo: \" + str); }\n");
+    ASSERT_NE(echo, nullptr);
+    move_object(echo, hall);
+
+    svalue_t msg;
+    msg.type = T_STRING;
+    msg.subtype = STRING_CONSTANT;
+    msg.u.string = (char*)"Footsteps.\n";
+    int blocks = comm_message_blocks;
+    tell_room(hall, &msg, &the_null_array);
+
+    // only the nested broadcast, which reached the users, made a block
+    EXPECT_EQ(comm_message_blocks, blocks + 1);
+    EXPECT_EQ(heard(), "echo: Footsteps.\n");
+    for (object_t* ob : users) {
+        ASSERT_EQ(flush_message(ob->interactive), 1);
+        EXPECT_EQ(drain(), "echo: Footsteps.\r\n");
+    }
+
+    destruct_object(echo);
+    destruct_object(hall);
+}
+
+TEST_F(BroadcastTest, SayAvoidsSpeaker) {
+    char text[] = "User1 says: hello\n";
+    svalue_t msg;
+    msg.type = T_STRING;
+    msg.subtype = STRING_CONSTANT;
+    msg.u.string = text;
+
+    command_giver = users[0];
+    current_object = users[0];
+    svalue_t* saved_sp = sp;
+    say(&msg, &the_null_array);
+    EXPECT_EQ(sp, saved_sp) << "say() should leave the value stack balanced";
+
+    EXPECT_FALSE(MESSAGE_PENDING(users[0]->interactive));
+    ASSERT_EQ(flush_message(users[1]->interactive), 1);
+    EXPECT_EQ(drain(), "User1 says: hello\r\n");
+    EXPECT_EQ(heard(), text);
+}
+
+TEST_F(BroadcastTest, OutputIsWrittenOncePerCycle) {
+    interactive_t* ip = users[0]->interactive;
+    int writes = comm_write_calls, interest = comm_interest_calls;
+
+    add_message(users[0], (char*)"one\n");
+    add_message(users[0], (char*)"two\n");
+    add_message(users[0], (char*)"three\n");
+
+    // nothing is written and no write interest is registered until the end of the cycle
+    EXPECT_TRUE(ip->iflags & OUTPUT_DIRTY);
+    EXPECT_EQ(comm_write_calls, writes);
+    EXPECT_EQ(comm_interest_calls, interest);
+
+    flush_pending_output();
+    EXPECT_FALSE(ip->iflags & OUTPUT_DIRTY);
+    EXPECT_FALSE(ip->iflags & WRITE_INTEREST);
+    EXPECT_EQ(comm_write_calls, writes + 1);
+    EXPECT_EQ(comm_interest_calls, interest);
+    EXPECT_EQ(drain(), "one\r\ntwo\r\nthree\r\n");
+    EXPECT_FALSE(MESSAGE_PENDING(ip));
+
+    // a user that goes away is taken off the list
+    add_message(users[1], (char*)"bye\n");
+    remove_test_interactive(users[1]->interactive);
+    flush_pending_output();
+    EXPECT_EQ(comm_write_calls, writes + 1);
+    EXPECT_EQ(drain(), "");
+}
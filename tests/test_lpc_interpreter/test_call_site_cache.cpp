@@ -0,0 +1,110 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string>
+#include "fixtures.hpp"
+
+extern "C" {
+    #include "apply.h"
+    #include "outbuf.h"
+    #include "lpc/include/origin.h"
+}
+
+class CallSiteCacheTest : public LPCInterpreterTest {
+protected:
+    object_t* caller = nullptr;
+
+    void SetUp() override {
+        LPCInterpreterTest::SetUp();
+        current_object = master_ob;
+        ASSERT_NE(load_target("target_a.c", 1), nullptr);
+        ASSERT_NE(load_target("target_b.c", 2), nullptr);
+        caller = load_object("caller.c",
+            "int run(int n) {\n"
+            "    object *obs = ({ find_object(\"target_a\"), find_object(\"target_b\") });\n"
+            "    int i, sum;\n"
+            "    for (i = 0; i < n; i++)\n"
+            "        sum += obs[i % 2]->id();\n" /* one polymorphic call site */
+            "    return sum;\n"
+            "}\n"
+            "int peek(object ob) { return ob->hidden(); }\n");
+        ASSERT_NE(caller, nullptr);
+    }
+
+    void TearDown() override {
+        for (const char* name : { "caller", "target_a", "target_b" }) {
+            object_t* ob = find_object_by_name(name);
+            if (ob)
+                destruct_object(ob);
+        }
+        LPCInterpreterTest::TearDown();
+    }
+
+    static object_t* load_target(const char* name, int id) {
+        std::string code = "int id() { return " + std::to_string(id) + "; }\n"
+                           "static int hidden() { return 42; }\n";
+        return load_object(name, code.c_str());
+    }
+
+    int64_t run(int n) {
+        push_number(n);
+        svalue_t* ret = apply("run", caller, 1, ORIGIN_DRIVER);
+        return ret && ret->type == T_NUMBER ? ret->u.number : -1;
+    }
+};
+
+TEST_F(CallSiteCacheTest, PolymorphicSiteHits) {
+    unsigned int hits = call_site_hits, misses = call_site_misses;
+
+    EXPECT_EQ(run(1000), 1500);
+    EXPECT_EQ(call_site_misses - misses, 2u) << "one miss per target program";
+    EXPECT_EQ(call_site_hits - hits, 998u);
+
+    outbuffer_t out;
+    outbuf_zero(&out);
+    print_call_site_stats(&out, 10);
+    outbuf_fix(&out);
+    ASSERT_NE(out.buffer, nullptr);
+    EXPECT_NE(std::string(out.buffer).find("caller.c:5"), std::string::npos) << out.buffer;
+    FREE_MSTR(out.buffer);
+}
+
+TEST_F(CallSiteCacheTest, OnlyStaleEntriesMiss) {
+    EXPECT_EQ(run(10), 15);
+
+    // freeing an unrelated program leaves the caches alone
+    ASSERT_NE(load_target("other.c", 9), nullptr);
+    destruct_object(find_object_by_name("other"));
+    remove_destructed_objects();
+    current_object = master_ob;
+    unsigned int hits = call_site_hits, misses = call_site_misses;
+    EXPECT_EQ(run(10), 15);
+    EXPECT_EQ(call_site_misses - misses, 0u);
+    EXPECT_EQ(call_site_hits - hits, 10u);
+
+    // reload target_b with a different id(): its old program is freed
+    destruct_object(find_object_by_name("target_b"));
+    remove_destructed_objects();
+    current_object = master_ob;
+    ASSERT_NE(load_target("target_b.c", 5), nullptr);
+
+    misses = call_site_misses;
+    EXPECT_EQ(run(10), 30);
+    EXPECT_EQ(call_site_misses - misses, 1u) << "only the entry for target_b is stale";
+}
+
+TEST_F(CallSiteCacheTest, VisibilityDependsOnOrigin) {
+    object_t* target = find_object_by_name("target_a");
+
+    // a static function is not visible to call_other() ...
+    push_object(target);
+    svalue_t* ret = apply("peek", caller, 1, ORIGIN_DRIVER);
+    ASSERT_NE(ret, nullptr);
+    EXPECT_EQ(ret->u.number, 0);
+
+    // ... but the driver may still apply it afterwards
+    ret = apply("hidden", target, 0, ORIGIN_DRIVER);
+    ASSERT_NE(ret, nullptr);
+    EXPECT_EQ(ret->u.number, 42);
+}
@@ -0,0 +1,155 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <chrono>
+#include <vector>
+#include "fixtures.hpp"
+
+extern "C" {
+    #include "apply.h"
+    #include "lpc/array.h"
+    #include "lpc/otable.h"
+    #include "lpc/include/origin.h"
+}
+
+class ClonesTest : public LPCInterpreterTest {
+protected:
+    object_t* ob = nullptr;
+    std::vector<object_t*> clones;
+
+    void SetUp() override {
+        LPCInterpreterTest::SetUp();
+        current_object = master_ob;
+        ASSERT_NE(load_object("thing.c", "void create() { }\n"), nullptr);
+        ASSERT_NE(load_object("other.c", "void create() { }\n"), nullptr);
+        ob = load_object("counter.c",
+            "int count(mixed x) { return clone_count(x); }\n"
+            "int kids(string name) { return sizeof(children(name)); }\n");
+        ASSERT_NE(ob, nullptr);
+    }
+
+    void TearDown() override {
+        for (object_t* c : clones)
+            if (!(c->flags & O_DESTRUCTED))
+                destruct_object(c);
+        for (const char* name : { "counter", "thing", "other" }) {
+            object_t* o = find_object_by_name(name);
+            if (o)
+                destruct_object(o);
+        }
+        LPCInterpreterTest::TearDown();
+    }
+
+    object_t* clone(const char* name) {
+        object_t* c = clone_object(name, 0);
+        if (c)
+            clones.push_back(c);
+        return c;
+    }
+
+    int64_t call(const char* fun, svalue_t* arg) {
+        push_svalue(arg);
+        svalue_t* ret = apply(fun, ob, 1, ORIGIN_DRIVER);
+        return ret && ret->type == T_NUMBER ? ret->u.number : -1;
+    }
+
+    int64_t call(const char* fun, const char* name) {
+        svalue_t v;
+        v.type = T_STRING;
+        v.subtype = STRING_CONSTANT;
+        v.u.string = (char*)name;
+        return call(fun, &v);
+    }
+};
+
+TEST_F(ClonesTest, ChildrenAndCount) {
+    object_t* a = clone("/thing");
+    object_t* b = clone("/thing.c");
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+    ASSERT_NE(clone("/other"), nullptr);
+
+    int n = -1;
+    EXPECT_EQ(lookup_clones("thing", &n, nullptr), b) << "newest clone first";
+    EXPECT_EQ(n, 2);
+    EXPECT_EQ(b->next_clone, a);
+
+    EXPECT_EQ(call("count", "/thing"), 2);
+    EXPECT_EQ(call("count", "other.c"), 1);
+    EXPECT_EQ(call("count", "/nothing"), 0);
+    svalue_t v;
+    v.type = T_OBJECT;
+    v.u.ob = a;
+    EXPECT_EQ(call("count", &v), 2) << "a clone counts its siblings";
+
+    array_t* vec = children((char*)"/thing");
+    ASSERT_EQ(vec->size, 3);
+    EXPECT_EQ(vec->item[0].u.ob, find_object_by_name("thing"));
+    EXPECT_EQ(vec->item[1].u.ob, b);
+    EXPECT_EQ(vec->item[2].u.ob, a);
+    free_array(vec);
+
+    destruct_object(b);
+    EXPECT_EQ(call("count", "/thing"), 1);
+    EXPECT_EQ(call("kids", "/thing"), 2);
+    destruct_object(a);
+    EXPECT_EQ(lookup_clones("thing", &n, nullptr), nullptr);
+    EXPECT_EQ(n, 0);
+    EXPECT_EQ(call("kids", "/thing"), 1);
+}
+
+TEST_F(ClonesTest, HiddenClones) {
+    object_t* a = clone("/thing");
+    object_t* b = clone("/thing");
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+
+    int n = -1, hidden = -1;
+    set_object_hidden(b, 1);
+    EXPECT_TRUE(b->flags & O_HIDDEN);
+    lookup_clones("thing", &n, &hidden);
+    EXPECT_EQ(n, 2);
+    EXPECT_EQ(hidden, 1);
+    set_object_hidden(b, 1); // no change
+    lookup_clones("thing", &n, &hidden);
+    EXPECT_EQ(hidden, 1);
+
+    // without a master object valid_hide() approves, so both see the hidden clone
+    ASSERT_EQ(master_ob, nullptr);
+    EXPECT_EQ(call("count", "/thing"), 2);
+    EXPECT_EQ(call("kids", "/thing"), 3);
+
+    set_object_hidden(a, 1);
+    destruct_object(b);
+    lookup_clones("thing", &n, &hidden);
+    EXPECT_EQ(n, 1);
+    EXPECT_EQ(hidden, 1) << "a destructed hidden clone should leave the count";
+
+    set_object_hidden(a, 0);
+    EXPECT_FALSE(a->flags & O_HIDDEN);
+    lookup_clones("thing", &n, &hidden);
+    EXPECT_EQ(hidden, 0);
+    EXPECT_EQ(call("count", "/thing"), 1);
+    EXPECT_EQ(call("kids", "/thing"), 2);
+}
+
+TEST_F(ClonesTest, DISABLED_benchmarkChildren) {
+    const int n = 5000, rounds = 1000;
+
+    for (int i = 0; i < n; i++)
+        ASSERT_NE(clone("/other"), nullptr);
+    for (int i = 0; i < 10; i++)
+        ASSERT_NE(clone("/thing"), nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        array_t* vec = children((char*)"/thing");
+        ASSERT_EQ(vec->size, 11);
+        free_array(vec);
+    }
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    debug_message("[ BENCH    ] %d children() calls among %d objects: %.1f ms\n", rounds, n, elapsed);
+    RecordProperty("elapsed_ms", (int)elapsed);
+}
@@ -0,0 +1,239 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include "fixtures.hpp"
+
+extern "C" {
+    #include "apply.h"
+    #include "lpc/mapping.h"
+    #include "lpc/program.h"
+    #include "lpc/program/disassemble.h"
+    #include "lpc/include/origin.h"
+}
+
+class DispatchTest : public LPCInterpreterTest {
+protected:
+    object_t* ob = nullptr;
+
+    void SetUp() override {
+        LPCInterpreterTest::SetUp();
+        current_object = master_ob;
+        ob = load_object("dispatch.c",
+            "object thing;\n"
+            "int flag;\n"
+            "int sum(int a, int b) { return a + b; }\n"
+            "mixed add(mixed a, mixed b) { return a + b; }\n"
+            "int *make() { int *arr = ({ 1, 2, 3 }); return arr; }\n"
+            "object get() { object o = thing; return o; }\n"
+            "string test() { if (flag) return \"yes\"; return \"no\"; }\n"
+            "string test_thing() { if (thing) return \"yes\"; return \"no\"; }\n"
+            "void set(int f, object o) { flag = f; thing = o; }\n"
+            "int fib(int n) {\n"
+            "    int a = 0, b = 1, i, t;\n"
+            "    for (i = 0; i < n; i++) { t = a + b; a = b; b = t; }\n"
+            "    return a;\n"
+            "}\n"
+            "int plain(int a) {\n"
+            "    int b = a, c = a;\n"
+            "    b = a + c; c = b + a; b = a + c; c = b + a; b = a + c; c = b + a;\n"
+            "    b = a + c; c = b + a; b = a + c; c = b + a; b = a + c; c = b + a;\n"
+            "    return c;\n"
+            "}\n"
+            "int guarded(int a) {\n"
+            "    int b = a, c = a;\n"
+            "    catch {\n"
+            "    b = a + c; c = b + a; b = a + c; c = b + a; b = a + c; c = b + a;\n"
+            "    b = a + c; c = b + a; b = a + c; c = b + a; b = a + c; c = b + a;\n"
+            "    };\n"
+            "    return c;\n"
+            "}\n"
+            "int *squares(int n) {\n"
+            "    int *arr = allocate(n), i;\n"
+            "    for (i = 0; i < n; i++) arr[i] = i * i;\n"
+            "    arr[0] += 5;\n"
+            "    return arr;\n"
+            "}\n"
+            "string capitalize_first(string s) { s[0] = 'A'; return s; }\n"
+            "mapping tag(mapping m) { m[\"x\"] = 1; return m; }\n"
+            "int loop(int n) {\n"
+            "    int i, s;\n"
+            "    for (i = 0; i < n; i++) { s = s + i; if (flag) s = s - i; }\n"
+            "    return s;\n"
+            "}\n");
+        ASSERT_NE(ob, nullptr);
+    }
+
+    void TearDown() override {
+        for (const char* name : { "dispatch", "victim" }) {
+            object_t* o = find_object_by_name(name);
+            if (o)
+                destruct_object(o);
+        }
+        LPCInterpreterTest::TearDown();
+    }
+
+    svalue_t* call(const char* fun, int num_arg = 0) {
+        return apply(fun, ob, num_arg, ORIGIN_DRIVER);
+    }
+
+    std::string disassembly() {
+        FILE* f = tmpfile();
+        program_t* prog = ob->prog;
+        disassemble(f, prog->program, 0, prog->program_size, prog);
+        std::string out(ftell(f), '\0');
+        rewind(f);
+        out.resize(fread(out.data(), 1, out.size(), f));
+        fclose(f);
+        return out;
+    }
+};
+
+TEST_F(DispatchTest, SuperinstructionsAreGenerated) {
+    std::string code = disassembly();
+    EXPECT_NE(code.find("add_locals"), std::string::npos) << code;
+    EXPECT_NE(code.find("return_local"), std::string::npos) << code;
+    EXPECT_NE(code.find("global_branch_when_zero"), std::string::npos) << code;
+    EXPECT_NE(code.find("local_index_lvalue"), std::string::npos) << code;
+}
+
+TEST_F(DispatchTest, AddLocals) {
+    push_number(40);
+    push_number(2);
+    svalue_t* ret = call("sum", 2);
+    ASSERT_NE(ret, nullptr);
+    ASSERT_EQ(ret->type, T_NUMBER);
+    EXPECT_EQ(ret->u.number, 42);
+
+    // other types go through the generic F_ADD code
+    push_constant_string("foo");
+    push_number(1);
+    ret = call("add", 2);
+    ASSERT_NE(ret, nullptr);
+    ASSERT_EQ(ret->type, T_STRING);
+    EXPECT_STREQ(ret->u.string, "foo1");
+
+    push_real(0.5);
+    push_number(2);
+    ret = call("add", 2);
+    ASSERT_NE(ret, nullptr);
+    ASSERT_EQ(ret->type, T_REAL);
+    EXPECT_DOUBLE_EQ(ret->u.real, 2.5);
+}
+
+TEST_F(DispatchTest, ReturnLocal) {
+    svalue_t* ret = call("make");
+    ASSERT_NE(ret, nullptr);
+    ASSERT_EQ(ret->type, T_ARRAY);
+    EXPECT_EQ(ret->u.arr->size, 3);
+    EXPECT_EQ(ret->u.arr->ref, 1) << "the returned array should be moved out of the frame";
+
+    object_t* victim = load_object("victim.c", "void create() { }\n");
+    ASSERT_NE(victim, nullptr);
+    push_number(0);
+    push_object(victim);
+    call("set", 2);
+    ret = call("get");
+    ASSERT_NE(ret, nullptr);
+    ASSERT_EQ(ret->type, T_OBJECT);
+    EXPECT_EQ(ret->u.ob, victim);
+
+    destruct_object(victim);
+    ret = call("get");
+    ASSERT_NE(ret, nullptr);
+    EXPECT_EQ(ret->type, T_NUMBER);
+    EXPECT_EQ(ret->u.number, 0);
+}
+
+TEST_F(DispatchTest, GlobalBranchWhenZero) {
+    svalue_t* ret = call("test");
+    ASSERT_NE(ret, nullptr);
+    EXPECT_STREQ(ret->u.string, "no");
+
+    object_t* victim = load_object("victim.c", "void create() { }\n");
+    ASSERT_NE(victim, nullptr);
+    push_number(1);
+    push_object(victim);
+    call("set", 2);
+    ret = call("test");
+    ASSERT_NE(ret, nullptr);
+    EXPECT_STREQ(ret->u.string, "yes");
+    ret = call("test_thing");
+    ASSERT_NE(ret, nullptr);
+    EXPECT_STREQ(ret->u.string, "yes");
+
+    // a destructed object is false
+    destruct_object(victim);
+    ret = call("test_thing");
+    ASSERT_NE(ret, nullptr);
+    EXPECT_STREQ(ret->u.string, "no");
+}
+
+TEST_F(DispatchTest, LocalIndexLvalue) {
+    push_number(5);
+    svalue_t* ret = call("squares", 1);
+    ASSERT_NE(ret, nullptr);
+    ASSERT_EQ(ret->type, T_ARRAY);
+    ASSERT_EQ(ret->u.arr->size, 5);
+    EXPECT_EQ(ret->u.arr->item[0].u.number, 5);
+    EXPECT_EQ(ret->u.arr->item[4].u.number, 16);
+
+    // string characters and mapping values are lvalues too
+    push_malloced_string(string_copy("xyz", "LocalIndexLvalue"));
+    ret = call("capitalize_first", 1);
+    ASSERT_NE(ret, nullptr);
+    ASSERT_EQ(ret->type, T_STRING);
+    EXPECT_STREQ(ret->u.string, "Ayz");
+
+    push_refed_mapping(allocate_mapping(0));
+    ret = call("tag", 1);
+    ASSERT_NE(ret, nullptr);
+    ASSERT_EQ(ret->type, T_MAPPING);
+    EXPECT_EQ(ret->u.map->count, 1);
+}
+
+TEST_F(DispatchTest, EvalCostIsCharged) {
+    int64_t before = eval_cost;
+    push_number(50);
+    svalue_t* ret = call("fib", 1);
+    ASSERT_NE(ret, nullptr);
+    EXPECT_EQ(ret->u.number, 12586269025LL);
+    // every instruction of the loop body is charged, several per iteration
+    EXPECT_GT(before - eval_cost, 50 * 6);
+}
+
+TEST_F(DispatchTest, EvalCostIsChargedInCatch) {
+    int64_t before = eval_cost;
+    push_number(1);
+    svalue_t* ret = call("plain", 1);
+    ASSERT_NE(ret, nullptr);
+    EXPECT_EQ(ret->u.number, 13);
+    int64_t plain = before - eval_cost;
+
+    // the instructions of a catch block are charged when it ends, too
+    before = eval_cost;
+    push_number(1);
+    ret = call("guarded", 1);
+    ASSERT_NE(ret, nullptr);
+    EXPECT_EQ(ret->u.number, 13);
+    EXPECT_GT(before - eval_cost, plain);
+}
+
+TEST_F(DispatchTest, DISABLED_benchmarkInterpreter) {
+    const int n = 5000000;
+
+    eval_cost = INT64_MAX;
+    push_number(n);
+    auto start = std::chrono::steady_clock::now();
+    svalue_t* ret = call("loop", 1);
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    eval_cost = CONFIG_INT (__MAX_EVAL_COST__);
+
+    ASSERT_NE(ret, nullptr);
+    EXPECT_EQ(ret->u.number, (int64_t)n * (n - 1) / 2);
+    debug_message("[ BENCH    ] %d loop iterations: %.1f ms\n", n, elapsed);
+    RecordProperty("elapsed_ms", (int)elapsed);
+}
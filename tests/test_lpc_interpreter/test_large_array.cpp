@@ -0,0 +1,116 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <chrono>
+#include <cstddef>
+#include "fixtures.hpp"
+
+extern "C" {
+    #include "apply.h"
+    #include "lpc/include/origin.h"
+}
+
+// sizes past the old 16-bit limit of array and buffer sizes and refcounts
+class LargeArrayTest : public LPCInterpreterTest {
+protected:
+    object_t* ob = nullptr;
+    unsigned long trace_flags = 0;
+    int max_array_size = 0, max_buffer_size = 0, max_string_length = 0;
+
+    void SetUp() override {
+        LPCInterpreterTest::SetUp();
+        trace_flags = MAIN_OPTION(trace_flags);
+        MAIN_OPTION(trace_flags) = 0; // millions of traced instructions otherwise
+        eval_cost = INT64_MAX;
+        max_array_size = CONFIG_INT (__MAX_ARRAY_SIZE__);
+        max_buffer_size = CONFIG_INT (__MAX_BUFFER_SIZE__);
+        max_string_length = CONFIG_INT (__MAX_STRING_LENGTH__);
+        CONFIG_INT (__MAX_ARRAY_SIZE__) = 2500000;
+        CONFIG_INT (__MAX_BUFFER_SIZE__) = 2500000;
+        CONFIG_INT (__MAX_STRING_LENGTH__) = 5000000;
+        current_object = master_ob;
+        ob = load_object("large_array.c",
+            "int arrays(int n) {\n"
+            "    mixed *a = allocate(n), *b, *c;\n"
+            "    int i;\n"
+            "    for (i = 0; i < n; i++) a[i] = i;\n"
+            "    b = a + a;\n"
+            "    if (sizeof(b) != 2 * n || b[n] != 0 || b[2 * n - 1] != n - 1) return -1;\n"
+            "    c = b[n - 5 .. n + 4];\n"
+            "    if (sizeof(c) != 10 || c[5] != 0) return -2;\n"
+            "    c = b[1 ..];\n"
+            "    if (sizeof(c) != 2 * n - 1 || c[<1] != n - 1) return -3;\n"
+            "    c = b - ({ 0 });\n"
+            "    if (sizeof(c) != 2 * n - 2) return -4;\n"
+            "    a = explode(\"x\" + repeat_string(\",x\", n - 1), \",\");\n"
+            "    if (sizeof(a) != n || a[n - 1] != \"x\") return -5;\n"
+            "    return 1;\n"
+            "}\n"
+            "int references(int n) {\n"
+            "    mixed *x = ({ 1 }), *a = allocate(n);\n"
+            "    int i;\n"
+            "    for (i = 0; i < n; i++) a[i] = x;\n"
+            "    if (refs(x) != n + 1) return -1;\n"
+            "    a = 0;\n"
+            "    return refs(x);\n"
+            "}\n"
+            "int restore(int n) {\n"
+            "    mixed *a = allocate(n), *b;\n"
+            "    int i;\n"
+            "    for (i = 0; i < n; i++) a[i] = i % 10;\n"
+            "    b = restore_variable(save_variable(a));\n"
+            "    return sizeof(b) == n && b[n - 1] == (n - 1) % 10;\n"
+            "}\n"
+            "int buffers(int n) {\n"
+            "    buffer b = allocate_buffer(n);\n"
+            "    b[n - 1] = 7;\n"
+            "    return sizeof(b) == n && b[n - 1] == 7;\n"
+            "}\n");
+        ASSERT_NE(ob, nullptr);
+    }
+
+    void TearDown() override {
+        object_t* o = find_object_by_name("large_array");
+        if (o)
+            destruct_object(o);
+        MAIN_OPTION(trace_flags) = trace_flags;
+        CONFIG_INT (__MAX_ARRAY_SIZE__) = max_array_size;
+        CONFIG_INT (__MAX_BUFFER_SIZE__) = max_buffer_size;
+        CONFIG_INT (__MAX_STRING_LENGTH__) = max_string_length;
+        eval_cost = CONFIG_INT (__MAX_EVAL_COST__);
+        LPCInterpreterTest::TearDown();
+    }
+
+    int call(const char* fun, int64_t n) {
+        push_number(n);
+        svalue_t* ret = apply(fun, ob, 1, ORIGIN_DRIVER);
+        return ret && ret->type == T_NUMBER ? (int)ret->u.number : -100;
+    }
+};
+
+TEST_F(LargeArrayTest, MillionElementArrays) {
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(call("arrays", 1000000), 1);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // the array header holds ref and size; each element is one svalue
+    debug_message("[ BENCH    ] 1000000 element arrays: %.1f ms, header %zu bytes, %zu bytes per element\n",
+                  ms, offsetof(array_t, item), sizeof(svalue_t));
+    RecordProperty("array_header_bytes", (int)offsetof(array_t, item));
+    RecordProperty("array_element_bytes", (int)sizeof(svalue_t));
+    EXPECT_LE(offsetof(array_t, item), 16u);
+}
+
+TEST_F(LargeArrayTest, MoreThan65535References) {
+    EXPECT_EQ(call("references", 100000), 1);
+}
+
+TEST_F(LargeArrayTest, RestoreLargeArray) {
+    EXPECT_EQ(call("restore", 200000), 1);
+}
+
+TEST_F(LargeArrayTest, LargeBuffer) {
+    EXPECT_EQ(call("buffers", 100000), 1);
+    EXPECT_EQ(call("buffers", 2000000), 1);
+}
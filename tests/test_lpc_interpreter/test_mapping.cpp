@@ -0,0 +1,200 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <chrono>
+#include <string>
+#include "fixtures.hpp"
+
+extern "C" {
+    #include "apply.h"
+    #include "lpc/mapping.h"
+    #include "lpc/include/origin.h"
+}
+
+class MappingTest : public LPCInterpreterTest {
+protected:
+    object_t* ob = nullptr;
+
+    void SetUp() override {
+        LPCInterpreterTest::SetUp();
+        current_object = master_ob;
+        ob = load_object("mapping.c",
+            "string order() {\n"
+            "    mapping m = ([ ]);\n"
+            "    m[\"c\"] = 1; m[\"a\"] = 2; m[\"b\"] = 3; m[\"a\"] = 4;\n"
+            "    map_delete(m, \"c\");\n"
+            "    m[\"d\"] = 5; m[\"c\"] = 6;\n"
+            "    return implode(keys(m), \",\");\n"
+            "}\n"
+            "int big(int n) {\n"
+            "    mapping m = ([ ]);\n"
+            "    int i, sum;\n"
+            "    for (i = 0; i < n; i++) m[i] = i;\n"
+            "    for (i = 0; i < n; i += 2) map_delete(m, i);\n"
+            "    for (i = 0; i < n; i++) if (m[i] != (i % 2 ? i : 0)) return -1;\n"
+            "    for (i = 0; i < n; i += 2) m[i] = i;\n"
+            "    for (i = 0; i < n; i++) sum += m[i];\n"
+            "    return sizeof(m) == n ? sum : -2;\n"
+            "}\n"
+            "int churn(int n) {\n"
+            "    mapping m = ([ ]);\n"
+            "    int i;\n"
+            "    for (i = 0; i < n; i++) { m[i] = i; if (i >= 10) map_delete(m, i - 10); }\n"
+            "    return sizeof(m) * 1000 + m[n - 1] - m[n - 10];\n"
+            "}\n"
+            "int strings() {\n"
+            "    mapping m = ([ \"apple\" : 1, \"pear\" : 2 ]);\n"
+            "    string s = \"app\", t = \"nope\";\n"
+            "    s += \"le\"; t += \"x\";\n" /* not shared strings */
+            "    return m[s] * 10 + m[t] + (undefinedp(m[t]) ? 100 : 0) + sizeof(m) * 1000;\n"
+            "}\n"
+            "string compose() {\n"
+            "    mapping m1 = ([ \"a\" : 1, \"b\" : 2, \"c\" : 3 ]), m2 = ([ 1 : \"x\", 3 : \"z\" ]);\n"
+            "    m1 = filter(m1 + ([ \"d\" : 1 ]), (: $2 != 2 :));\n"
+            "    return save_variable(m1) + \" \" + save_variable(m1 + m2);\n"
+            "}\n"
+            "int restore(int n) {\n"
+            "    mapping m = ([ ]), r;\n"
+            "    int i;\n"
+            "    for (i = 0; i < n; i++) m[\"k\" + i] = ({ i });\n"
+            "    r = restore_variable(save_variable(m));\n"
+            "    for (i = 0; i < n; i++) if (r[\"k\" + i][0] != i) return 0;\n"
+            "    return sizeof(r);\n"
+            "}\n"
+            "mapping holes(int n) {\n"
+            "    mapping m = ([ ]);\n"
+            "    int i;\n"
+            "    for (i = 0; i < n; i++) m[i] = \"v\" + i;\n"
+            "    for (i = 0; i < n - 2; i++) map_delete(m, i);\n"
+            "    return m;\n"
+            "}\n"
+            "string nested(mapping m) {\n"
+            "    sscanf(\"p q\", \"%s %s\", m[\"a\"], m[(m[\"b\"] = \"x\" + 1, \"c\")]);\n"
+            "    m[27][(m[\"d\"] = \"y\", 0)] = 'z';\n"
+            "    return implode(map(keys(m), (: $1 + \"=\" + $(m)[$1] :)), \",\");\n"
+            "}\n"
+            "int lookup(int n, int rounds) {\n"
+            "    mapping m = ([ ]);\n"
+            "    int i, j, sum;\n"
+            "    for (i = 0; i < n; i++) m[i * 7919] = i;\n"
+            "    for (j = 0; j < rounds; j++) for (i = 0; i < n; i++) sum += m[i * 7919];\n"
+            "    return sum;\n"
+            "}\n");
+        ASSERT_NE(ob, nullptr);
+    }
+
+    void TearDown() override {
+        object_t* o = find_object_by_name("mapping");
+        if (o)
+            destruct_object(o);
+        LPCInterpreterTest::TearDown();
+    }
+
+    svalue_t* call(const char* fun, int num_arg = 0) {
+        return apply(fun, ob, num_arg, ORIGIN_DRIVER);
+    }
+};
+
+TEST_F(MappingTest, InsertionOrder) {
+    svalue_t* ret = call("order");
+    ASSERT_NE(ret, nullptr);
+    ASSERT_EQ(ret->type, T_STRING);
+    // an updated key keeps its place, a deleted and re-added one moves to the end
+    EXPECT_STREQ(ret->u.string, "a,b,d,c");
+}
+
+TEST_F(MappingTest, LargeMapping) {
+    // more nodes than the old 32K bucket limit, with holes and refills
+    const int n = 100000;
+    int max_size = CONFIG_INT (__MAX_MAPPING_SIZE__);
+
+    CONFIG_INT (__MAX_MAPPING_SIZE__) = n;
+    eval_cost = INT64_MAX;
+    push_number(n);
+    svalue_t* ret = call("big", 1);
+    eval_cost = CONFIG_INT (__MAX_EVAL_COST__);
+    CONFIG_INT (__MAX_MAPPING_SIZE__) = max_size;
+    ASSERT_NE(ret, nullptr);
+    ASSERT_EQ(ret->type, T_NUMBER);
+    EXPECT_EQ(ret->u.number, (int64_t)n * (n - 1) / 2);
+}
+
+TEST_F(MappingTest, DeleteWhileGrowing) {
+    int num_nodes = total_mapping_nodes;
+    push_number(5000);
+    svalue_t* ret = call("churn", 1);
+    ASSERT_NE(ret, nullptr);
+    EXPECT_EQ(ret->u.number, 10 * 1000 + 9);
+    EXPECT_EQ(total_mapping_nodes, num_nodes);
+}
+
+TEST_F(MappingTest, NestedAssignmentWithHoles) {
+    // the insertions fill the chunks while most of the nodes are deleted
+    push_number(28);
+    svalue_t* ret = call("holes", 1);
+    ASSERT_NE(ret, nullptr);
+    ASSERT_EQ(ret->type, T_MAPPING);
+    mapping_t* m = ret->u.map;
+    m->ref++;
+    EXPECT_EQ(m->fill, 28u);
+
+    push_refed_mapping(m);
+    m->ref++;
+    ret = call("nested", 1);
+    ASSERT_NE(ret, nullptr);
+    ASSERT_EQ(ret->type, T_STRING);
+    EXPECT_STREQ(ret->u.string, "26=v26,27=z27,a=p,b=x1,c=q,d=y");
+    // no node moved during the evaluation, when lvalues may point to them
+    EXPECT_EQ(m->fill, 32u);
+    EXPECT_TRUE(m->compact_pending);
+
+    // the deleted nodes are squeezed out between evaluations, in order
+    compact_mappings();
+    EXPECT_FALSE(m->compact_pending);
+    EXPECT_EQ(m->fill, 6u);
+    EXPECT_STREQ(find_string_in_mapping(m, (char*)"a")->u.string, "p");
+    free_mapping(m);
+}
+
+TEST_F(MappingTest, StringKeys) {
+    svalue_t* ret = call("strings");
+    ASSERT_NE(ret, nullptr);
+    // looking up a missing string doesn't add it
+    EXPECT_EQ(ret->u.number, 2110);
+}
+
+TEST_F(MappingTest, FilterAndAdd) {
+    svalue_t* ret = call("compose");
+    ASSERT_NE(ret, nullptr);
+    ASSERT_EQ(ret->type, T_STRING);
+    EXPECT_STREQ(ret->u.string,
+        "([\"a\":1,\"c\":3,\"d\":1,]) ([\"a\":1,\"c\":3,\"d\":1,1:\"x\",3:\"z\",])");
+}
+
+TEST_F(MappingTest, SaveRestore) {
+    push_number(2000);
+    svalue_t* ret = call("restore", 1);
+    ASSERT_NE(ret, nullptr);
+    EXPECT_EQ(ret->u.number, 2000);
+}
+
+TEST_F(MappingTest, DISABLED_benchmarkLookup) {
+    const int n = 100000, rounds = 20;
+    int max_size = CONFIG_INT (__MAX_MAPPING_SIZE__);
+
+    CONFIG_INT (__MAX_MAPPING_SIZE__) = n;
+    eval_cost = INT64_MAX;
+    push_number(n);
+    push_number(rounds);
+    auto start = std::chrono::steady_clock::now();
+    svalue_t* ret = call("lookup", 2);
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    eval_cost = CONFIG_INT (__MAX_EVAL_COST__);
+    CONFIG_INT (__MAX_MAPPING_SIZE__) = max_size;
+
+    ASSERT_NE(ret, nullptr);
+    EXPECT_EQ(ret->u.number, (int64_t)rounds * n * (n - 1) / 2);
+    debug_message("[ BENCH    ] %d mapping lookups: %.1f ms\n", n * rounds, elapsed);
+    RecordProperty("elapsed_ms", (int)elapsed);
+}
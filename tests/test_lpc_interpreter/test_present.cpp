@@ -0,0 +1,176 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <chrono>
+#include "fixtures.hpp"
+
+extern "C" {
+    #include "apply.h"
+    #include "lpc/include/origin.h"
+}
+
+class PresentTest : public LPCInterpreterTest {
+protected:
+    object_t* room = nullptr;
+
+    void SetUp() override {
+        LPCInterpreterTest::SetUp();
+        current_object = master_ob;
+        ASSERT_NE(load_object("item.c",
+            "string *names = ({});\n"
+            "int calls;\n"
+            "void setup(string *ids, int indexed) { names = ids; if (indexed) set_ids(ids); }\n"
+            "void index(string *ids) { set_ids(ids); }\n"
+            "int id(string s) { calls++; return member_array(s, names) >= 0; }\n"
+            "int query_calls() { return calls; }\n"
+            "void move(object dest) { move_object(dest); }\n"), nullptr);
+        room = load_object("room.c",
+            "object *pool;\n"
+            "int next;\n"
+            "void set_pool(object *p) { pool = p; next = 0; }\n"
+            "object make(string *ids, int indexed) {\n"
+            "    object o = pool[next++];\n"
+            "    o->setup(ids, indexed);\n"
+            "    o->move(this_object());\n"
+            "    return o;\n"
+            "}\n"
+            "int calls() {\n"
+            "    int n;\n"
+            "    foreach (object o in deep_inventory()) n += o->query_calls();\n"
+            "    return n;\n"
+            "}\n"
+            "void clear() { foreach (object o in all_inventory()) destruct(o); }\n"
+            "int check_indexed() {\n"
+            "    object a = make(({ \"sword\", \"weapon\" }), 1), b = make(({ \"shield\" }), 1);\n"
+            "    object c = make(({ \"sword\" }), 1), me = this_object();\n"
+            "    if (present(\"sword\", me) != c || present(\"sword 2\", me) != a) return -1;\n"
+            "    if (present(\"sword 3\", me) || present(\"axe\", me)) return -2;\n"
+            "    if (present(\"weapon\", me) != a || present(\"shield 1\", me) != b) return -3;\n"
+            "    c->index(({ \"axe\", \"sword\" }));\n"
+            "    a->index(({ \"sword\", \"sword\", \"knife\" }));\n"
+            "    if (present(\"axe\", me) != c || present(\"sword 2\", me) != a) return -4;\n"
+            "    if (present(\"weapon\", me) || present(\"sword 3\", me)) return -5;\n"
+            "    a->move(b);\n"
+            "    if (present(\"sword 2\", me) || present(\"knife\", b) != a) return -6;\n"
+            "    destruct(c);\n"
+            "    if (present(\"sword\", me) || present(\"axe\", me)) return -7;\n"
+            "    if (calls()) return -8;\n"
+            "    return 1;\n"
+            "}\n"
+            "int check_mixed() {\n"
+            "    object a = make(({ \"sword\" }), 1), b = make(({ \"sword\" }), 0);\n"
+            "    object c = make(({ \"sword\" }), 1), d = make(({ \"shield\" }), 0), me = this_object();\n"
+            "    int n;\n"
+            "    if (present(\"sword\", me) != c || present(\"sword 2\", me) != b) return -1;\n"
+            "    if (present(\"sword 3\", me) != a || present(\"shield\", me) != d) return -2;\n"
+            "    if (calls() == 0) return -3;\n"
+            "    b->index(({ \"sword\" }));\n"
+            "    destruct(d);\n"
+            "    n = calls();\n"
+            "    if (present(\"sword 2\", me) != b || present(\"sword 3\", me) != a) return -4;\n"
+            "    if (calls() != n) return -5;\n"
+            "    c->index(({}));\n"
+            "    if (present(\"sword\", me) != c || calls() != n + 1) return -6;\n"
+            "    return 1;\n"
+            "}\n"
+            "int check_many(int n) {\n"
+            "    object *v = allocate(n), me = this_object();\n"
+            "    int i;\n"
+            "    for (i = 0; i < n; i++) v[i] = make(({ \"thing\", \"item\" + i, \"sword\" }), 1);\n"
+            "    for (i = 0; i < n; i++)\n"
+            "        if (present(\"thing \" + (n - i), me) != v[i] || present(\"item\" + i, me) != v[i]) return -1;\n"
+            "    clear();\n"
+            "    return calls() == 0;\n"
+            "}\n"
+            "int bench(int rounds) {\n"
+            "    int i, found;\n"
+            "    for (i = 0; i < rounds; i++) if (present(\"sword 300\", this_object())) found++;\n"
+            "    return found;\n"
+            "}\n");
+        ASSERT_NE(room, nullptr);
+    }
+
+    void TearDown() override {
+        for (const char* name : { "room", "item" }) {
+            object_t* o = find_object_by_name(name);
+            if (o)
+                destruct_object(o);
+        }
+        LPCInterpreterTest::TearDown();
+    }
+
+    // clones made by the driver, as the room has no euid to clone them itself
+    void make_pool(int n) {
+        array_t* pool = allocate_empty_array(n);
+        for (int i = 0; i < n; i++) {
+            pool->item[i].type = T_OBJECT;
+            pool->item[i].u.ob = clone_object("/item", 0);
+            ASSERT_NE(pool->item[i].u.ob, nullptr);
+            add_ref(pool->item[i].u.ob, "make_pool");
+        }
+        push_refed_array(pool);
+        apply("set_pool", room, 1, ORIGIN_DRIVER);
+    }
+
+    int call(const char* fun, int num_arg = 0) {
+        svalue_t* ret = apply(fun, room, num_arg, ORIGIN_DRIVER);
+        return ret && ret->type == T_NUMBER ? (int)ret->u.number : -100;
+    }
+
+    void make_items(int n, int indexed) {
+        make_pool(n);
+        for (int i = 0; i < n; i++) {
+            array_t* ids = allocate_empty_array(1);
+            ids->item[0].type = T_STRING;
+            ids->item[0].subtype = STRING_CONSTANT;
+            ids->item[0].u.string = (char*)"sword";
+            push_refed_array(ids);
+            push_number(indexed);
+            ASSERT_NE(apply("make", room, 2, ORIGIN_DRIVER), nullptr);
+        }
+    }
+};
+
+TEST_F(PresentTest, IndexedIds) {
+    make_pool(3);
+    EXPECT_EQ(call("check_indexed"), 1);
+    EXPECT_EQ(room->id_index->count, 1) << "only the shield is left";
+    EXPECT_EQ(room->id_index->others, 0);
+}
+
+TEST_F(PresentTest, MixedWithId) {
+    make_pool(4);
+    EXPECT_EQ(call("check_mixed"), 1);
+}
+
+TEST_F(PresentTest, ManyIds) {
+    make_pool(200);
+    push_number(200);
+    EXPECT_EQ(call("check_many", 1), 1);
+    EXPECT_EQ(room->id_index->count, 0);
+}
+
+TEST_F(PresentTest, DISABLED_benchmarkPresent) {
+    const int rounds = 200;
+    unsigned long trace_flags = MAIN_OPTION(trace_flags);
+    MAIN_OPTION(trace_flags) = 0;
+    eval_cost = INT64_MAX;
+
+    double ms[2];
+    for (int indexed : { 0, 1 }) {
+        make_items(300, indexed);
+        auto start = std::chrono::steady_clock::now();
+        push_number(rounds);
+        EXPECT_EQ(call("bench", 1), rounds);
+        ms[indexed] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        call("clear");
+    }
+    eval_cost = CONFIG_INT (__MAX_EVAL_COST__);
+    MAIN_OPTION(trace_flags) = trace_flags;
+
+    debug_message("[ BENCH    ] %d x present(\"sword 300\") in 300 items: id() %.1f ms, set_ids() %.1f ms\n",
+                  rounds, ms[0], ms[1]);
+    RecordProperty("present_id_ms", (int)ms[0]);
+    RecordProperty("present_set_ids_ms", (int)ms[1]);
+}
@@ -0,0 +1,142 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <chrono>
+#include <string>
+#include "fixtures.hpp"
+
+extern "C" {
+    #include "apply.h"
+    #include "lpc/include/origin.h"
+}
+
+class StringAppendTest : public LPCInterpreterTest {
+protected:
+    object_t* ob = nullptr;
+
+    void SetUp() override {
+        LPCInterpreterTest::SetUp();
+        current_object = master_ob;
+        ob = load_object("string_append.c",
+            "string append(int n) {\n"
+            "    string s = \"\";\n"
+            "    int i;\n"
+            "    for (i = 0; i < n; i++) { s += \"player\"; s += i + \"\\n\"; }\n"
+            "    return s;\n"
+            "}\n"
+            "string concat(int n) {\n"
+            "    string s = \"\";\n"
+            "    int i;\n"
+            "    for (i = 0; i < n; i++) s = s + \"player\" + i + \"\\n\";\n"
+            "    return s;\n"
+            "}\n"
+            "string shared() {\n"
+            "    string s = \"abc\", t;\n"
+            "    s += \"d\";\n"
+            "    t = s;\n"
+            "    s += \"e\";\n"
+            "    t += \"f\";\n"
+            "    return s + \",\" + t;\n"
+            "}\n"
+            "string self() {\n"
+            "    string s = \"ab\";\n"
+            "    s += \"c\";\n"
+            "    s += s;\n"
+            "    s += s;\n"
+            "    return s;\n"
+            "}\n"
+            "string element() {\n"
+            "    string *a = ({ \"x\", \"y\" });\n"
+            "    mapping m = ([ \"k\": \"v\" ]);\n"
+            "    mixed two = 2, half = 3.5;\n"
+            "    a[0] += \"1\"; a[0] += two; a[0] += half;\n"
+            "    m[\"k\"] += \"w\"; m[\"k\"] += \"z\";\n"
+            "    return a[0] + \",\" + m[\"k\"];\n"
+            "}\n"
+            "int lengths(int n) {\n"
+            "    string s = \"\";\n"
+            "    int i;\n"
+            "    for (i = 0; i < n; i++) { s += \"ab\"; if (strlen(s) != 2 * (i + 1)) return -1; }\n"
+            "    return strlen(s + \"\") == 2 * n && s[<1] == 'b' ? 1 : 0;\n"
+            "}\n");
+        ASSERT_NE(ob, nullptr);
+    }
+
+    void TearDown() override {
+        object_t* o = find_object_by_name("string_append");
+        if (o)
+            destruct_object(o);
+        LPCInterpreterTest::TearDown();
+    }
+
+    svalue_t* call(const char* fun, int num_arg = 0) {
+        return apply(fun, ob, num_arg, ORIGIN_DRIVER);
+    }
+};
+
+TEST_F(StringAppendTest, AppendBuildsTheSameString) {
+    push_number(1000);
+    svalue_t* ret = call("append", 1);
+    ASSERT_NE(ret, nullptr);
+    ASSERT_EQ(ret->type, T_STRING);
+    std::string appended(ret->u.string, SVALUE_STRLEN(ret));
+
+    push_number(1000);
+    ret = call("concat", 1);
+    ASSERT_NE(ret, nullptr);
+    EXPECT_EQ(appended, std::string(ret->u.string, SVALUE_STRLEN(ret)));
+    EXPECT_EQ(SVALUE_STRLEN(ret), strlen(ret->u.string));
+}
+
+TEST_F(StringAppendTest, AppendDoesNotTouchOtherReferences) {
+    svalue_t* ret = call("shared");
+    ASSERT_NE(ret, nullptr);
+    EXPECT_STREQ(ret->u.string, "abcde,abcdf");
+
+    ret = call("self");
+    ASSERT_NE(ret, nullptr);
+    EXPECT_STREQ(ret->u.string, "abcabcabcabc");
+
+    ret = call("element");
+    ASSERT_NE(ret, nullptr);
+    EXPECT_STREQ(ret->u.string, "x123.500000,vwz");
+
+    push_number(500);
+    ret = call("lengths", 1);
+    ASSERT_NE(ret, nullptr);
+    EXPECT_EQ(ret->u.number, 1);
+}
+
+TEST_F(StringAppendTest, DISABLED_benchmarkStringAppend) {
+    // a who list of a few thousand lines, around 50KB
+    const int n = 4000, rounds = 20;
+    double append_ms = 0, concat_ms = 0;
+    size_t len = 0;
+
+    unsigned long trace_flags = MAIN_OPTION(trace_flags);
+    MAIN_OPTION(trace_flags) = 0; // every += would be traced otherwise
+    eval_cost = INT64_MAX;
+    for (int round = 0; round < rounds; round++) {
+        push_number(n);
+        auto start = std::chrono::steady_clock::now();
+        svalue_t* ret = call("append", 1);
+        append_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        ASSERT_NE(ret, nullptr);
+        len = SVALUE_STRLEN(ret);
+
+        push_number(n);
+        start = std::chrono::steady_clock::now();
+        ret = call("concat", 1);
+        concat_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        ASSERT_NE(ret, nullptr);
+        EXPECT_EQ(SVALUE_STRLEN(ret), len);
+    }
+    eval_cost = CONFIG_INT (__MAX_EVAL_COST__);
+    MAIN_OPTION(trace_flags) = trace_flags;
+
+    debug_message("[ BENCH    ] %d x %d appends (%zu bytes): s += x %.1f ms, s = s + x %.1f ms\n",
+                  rounds, 2 * n, len, append_ms, concat_ms);
+    RecordProperty("append_ms", (int)append_ms);
+    RecordProperty("concat_ms", (int)concat_ms);
+}
@@ -0,0 +1,103 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <chrono>
+#include <string>
+#include "fixtures.hpp"
+
+extern "C" {
+    #include "apply.h"
+    #include "simulate.h"
+    #include "lpc/include/origin.h"
+}
+
+class VerbIndexTest : public LPCInterpreterTest {
+protected:
+    object_t* player = nullptr;
+
+    void SetUp() override {
+        LPCInterpreterTest::SetUp();
+        current_object = master_ob;
+        player = load_object("player.c",
+            "string log = \"\";\n"
+            "void create() { enable_commands(); }\n"
+            "void setup() {\n"
+            "    add_action(\"a1\", \"look\");\n"
+            "    add_action(\"a2\", \"l\", 1);\n"
+            "    add_action(\"a3\", \"\");\n"
+            "    add_action(\"a4\", ({ \"look\", \"peer\" }));\n"
+            "    add_action(\"a5\", \"sm\", 2);\n"
+            "}\n"
+            "void many(int n) { int i; for (i = 0; i < n; i++) add_action(\"a1\", \"verb\" + i); }\n"
+            "int unlook() { return remove_action(\"a4\", \"look\"); }\n"
+            "int a1(string arg) { log += \"a1\"; return 1; }\n"
+            "int a2(string arg) { log += \"a2,\"; return 0; }\n"
+            "int a3(string arg) { log += \"a3,\"; return 0; }\n"
+            "int a4(string arg) { log += \"a4,\"; return 0; }\n"
+            "int a5(string arg) { log += \"a5(\" + arg + \")\"; return 1; }\n"
+            "string cmd(string c) { log = \"\"; command(c); return log; }\n");
+        ASSERT_NE(player, nullptr);
+        command_giver = player;
+        apply("setup", player, 0, ORIGIN_DRIVER);
+    }
+
+    void TearDown() override {
+        command_giver = nullptr;
+        destruct_object(player);
+        LPCInterpreterTest::TearDown();
+    }
+
+    std::string cmd(const char* c) {
+        copy_and_push_string((char*)c);
+        svalue_t* ret = apply("cmd", player, 1, ORIGIN_DRIVER);
+        return ret && ret->type == T_STRING ? ret->u.string : "?";
+    }
+};
+
+TEST_F(VerbIndexTest, PrecedenceFollowsAddAction) {
+    // newest first, whatever chain of the index they're in
+    EXPECT_EQ(cmd("look at me"), "a4,a3,a2,a1");
+    EXPECT_EQ(cmd("lx"), "a3,a2,");
+    EXPECT_EQ(cmd("peer"), "a4,a3,");
+    EXPECT_EQ(cmd("smile"), "a5(ile)");
+    EXPECT_EQ(cmd("jump"), "a3,");
+}
+
+TEST_F(VerbIndexTest, RemoveAction) {
+    svalue_t* ret = apply("unlook", player, 0, ORIGIN_DRIVER);
+    ASSERT_NE(ret, nullptr);
+    EXPECT_EQ(ret->u.number, 1);
+    EXPECT_EQ(cmd("look"), "a3,a2,a1");
+    EXPECT_EQ(cmd("peer"), "a4,a3,");
+}
+
+TEST_F(VerbIndexTest, ManyVerbs) {
+    // enough to grow the index a few times
+    push_number(1000);
+    apply("many", player, 1, ORIGIN_DRIVER);
+    EXPECT_EQ(cmd("verb999"), "a1");
+    EXPECT_EQ(cmd("look"), "a4,a3,a2,a1");
+
+    free_sentences(player);
+    EXPECT_EQ(player->verb_index, nullptr);
+    EXPECT_EQ(cmd("look"), "");
+}
+
+TEST_F(VerbIndexTest, DISABLED_benchmarkCommands) {
+    const int n = 500, rounds = 20000;
+
+    push_number(n);
+    apply("many", player, 1, ORIGIN_DRIVER);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        char buf[] = "verb0";
+        ASSERT_EQ(user_parser(buf), 1);
+        command_giver = player;
+    }
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    debug_message("[ BENCH    ] %d commands among %d sentences: %.1f ms\n", rounds, n + 6, elapsed);
+    RecordProperty("elapsed_ms", (int)elapsed);
+}
@@ -3,6 +3,9 @@
 #endif /* HAVE_CONFIG_H */
 
 #include "fixtures.hpp"
+#include <chrono>
+#include <fstream>
+#include <thread>
 extern "C" {
     #include "lpc/preprocess.h"
 }
@@ -26,6 +29,51 @@ TEST_F(LPCLexerTest, handleInclude) {
     current_file = 0;
 }
 
+static int lex_include_cache_test () {
+    int value = -1;
+
+    current_file = make_shared_string ("include_cache_test.c");
+    current_file_id = 0;
+    start_new_file (-1,
+        "#include \"include_cache_test.h\"\n"
+        "INCLUDE_CACHE_TEST\n"
+    );
+    if (yylex() == L_NUMBER)
+        value = (int)yylval.number;
+    end_new_file ();
+    free_string(current_file);
+    current_file = 0;
+    return value;
+}
+
+TEST_F(LPCLexerTest, includeCache) {
+    clear_include_cache ();
+    ASSERT_TRUE(std::ofstream("include_cache_test.h") << "#define INCLUDE_CACHE_TEST 1\n");
+
+    unsigned long misses = include_cache_misses;
+    EXPECT_EQ(lex_include_cache_test(), 1);
+    EXPECT_EQ(include_cache_misses, misses + 1) << "first #include reads the file";
+
+    // served from the cache
+    unsigned long hits = include_cache_hits;
+    misses = include_cache_misses;
+    EXPECT_EQ(lex_include_cache_test(), 1);
+    EXPECT_EQ(include_cache_hits, hits + 1);
+    EXPECT_EQ(include_cache_misses, misses);
+
+    // a changed header is read again once the entry is older than a second
+    ASSERT_TRUE(std::ofstream("include_cache_test.h") << "#define INCLUDE_CACHE_TEST 22\n");
+    time_t now = time (NULL);
+    while (time (NULL) == now)
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    misses = include_cache_misses;
+    EXPECT_EQ(lex_include_cache_test(), 22);
+    EXPECT_EQ(include_cache_misses, misses + 1);
+
+    clear_include_cache ();
+    std::filesystem::remove("include_cache_test.h");
+}
+
 TEST_F(LPCLexerTest, preprocessIf) {
     current_file = make_shared_string ("preprocess_if_test");
     current_file_id = 0;
@@ -5,6 +5,9 @@ extern "C" {
     #include "std.h"
     #include "stralloc.h"
 }
+#include <chrono>
+#include <string>
+#include <vector>
 #include <gtest/gtest.h>
 using namespace testing;
 
@@ -28,7 +31,7 @@ protected:
 TEST_F(StrAllocTest, initialState) {
     EXPECT_EQ(num_distinct_strings, 0);
     EXPECT_EQ(bytes_distinct_strings, 0);
-    EXPECT_EQ(overhead_bytes, sizeof(block_t*) * 16384); // 15000 rounded up to next power of two
+    EXPECT_EQ(overhead_bytes, sizeof(str_slot_t) * 16384); // 15000 rounded up to next power of two
 }
 
 TEST_F(StrAllocTest, makeSharedString) {
@@ -68,3 +71,132 @@ TEST_F(StrAllocTest, findString) {
     found2 = findstring("test string");
     EXPECT_EQ(found2, nullptr); // should not be found after all frees
 }
+
+TEST_F(StrAllocTest, sharedPrefixes) {
+    // long paths that only differ after the first 20 characters
+    std::vector<char*> strs;
+    for (int i = 0; i < 1000; i++) {
+        std::string path = "/domains/forest/rooms/clearing_" + std::to_string(i) + ".c";
+        strs.push_back(make_shared_string(path.c_str()));
+    }
+    for (int i = 0; i < 1000; i++) {
+        std::string path = "/domains/forest/rooms/clearing_" + std::to_string(i) + ".c";
+        EXPECT_EQ(findstring(path.c_str()), strs[i]);
+        EXPECT_EQ(SHARED_STRLEN(strs[i]), path.size());
+    }
+    EXPECT_EQ(num_distinct_strings, 1000);
+    for (char* s : strs)
+        free_string(s);
+    EXPECT_EQ(num_distinct_strings, 0);
+}
+
+TEST_F(StrAllocTest, longStrings) {
+    // lengths and reference counts are no longer limited to 16 bits
+    std::string text(100000, 'x');
+    char* str1 = make_shared_string(text.c_str());
+    EXPECT_EQ(SHARED_STRLEN(str1), text.size());
+    EXPECT_EQ(findstring(text.c_str()), str1);
+
+    for (int i = 0; i < 70000; i++)
+        ref_string(str1);
+    EXPECT_EQ(COUNTED_REF(str1), 70001u);
+    for (int i = 0; i < 70001; i++)
+        free_string(str1);
+    EXPECT_EQ(findstring(text.c_str()), nullptr);
+
+    char* mstr = int_new_string(text.size());
+    EXPECT_EQ(COUNTED_STRLEN(mstr), text.size());
+    FREE_MSTR(mstr);
+}
+
+TEST_F(StrAllocTest, truncatedToMaxLength) {
+    deinit_strings();
+    init_strings(16, 10);
+
+    char* str1 = make_shared_string("0123456789abcdef");
+    EXPECT_STREQ(str1, "0123456789");
+    EXPECT_EQ(make_shared_string("0123456789xyz"), str1);
+    EXPECT_EQ(findstring("0123456789"), str1);
+    EXPECT_EQ(findstring("0123456789abcdef"), nullptr);
+    free_string(str1);
+    free_string(str1);
+    EXPECT_EQ(num_distinct_strings, 0);
+}
+
+TEST_F(StrAllocTest, incrementalResize) {
+    deinit_strings();
+    init_strings(16, 1000000);
+    size_t initial_overhead = overhead_bytes;
+
+    std::vector<char*> strs;
+    for (int i = 0; i < 10000; i++)
+        strs.push_back(make_shared_string(("string #" + std::to_string(i)).c_str()));
+    EXPECT_GT(overhead_bytes, initial_overhead);
+
+    // free every other string while the table keeps growing and rehashing
+    for (int i = 0; i < 10000; i += 2) {
+        free_string(strs[i]);
+        strs[i] = make_shared_string(("other #" + std::to_string(i)).c_str());
+    }
+    for (int i = 0; i < 10000; i++) {
+        std::string s = (i % 2 ? "string #" : "other #") + std::to_string(i);
+        EXPECT_EQ(findstring(s.c_str()), strs[i]) << s;
+        if (i % 2 == 0) {
+            EXPECT_EQ(findstring(("string #" + std::to_string(i)).c_str()), nullptr);
+        }
+    }
+    for (char* s : strs)
+        free_string(s);
+    EXPECT_EQ(num_distinct_strings, 0);
+}
+
+TEST_F(StrAllocTest, resizeMostlyTombstones) {
+    deinit_strings();
+    init_strings(16, 1000000);
+
+    // a table just below 3/4 full, then almost all of its strings freed again
+    std::vector<char*> strs;
+    for (int i = 0; i < 196000; i++)
+        strs.push_back(make_shared_string(("string #" + std::to_string(i)).c_str()));
+    for (int i = 100; i < 196000; i++)
+        free_string(strs[i]);
+    strs.resize(100);
+
+    // the next resize is to a much smaller table, which has to be done with
+    // the old one before it fills up itself
+    for (int i = 0; i < 20000; i++)
+        strs.push_back(make_shared_string(("more #" + std::to_string(i)).c_str()));
+    for (int i = 0; i < 100; i++)
+        EXPECT_EQ(findstring(("string #" + std::to_string(i)).c_str()), strs[i]);
+    for (int i = 0; i < 20000; i++)
+        EXPECT_EQ(findstring(("more #" + std::to_string(i)).c_str()), strs[100 + i]);
+    EXPECT_EQ(findstring("string #100"), nullptr);
+
+    for (char* s : strs)
+        free_string(s);
+    EXPECT_EQ(num_distinct_strings, 0);
+}
+
+TEST_F(StrAllocTest, DISABLED_benchmarkSharedStrings) {
+    const int n = 200000;
+    std::vector<std::string> names;
+    std::vector<char*> strs(n);
+
+    names.reserve(n);
+    for (int i = 0; i < n; i++)
+        names.push_back("/domains/city/npc/guard_" + std::to_string(i) + "#" + std::to_string(i * 7));
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)
+        strs[i] = make_shared_string(names[i].c_str());
+    for (int round = 0; round < 4; round++)
+        for (int i = 0; i < n; i++)
+            ASSERT_EQ(findstring(names[i].c_str()), strs[i]);
+    for (int i = 0; i < n; i++)
+        free_string(strs[i]);
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    EXPECT_EQ(num_distinct_strings, 0);
+    debug_message("[ BENCH    ] %d shared strings, 4 lookups each: %.1f ms\n", n, elapsed);
+    RecordProperty("elapsed_ms", (int)elapsed);
+}